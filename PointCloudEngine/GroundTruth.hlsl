@@ -22,7 +22,8 @@ cbuffer GroundTruthRendererConstantBuffer : register(b0)
 //------------------------------------------------------------------------------ (16 byte boundary)
 	bool normalsInScreenSpace;
 	bool backfaceCulling;
-	// 8 bytes auto padding
+	bool drawGBuffer;
+	// 4 bytes auto padding
 //------------------------------------------------------------------------------ (16 byte boundary)
 };  // Total: 368 bytes with constant buffer packing rules
 
@@ -40,6 +41,14 @@ struct VS_OUTPUT
     float3 color : COLOR;
 };
 
+// The first render target is the back buffer, the other two are only bound when all the attributes of the G-buffer are drawn at once
+struct PS_GBUFFER_OUTPUT
+{
+	float4 color : SV_TARGET0;
+	float4 normal : SV_TARGET1;
+	float4 normalScreen : SV_TARGET2;
+};
+
 VS_OUTPUT VS(VS_INPUT input)
 {
 	VS_OUTPUT output;
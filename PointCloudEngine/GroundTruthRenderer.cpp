@@ -91,6 +91,7 @@ void GroundTruthRenderer::Draw()
     constantBufferData.WorldInverseTranspose = constantBufferData.World.Invert().Transpose();
 	constantBufferData.WorldViewProjectionInverse = (sceneObject->transform->worldMatrix * camera->GetViewMatrix() * camera->GetProjectionMatrix()).Invert().Transpose();
 	constantBufferData.backfaceCulling = settings->backfaceCulling;
+	constantBufferData.drawGBuffer = drawGBuffer;
     constantBufferData.cameraPosition = camera->GetPosition();
 	constantBufferData.blendFactor = settings->blendFactor;
 	constantBufferData.useBlending = false;
@@ -120,13 +121,18 @@ void GroundTruthRenderer::Draw()
 
 	if ((settings->viewMode == ViewMode::Splats || settings->viewMode == ViewMode::SparseSplats) && settings->useBlending)
 	{
-		DrawBlended(vertexCount, constantBuffer, &constantBufferData, constantBufferData.useBlending);
+		DrawBlended(vertexCount, constantBuffer, &constantBufferData, constantBufferData.useBlending, drawGBuffer);
 	}
 	else
 	{
 		d3d11DevCon->Draw(vertexCount, 0);
 	}
 
+	if (settings->splatRasterizerBenchmark && (settings->viewMode == ViewMode::Splats || settings->viewMode == ViewMode::SparseSplats))
+	{
+		DrawSplatRasterizer(vertexCount);
+	}
+
 	// Show vertex count on GUI
 	GUI::vertexCount = vertexCount;
 }
@@ -135,12 +141,55 @@ void GroundTruthRenderer::Release()
 {
     SAFE_RELEASE(vertexBuffer);
     SAFE_RELEASE(constantBuffer);
+	SafeDelete(splatRasterizer);
+	SafeDelete(pointRasterizer);
 
 	// Neural Network
 	SAFE_RELEASE(colorTexture);
 	SAFE_RELEASE(depthTexture);
 }
 
+void PointCloudEngine::GroundTruthRenderer::DrawSplatRasterizer(UINT vertexCount)
+{
+	if ((splatRasterizer == NULL) || (splatRasterizer->width != settings->resolutionX) || (splatRasterizer->height != settings->resolutionY))
+	{
+		SafeDelete(splatRasterizer);
+		splatRasterizer = new SplatRasterizer(settings->resolutionX, settings->resolutionY);
+	}
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	// Draw the same splats as the GPU with the values of the constant buffers
+	Matrix world = sceneObject->transform->worldMatrix;
+	SplatRasterizer::GetVertexSplats(vertices, vertexCount, world, camera->GetPosition(), constantBufferData.samplingRate, settings->backfaceCulling, splats);
+
+	SplatRasterizer::Parameters parameters;
+	parameters.View = camera->GetViewMatrix();
+	parameters.Projection = camera->GetProjectionMatrix();
+	parameters.cameraPosition = camera->GetPosition();
+	parameters.useBlending = settings->useBlending;
+	parameters.blendFactor = settings->blendFactor;
+	parameters.useLighting = lightingConstantBufferData.useLighting;
+	parameters.lightDirection = lightingConstantBufferData.lightDirection;
+	parameters.lightIntensity = lightingConstantBufferData.lightIntensity;
+	parameters.ambient = lightingConstantBufferData.ambient;
+	parameters.diffuse = lightingConstantBufferData.diffuse;
+	parameters.specular = lightingConstantBufferData.specular;
+	parameters.specularExponent = lightingConstantBufferData.specularExponent;
+	parameters.backgroundColor = lightingConstantBufferData.backgroundColor;
+
+	splatRasterizer->Draw(splats, parameters);
+
+	// Report the time of the rasterization alone and together with the splat setup
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	std::wstringstream outputStream;
+	outputStream << L"Splat rasterizer: " << splatRasterizer->width << L"x" << splatRasterizer->height << L", " << (parameters.useBlending ? L"blended" : L"opaque") << L", ";
+	outputStream << splatRasterizer->splatsCount << L" splats, " << splatRasterizer->drawnSplatsCount << L" drawn splats, " << splatRasterizer->milliseconds << L" ms (" << milliseconds << L" ms with setup), ";
+	outputStream << splatRasterizer->GetSplatsPerSecond() / 1000000.0 << L" million splats per second" << std::endl;
+	OutputDebugString(outputStream.str().c_str());
+}
+
 void PointCloudEngine::GroundTruthRenderer::GetBoundingCubePositionAndSize(Vector3 &outPosition, float &outSize)
 {
 	outPosition = boundingCubePosition;
@@ -154,7 +203,7 @@ void PointCloudEngine::GroundTruthRenderer::RemoveComponentFromSceneObject()
 
 void PointCloudEngine::GroundTruthRenderer::GenerateSphereDataset()
 {
-	HDF5File hdf5file = CreateDatasetHDF5File();
+	HDF5File* hdf5file = CreateDatasetHDF5File();
 	ViewMode startViewMode = settings->viewMode;
 	Vector3 startPosition = camera->GetPosition();
 	Matrix startRotation = camera->GetRotationMatrix();
@@ -180,10 +229,13 @@ void PointCloudEngine::GroundTruthRenderer::GenerateSphereDataset()
 			GUI::cameraRecordingPositions.push_back(newPosition);
 			GUI::cameraRecordingRotations.push_back(camera->GetRotationMatrix());
 
-			HDF5DrawDatasets(hdf5file, counter++);
+			HDF5DrawDatasets(*hdf5file, counter++);
 		}
 	}
 
+	// Wait until the writer threads have written the remaining groups and close the file
+	SafeDelete(hdf5file);
+
 	// Reset properties
 	camera->SetPosition(startPosition);
 	camera->SetRotationMatrix(startRotation);
@@ -192,7 +244,7 @@ void PointCloudEngine::GroundTruthRenderer::GenerateSphereDataset()
 
 void PointCloudEngine::GroundTruthRenderer::GenerateWaypointDataset()
 {
-	HDF5File hdf5file = CreateDatasetHDF5File();
+	HDF5File* hdf5file = CreateDatasetHDF5File();
 	ViewMode startViewMode = settings->viewMode;
 	Vector3 startPosition = camera->GetPosition();
 	Matrix startRotation = camera->GetRotationMatrix();
@@ -220,12 +272,15 @@ void PointCloudEngine::GroundTruthRenderer::GenerateWaypointDataset()
 			GUI::cameraRecordingPositions.push_back(newCameraPosition);
 			GUI::cameraRecordingRotations.push_back(newCameraRotation);
 
-			HDF5DrawDatasets(hdf5file, counter++);
+			HDF5DrawDatasets(*hdf5file, counter++);
 
 			waypointLocation += settings->waypointStepSize;
 		}
 	}
 
+	// Wait until the writer threads have written the remaining groups and close the file
+	SafeDelete(hdf5file);
+
 	// Reset properties
 	camera->SetPosition(startPosition);
 	camera->SetRotationMatrix(startRotation);
@@ -727,13 +782,31 @@ void PointCloudEngine::GroundTruthRenderer::Redraw(bool present)
 	}
 }
 
+void PointCloudEngine::GroundTruthRenderer::RedrawGBuffer(bool present)
+{
+	// The back buffer is cleared by the redraw, the normal render targets are blended in the same way and need the same background
+	d3d11DevCon->ClearRenderTargetView(normalTextureRTV, (float*)&settings->backgroundColor);
+	d3d11DevCon->ClearRenderTargetView(normalScreenTextureRTV, (float*)&settings->backgroundColor);
+
+	// Draw the color, the normals and the screen normals at once, the depth is in the depth buffer or in the depth texture of the blending
+	ID3D11RenderTargetView* renderTargetViews[3] = { renderTargetView, normalTextureRTV, normalScreenTextureRTV };
+	d3d11DevCon->OMSetRenderTargets(3, renderTargetViews, depthStencilView);
+
+	drawGBuffer = true;
+	Redraw(present);
+	drawGBuffer = false;
+
+	// Reset to the default render target
+	d3d11DevCon->OMSetRenderTargets(1, &renderTargetView, depthStencilView);
+}
+
 void PointCloudEngine::GroundTruthRenderer::HDF5DrawDatasets(HDF5File& hdf5file, const UINT groupIndex)
 {
 	// Save the viewports in numbered groups with leading zeros
 	std::stringstream groupNameStream;
 	groupNameStream << std::setw(5) << std::setfill('0') << groupIndex;
 
-	H5::Group group = hdf5file.CreateGroup(groupNameStream.str());
+	HDF5Group group = hdf5file.CreateGroup(groupNameStream.str());
 
 	// When using headlight update the light direction
 	if (settings->useHeadlight)
@@ -755,80 +828,155 @@ void PointCloudEngine::GroundTruthRenderer::HDF5DrawDatasets(HDF5File& hdf5file,
 
 	// Reset to full resolution
 	ChangeRenderingResolution(resolutionX, resolutionY);
+
+	// The next viewport is drawn while the writer threads convert, compress and write this group
+	hdf5file.SubmitGroup(group);
 }
 
-void PointCloudEngine::GroundTruthRenderer::HDF5DrawRenderModes(HDF5File& hdf5file, H5::Group group, std::wstring comment, bool sparseUpsample)
+void PointCloudEngine::GroundTruthRenderer::HDF5DrawRenderModes(HDF5File& hdf5file, HDF5Group& group, std::wstring comment, bool sparseUpsample)
 {
 	// Calculates view and projection matrices and sets the viewport
 	camera->PrepareDraw();
 
-	// Draw in every render mode and save it to the dataset
+	// Draw every view mode only once and save all of its shading modes to the dataset
 	for (auto it = renderModes.begin(); it != renderModes.end(); it++)
 	{
+		if ((ShadingMode)it->second.y != ShadingMode::Color)
+		{
+			continue;
+		}
+
 		settings->viewMode = (ViewMode)it->second.x;
 
-		// Render differently based on the shading mode
-		switch ((ShadingMode)it->second.y)
+		// Fast path for the points that does not need to read back the textures
+		if (settings->pointRasterizerExport && (settings->viewMode == ViewMode::Points || settings->viewMode == ViewMode::SparsePoints))
 		{
-			case ShadingMode::Color:
+			HDF5DrawPointRasterizer(hdf5file, group, comment, sparseUpsample);
+			continue;
+		}
+
+		RedrawGBuffer(true);
+
+		// Depth without blending, the depth buffer is cleared when using blending but the depth pass of the blending draws the same depth
+		ID3D11Texture2D* gBufferDepthTexture = depthStencilTexture;
+
+		if ((settings->viewMode == ViewMode::Splats || settings->viewMode == ViewMode::SparseSplats) && settings->useBlending)
+		{
+			gBufferDepthTexture = blendingDepthTexture;
+		}
+
+		for (auto renderMode = renderModes.begin(); renderMode != renderModes.end(); renderMode++)
+		{
+			if (renderMode->second.x != it->second.x)
 			{
-				// Color
-				Redraw(true);
-				hdf5file.AddColorTextureDataset(group, it->first + comment, backBufferTexture, sparseUpsample);
-				break;
+				continue;
 			}
-			case ShadingMode::Depth:
+
+			// Save the render target of the shading mode
+			switch ((ShadingMode)renderMode->second.y)
 			{
-				// Depth without blending (depth buffer is cleared when using blending)
-				if (settings->useBlending)
+				case ShadingMode::Color:
 				{
-					settings->useBlending = false;
-					Redraw(true);
-					settings->useBlending = true;
+					hdf5file.AddColorTextureDataset(group, renderMode->first + comment, backBufferTexture, sparseUpsample);
+					break;
 				}
-				else
+				case ShadingMode::Depth:
 				{
-					Redraw(true);
+					hdf5file.AddDepthTextureDataset(group, renderMode->first + comment, gBufferDepthTexture, sparseUpsample);
+					break;
 				}
-				hdf5file.AddDepthTextureDataset(group, it->first + comment, depthStencilTexture, sparseUpsample);
+				case ShadingMode::Normal:
+				{
+					hdf5file.AddColorTextureDataset(group, renderMode->first + comment, normalTexture, sparseUpsample);
+					break;
+				}
+				case ShadingMode::NormalScreen:
+				{
+					hdf5file.AddColorTextureDataset(group, renderMode->first + comment, normalScreenTexture, sparseUpsample);
+					break;
+				}
+			}
+		}
+	}
+}
+
+void PointCloudEngine::GroundTruthRenderer::HDF5DrawPointRasterizer(HDF5File& hdf5file, HDF5Group& group, std::wstring comment, bool sparseUpsample)
+{
+	if ((pointRasterizer == NULL) || (pointRasterizer->width != settings->resolutionX) || (pointRasterizer->height != settings->resolutionY))
+	{
+		SafeDelete(pointRasterizer);
+		pointRasterizer = new PointRasterizer(settings->resolutionX, settings->resolutionY);
+	}
+
+	// Same amount of points as in the draw function
+	UINT vertexCount = vertices.size();
+
+	if (settings->viewMode == ViewMode::SparsePoints)
+	{
+		vertexCount *= settings->density;
+	}
+
+	PointRasterizer::Parameters parameters;
+	parameters.World = sceneObject->transform->worldMatrix;
+	parameters.View = camera->GetViewMatrix();
+	parameters.Projection = camera->GetProjectionMatrix();
+	parameters.cameraPosition = camera->GetPosition();
+	parameters.backfaceCulling = settings->backfaceCulling;
+	parameters.useLighting = lightingConstantBufferData.useLighting;
+	parameters.lightDirection = lightingConstantBufferData.lightDirection;
+	parameters.lightIntensity = lightingConstantBufferData.lightIntensity;
+	parameters.ambient = lightingConstantBufferData.ambient;
+	parameters.diffuse = lightingConstantBufferData.diffuse;
+	parameters.specular = lightingConstantBufferData.specular;
+	parameters.specularExponent = lightingConstantBufferData.specularExponent;
+	parameters.backgroundColor = lightingConstantBufferData.backgroundColor;
+
+	// A single draw computes all the shading modes of the view mode
+	pointRasterizer->Draw(vertices, vertexCount, parameters);
+
+	for (auto it = renderModes.begin(); it != renderModes.end(); it++)
+	{
+		if ((ViewMode)it->second.x != settings->viewMode)
+		{
+			continue;
+		}
+
+		switch ((ShadingMode)it->second.y)
+		{
+			case ShadingMode::Color:
+			{
+				hdf5file.AddColorDataset(group, it->first + comment, pointRasterizer->width, pointRasterizer->height, pointRasterizer->colors, sparseUpsample);
+				break;
+			}
+			case ShadingMode::Depth:
+			{
+				hdf5file.AddDepthDataset(group, it->first + comment, pointRasterizer->width, pointRasterizer->height, pointRasterizer->depths, sparseUpsample);
 				break;
 			}
 			case ShadingMode::Normal:
 			{
-				// Normal
-				constantBufferData.drawNormals = true;
-				constantBufferData.normalsInScreenSpace = false;
-				Redraw(true);
-				constantBufferData.drawNormals = false;
-				hdf5file.AddColorTextureDataset(group, it->first + comment, backBufferTexture, sparseUpsample);
+				hdf5file.AddColorDataset(group, it->first + comment, pointRasterizer->width, pointRasterizer->height, pointRasterizer->normals, sparseUpsample);
 				break;
 			}
 			case ShadingMode::NormalScreen:
 			{
-				// Normal Screen
-				constantBufferData.drawNormals = true;
-				constantBufferData.normalsInScreenSpace = true;
-				Redraw(true);
-				constantBufferData.drawNormals = false;
-				hdf5file.AddColorTextureDataset(group, it->first + comment, backBufferTexture, sparseUpsample);
+				hdf5file.AddColorDataset(group, it->first + comment, pointRasterizer->width, pointRasterizer->height, pointRasterizer->screenNormals, sparseUpsample);
 				break;
 			}
 		}
 	}
-
-	group.close();
 }
 
-HDF5File PointCloudEngine::GroundTruthRenderer::CreateDatasetHDF5File()
+HDF5File* PointCloudEngine::GroundTruthRenderer::CreateDatasetHDF5File()
 {
 	// Create a directory for the HDF5 files
 	CreateDirectory((executableDirectory + L"/HDF5").c_str(), NULL);
 
-	// Create and save the file
-	HDF5File hdf5file(executableDirectory + L"/HDF5/" + std::to_wstring(time(0)) + L".hdf5");
+	// Create and save the file, it owns the writer threads and is written completely when it is deleted
+	HDF5File* hdf5file = new HDF5File(executableDirectory + L"/HDF5/" + std::to_wstring(time(0)) + L".hdf5");
 
 	// Add attribute storing the settings
-	hdf5file.AddStringAttribute(L"Settings", settings->ToKeyValueString());
+	hdf5file->AddStringAttribute(L"Settings", settings->ToKeyValueString());
 
 	return hdf5file;
 }
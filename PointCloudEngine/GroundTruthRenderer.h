@@ -43,7 +43,8 @@ namespace PointCloudEngine
 			int drawNormals;
 			int normalsInScreenSpace;
 			int backfaceCulling;
-			float padding[2];
+			int drawGBuffer;
+			float padding;
         };
 
         std::vector<Vertex> vertices;
@@ -53,6 +54,16 @@ namespace PointCloudEngine
         ID3D11Buffer* vertexBuffer;		        // Holds vertex data
         ID3D11Buffer* constantBuffer;
 
+		// Only used by the splat rasterizer benchmark, it is recreated when the resolution changes
+		SplatRasterizer* splatRasterizer = NULL;
+		std::vector<SplatRasterizer::Splat> splats;
+
+		// Only used when the point view modes of the datasets are drawn on the CPU
+		PointRasterizer* pointRasterizer = NULL;
+
+		// Set while the color, normal and screen normal render targets are bound together for the dataset generation
+		bool drawGBuffer = false;
+
 		// Maps from the name of the render mode to the view mode (x) and the shading mode (y)
 		std::map<std::wstring, XMUINT2> renderModes =
 		{
@@ -106,15 +117,18 @@ namespace PointCloudEngine
 		torch::NoGradGuard noGradGuard;
 
 		void DrawNeuralNetwork();
+		void DrawSplatRasterizer(UINT vertexCount);
 		void CalculateLosses();
 		void RenderToTensor(std::wstring renderMode, torch::Tensor& tensor);
 		void CopyBackbufferTextureToTensor(torch::Tensor &tensor);
 		void CopyDepthTextureToTensor(torch::Tensor &tensor);
 		void OutputTensorSize(torch::Tensor &tensor);
 		void Redraw(bool present);
+		void RedrawGBuffer(bool present);
 		void HDF5DrawDatasets(HDF5File& hdf5file, const UINT groupIndex);
-		void HDF5DrawRenderModes(HDF5File& hdf5file, H5::Group group, std::wstring comment, bool sparseUpsample = false);
-		HDF5File CreateDatasetHDF5File();
+		void HDF5DrawRenderModes(HDF5File& hdf5file, HDF5Group& group, std::wstring comment, bool sparseUpsample = false);
+		void HDF5DrawPointRasterizer(HDF5File& hdf5file, HDF5Group& group, std::wstring comment, bool sparseUpsample);
+		HDF5File* CreateDatasetHDF5File();
 		std::vector<std::wstring> SplitString(std::wstring s, wchar_t delimiter);
     };
 }
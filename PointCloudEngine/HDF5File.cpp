@@ -1,69 +1,98 @@
 #include "HDF5File.h"
 
-HDF5File::HDF5File(std::wstring filename)
+HDF5File::HDF5File(std::wstring filename) : HDF5File(std::string(filename.begin(), filename.end()))
 {
-	file = new H5::H5File(std::string(filename.begin(), filename.end()).c_str(), H5F_ACC_TRUNC);
 }
 
 HDF5File::HDF5File(std::string filename)
 {
 	file = new H5::H5File(filename.c_str(), H5F_ACC_TRUNC);
+	maxPendingGroups = max(1, settings->hdf5WriterQueueSize);
+
+	// The codec stays the same for all the datasets of the file
+	compressionPool = new ThreadPool(settings->hdf5CompressionThreads);
+	compression = settings->hdf5Compression;
+	compressionLevel = settings->hdf5CompressionLevel;
+	compressionBenchmark = settings->hdf5CompressionBenchmark;
+
+	for (int i = 0; i < max(1, settings->hdf5WriterThreads); i++)
+	{
+		writers.push_back(std::thread(&HDF5File::WriterLoop, this));
+	}
 }
 
 HDF5File::~HDF5File()
 {
+	// Write the remaining groups before closing the file
+	Flush();
+
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		stop = true;
+	}
+
+	pendingCondition.notify_all();
+
+	for (auto it = writers.begin(); it != writers.end(); it++)
+	{
+		it->join();
+	}
+
+	OutputCompressionStatistics();
+
+	ReleaseConversionTextures();
+
+	for (auto it = freeStagingTextures.begin(); it != freeStagingTextures.end(); it++)
+	{
+		SAFE_RELEASE(*it);
+	}
+
+	SafeDelete(compressionPool);
 	delete file;
 }
 
-H5::Group HDF5File::CreateGroup(std::wstring name)
+HDF5Group HDF5File::CreateGroup(std::wstring name)
 {
-	return file->createGroup(std::string(name.begin(), name.end()));
+	return CreateGroup(std::string(name.begin(), name.end()));
 }
 
-H5::Group HDF5File::CreateGroup(std::string name)
+HDF5Group HDF5File::CreateGroup(std::string name)
 {
-	return file->createGroup(name);
+	HDF5Group group;
+	group.name = name;
+	group.downsampleFactor = settings->downsampleFactor;
+	group.backgroundColor = Vector3(settings->backgroundColor.x, settings->backgroundColor.y, settings->backgroundColor.z);
+
+	return group;
 }
 
-void HDF5File::AddColorTextureDataset(H5::Group& group, std::wstring name, ID3D11Texture2D* texture, bool sparseUpsample, float gammaCorrection)
+void HDF5File::AddColorTextureDataset(HDF5Group& group, std::wstring name, ID3D11Texture2D* texture, bool sparseUpsample, float gammaCorrection)
 {
 	AddColorTextureDataset(group, std::string(name.begin(), name.end()), texture, sparseUpsample, gammaCorrection);
 }
 
-void HDF5File::AddColorTextureDataset(H5::Group& group, std::string name, ID3D11Texture2D* texture, bool sparseUpsample, float gammaCorrection)
+void HDF5File::AddColorTextureDataset(HDF5Group& group, std::string name, ID3D11Texture2D* texture, bool sparseUpsample, float gammaCorrection)
 {
 	// 1. Convert the input RGBA texture into a 32bit RGBA texture
-	// 2. Make it readable by the CPU and convert only the RGB content to a 8bit buffer (skip alpha)
-	// 3. Use the HDF5 high level API to create an image dataset from this buffer
-	ID3D11Texture2D* inputTexture = NULL;
-	ID3D11Texture2D* outputTexture = NULL;
-	ID3D11Texture2D* readableTexture = NULL;
-	ID3D11RenderTargetView* outputTextureRTV = NULL;
-	ID3D11ShaderResourceView* inputTextureSRV = NULL;
-
-	// Get the texture description
+	// 2. Copy it into a CPU readable staging texture, it is mapped when the GPU has finished the copy a few groups later
+	// 3. The writer threads convert it to 8bit and create the HDF5 image dataset
 	D3D11_TEXTURE2D_DESC inputTextureDesc;
 	texture->GetDesc(&inputTextureDesc);
 
-	// Change the bind flag to make it possible to access the texture in a shader
-	inputTextureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-
-	// Create the input texture
-	hr = d3d11Device->CreateTexture2D(&inputTextureDesc, NULL, &inputTexture);
-	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateTexture2D) + L" failed!");
-
-	// Create a shader resource view for the input texture
-	D3D11_SHADER_RESOURCE_VIEW_DESC inputTextureSRVDesc;
-	ZeroMemory(&inputTextureSRVDesc, sizeof(inputTextureSRVDesc));
-	inputTextureSRVDesc.Format = inputTextureDesc.Format;
-	inputTextureSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	inputTextureSRVDesc.Texture2D.MipLevels = 1;
+	// The conversion textures are reused as long as the size and format of the input textures stay the same
+	if (conversionInputTexture != NULL)
+	{
+		D3D11_TEXTURE2D_DESC conversionInputTextureDesc;
+		conversionInputTexture->GetDesc(&conversionInputTextureDesc);
 
-	hr = d3d11Device->CreateShaderResourceView(inputTexture, &inputTextureSRVDesc, &inputTextureSRV);
-	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateShaderResourceView) + L" failed for the " + NAMEOF(inputTexture));
+		if ((conversionInputTextureDesc.Width != inputTextureDesc.Width) || (conversionInputTextureDesc.Height != inputTextureDesc.Height) || (conversionInputTextureDesc.Format != inputTextureDesc.Format))
+		{
+			ReleaseConversionTextures();
+		}
+	}
 
-	// Copy the content to the input texture
-	d3d11DevCon->CopyResource(inputTexture, texture);
+	// Change the bind flag to make it possible to access the texture in a shader
+	inputTextureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
 
 	// Change the output description to unsigned 32bit RGBA format and render target
 	D3D11_TEXTURE2D_DESC outputTextureDesc = inputTextureDesc;
@@ -72,20 +101,40 @@ void HDF5File::AddColorTextureDataset(H5::Group& group, std::string name, ID3D11
 	outputTextureDesc.Usage = D3D11_USAGE_DEFAULT;
 	outputTextureDesc.CPUAccessFlags = 0;
 
-	// Create a temporary texure with that format
-	hr = d3d11Device->CreateTexture2D(&outputTextureDesc, NULL, &outputTexture);
-	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateTexture2D) + L" failed!");
+	if (conversionInputTexture == NULL)
+	{
+		// Create the input texture
+		hr = d3d11Device->CreateTexture2D(&inputTextureDesc, NULL, &conversionInputTexture);
+		ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateTexture2D) + L" failed!");
+
+		// Create a shader resource view for the input texture
+		D3D11_SHADER_RESOURCE_VIEW_DESC inputTextureSRVDesc;
+		ZeroMemory(&inputTextureSRVDesc, sizeof(inputTextureSRVDesc));
+		inputTextureSRVDesc.Format = inputTextureDesc.Format;
+		inputTextureSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		inputTextureSRVDesc.Texture2D.MipLevels = 1;
+
+		hr = d3d11Device->CreateShaderResourceView(conversionInputTexture, &inputTextureSRVDesc, &conversionInputTextureSRV);
+		ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateShaderResourceView) + L" failed for the " + NAMEOF(conversionInputTexture));
+
+		// Create a texure with the output format
+		hr = d3d11Device->CreateTexture2D(&outputTextureDesc, NULL, &conversionOutputTexture);
+		ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateTexture2D) + L" failed!");
+
+		// Create render target view for this texture
+		hr = d3d11Device->CreateRenderTargetView(conversionOutputTexture, NULL, &conversionOutputTextureRTV);
+		ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateRenderTargetView) + L" failed!");
+	}
 
-	// Create render target view for this texture
-	hr = d3d11Device->CreateRenderTargetView(outputTexture, NULL, &outputTextureRTV);
-	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateRenderTargetView) + L" failed!");
+	// Copy the content to the input texture
+	d3d11DevCon->CopyResource(conversionInputTexture, texture);
 
 	// Set the shader and resources that will be used for the texture conversion
 	d3d11DevCon->VSSetShader(textureConversionShader->vertexShader, NULL, 0);
 	d3d11DevCon->GSSetShader(textureConversionShader->geometryShader, NULL, 0);
 	d3d11DevCon->PSSetShader(textureConversionShader->pixelShader, NULL, 0);
-	d3d11DevCon->PSSetShaderResources(0, 1, &inputTextureSRV);
-	d3d11DevCon->OMSetRenderTargets(1, &outputTextureRTV, NULL);
+	d3d11DevCon->PSSetShaderResources(0, 1, &conversionInputTextureSRV);
+	d3d11DevCon->OMSetRenderTargets(1, &conversionOutputTextureRTV, NULL);
 
 	// Perform texture conversion
 	d3d11DevCon->Draw(1, 0);
@@ -97,230 +146,573 @@ void HDF5File::AddColorTextureDataset(H5::Group& group, std::string name, ID3D11
 	d3d11DevCon->PSSetShaderResources(0, 1, nullSRV);
 	d3d11DevCon->OMSetRenderTargets(1, &renderTargetView, depthStencilView);
 
-	// Change the output description to unsigned 8bit RGBA format, render target and CPU readable
-	D3D11_TEXTURE2D_DESC readableTextureDesc = outputTextureDesc;
-	readableTextureDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
-	readableTextureDesc.Usage = D3D11_USAGE_STAGING;
-	readableTextureDesc.BindFlags = 0;
-
-	// Create a temporary CPU readable texure with that format
-	hr = d3d11Device->CreateTexture2D(&readableTextureDesc, NULL, &readableTexture);
-	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateTexture2D) + L" failed!");
+	// Copy the data from the output texture to a readable texture without waiting for the GPU
+	HDF5Group::Readback readback;
+	readback.datasetIndex = group.datasets.size();
+	readback.stagingTexture = GetStagingTexture(outputTextureDesc);
+	d3d11DevCon->CopyResource(readback.stagingTexture, conversionOutputTexture);
+	group.readbacks.push_back(readback);
 
-	// Copy the data from the output texture to the readable texture
-	d3d11DevCon->CopyResource(readableTexture, outputTexture);
+	HDF5Group::Dataset& dataset = AddDataset(group, name, outputTextureDesc.Width, outputTextureDesc.Height, false, sparseUpsample);
+	dataset.gammaCorrection = gammaCorrection;
+}
 
-	// Read the raw texture data
-	D3D11_MAPPED_SUBRESOURCE subresource;
-	d3d11DevCon->Map(readableTexture, 0, D3D11_MAP_READ, 0, &subresource);
+void HDF5File::AddDepthTextureDataset(HDF5Group& group, std::wstring name, ID3D11Texture2D* texture, bool sparseUpsample)
+{
+	AddDepthTextureDataset(group, std::string(name.begin(), name.end()), texture, sparseUpsample);
+}
 
-	// Create a vector for the 8bit RGB data
-	std::vector<BYTE> buffer;
+void HDF5File::AddDepthTextureDataset(HDF5Group& group, std::string name, ID3D11Texture2D* texture, bool sparseUpsample)
+{
+	// Get the texture description
+	D3D11_TEXTURE2D_DESC textureDesc;
+	texture->GetDesc(&textureDesc);
 
-	// Convert from 32bit float to 8bit and ignore alpha component
-	for (UINT i = 0; i < 4 * readableTextureDesc.Width * readableTextureDesc.Height; i++)
+	if (textureDesc.Format != DXGI_FORMAT_R32_TYPELESS)
 	{
-		// Ignore alpha channel
-		if ((i + 1) % 4 != 0)
-		{
-			float f = ((float*)subresource.pData)[i];
+		ERROR_MESSAGE(NAMEOF(AddDepthTextureDataset) + L" only supports textures with DXGI_FORMAT_R32_TYPELESS format!");
+		return;
+	}
 
-			// Make sure that the value is in the desired range
-			// It can be slightly out of range for floating point render targets
-			f = max(min(1.0f, f), 0);
+	// Copy the content of the original texture to a readable texture without waiting for the GPU
+	HDF5Group::Readback readback;
+	readback.datasetIndex = group.datasets.size();
+	readback.stagingTexture = GetStagingTexture(textureDesc);
+	d3d11DevCon->CopyResource(readback.stagingTexture, texture);
+	group.readbacks.push_back(readback);
 
-			// Perform gamma correction and add to buffer
-			buffer.push_back(std::pow(f, gammaCorrection) * 255);
-		}
-	}
+	AddDataset(group, name, textureDesc.Width, textureDesc.Height, true, sparseUpsample);
+}
 
-	// Unmap the texture
-	d3d11DevCon->Unmap(readableTexture, 0);
+void HDF5File::AddColorDataset(HDF5Group& group, std::wstring name, UINT width, UINT height, const std::vector<Vector3> &colors, bool sparseUpsample, float gammaCorrection)
+{
+	HDF5Group::Dataset& dataset = AddDataset(group, std::string(name.begin(), name.end()), width, height, false, sparseUpsample);
+	dataset.gammaCorrection = gammaCorrection;
 
-	// Release the resources
-	SAFE_RELEASE(inputTexture);
-	SAFE_RELEASE(outputTexture);
-	SAFE_RELEASE(readableTexture);
-	SAFE_RELEASE(outputTextureRTV);
-	SAFE_RELEASE(inputTextureSRV);
+	// Same conversion as for the textures so that the CPU and GPU exports are identical
+	dataset.values.resize(3 * width * height);
 
-	// Save in a custom 8bit 3D array (height * width * depth)
-	H5::DataSpace dataSpace = CreateDataspace({ readableTextureDesc.Height, readableTextureDesc.Width, 3 });
+	for (UINT i = 0; i < width * height; i++)
+	{
+		dataset.values[3 * i] = colors[i].x;
+		dataset.values[3 * i + 1] = colors[i].y;
+		dataset.values[3 * i + 2] = colors[i].z;
+	}
+}
 
-	// Create a property list to set up the chunking and ZLIB deflate compression
-	H5::DSetCreatPropList propList = CreateDeflateCompressionPropList({ 64, 64, 3 });
+void HDF5File::AddDepthDataset(HDF5Group& group, std::wstring name, UINT width, UINT height, const std::vector<float> &depths, bool sparseUpsample)
+{
+	HDF5Group::Dataset& dataset = AddDataset(group, std::string(name.begin(), name.end()), width, height, true, sparseUpsample);
+	dataset.values.assign(depths.begin(), depths.begin() + width * height);
+}
 
-	// Create the dataset
-	H5::DataSet dataSet = group.createDataSet(name.c_str(), H5::PredType::STD_U8BE, dataSpace, propList);
+void HDF5File::AddStringAttribute(std::wstring name, std::wstring value)
+{
+	std::lock_guard<std::mutex> lock(fileMutex);
+	AddStringAttribute(file, name, value);
+}
 
-	// Create attributes so that this data is interpreted as an image
-	SetImageAttributes(dataSet);
+void HDF5File::SubmitGroup(HDF5Group& group)
+{
+	copiedGroups.push_back(std::move(group));
+	group = HDF5Group();
 
-	// Write the data
-	dataSet.write(buffer.data(), H5::PredType::STD_U8BE);
+	// The copies of the oldest group were issued before the later groups were drawn, mapping them most likely doesn't wait for the GPU anymore
+	while (copiedGroups.size() > HDF5_READBACK_LATENCY)
+	{
+		QueueGroup(copiedGroups.front());
+		copiedGroups.pop_front();
+	}
+}
 
-	// Save a texture with twice the width and height where each original pixel is just surrounded by 8 blank pixels
-	if (sparseUpsample)
+void HDF5File::Flush()
+{
+	while (!copiedGroups.empty())
 	{
-		AddSparseUpsampleOfColorTexture(group, (name + "Upsampled").c_str(), readableTextureDesc.Width, readableTextureDesc.Height, buffer);
+		QueueGroup(copiedGroups.front());
+		copiedGroups.pop_front();
 	}
+
+	std::unique_lock<std::mutex> lock(queueMutex);
+	writtenCondition.wait(lock, [this] { return pendingGroups.empty() && (writingGroupsCount == 0); });
 }
 
-void HDF5File::AddDepthTextureDataset(H5::Group& group, std::wstring name, ID3D11Texture2D* texture, bool sparseUpsample)
+void HDF5File::QueueGroup(HDF5Group& group)
 {
-	AddDepthTextureDataset(group, std::string(name.begin(), name.end()), texture, sparseUpsample);
+	ReadBack(group);
+
+	{
+		// Wait until a writer thread takes one of the pending groups (backpressure)
+		std::unique_lock<std::mutex> lock(queueMutex);
+		writtenCondition.wait(lock, [this] { return pendingGroups.size() < maxPendingGroups; });
+		pendingGroups.push_back(std::move(group));
+	}
+
+	pendingCondition.notify_one();
 }
 
-void HDF5File::AddDepthTextureDataset(H5::Group& group, std::string name, ID3D11Texture2D* texture, bool sparseUpsample)
+void HDF5File::ReadBack(HDF5Group& group)
 {
-	ID3D11Texture2D* readableTexture = NULL;
+	for (auto it = group.readbacks.begin(); it != group.readbacks.end(); it++)
+	{
+		HDF5Group::Dataset& dataset = group.datasets[it->datasetIndex];
 
-	// Get the texture description
-	D3D11_TEXTURE2D_DESC textureDesc;
-	texture->GetDesc(&textureDesc);
+		// Read the raw texture data
+		D3D11_MAPPED_SUBRESOURCE subresource;
+		hr = d3d11DevCon->Map(it->stagingTexture, 0, D3D11_MAP_READ, 0, &subresource);
+		ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11DevCon->Map) + L" failed for the dataset " + std::wstring(dataset.name.begin(), dataset.name.end()));
 
-	if (textureDesc.Format != DXGI_FORMAT_R32_TYPELESS)
+		if (SUCCEEDED(hr))
+		{
+			if (dataset.depth)
+			{
+				dataset.values.resize((size_t)dataset.width * dataset.height);
+
+				// Copy the depth values row by row
+				for (UINT y = 0; y < dataset.height; y++)
+				{
+					memcpy(&dataset.values[(size_t)y * dataset.width], (byte*)subresource.pData + y * subresource.RowPitch, dataset.width * sizeof(float));
+				}
+			}
+			else
+			{
+				dataset.values.resize(3 * (size_t)dataset.width * dataset.height);
+
+				// Copy the 32bit float RGB values row by row and ignore alpha component
+				for (UINT y = 0; y < dataset.height; y++)
+				{
+					float* row = (float*)((byte*)subresource.pData + y * subresource.RowPitch);
+
+					for (UINT x = 0; x < dataset.width; x++)
+					{
+						size_t index = 3 * ((size_t)y * dataset.width + x);
+						dataset.values[index] = row[4 * x];
+						dataset.values[index + 1] = row[4 * x + 1];
+						dataset.values[index + 2] = row[4 * x + 2];
+					}
+				}
+			}
+
+			d3d11DevCon->Unmap(it->stagingTexture, 0);
+		}
+
+		// The staging texture can be used by the next groups
+		freeStagingTextures.push_back(it->stagingTexture);
+	}
+
+	group.readbacks.clear();
+}
+
+ID3D11Texture2D* HDF5File::GetStagingTexture(D3D11_TEXTURE2D_DESC textureDesc)
+{
+	// Reuse a staging texture of a group that was already read back, there is one for each dataset of the groups in flight
+	for (auto it = freeStagingTextures.begin(); it != freeStagingTextures.end(); it++)
 	{
-		ERROR_MESSAGE(NAMEOF(AddDepthTextureDataset) + L" only supports textures with DXGI_FORMAT_R32_TYPELESS format!");
-		return;
+		D3D11_TEXTURE2D_DESC stagingTextureDesc;
+		(*it)->GetDesc(&stagingTextureDesc);
+
+		if ((stagingTextureDesc.Width == textureDesc.Width) && (stagingTextureDesc.Height == textureDesc.Height) && (stagingTextureDesc.Format == textureDesc.Format))
+		{
+			ID3D11Texture2D* stagingTexture = *it;
+			freeStagingTextures.erase(it);
+
+			return stagingTexture;
+		}
 	}
 
 	// Change the description to make the texture CPU readable
 	textureDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
 	textureDesc.Usage = D3D11_USAGE_STAGING;
 	textureDesc.BindFlags = 0;
+	textureDesc.MiscFlags = 0;
 
-	// Create a readable temporary texture
-	hr = d3d11Device->CreateTexture2D(&textureDesc, NULL, &readableTexture);
-	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateTexture2D) + L" failed!");
+	ID3D11Texture2D* stagingTexture = NULL;
+	hr = d3d11Device->CreateTexture2D(&textureDesc, NULL, &stagingTexture);
+	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateTexture2D) + L" failed for the " + NAMEOF(stagingTexture));
 
-	// Copy the content of the original texture
-	d3d11DevCon->CopyResource(readableTexture, texture);
+	return stagingTexture;
+}
 
-	// Read the raw texture data
-	D3D11_MAPPED_SUBRESOURCE subresource;
-	d3d11DevCon->Map(readableTexture, 0, D3D11_MAP_READ, 0, &subresource);
+void HDF5File::ReleaseConversionTextures()
+{
+	SAFE_RELEASE(conversionInputTexture);
+	SAFE_RELEASE(conversionInputTextureSRV);
+	SAFE_RELEASE(conversionOutputTexture);
+	SAFE_RELEASE(conversionOutputTextureRTV);
+}
 
-	// Save in a HDF5 2D array
-	H5::DataSpace dataSpace = CreateDataspace({ textureDesc.Height, textureDesc.Width });
+void HDF5File::WriterLoop()
+{
+	while (true)
+	{
+		HDF5Group group;
 
-	// Create a property list to set up the chunking and ZLIB deflate compression
-	H5::DSetCreatPropList propList = CreateDeflateCompressionPropList({ 64, 64 });
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			pendingCondition.wait(lock, [this] { return stop || !pendingGroups.empty(); });
 
-	// Create the dataset
-	H5::DataSet dataSet = group.createDataSet(name.c_str(), H5::PredType::NATIVE_FLOAT, dataSpace, propList);
+			if (pendingGroups.empty())
+			{
+				return;
+			}
 
-	// Create attributes so that this data is interpreted as an image
-	SetImageAttributes(dataSet);
+			group = std::move(pendingGroups.front());
+			pendingGroups.pop_front();
+			writingGroupsCount++;
+		}
 
-	// Write the data
-	dataSet.write(subresource.pData, H5::PredType::NATIVE_FLOAT);
+		// There is space for another pending group now
+		writtenCondition.notify_all();
 
-	// Save a texture with twice the width and height where each original pixel is just surrounded by 8 blank pixels
-	if (sparseUpsample)
-	{
-		AddSparseUpsampleOfDepthTexture(group, (name + "Upsampled").c_str(), textureDesc.Width, textureDesc.Height, (float*)subresource.pData);
-	}
-	
-	// Unmap the texture
-	d3d11DevCon->Unmap(readableTexture, 0);
+		WriteGroup(group);
 
-	SAFE_RELEASE(readableTexture);
-}
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			writingGroupsCount--;
+		}
 
-void HDF5File::AddStringAttribute(std::wstring name, std::wstring value)
-{
-	AddStringAttribute(file, name, value);
+		writtenCondition.notify_all();
+	}
 }
 
-void HDF5File::AddSparseUpsampleOfColorTexture(H5::Group& group, std::string name, int width, int height, std::vector<byte> data)
+void HDF5File::WriteGroup(HDF5Group& group)
 {
-	// Create an upscaled texture with blank pixels around each RGB input pixel
-	size_t newWidth = settings->downsampleFactor * width;
-	size_t newHeight = settings->downsampleFactor * height;
+	// Convert the colors and create the sparse upsampled datasets without holding the file mutex, other writer threads can write in the meantime
+	size_t datasetsCount = group.datasets.size();
+
+	for (size_t i = 0; i < datasetsCount; i++)
+	{
+		if (!group.datasets[i].depth)
+		{
+			ConvertColorDataset(group.datasets[i]);
+		}
 
-	byte* newData = new byte[3 * newWidth * newHeight];
+		// Save a texture with twice the width and height where each original pixel is just surrounded by 8 blank pixels
+		if (group.datasets[i].sparseUpsample)
+		{
+			HDF5Group::Dataset upsample = GetSparseUpsample(group.datasets[i], group.downsampleFactor, group.backgroundColor);
+			group.datasets.push_back(std::move(upsample));
+		}
+	}
 
-	for (int y = 0; y < newHeight; y++)
+	// Compare the selected codec with all the other ones, the chunks of the selected codec are compressed last and written
+	if (compressionBenchmark)
 	{
-		for (int x = 0; x < newWidth; x++)
+		for (int i = 0; i < HDF5_COMPRESSION_COUNT; i++)
 		{
-			int index = x + y * newWidth;
-			int r = 3 * index;
-			int g = r + 1;
-			int b = g + 1;
+			if ((HDF5Compression)i != compression)
+			{
+				CompressChunks(group, (HDF5Compression)i);
+			}
+		}
+	}
+
+	CompressChunks(group, compression);
 
-			if ((y % settings->downsampleFactor == 1) && (x % settings->downsampleFactor == 1))
+	std::lock_guard<std::mutex> lock(fileMutex);
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	try
+	{
+		H5::Group h5Group = file->createGroup(group.name);
+
+		for (auto it = group.datasets.begin(); it != group.datasets.end(); it++)
+		{
+			if (it->depth)
 			{
-				// Write the original pixel
-				int originalX = x / settings->downsampleFactor;
-				int originalY = y / settings->downsampleFactor;
-				int originalIndex = originalX + originalY * width;
-				int originalR = 3 * originalIndex;
-				int originalG = originalR + 1;
-				int originalB = originalG + 1;
-
-				newData[r] = data[originalR];
-				newData[g] = data[originalG];
-				newData[b] = data[originalB];
+				WriteDepthDataset(h5Group, *it);
 			}
 			else
 			{
-				// Write blank (background color)
-				newData[r] = settings->backgroundColor.x * 255;
-				newData[g] = settings->backgroundColor.y * 255;
-				newData[b] = settings->backgroundColor.z * 255;
+				WriteColorDataset(h5Group, *it);
 			}
 		}
+
+		h5Group.close();
+	}
+	catch (H5::Exception &exception)
+	{
+		std::string message = exception.getDetailMsg();
+		ERROR_MESSAGE(L"Could not write the group " + std::wstring(group.name.begin(), group.name.end()) + L" to the HDF5 file: " + std::wstring(message.begin(), message.end()));
 	}
 
-	H5::DataSpace dataSpace = CreateDataspace({ newHeight, newWidth, 3 });
-	H5::DSetCreatPropList propList = CreateDeflateCompressionPropList({ 64, 64, 3 });
-	H5::DataSet dataSet = group.createDataSet(name.c_str(), H5::PredType::STD_U8BE, dataSpace, propList);
-	SetImageAttributes(dataSet);
-	dataSet.write(newData, H5::PredType::STD_U8BE);
+	std::lock_guard<std::mutex> statisticsLock(statisticsMutex);
+	compressionStatistics[(int)compression].milliseconds += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
 
-	delete[] newData;
+HDF5Group::Dataset& HDF5File::AddDataset(HDF5Group& group, std::string name, UINT width, UINT height, bool depth, bool sparseUpsample)
+{
+	HDF5Group::Dataset dataset;
+	dataset.name = name;
+	dataset.width = width;
+	dataset.height = height;
+	dataset.depth = depth;
+	dataset.sparseUpsample = sparseUpsample;
+	dataset.gammaCorrection = 1.0f;
+
+	group.datasets.push_back(std::move(dataset));
+
+	return group.datasets.back();
 }
 
-void HDF5File::AddSparseUpsampleOfDepthTexture(H5::Group& group, std::string name, int width, int height, float* data)
+void HDF5File::ConvertColorDataset(HDF5Group::Dataset& dataset)
 {
-	// Create an upscaled texture with blank pixels around each input pixel
-	size_t newWidth = settings->downsampleFactor * width;
-	size_t newHeight = settings->downsampleFactor * height;
+	dataset.colors.resize(dataset.values.size());
+
+	// Convert from 32bit float to 8bit
+	for (size_t i = 0; i < dataset.values.size(); i++)
+	{
+		// Make sure that the value is in the desired range
+		// It can be slightly out of range for floating point render targets
+		float f = max(min(1.0f, dataset.values[i]), 0);
+
+		// Perform gamma correction
+		dataset.colors[i] = std::pow(f, dataset.gammaCorrection) * 255;
+	}
 
-	float* newData = new float[newWidth * newHeight];
+	// The float values are not needed anymore
+	std::vector<float>().swap(dataset.values);
+}
 
-	for (int y = 0; y < newHeight; y++)
+HDF5Group::Dataset HDF5File::GetSparseUpsample(const HDF5Group::Dataset& dataset, int downsampleFactor, Vector3 backgroundColor)
+{
+	// Create an upscaled dataset with blank pixels around each input pixel
+	HDF5Group::Dataset upsample;
+	upsample.name = dataset.name + "Upsampled";
+	upsample.width = downsampleFactor * dataset.width;
+	upsample.height = downsampleFactor * dataset.height;
+	upsample.depth = dataset.depth;
+	upsample.sparseUpsample = false;
+	upsample.gammaCorrection = dataset.gammaCorrection;
+
+	// Write blank (background color or maximum depth)
+	if (dataset.depth)
+	{
+		upsample.values.assign(upsample.width * upsample.height, 1.0f);
+	}
+	else
 	{
-		for (int x = 0; x < newWidth; x++)
+		byte blank[3] = { (byte)(backgroundColor.x * 255), (byte)(backgroundColor.y * 255), (byte)(backgroundColor.z * 255) };
+		upsample.colors.resize(3 * upsample.width * upsample.height);
+
+		for (size_t i = 0; i < upsample.colors.size(); i++)
 		{
-			int index = x + y * newWidth;
+			upsample.colors[i] = blank[i % 3];
+		}
+	}
 
-			if ((y % settings->downsampleFactor == 1) && (x % settings->downsampleFactor == 1))
+	for (UINT y = 0; y < upsample.height; y++)
+	{
+		for (UINT x = 0; x < upsample.width; x++)
+		{
+			if ((y % downsampleFactor == 1) && (x % downsampleFactor == 1))
 			{
 				// Write the original pixel
-				int originalX = x / settings->downsampleFactor;
-				int originalY = y / settings->downsampleFactor;
-				int originalIndex = originalX + originalY * width;
-
-				newData[index] = data[originalIndex];
+				size_t index = x + (size_t)y * upsample.width;
+				size_t originalIndex = (x / downsampleFactor) + (size_t)(y / downsampleFactor) * dataset.width;
+
+				if (dataset.depth)
+				{
+					upsample.values[index] = dataset.values[originalIndex];
+				}
+				else
+				{
+					upsample.colors[3 * index] = dataset.colors[3 * originalIndex];
+					upsample.colors[3 * index + 1] = dataset.colors[3 * originalIndex + 1];
+					upsample.colors[3 * index + 2] = dataset.colors[3 * originalIndex + 2];
+				}
 			}
-			else
+		}
+	}
+
+	return upsample;
+}
+
+void HDF5File::CompressChunks(HDF5Group& group, HDF5Compression chunkCompression)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	// Every chunk of every dataset is compressed by a separate task (index of the dataset and index of the chunk)
+	std::vector<std::pair<size_t, size_t>> chunkTasks;
+	size_t bytes = 0;
+
+	for (size_t i = 0; i < group.datasets.size(); i++)
+	{
+		HDF5Group::Dataset& dataset = group.datasets[i];
+		size_t chunksX = (dataset.width + HDF5_CHUNK_SIZE - 1) / HDF5_CHUNK_SIZE;
+		size_t chunksY = (dataset.height + HDF5_CHUNK_SIZE - 1) / HDF5_CHUNK_SIZE;
+
+		dataset.chunks.resize(chunksX * chunksY);
+		bytes += (size_t)dataset.width * dataset.height * (dataset.depth ? sizeof(float) : 3);
+
+		for (size_t j = 0; j < dataset.chunks.size(); j++)
+		{
+			chunkTasks.push_back(std::make_pair(i, j));
+		}
+	}
+
+	compressionPool->ParallelFor(chunkTasks.size(), [&](size_t i)
+	{
+		HDF5Group::Dataset& dataset = group.datasets[chunkTasks[i].first];
+		CompressChunk(dataset, chunkTasks[i].second, chunkCompression, dataset.chunks[chunkTasks[i].second]);
+	});
+
+	size_t compressedBytes = 0;
+
+	for (auto it = group.datasets.begin(); it != group.datasets.end(); it++)
+	{
+		for (auto chunk = it->chunks.begin(); chunk != it->chunks.end(); chunk++)
+		{
+			compressedBytes += chunk->size();
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(statisticsMutex);
+	CompressionStatistics& statistics = compressionStatistics[(int)chunkCompression];
+	statistics.bytes += bytes;
+	statistics.compressedBytes += compressedBytes;
+	statistics.milliseconds += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+void HDF5File::CompressChunk(const HDF5Group::Dataset& dataset, size_t chunkIndex, HDF5Compression chunkCompression, std::vector<byte> &outChunk)
+{
+	const size_t elementSize = dataset.depth ? sizeof(float) : sizeof(byte);
+	const size_t pixelSize = dataset.depth ? sizeof(float) : 3;
+	const byte* data = dataset.depth ? (const byte*)dataset.values.data() : dataset.colors.data();
+
+	const UINT chunksX = (dataset.width + HDF5_CHUNK_SIZE - 1) / HDF5_CHUNK_SIZE;
+	const UINT startX = (chunkIndex % chunksX) * HDF5_CHUNK_SIZE;
+	const UINT startY = (chunkIndex / chunksX) * HDF5_CHUNK_SIZE;
+	const UINT endX = min(dataset.width, startX + HDF5_CHUNK_SIZE);
+	const UINT endY = min(dataset.height, startY + HDF5_CHUNK_SIZE);
+
+	// HDF5 always stores complete chunks, the chunks at the right and bottom edge are padded with zeros
+	std::vector<byte> chunk(HDF5_CHUNK_SIZE * HDF5_CHUNK_SIZE * pixelSize, 0);
+
+	for (UINT y = startY; y < endY; y++)
+	{
+		memcpy(&chunk[(y - startY) * HDF5_CHUNK_SIZE * pixelSize], data + ((size_t)y * dataset.width + startX) * pixelSize, (endX - startX) * pixelSize);
+	}
+
+	if (chunkCompression == HDF5Compression::None)
+	{
+		outChunk.swap(chunk);
+		return;
+	}
+
+	// Same byte order as the shuffle filter of the HDF5 library, first the first bytes of all the floats, then the second bytes and so on
+	// The sign, exponent and upper mantissa bytes of neighbouring depths are almost the same and compress much better this way
+	if ((chunkCompression == HDF5Compression::ShuffleDeflate) && (elementSize > 1))
+	{
+		std::vector<byte> shuffledChunk(chunk.size());
+		size_t elementsCount = chunk.size() / elementSize;
+
+		for (size_t i = 0; i < elementsCount; i++)
+		{
+			for (size_t j = 0; j < elementSize; j++)
 			{
-				// Write blank
-				newData[index] = 1.0f;
+				shuffledChunk[j * elementsCount + i] = chunk[i * elementSize + j];
 			}
 		}
+
+		chunk.swap(shuffledChunk);
 	}
 
-	H5::DataSpace dataSpace = CreateDataspace({ newHeight, newWidth });
-	H5::DSetCreatPropList propList = CreateDeflateCompressionPropList({ 64, 64 });
-	H5::DataSet dataSet = group.createDataSet(name.c_str(), H5::PredType::NATIVE_FLOAT, dataSpace, propList);
+	// Same zlib stream as the deflate filter of the HDF5 library creates
+	uLongf compressedSize = compressBound(chunk.size());
+	outChunk.resize(compressedSize);
+	int result = compress2(outChunk.data(), &compressedSize, chunk.data(), chunk.size(), compressionLevel);
+
+	if (result != Z_OK)
+	{
+		// An empty chunk is not written, this way the dataset contains zeros instead of a corrupt chunk
+		outChunk.clear();
+		ERROR_MESSAGE(NAMEOF(compress2) + L" failed with the error " + std::to_wstring(result) + L" for the chunk " + std::to_wstring(chunkIndex) + L" of the dataset " + std::wstring(dataset.name.begin(), dataset.name.end()));
+		return;
+	}
+
+	outChunk.resize(compressedSize);
+}
+
+void HDF5File::WriteColorDataset(H5::Group& group, const HDF5Group::Dataset& dataset)
+{
+	// Save in a custom 8bit 3D array (height * width * depth)
+	H5::DataSpace dataSpace = CreateDataspace({ dataset.height, dataset.width, 3 });
+
+	// Create a property list to set up the chunking and the filters of the compressed chunks
+	H5::DSetCreatPropList propList = CreateCompressionPropList({ HDF5_CHUNK_SIZE, HDF5_CHUNK_SIZE, 3 }, sizeof(byte));
+
+	// Create the dataset
+	H5::DataSet dataSet = group.createDataSet(dataset.name.c_str(), H5::PredType::STD_U8BE, dataSpace, propList);
+
+	// Create attributes so that this data is interpreted as an image
 	SetImageAttributes(dataSet);
-	dataSet.write(newData, H5::PredType::NATIVE_FLOAT);
 
-	delete[] newData;
+	// Write the data
+	WriteChunks(dataSet, dataset);
+}
+
+void HDF5File::WriteDepthDataset(H5::Group& group, const HDF5Group::Dataset& dataset)
+{
+	// Save in a HDF5 2D array
+	H5::DataSpace dataSpace = CreateDataspace({ dataset.height, dataset.width });
+
+	// Create a property list to set up the chunking and the filters of the compressed chunks
+	H5::DSetCreatPropList propList = CreateCompressionPropList({ HDF5_CHUNK_SIZE, HDF5_CHUNK_SIZE }, sizeof(float));
+
+	// Create the dataset
+	H5::DataSet dataSet = group.createDataSet(dataset.name.c_str(), H5::PredType::NATIVE_FLOAT, dataSpace, propList);
+
+	// Create attributes so that this data is interpreted as an image
+	SetImageAttributes(dataSet);
+
+	// Write the data
+	WriteChunks(dataSet, dataset);
+}
+
+void HDF5File::WriteChunks(H5::DataSet& dataSet, const HDF5Group::Dataset& dataset)
+{
+	const UINT chunksX = (dataset.width + HDF5_CHUNK_SIZE - 1) / HDF5_CHUNK_SIZE;
+
+	for (size_t i = 0; i < dataset.chunks.size(); i++)
+	{
+		// The compression of this chunk failed and was already reported
+		if (dataset.chunks[i].empty())
+		{
+			continue;
+		}
+
+		// Offset of the first pixel of the chunk, the filter mask 0 means that all the filters of the pipeline were applied
+		hsize_t offset[3] = { (i / chunksX) * HDF5_CHUNK_SIZE, (i % chunksX) * HDF5_CHUNK_SIZE, 0 };
+
+		if (H5Dwrite_chunk(dataSet.getId(), H5P_DEFAULT, 0, offset, dataset.chunks[i].size(), dataset.chunks[i].data()) < 0)
+		{
+			throw H5::DataSetIException("H5Dwrite_chunk", "Could not write the chunk " + std::to_string(i) + " of the dataset " + dataset.name);
+		}
+	}
+}
+
+void HDF5File::OutputCompressionStatistics()
+{
+	const wchar_t* compressionNames[HDF5_COMPRESSION_COUNT] = { L"None", L"Deflate", L"ShuffleDeflate" };
+	std::wstringstream outputStream;
+
+	for (int i = 0; i < HDF5_COMPRESSION_COUNT; i++)
+	{
+		CompressionStatistics& statistics = compressionStatistics[i];
+
+		if ((statistics.bytes == 0) || (statistics.milliseconds <= 0))
+		{
+			continue;
+		}
+
+		// Only the time of the written codec contains the direct chunk writes
+		outputStream << L"HDF5 compression " << compressionNames[i] << (((HDF5Compression)i == compression) ? L" (written): " : L": ");
+		outputStream << statistics.bytes / 1000000.0 << L" MB, ratio " << (double)statistics.bytes / max(1, statistics.compressedBytes) << L", " << statistics.milliseconds << L" ms, ";
+		outputStream << (statistics.bytes / 1000000.0) / (statistics.milliseconds / 1000.0) << L" MB/s" << std::endl;
+	}
+
+	OutputDebugString(outputStream.str().c_str());
 }
 
 H5::DataSpace HDF5File::CreateDataspace(std::initializer_list<hsize_t> dimensions)
@@ -328,11 +720,21 @@ H5::DataSpace HDF5File::CreateDataspace(std::initializer_list<hsize_t> dimension
 	return H5::DataSpace(dimensions.size(), dimensions.begin());
 }
 
-H5::DSetCreatPropList HDF5File::CreateDeflateCompressionPropList(std::initializer_list<hsize_t> chunkDimensions, int deflateLevel)
+H5::DSetCreatPropList HDF5File::CreateCompressionPropList(std::initializer_list<hsize_t> chunkDimensions, size_t elementSize)
 {
+	// The filters have to be the same ones that were applied to the compressed chunks
 	H5::DSetCreatPropList propList;
 	propList.setChunk(chunkDimensions.size(), chunkDimensions.begin());
-	propList.setDeflate(deflateLevel);
+
+	if ((compression == HDF5Compression::ShuffleDeflate) && (elementSize > 1))
+	{
+		propList.setShuffle();
+	}
+
+	if (compression != HDF5Compression::None)
+	{
+		propList.setDeflate(compressionLevel);
+	}
 
 	return propList;
 }
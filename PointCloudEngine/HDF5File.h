@@ -3,10 +3,61 @@
 
 #define H5_BUILT_AS_DYNAMIC_LIB
 
+// Width and height of the dataset chunks in pixels, each chunk is compressed separately
+#define HDF5_CHUNK_SIZE 64
+
+// Amount of codecs in HDF5Compression, the settings fall back to Deflate for other values
+#define HDF5_COMPRESSION_COUNT 3
+
+// Amount of submitted groups whose texture copies are still in flight, the textures of a group are mapped when this many later groups were submitted
+#define HDF5_READBACK_LATENCY 2
+
 #pragma once
 #include "H5Cpp.h"
+#include "zlib.h"
 #include "PointCloudEngine.h"
 
+// Datasets of one group that are collected on the render thread and written together once the group is submitted to the file
+struct HDF5Group
+{
+	// Values that were read back from a texture or a CPU buffer, the conversion into the stored format happens on the writer threads
+	struct Dataset
+	{
+		std::string name;
+		UINT width;
+		UINT height;
+		bool depth;
+		bool sparseUpsample;
+		float gammaCorrection;
+
+		// RGB colors or depths in row major order starting at the top left pixel
+		std::vector<float> values;
+
+		// 8bit RGB colors that are converted from the values before writing
+		std::vector<byte> colors;
+
+		// Compressed chunks in row major order, they are written directly without the filter pipeline of the HDF5 library
+		std::vector<std::vector<byte>> chunks;
+	};
+
+	// Staging texture that the GPU copies a texture into, it is mapped into the values of the dataset a few groups later
+	struct Readback
+	{
+		size_t datasetIndex;
+		ID3D11Texture2D* stagingTexture;
+	};
+
+	std::string name;
+	std::vector<Dataset> datasets;
+	std::vector<Readback> readbacks;
+
+	// Settings at the time the group was created, they are used by the writer threads for the sparse upsampling
+	int downsampleFactor;
+	Vector3 backgroundColor;
+};
+
+// The groups are written by a pool of writer threads while the next groups are drawn
+// Submitting a group blocks while the queue of pending groups is full, this keeps the memory of the pending datasets bounded
 class HDF5File
 {
 public:
@@ -14,22 +65,88 @@ public:
 	HDF5File(std::string filename);
 	~HDF5File();
 
-	H5::Group CreateGroup(std::wstring name);
-	H5::Group CreateGroup(std::string name);
+	HDF5Group CreateGroup(std::wstring name);
+	HDF5Group CreateGroup(std::string name);
+
+	// The textures are copied on the GPU, they can be drawn again as soon as these functions return
+	// The copies are only mapped after HDF5_READBACK_LATENCY more groups were submitted, this way the render thread does not wait for the GPU
+	void AddColorTextureDataset(HDF5Group& group, std::wstring name, ID3D11Texture2D* texture, bool sparseUpsample = false, float gammaCorrection = 1.0f);
+	void AddColorTextureDataset(HDF5Group& group, std::string name, ID3D11Texture2D* texture, bool sparseUpsample = false, float gammaCorrection = 1.0f);
+	void AddDepthTextureDataset(HDF5Group& group, std::wstring name, ID3D11Texture2D* texture, bool sparseUpsample = false);
+	void AddDepthTextureDataset(HDF5Group& group, std::string name, ID3D11Texture2D* texture, bool sparseUpsample = false);
 
-	void AddColorTextureDataset(H5::Group& group, std::wstring name, ID3D11Texture2D* texture, bool sparseUpsample = false, float gammaCorrection = 1.0f);
-	void AddColorTextureDataset(H5::Group& group, std::string name, ID3D11Texture2D* texture, bool sparseUpsample = false, float gammaCorrection = 1.0f);
-	void AddDepthTextureDataset(H5::Group& group, std::wstring name, ID3D11Texture2D* texture, bool sparseUpsample = false);
-	void AddDepthTextureDataset(H5::Group& group, std::string name, ID3D11Texture2D* texture, bool sparseUpsample = false);
+	// Same datasets from color and depth buffers on the CPU in row major order starting at the top left pixel
+	void AddColorDataset(HDF5Group& group, std::wstring name, UINT width, UINT height, const std::vector<Vector3> &colors, bool sparseUpsample = false, float gammaCorrection = 1.0f);
+	void AddDepthDataset(HDF5Group& group, std::wstring name, UINT width, UINT height, const std::vector<float> &depths, bool sparseUpsample = false);
 	void AddStringAttribute(std::wstring name, std::wstring value);
 
+	// Hands the group over to the writer threads once its textures are read back, the group is empty afterwards
+	// The texture readbacks use the immediate context, this has to be called from the render thread
+	void SubmitGroup(HDF5Group& group);
+
+	// Reads back the textures of all the submitted groups and blocks until they are written to the file
+	void Flush();
+
 private:
 	H5::H5File* file = NULL;
 
-	void AddSparseUpsampleOfColorTexture(H5::Group& group, std::string name, int width, int height, std::vector<byte> data);
-	void AddSparseUpsampleOfDepthTexture(H5::Group& group, std::string name, int width, int height, float* data);
+	// The HDF5 library is not thread safe, all the calls that access the file are done while holding this mutex
+	std::mutex fileMutex;
+
+	// Submitted groups whose textures are not read back yet, they are only accessed by the render thread
+	std::deque<HDF5Group> copiedGroups;
+
+	// Staging textures of the groups that were already read back and the textures of the color conversion, both are reused for the next datasets
+	std::vector<ID3D11Texture2D*> freeStagingTextures;
+	ID3D11Texture2D* conversionInputTexture = NULL;
+	ID3D11Texture2D* conversionOutputTexture = NULL;
+	ID3D11ShaderResourceView* conversionInputTextureSRV = NULL;
+	ID3D11RenderTargetView* conversionOutputTextureRTV = NULL;
+
+	// Bounded queue of the submitted groups that are not yet taken by a writer thread
+	std::deque<HDF5Group> pendingGroups;
+	size_t maxPendingGroups;
+	size_t writingGroupsCount = 0;
+	bool stop = false;
+	std::mutex queueMutex;
+	std::condition_variable pendingCondition;
+	std::condition_variable writtenCondition;
+	std::vector<std::thread> writers;
+
+	// The chunks of the datasets are compressed by this pool before the writer thread locks the file
+	ThreadPool* compressionPool = NULL;
+	HDF5Compression compression;
+	int compressionLevel;
+	bool compressionBenchmark;
+
+	// Throughput of each codec, the time of the selected codec also contains the direct chunk writes
+	struct CompressionStatistics
+	{
+		size_t bytes = 0;
+		size_t compressedBytes = 0;
+		double milliseconds = 0;
+	};
+
+	CompressionStatistics compressionStatistics[HDF5_COMPRESSION_COUNT];
+	std::mutex statisticsMutex;
+
+	void QueueGroup(HDF5Group& group);
+	void ReadBack(HDF5Group& group);
+	ID3D11Texture2D* GetStagingTexture(D3D11_TEXTURE2D_DESC textureDesc);
+	void ReleaseConversionTextures();
+	void WriterLoop();
+	void WriteGroup(HDF5Group& group);
+	HDF5Group::Dataset& AddDataset(HDF5Group& group, std::string name, UINT width, UINT height, bool depth, bool sparseUpsample);
+	void ConvertColorDataset(HDF5Group::Dataset& dataset);
+	HDF5Group::Dataset GetSparseUpsample(const HDF5Group::Dataset& dataset, int downsampleFactor, Vector3 backgroundColor);
+	void CompressChunks(HDF5Group& group, HDF5Compression chunkCompression);
+	void CompressChunk(const HDF5Group::Dataset& dataset, size_t chunkIndex, HDF5Compression chunkCompression, std::vector<byte> &outChunk);
+	void WriteColorDataset(H5::Group& group, const HDF5Group::Dataset& dataset);
+	void WriteDepthDataset(H5::Group& group, const HDF5Group::Dataset& dataset);
+	void WriteChunks(H5::DataSet& dataSet, const HDF5Group::Dataset& dataset);
+	void OutputCompressionStatistics();
 	H5::DataSpace CreateDataspace(std::initializer_list<hsize_t> dimensions = {});
-	H5::DSetCreatPropList CreateDeflateCompressionPropList(std::initializer_list<hsize_t> chunkDimensions = {}, int deflateLevel = 6);
+	H5::DSetCreatPropList CreateCompressionPropList(std::initializer_list<hsize_t> chunkDimensions, size_t elementSize);
 	void AddStringAttribute(H5::H5Object* object, std::wstring name, std::wstring value);
 	void AddStringAttribute(H5::H5Object* object, std::string name, std::string value);
 	void SetImageAttributes(H5::DataSet& dataSet);
@@ -0,0 +1,155 @@
+#include "Hash64.h"
+
+#define HASH64_PRIME1 11400714785074694791ULL
+#define HASH64_PRIME2 14029467366897019727ULL
+#define HASH64_PRIME3 1609587929392839161ULL
+#define HASH64_PRIME4 9650029242287828579ULL
+#define HASH64_PRIME5 2870177450012600261ULL
+
+PointCloudEngine::Hash64::Hash64(UINT64 seed) : seed(seed)
+{
+	accumulators[0] = seed + HASH64_PRIME1 + HASH64_PRIME2;
+	accumulators[1] = seed + HASH64_PRIME2;
+	accumulators[2] = seed;
+	accumulators[3] = seed - HASH64_PRIME1;
+}
+
+void PointCloudEngine::Hash64::Update(const void *data, size_t length)
+{
+	const byte* input = (const byte*)data;
+	const byte* end = input + length;
+	totalLength += length;
+
+	// Complete the buffered stripe first
+	if (bufferSize > 0)
+	{
+		size_t count = min(length, 32 - bufferSize);
+		memcpy(buffer + bufferSize, input, count);
+		bufferSize += count;
+		input += count;
+
+		if (bufferSize < 32)
+		{
+			return;
+		}
+
+		ProcessStripe(buffer);
+		bufferSize = 0;
+	}
+
+	while (end - input >= 32)
+	{
+		ProcessStripe(input);
+		input += 32;
+	}
+
+	memcpy(buffer, input, end - input);
+	bufferSize = end - input;
+}
+
+UINT64 PointCloudEngine::Hash64::Digest() const
+{
+	UINT64 hash;
+
+	if (totalLength >= 32)
+	{
+		hash = Rotate(accumulators[0], 1) + Rotate(accumulators[1], 7) + Rotate(accumulators[2], 12) + Rotate(accumulators[3], 18);
+
+		for (int i = 0; i < 4; i++)
+		{
+			hash = Merge(hash, accumulators[i]);
+		}
+	}
+	else
+	{
+		hash = seed + HASH64_PRIME5;
+	}
+
+	hash += totalLength;
+
+	// Mix in the remaining bytes that do not fill a whole stripe
+	const byte* input = buffer;
+	const byte* end = buffer + bufferSize;
+
+	while (end - input >= 8)
+	{
+		hash ^= Round(0, Read64(input));
+		hash = Rotate(hash, 27) * HASH64_PRIME1 + HASH64_PRIME4;
+		input += 8;
+	}
+
+	if (end - input >= 4)
+	{
+		hash ^= (UINT64)Read32(input) * HASH64_PRIME1;
+		hash = Rotate(hash, 23) * HASH64_PRIME2 + HASH64_PRIME3;
+		input += 4;
+	}
+
+	while (input < end)
+	{
+		hash ^= (*input) * HASH64_PRIME5;
+		hash = Rotate(hash, 11) * HASH64_PRIME1;
+		input++;
+	}
+
+	// Final avalanche
+	hash ^= hash >> 33;
+	hash *= HASH64_PRIME2;
+	hash ^= hash >> 29;
+	hash *= HASH64_PRIME3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
+
+UINT64 PointCloudEngine::Hash64::Compute(const void *data, size_t length, UINT64 seed)
+{
+	Hash64 hash(seed);
+	hash.Update(data, length);
+
+	return hash.Digest();
+}
+
+void PointCloudEngine::Hash64::ProcessStripe(const byte *stripe)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		accumulators[i] = Round(accumulators[i], Read64(stripe + 8 * i));
+	}
+}
+
+UINT64 PointCloudEngine::Hash64::Round(UINT64 accumulator, UINT64 input)
+{
+	accumulator += input * HASH64_PRIME2;
+	accumulator = Rotate(accumulator, 31);
+
+	return accumulator * HASH64_PRIME1;
+}
+
+UINT64 PointCloudEngine::Hash64::Merge(UINT64 hash, UINT64 accumulator)
+{
+	hash ^= Round(0, accumulator);
+
+	return hash * HASH64_PRIME1 + HASH64_PRIME4;
+}
+
+UINT64 PointCloudEngine::Hash64::Rotate(UINT64 value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+UINT64 PointCloudEngine::Hash64::Read64(const byte *data)
+{
+	UINT64 value;
+	memcpy(&value, data, sizeof(UINT64));
+
+	return value;
+}
+
+UINT PointCloudEngine::Hash64::Read32(const byte *data)
+{
+	UINT value;
+	memcpy(&value, data, sizeof(UINT));
+
+	return value;
+}
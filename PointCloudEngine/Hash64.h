@@ -0,0 +1,39 @@
+#ifndef HASH64_H
+#define HASH64_H
+
+#pragma once
+#include "PointCloudEngine.h"
+
+namespace PointCloudEngine
+{
+	// Streaming 64 bit xxHash (XXH64), the data can be passed in pieces of any size and results in the same hash as hashing it at once
+	class Hash64
+	{
+	public:
+		Hash64(UINT64 seed = 0);
+
+		void Update(const void *data, size_t length);
+		UINT64 Digest() const;
+
+		static UINT64 Compute(const void *data, size_t length, UINT64 seed = 0);
+
+	private:
+		UINT64 seed;
+		UINT64 accumulators[4];
+		UINT64 totalLength = 0;
+
+		// Input that does not fill a whole 32 byte stripe yet
+		byte buffer[32];
+		size_t bufferSize = 0;
+
+		void ProcessStripe(const byte *stripe);
+
+		static UINT64 Round(UINT64 accumulator, UINT64 input);
+		static UINT64 Merge(UINT64 hash, UINT64 accumulator);
+		static UINT64 Rotate(UINT64 value, int bits);
+		static UINT64 Read64(const byte *data);
+		static UINT Read32(const byte *data);
+	};
+}
+
+#endif
@@ -0,0 +1,447 @@
+#include "NormalClustering.h"
+
+static float HorizontalSum(__m128 v)
+{
+	__m128 shuffled = _mm_movehl_ps(v, v);
+	__m128 sums = _mm_add_ps(v, shuffled);
+	shuffled = _mm_shuffle_ps(sums, sums, 0x1);
+	sums = _mm_add_ss(sums, shuffled);
+
+	return _mm_cvtss_f32(sums);
+}
+
+static UINT HorizontalSum(__m128i v)
+{
+	__m128i shuffled = _mm_shuffle_epi32(v, 0x4e);
+	__m128i sums = _mm_add_epi32(v, shuffled);
+	shuffled = _mm_shuffle_epi32(sums, 0xb1);
+	sums = _mm_add_epi32(sums, shuffled);
+
+	return _mm_cvtsi128_si32(sums);
+}
+
+void PointCloudEngine::NormalClustering::Cluster(const Vertex *vertices, size_t vertexCount, OctreeNodeClusters &outClusters)
+{
+	InstructionSet instructionSet = settings->useSIMDClustering ? GetSupportedInstructionSet() : InstructionSet::Scalar;
+	Cluster(instructionSet, vertices, vertexCount, settings->clusteringMaxIterations, settings->clusteringTolerance, outClusters);
+}
+
+void PointCloudEngine::NormalClustering::Cluster(InstructionSet instructionSet, const Vertex *vertices, size_t vertexCount, UINT maxIterations, float tolerance, OctreeNodeClusters &outClusters)
+{
+	ZeroMemory(&outClusters, sizeof(OctreeNodeClusters));
+
+	if (vertexCount == 0)
+	{
+		return;
+	}
+
+	// Set initial means to the first k normals
+	Vector3 means[4];
+	const int k = min(vertexCount, 4);
+
+	for (int i = 0; i < k; i++)
+	{
+		means[i] = vertices[i].normal;
+	}
+
+	// Save the index of the mean that each vertex is assigned to
+	std::vector<byte> clusters(vertexCount, 0);
+	Vector3 sums[4];
+	UINT counts[4];
+
+	// The SIMD assignment reads the normals from a structure of arrays, it is only converted once when all the vertices fit into one block
+	static thread_local std::vector<float> normalsSoA(3 * NORMAL_CLUSTERING_BLOCK_SIZE);
+	const bool singleBlock = vertexCount <= NORMAL_CLUSTERING_BLOCK_SIZE;
+
+	if ((instructionSet != InstructionSet::Scalar) && singleBlock)
+	{
+		ConvertToSoA(vertices, vertexCount, normalsSoA.data());
+	}
+
+	// An iteration limit of 0 iterates until the means converge
+	for (UINT iteration = 0; (maxIterations == 0) || (iteration < maxIterations); iteration++)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			sums[i] = Vector3::Zero;
+			counts[i] = 0;
+		}
+
+		if (instructionSet == InstructionSet::Scalar)
+		{
+			AssignScalar(vertices, vertexCount, means, k, clusters.data(), sums, counts);
+		}
+		else
+		{
+			for (size_t blockStart = 0; blockStart < vertexCount; blockStart += NORMAL_CLUSTERING_BLOCK_SIZE)
+			{
+				const size_t blockCount = min((size_t)NORMAL_CLUSTERING_BLOCK_SIZE, vertexCount - blockStart);
+
+				if (!singleBlock)
+				{
+					ConvertToSoA(vertices + blockStart, blockCount, normalsSoA.data());
+				}
+
+				if (instructionSet == InstructionSet::AVX2)
+				{
+					AssignAVX2(normalsSoA.data(), blockCount, means, k, clusters.data() + blockStart, sums, counts);
+				}
+				else
+				{
+					AssignSSE(normalsSoA.data(), blockCount, means, k, clusters.data() + blockStart, sums, counts);
+				}
+			}
+		}
+
+		// Update the means
+		bool meanChanged = false;
+
+		for (int i = 0; i < k; i++)
+		{
+			if (counts[i] > 0)
+			{
+				Vector3 newMean = sums[i] / counts[i];
+
+				if (Vector3::DistanceSquared(means[i], newMean) > tolerance)
+				{
+					meanChanged = true;
+				}
+
+				means[i] = newMean;
+			}
+		}
+
+		if (!meanChanged)
+		{
+			break;
+		}
+	}
+
+	// Normalize the means
+	for (int i = 0; i < k; i++)
+	{
+		means[i].Normalize();
+	}
+
+	// Calculate the color sums and the smallest cosine between the mean normal and any normal in the cluster (acos is only needed once per cluster)
+	float minDots[4] = { 1, 1, 1, 1 };
+	UINT64 colorSums[4][3] = { { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 } };
+
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		byte cluster = clusters[i];
+
+		colorSums[cluster][0] += vertices[i].color[0];
+		colorSums[cluster][1] += vertices[i].color[1];
+		colorSums[cluster][2] += vertices[i].color[2];
+
+		minDots[cluster] = min(minDots[cluster], means[cluster].Dot(vertices[i].normal));
+	}
+
+	for (int i = 0; i < k; i++)
+	{
+		outClusters.normalSums[i] = sums[i];
+		outClusters.colorSums[i][0] = colorSums[i][0];
+		outClusters.colorSums[i][1] = colorSums[i][1];
+		outClusters.colorSums[i][2] = colorSums[i][2];
+		outClusters.counts[i] = counts[i];
+		outClusters.cones[i] = acos(max(-1.0f, minDots[i]));
+	}
+}
+
+PointCloudEngine::NormalClustering::InstructionSet PointCloudEngine::NormalClustering::GetSupportedInstructionSet()
+{
+	// SSE2 is always available on x64, AVX2 requires support by the processor and the operating system (saving the ymm registers)
+	static const InstructionSet supportedInstructionSet = []
+	{
+		int info[4];
+		__cpuid(info, 0);
+		int maxLeaf = info[0];
+
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+
+		if ((maxLeaf >= 7) && osxsave && avx && ((_xgetbv(0) & 0x6) == 0x6))
+		{
+			__cpuidex(info, 7, 0);
+
+			if (info[1] & (1 << 5))
+			{
+				return InstructionSet::AVX2;
+			}
+		}
+
+		return InstructionSet::SSE;
+	}();
+
+	return supportedInstructionSet;
+}
+
+void PointCloudEngine::NormalClustering::Benchmark(const std::vector<Vertex> &vertices)
+{
+	// Cluster blocks of vertices the same way as octree nodes with each instruction set and compare the throughput
+	const size_t nodeVertexCount = 4096;
+	const size_t vertexCount = min(vertices.size(), (size_t)1 << 22);
+
+	InstructionSet instructionSets[3] = { InstructionSet::Scalar, InstructionSet::SSE, InstructionSet::AVX2 };
+	const wchar_t* instructionSetNames[3] = { L"scalar", L"SSE", L"AVX2" };
+	const int instructionSetCount = (GetSupportedInstructionSet() == InstructionSet::AVX2) ? 3 : 2;
+
+	for (int i = 0; i < instructionSetCount; i++)
+	{
+		auto startTime = std::chrono::high_resolution_clock::now();
+		OctreeNodeClusters clusters;
+
+		for (size_t start = 0; start < vertexCount; start += nodeVertexCount)
+		{
+			Cluster(instructionSets[i], vertices.data() + start, min(nodeVertexCount, vertexCount - start), settings->clusteringMaxIterations, settings->clusteringTolerance, clusters);
+		}
+
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+		std::wstringstream outputStream;
+		outputStream << L"Normal clustering: " << instructionSetNames[i] << L", " << vertexCount << L" points, ";
+		outputStream << seconds << L" s, " << (vertexCount / seconds) << L" points/s" << std::endl;
+		OutputDebugString(outputStream.str().c_str());
+	}
+}
+
+void PointCloudEngine::NormalClustering::AssignScalar(const Vertex *vertices, size_t vertexCount, const Vector3 means[4], int k, byte *clusters, Vector3 sums[4], UINT counts[4])
+{
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		// Only assign the vertex to another cluster when the distance to its mean is strictly smaller
+		float minDistance = Vector3::DistanceSquared(vertices[i].normal, means[clusters[i]]);
+
+		for (int j = 0; j < k; j++)
+		{
+			float distance = Vector3::DistanceSquared(vertices[i].normal, means[j]);
+
+			if (distance < minDistance)
+			{
+				clusters[i] = j;
+				minDistance = distance;
+			}
+		}
+
+		sums[clusters[i]] += vertices[i].normal;
+		counts[clusters[i]]++;
+	}
+}
+
+void PointCloudEngine::NormalClustering::AssignSSE(const float *normalsSoA, size_t vertexCount, const Vector3 means[4], int k, byte *clusters, Vector3 sums[4], UINT counts[4])
+{
+	// Only SSE2 instructions are used, selections are done with and/andnot/or instead of blends
+	const float* x = normalsSoA;
+	const float* y = normalsSoA + NORMAL_CLUSTERING_BLOCK_SIZE;
+	const float* z = normalsSoA + 2 * NORMAL_CLUSTERING_BLOCK_SIZE;
+	const size_t simdCount = vertexCount & ~0x3;
+	const __m128i zero = _mm_setzero_si128();
+
+	__m128 meansX[4], meansY[4], meansZ[4];
+	__m128 sumsX[4], sumsY[4], sumsZ[4];
+	__m128i countsPerCluster[4];
+	__m128i indices[4];
+
+	for (int j = 0; j < 4; j++)
+	{
+		meansX[j] = _mm_set1_ps(means[j].x);
+		meansY[j] = _mm_set1_ps(means[j].y);
+		meansZ[j] = _mm_set1_ps(means[j].z);
+		sumsX[j] = _mm_setzero_ps();
+		sumsY[j] = _mm_setzero_ps();
+		sumsZ[j] = _mm_setzero_ps();
+		countsPerCluster[j] = _mm_setzero_si128();
+		indices[j] = _mm_set1_epi32(j);
+	}
+
+	for (size_t i = 0; i < simdCount; i += 4)
+	{
+		__m128 normalX = _mm_loadu_ps(x + i);
+		__m128 normalY = _mm_loadu_ps(y + i);
+		__m128 normalZ = _mm_loadu_ps(z + i);
+
+		int currentBytes;
+		memcpy(&currentBytes, clusters + i, sizeof(int));
+		__m128i current = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(currentBytes), zero), zero);
+
+		// Squared distances to all the means
+		__m128 distances[4];
+
+		for (int j = 0; j < k; j++)
+		{
+			__m128 dx = _mm_sub_ps(normalX, meansX[j]);
+			__m128 dy = _mm_sub_ps(normalY, meansY[j]);
+			__m128 dz = _mm_sub_ps(normalZ, meansZ[j]);
+			distances[j] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		}
+
+		// Start with the distance to the current cluster, only a strictly smaller distance changes the cluster
+		__m128 minDistance = distances[0];
+
+		for (int j = 1; j < k; j++)
+		{
+			__m128 isCurrent = _mm_castsi128_ps(_mm_cmpeq_epi32(current, indices[j]));
+			minDistance = _mm_or_ps(_mm_and_ps(isCurrent, distances[j]), _mm_andnot_ps(isCurrent, minDistance));
+		}
+
+		__m128i closest = current;
+
+		for (int j = 0; j < k; j++)
+		{
+			__m128 smaller = _mm_cmplt_ps(distances[j], minDistance);
+			minDistance = _mm_or_ps(_mm_and_ps(smaller, distances[j]), _mm_andnot_ps(smaller, minDistance));
+			closest = _mm_or_si128(_mm_and_si128(_mm_castps_si128(smaller), indices[j]), _mm_andnot_si128(_mm_castps_si128(smaller), closest));
+		}
+
+		// Store the cluster indices as bytes
+		__m128i closestBytes = _mm_packus_epi16(_mm_packs_epi32(closest, zero), zero);
+		int closestInt = _mm_cvtsi128_si32(closestBytes);
+		memcpy(clusters + i, &closestInt, sizeof(int));
+
+		// Accumulate the sums and counts with masks (the mask is -1 for each assigned vertex)
+		for (int j = 0; j < k; j++)
+		{
+			__m128i assigned = _mm_cmpeq_epi32(closest, indices[j]);
+			__m128 assignedMask = _mm_castsi128_ps(assigned);
+
+			sumsX[j] = _mm_add_ps(sumsX[j], _mm_and_ps(assignedMask, normalX));
+			sumsY[j] = _mm_add_ps(sumsY[j], _mm_and_ps(assignedMask, normalY));
+			sumsZ[j] = _mm_add_ps(sumsZ[j], _mm_and_ps(assignedMask, normalZ));
+			countsPerCluster[j] = _mm_sub_epi32(countsPerCluster[j], assigned);
+		}
+	}
+
+	for (int j = 0; j < k; j++)
+	{
+		sums[j] += Vector3(HorizontalSum(sumsX[j]), HorizontalSum(sumsY[j]), HorizontalSum(sumsZ[j]));
+		counts[j] += HorizontalSum(countsPerCluster[j]);
+	}
+
+	AssignRemainingSoA(normalsSoA, simdCount, vertexCount, means, k, clusters, sums, counts);
+}
+
+void PointCloudEngine::NormalClustering::AssignAVX2(const float *normalsSoA, size_t vertexCount, const Vector3 means[4], int k, byte *clusters, Vector3 sums[4], UINT counts[4])
+{
+	const float* x = normalsSoA;
+	const float* y = normalsSoA + NORMAL_CLUSTERING_BLOCK_SIZE;
+	const float* z = normalsSoA + 2 * NORMAL_CLUSTERING_BLOCK_SIZE;
+	const size_t simdCount = vertexCount & ~0x7;
+
+	__m256 meansX[4], meansY[4], meansZ[4];
+	__m256 sumsX[4], sumsY[4], sumsZ[4];
+	__m256i countsPerCluster[4];
+	__m256i indices[4];
+
+	for (int j = 0; j < 4; j++)
+	{
+		meansX[j] = _mm256_set1_ps(means[j].x);
+		meansY[j] = _mm256_set1_ps(means[j].y);
+		meansZ[j] = _mm256_set1_ps(means[j].z);
+		sumsX[j] = _mm256_setzero_ps();
+		sumsY[j] = _mm256_setzero_ps();
+		sumsZ[j] = _mm256_setzero_ps();
+		countsPerCluster[j] = _mm256_setzero_si256();
+		indices[j] = _mm256_set1_epi32(j);
+	}
+
+	for (size_t i = 0; i < simdCount; i += 8)
+	{
+		__m256 normalX = _mm256_loadu_ps(x + i);
+		__m256 normalY = _mm256_loadu_ps(y + i);
+		__m256 normalZ = _mm256_loadu_ps(z + i);
+		__m256i current = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(clusters + i)));
+
+		// Squared distances to all the means
+		__m256 distances[4];
+
+		for (int j = 0; j < k; j++)
+		{
+			__m256 dx = _mm256_sub_ps(normalX, meansX[j]);
+			__m256 dy = _mm256_sub_ps(normalY, meansY[j]);
+			__m256 dz = _mm256_sub_ps(normalZ, meansZ[j]);
+			distances[j] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+		}
+
+		// Start with the distance to the current cluster, only a strictly smaller distance changes the cluster
+		__m256 minDistance = distances[0];
+
+		for (int j = 1; j < k; j++)
+		{
+			minDistance = _mm256_blendv_ps(minDistance, distances[j], _mm256_castsi256_ps(_mm256_cmpeq_epi32(current, indices[j])));
+		}
+
+		__m256i closest = current;
+
+		for (int j = 0; j < k; j++)
+		{
+			__m256 smaller = _mm256_cmp_ps(distances[j], minDistance, _CMP_LT_OQ);
+			minDistance = _mm256_blendv_ps(minDistance, distances[j], smaller);
+			closest = _mm256_blendv_epi8(closest, indices[j], _mm256_castps_si256(smaller));
+		}
+
+		// Store the cluster indices as bytes
+		__m128i closest16 = _mm_packus_epi32(_mm256_castsi256_si128(closest), _mm256_extracti128_si256(closest, 1));
+		_mm_storel_epi64((__m128i*)(clusters + i), _mm_packus_epi16(closest16, closest16));
+
+		// Accumulate the sums and counts with masks (the mask is -1 for each assigned vertex)
+		for (int j = 0; j < k; j++)
+		{
+			__m256i assigned = _mm256_cmpeq_epi32(closest, indices[j]);
+			__m256 assignedMask = _mm256_castsi256_ps(assigned);
+
+			sumsX[j] = _mm256_add_ps(sumsX[j], _mm256_and_ps(assignedMask, normalX));
+			sumsY[j] = _mm256_add_ps(sumsY[j], _mm256_and_ps(assignedMask, normalY));
+			sumsZ[j] = _mm256_add_ps(sumsZ[j], _mm256_and_ps(assignedMask, normalZ));
+			countsPerCluster[j] = _mm256_sub_epi32(countsPerCluster[j], assigned);
+		}
+	}
+
+	for (int j = 0; j < k; j++)
+	{
+		__m128 sumX = _mm_add_ps(_mm256_castps256_ps128(sumsX[j]), _mm256_extractf128_ps(sumsX[j], 1));
+		__m128 sumY = _mm_add_ps(_mm256_castps256_ps128(sumsY[j]), _mm256_extractf128_ps(sumsY[j], 1));
+		__m128 sumZ = _mm_add_ps(_mm256_castps256_ps128(sumsZ[j]), _mm256_extractf128_ps(sumsZ[j], 1));
+		__m128i count = _mm_add_epi32(_mm256_castsi256_si128(countsPerCluster[j]), _mm256_extracti128_si256(countsPerCluster[j], 1));
+
+		sums[j] += Vector3(HorizontalSum(sumX), HorizontalSum(sumY), HorizontalSum(sumZ));
+		counts[j] += HorizontalSum(count);
+	}
+
+	AssignRemainingSoA(normalsSoA, simdCount, vertexCount, means, k, clusters, sums, counts);
+}
+
+void PointCloudEngine::NormalClustering::AssignRemainingSoA(const float *normalsSoA, size_t start, size_t vertexCount, const Vector3 means[4], int k, byte *clusters, Vector3 sums[4], UINT counts[4])
+{
+	// Assigns the vertices at the end of the block that do not fill a whole SIMD register
+	for (size_t i = start; i < vertexCount; i++)
+	{
+		Vector3 normal(normalsSoA[i], normalsSoA[NORMAL_CLUSTERING_BLOCK_SIZE + i], normalsSoA[2 * NORMAL_CLUSTERING_BLOCK_SIZE + i]);
+		float minDistance = Vector3::DistanceSquared(normal, means[clusters[i]]);
+
+		for (int j = 0; j < k; j++)
+		{
+			float distance = Vector3::DistanceSquared(normal, means[j]);
+
+			if (distance < minDistance)
+			{
+				clusters[i] = j;
+				minDistance = distance;
+			}
+		}
+
+		sums[clusters[i]] += normal;
+		counts[clusters[i]]++;
+	}
+}
+
+void PointCloudEngine::NormalClustering::ConvertToSoA(const Vertex *vertices, size_t vertexCount, float *outNormalsSoA)
+{
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		outNormalsSoA[i] = vertices[i].normal.x;
+		outNormalsSoA[NORMAL_CLUSTERING_BLOCK_SIZE + i] = vertices[i].normal.y;
+		outNormalsSoA[2 * NORMAL_CLUSTERING_BLOCK_SIZE + i] = vertices[i].normal.z;
+	}
+}
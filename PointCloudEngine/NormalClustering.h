@@ -0,0 +1,42 @@
+#ifndef NORMALCLUSTERING_H
+#define NORMALCLUSTERING_H
+
+// Amount of vertices that are converted to a structure of arrays layout at once (fits into the L1/L2 cache)
+#define NORMAL_CLUSTERING_BLOCK_SIZE 4096
+
+#pragma once
+#include "PointCloudEngine.h"
+
+namespace PointCloudEngine
+{
+	// K-means clustering of the vertex normals with k=4 that is used to create the octree node properties
+	// The assignment step computes the squared distances to all the means at once with SSE (4 vertices) or AVX2 (8 vertices)
+	class NormalClustering
+	{
+	public:
+		enum class InstructionSet
+		{
+			Scalar,
+			SSE,
+			AVX2
+		};
+
+		// Clusters the normals with k = min(vertexCount, 4) and computes the normal sums, color sums, counts and cones of each cluster
+		static void Cluster(const Vertex *vertices, size_t vertexCount, OctreeNodeClusters &outClusters);
+		static void Cluster(InstructionSet instructionSet, const Vertex *vertices, size_t vertexCount, UINT maxIterations, float tolerance, OctreeNodeClusters &outClusters);
+
+		static InstructionSet GetSupportedInstructionSet();
+		static void Benchmark(const std::vector<Vertex> &vertices);
+
+	private:
+		// Assigns each vertex to the closest mean and adds its normal to the sum and count of that cluster
+		// The SIMD versions process one block of normals in a structure of arrays layout (x, y and z arrays of NORMAL_CLUSTERING_BLOCK_SIZE each)
+		static void AssignScalar(const Vertex *vertices, size_t vertexCount, const Vector3 means[4], int k, byte *clusters, Vector3 sums[4], UINT counts[4]);
+		static void AssignSSE(const float *normalsSoA, size_t vertexCount, const Vector3 means[4], int k, byte *clusters, Vector3 sums[4], UINT counts[4]);
+		static void AssignAVX2(const float *normalsSoA, size_t vertexCount, const Vector3 means[4], int k, byte *clusters, Vector3 sums[4], UINT counts[4]);
+		static void AssignRemainingSoA(const float *normalsSoA, size_t start, size_t vertexCount, const Vector3 means[4], int k, byte *clusters, Vector3 sums[4], UINT counts[4]);
+		static void ConvertToSoA(const Vertex *vertices, size_t vertexCount, float *outNormalsSoA);
+	};
+}
+
+#endif
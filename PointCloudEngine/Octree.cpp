@@ -1,9 +1,292 @@
 #include "Octree.h"
 
+struct PointCloudEngine::Octree::OctreeBuildNode
+{
+	OctreeNodeCreationEntry entry;
+	OctreeNode node;
+	OctreeBuildNode* parent = NULL;
+	OctreeBuildNode* children[8] = { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL };
+
+	// Only used for bottom up clustering and the requested root clusters, the clusters are deleted as soon as the parent node is created from them
+	std::atomic<int> pendingChildren;
+	OctreeNodeClusters* clusters = NULL;
+
+	~OctreeBuildNode()
+	{
+		SafeDelete(clusters);
+	}
+};
+
+struct PointCloudEngine::Octree::OctreeChunk
+{
+	int depth;
+	UINT64 prefix;
+
+	// Start of each level in the breadth first order of the chunk nodes file, the last entry is the amount of nodes
+	std::vector<size_t> levelStarts;
+
+	// Start of each level in the final octree nodes array
+	std::vector<size_t> globalLevelStarts;
+
+	// Clusters of the chunk root node that are used to create the nodes above the chunks
+	OctreeNodeClusters clusters;
+};
+
+struct PointCloudEngine::Octree::OctreeFileWriter
+{
+	// Intermediate files are always written uncompressed in breadth first order, they are only read once to reorder the nodes
+	OctreeFileWriter(const Octree &octree, const std::wstring &filepath, UINT nodesSize, bool intermediate = false);
+
+	void Write(const OctreeNode *nodes, size_t nodesCount);
+	void Close();
+
+private:
+	const Octree &octree;
+	std::ofstream file;
+	UINT nodesSize;
+	Hash64 nodesChecksum;
+
+	// Uncompressed nodes are split into the topology, normals and shading arrays, each written range is appended to all of them
+	OctreeFileHeader header;
+	size_t writtenNodesCount = 0;
+
+	// Nodes that are not compressed yet, multiple blocks are collected to compress them in parallel
+	UINT compressionBlockSize;
+	std::vector<OctreeNode> pendingNodes;
+	std::vector<OctreeFileBlock> blocks;
+	UINT nextChildrenStart = 1;
+
+	void CompressPendingNodes(bool compressPartialBlock);
+};
+
+struct PointCloudEngine::Octree::OctreeCut
+{
+	// Node of the cut tree, the refined nodes are above the cut and link their children, all the other nodes are part of the cut (drawn or culled)
+	// The topology and normals are kept so that the octree is only read again for the nodes that are added
+	struct CutNode
+	{
+		OctreeNodeTraversalEntry entry;
+		OctreeNodeTopology nodeTopology;
+		OctreeNodeNormals nodeNormals;
+		UINT parent;
+		UINT firstChild;
+		UINT nextSibling;
+
+		// Slot of the vertex of a drawn cut node, UINT_MAX for refined and culled nodes
+		UINT vertexIndex;
+
+		// Scheduled checks of older evaluations are ignored, freed nodes have the evaluation 0
+		UINT evaluation;
+		double translationKey;
+		double rotationKey;
+
+		bool refined;
+		bool visible;
+	};
+
+	// The check of a node is due when the accumulated camera movement reaches the key
+	struct ScheduledCheck
+	{
+		double key;
+		UINT node;
+		UINT evaluation;
+
+		bool operator>(const ScheduledCheck &other) const
+		{
+			return key > other.key;
+		}
+	};
+
+	typedef std::priority_queue<ScheduledCheck, std::vector<ScheduledCheck>, std::greater<ScheduledCheck>> CheckQueue;
+
+	std::vector<CutNode> nodes;
+	std::vector<UINT> freeNodes;
+	UINT root = UINT_MAX;
+	UINT evaluationCount = 0;
+
+	// Vertices of the drawn cut nodes in no particular order, they are patched when nodes are added to or removed from the cut
+	std::vector<OctreeNodeVertex> vertices;
+	std::vector<OctreeNodeCompactVertex> compactVertices;
+	std::vector<UINT> vertexNodes;
+	bool compact = false;
+
+	// Upper bounds of the camera translation (plus the plane offset changes) and of the plane normal changes summed over all the updates
+	// Each node is only checked again when one of these moved further than the distance to the closest threshold of its last check
+	double translation = 0;
+	double rotation = 0;
+	CheckQueue translationChecks;
+	CheckQueue rotationChecks;
+
+	// Nothing has to be updated when the view did not change since the last update
+	OctreeConstantBuffer lastConstantBufferData;
+
+	static bool IsCompact(const OctreeNodeVertex*) { return false; }
+	static bool IsCompact(const OctreeNodeCompactVertex*) { return true; }
+	std::vector<OctreeNodeVertex>& GetVertices(const OctreeNodeVertex*) { return vertices; }
+	std::vector<OctreeNodeCompactVertex>& GetVertices(const OctreeNodeCompactVertex*) { return compactVertices; }
+
+	UINT AllocateNode()
+	{
+		UINT index;
+
+		if (freeNodes.empty())
+		{
+			index = nodes.size();
+			nodes.emplace_back();
+		}
+		else
+		{
+			index = freeNodes.back();
+			freeNodes.pop_back();
+		}
+
+		CutNode &node = nodes[index];
+		node.firstChild = UINT_MAX;
+		node.nextSibling = UINT_MAX;
+		node.vertexIndex = UINT_MAX;
+		node.evaluation = 0;
+		node.refined = false;
+		node.visible = false;
+
+		return index;
+	}
+
+	template <typename T> void AddVertex(UINT index, const T &vertex)
+	{
+		std::vector<T> &cutVertices = GetVertices((T*)NULL);
+		nodes[index].vertexIndex = cutVertices.size();
+		cutVertices.push_back(vertex);
+		vertexNodes.push_back(index);
+	}
+
+	template <typename T> void RemoveVertex(UINT index)
+	{
+		// Move the last vertex into the freed slot
+		std::vector<T> &cutVertices = GetVertices((T*)NULL);
+		UINT slot = nodes[index].vertexIndex;
+
+		cutVertices[slot] = cutVertices.back();
+		vertexNodes[slot] = vertexNodes.back();
+		nodes[vertexNodes[slot]].vertexIndex = slot;
+		cutVertices.pop_back();
+		vertexNodes.pop_back();
+		nodes[index].vertexIndex = UINT_MAX;
+	}
+
+	// Frees all the nodes below the node and removes their vertices
+	template <typename T> void FreeChildren(UINT index, std::vector<UINT> &stack)
+	{
+		for (UINT child = nodes[index].firstChild; child != UINT_MAX; child = nodes[child].nextSibling)
+		{
+			stack.push_back(child);
+		}
+
+		nodes[index].firstChild = UINT_MAX;
+
+		while (!stack.empty())
+		{
+			UINT freed = stack.back();
+			stack.pop_back();
+
+			for (UINT child = nodes[freed].firstChild; child != UINT_MAX; child = nodes[child].nextSibling)
+			{
+				stack.push_back(child);
+			}
+
+			if (nodes[freed].vertexIndex != UINT_MAX)
+			{
+				RemoveVertex<T>(freed);
+			}
+
+			nodes[freed].evaluation = 0;
+			freeNodes.push_back(freed);
+		}
+	}
+
+	void Schedule(UINT index, float translationSlack, float rotationSlack)
+	{
+		CutNode &node = nodes[index];
+		node.evaluation = ++evaluationCount;
+		node.translationKey = (translationSlack < FLT_MAX) ? (translation + translationSlack) : DBL_MAX;
+		node.rotationKey = (rotationSlack < FLT_MAX) ? (rotation + rotationSlack) : DBL_MAX;
+
+		if (node.translationKey < DBL_MAX)
+		{
+			translationChecks.push({ node.translationKey, index, node.evaluation });
+		}
+
+		if (node.rotationKey < DBL_MAX)
+		{
+			rotationChecks.push({ node.rotationKey, index, node.evaluation });
+		}
+	}
+
+	void CompactChecks()
+	{
+		// Every evaluation leaves its old checks behind, rebuild the queues from the current keys when most of the checks are outdated
+		const size_t usedCount = nodes.size() - freeNodes.size();
+
+		if ((translationChecks.size() + rotationChecks.size()) < 8 * usedCount + 1024)
+		{
+			return;
+		}
+
+		translationChecks = CheckQueue();
+		rotationChecks = CheckQueue();
+
+		for (UINT i = 0; i < nodes.size(); i++)
+		{
+			if (nodes[i].evaluation != 0)
+			{
+				if (nodes[i].translationKey < DBL_MAX)
+				{
+					translationChecks.push({ nodes[i].translationKey, i, nodes[i].evaluation });
+				}
+
+				if (nodes[i].rotationKey < DBL_MAX)
+				{
+					rotationChecks.push({ nodes[i].rotationKey, i, nodes[i].evaluation });
+				}
+			}
+		}
+	}
+
+	void Clear()
+	{
+		nodes.clear();
+		freeNodes.clear();
+		root = UINT_MAX;
+		vertices.clear();
+		compactVertices.clear();
+		vertexNodes.clear();
+		translationChecks = CheckQueue();
+		rotationChecks = CheckQueue();
+	}
+};
+
 PointCloudEngine::Octree::Octree(const std::wstring &pointcloudFile)
 {
+	cut = new OctreeCut();
+
+	// The cached octree file is only used when it was built from the same point cloud
+	sourceHash = GetSourceHash(pointcloudFile);
+
     if (!LoadFromOctreeFile())
     {
+		// Point clouds that are larger than the memory budget are built in chunks and streamed directly into the octree file
+		std::wstring builtFilepath;
+
+		if ((settings->octreeMemoryBudget > 0) && BuildOutOfCore(pointcloudFile, builtFilepath))
+		{
+			if (!LoadFromOctreeFile(builtFilepath))
+			{
+				throw std::exception("Could not load .octree file after the out of core build!");
+			}
+
+			CreateLevelIndex();
+			return;
+		}
+
         // Try to load .pointcloud file here
         std::vector<Vertex> vertices;
 
@@ -12,82 +295,233 @@ PointCloudEngine::Octree::Octree(const std::wstring &pointcloudFile)
             throw std::exception("Could not load .pointcloud file!");
         }
 
-		// Stores the indices in the nodes array of the children of a node
-		// Will only be used while creating the octree (for simplicity)
-		// Finding the correct child index is easier this way
-		std::vector<UINT> children;
+		// The vertices are reordered while building the octree
+		if (settings->octreeBuildBenchmark)
+		{
+			// Compare the throughput of the scalar and SIMD normal clustering
+			NormalClustering::Benchmark(vertices);
 
-        // Stores the nodes that should be created for each octree level
-        std::queue<OctreeNodeCreationEntry> nodeCreationQueue;
+			// Build the same octree with both engines and an increasing amount of threads to measure how the build scales
+			UINT hardwareThreadCount = max(1, std::thread::hardware_concurrency());
 
-        OctreeNodeCreationEntry rootEntry;
-        rootEntry.nodesIndex = UINT_MAX;
-        rootEntry.childrenIndex = UINT_MAX;
-        rootEntry.vertices = vertices;
-        rootEntry.position = rootPosition;
-        rootEntry.size = rootSize;
-        rootEntry.depth = 0;
+			for (UINT threadCount = 1; threadCount < 2 * hardwareThreadCount; threadCount *= 2)
+			{
+				ThreadPool benchmarkPool(min(threadCount, hardwareThreadCount));
+				Build(vertices, benchmarkPool, OctreeBuildEngine::TopDown);
+				Build(vertices, benchmarkPool, OctreeBuildEngine::Morton);
+			}
+		}
 
-        nodeCreationQueue.push(rootEntry);
+		// Always use the selected engine last, this is the octree that is saved
+		Build(vertices, *threadPool, settings->octreeBuildEngine);
 
-        while (!nodeCreationQueue.empty())
-        {
-            // Remove the first entry from the queue
-            OctreeNodeCreationEntry first = nodeCreationQueue.front();
-            nodeCreationQueue.pop();
+        // Save the generated octree in a file and reference the nodes in the saved file instead of keeping a copy of them in memory
+		if (!SaveToOctreeFile() || !LoadFromOctreeFile())
+		{
+			LoadNodes(nodes.size());
+			SplitNodes(nodes.data(), nodes.size(), loadedTopology.data(), loadedNormals.data(), loadedShading.data());
+		}
+    }
 
-            // Assign the index at which this node will be stored
-            first.nodesIndex = nodes.size();
+	CreateLevelIndex();
+}
 
-            // Create the nodes and fill the queue
-            nodes.push_back(OctreeNode(nodeCreationQueue, nodes, children, first));
-        }
+PointCloudEngine::Octree::~Octree()
+{
+	CloseOctreeFile();
+	SafeDelete(cut);
+}
 
-		// Now the nodes actually store the childrenStartOrLeafPositionFactors index for the children array instead of the nodes array
-		for (auto it = nodes.begin(); it != nodes.end(); it++)
-		{
-			// Overwrite the index with one that is referencing the nodes array (that's fine because the nodes array stores children after each other and in order)
-			// Then there is no need to store the children array anymore
-			if (it->properties.childrenMask != 0)
-			{
-				it->childrenStartOrLeafPositionFactors = children[it->childrenStartOrLeafPositionFactors];
-			}
-		}
+std::vector<OctreeNodeVertex> PointCloudEngine::Octree::GetVertices(const OctreeConstantBuffer &octreeConstantBufferData, OctreeTraversalStatistics *outStatistics) const
+{
+	return TraverseVertices<OctreeNodeVertex>(octreeConstantBufferData, outStatistics);
+}
 
-        // Save the generated octree in a file
-        SaveToOctreeFile();
-    }
+std::vector<OctreeNodeCompactVertex> PointCloudEngine::Octree::GetCompactVertices(const OctreeConstantBuffer &octreeConstantBufferData, OctreeTraversalStatistics *outStatistics) const
+{
+	return TraverseVertices<OctreeNodeCompactVertex>(octreeConstantBufferData, outStatistics);
 }
 
-std::vector<OctreeNodeVertex> PointCloudEngine::Octree::GetVertices(const OctreeConstantBuffer &octreeConstantBufferData) const
+template <typename T> std::vector<T> PointCloudEngine::Octree::TraverseVertices(const OctreeConstantBuffer &octreeConstantBufferData, OctreeTraversalStatistics *outStatistics) const
 {
 	// If the level is -1 then it is ignored and only the node vertices with the projected size smaller than the splat size are returned
 	// Otherwise the camera positiona and splat size is ignored and only the node vertices at the given octree level are returned
-    // Use a queue instead of recursion to traverse the octree in the memory layout order (improves cache efficiency)
-    std::vector<OctreeNodeVertex> octreeVertices;
-	std::queue<OctreeNodeTraversalEntry> nodesQueue;
+	// Traverse the octree level by level like the compute shader (consume the current level, append the next one) instead of recursion
+	// This visits the nodes in the memory layout order (improves cache efficiency) and each level is split into chunks that are processed in parallel
+	std::vector<T> octreeVertices;
+	std::vector<OctreeNodeTraversalEntry> currentLevel;
+	std::vector<OctreeNodeTraversalEntry> nextLevel;
+
+	// Every chunk appends to its own vertices and next level entries, these are merged in chunk order afterwards without any locking
+	std::vector<std::vector<T>> chunkVertices;
+	std::vector<std::vector<OctreeNodeTraversalEntry>> chunkNextLevels;
+	std::vector<OctreeCulling> chunkCullings;
+	UINT traversedNodesCount = 0;
+
+	// Indices of all the traversed nodes, only collected for the statistics
+	std::vector<UINT> touchedIndices;
 
 	// Use this struct to compute the node positions and sizes at runtime
 	OctreeNodeTraversalEntry rootEntry;
 	rootEntry.index = 0;
 	rootEntry.position = rootPosition;
 	rootEntry.size = rootSize;
-	rootEntry.parentInsideViewFrustum = false;
+	rootEntry.viewFrustumPlaneMask = VIEW_FRUSTUM_PLANE_MASK;
 	rootEntry.depth = 0;
 
-    // Check the root node first
-    nodesQueue.push(rootEntry);
+	// The view frustum planes are only computed once for the whole traversal
+	OctreeCulling culling(octreeConstantBufferData);
 
-    while (!nodesQueue.empty())
-    {
-		OctreeNodeTraversalEntry entry = nodesQueue.front();
-        nodesQueue.pop();
+	// Each node culls its children against the view frustum, only the root has to be checked here
+	if (octreeConstantBufferData.useCulling)
+	{
+		float rootPositions[3][8] = { { rootPosition.x }, { rootPosition.y }, { rootPosition.z } };
+		UINT rootPlaneMasks[8];
 
-        // Check the node, add the vertex or add its children to the queue
-        nodes[entry.index].GetVertices(nodes, nodesQueue, octreeVertices, entry, octreeConstantBufferData);
-    }
+		if (culling.ClassifyCubes(rootPositions, 1, rootSize, VIEW_FRUSTUM_PLANE_MASK, rootPlaneMasks) == 0)
+		{
+			currentLevel.clear();
+		}
+		else
+		{
+			rootEntry.viewFrustumPlaneMask = rootPlaneMasks[0];
+			currentLevel.push_back(rootEntry);
+		}
+	}
+	else
+	{
+		currentLevel.push_back(rootEntry);
+	}
+
+	// Only created when the occlusion culling is used, it allocates the depth buffer
+	std::unique_ptr<OctreeOcclusion> occlusion;
+
+	// The point budget, the incremental traversal and the occlusion culling only apply to the traversal by splat size, the vertices of a single level are always returned completely
+	if ((settings->octreePointBudget > 0) && (octreeConstantBufferData.level < 0))
+	{
+		traversedNodesCount = GetBudgetedVertices(octreeVertices, currentLevel, octreeConstantBufferData, culling, (outStatistics != NULL) ? &touchedIndices : NULL);
+		currentLevel.clear();
+	}
+	else if (settings->octreeIncrementalTraversal && (octreeConstantBufferData.level < 0))
+	{
+		traversedNodesCount = GetIncrementalVertices(octreeVertices, octreeConstantBufferData, culling, (outStatistics != NULL) ? &touchedIndices : NULL);
+		currentLevel.clear();
+	}
+	else if (settings->octreeOcclusionCulling && octreeConstantBufferData.useCulling && (octreeConstantBufferData.level < 0))
+	{
+		occlusion.reset(new OctreeOcclusion(octreeConstantBufferData));
+		traversedNodesCount = GetOcclusionCulledVertices(octreeVertices, currentLevel, octreeConstantBufferData, culling, *occlusion, (outStatistics != NULL) ? &touchedIndices : NULL);
+		currentLevel.clear();
+	}
+	else if ((octreeConstantBufferData.level >= 0) && !levelStarts.empty())
+	{
+		// The nodes above the level don't have to be traversed when the level index is available
+		traversedNodesCount = GetLevelVertices(octreeVertices, octreeConstantBufferData, culling, (outStatistics != NULL) ? &touchedIndices : NULL);
+		currentLevel.clear();
+	}
+
+	while (!currentLevel.empty())
+	{
+		traversedNodesCount += currentLevel.size();
+
+		if (outStatistics != NULL)
+		{
+			for (auto it = currentLevel.begin(); it != currentLevel.end(); it++)
+			{
+				touchedIndices.push_back(it->index);
+			}
+		}
+
+		// The page cache is not thread safe, paged octrees are always traversed by the calling thread
+		size_t chunkCount = (currentLevel.size() + TRAVERSAL_CHUNK_SIZE - 1) / TRAVERSAL_CHUNK_SIZE;
+		chunkCount = IsPaged() ? 1 : min(chunkCount, 4 * threadPool->GetThreadCount());
+
+		const size_t chunkSize = (currentLevel.size() + chunkCount - 1) / chunkCount;
+
+		if (chunkCount == 1)
+		{
+			nextLevel.clear();
+
+			for (auto it = currentLevel.begin(); it != currentLevel.end(); it++)
+			{
+				// Check the node, add the vertex or add its children to the next level
+				GetNodeVertices(nextLevel, octreeVertices, *it, octreeConstantBufferData, culling);
+			}
+		}
+		else
+		{
+			// Each chunk counts its culling tests with its own copy
+			chunkVertices.resize(chunkCount);
+			chunkNextLevels.resize(chunkCount);
+			chunkCullings.assign(chunkCount, culling);
+
+			threadPool->ParallelFor(chunkCount, [&](size_t i)
+			{
+				const size_t start = i * chunkSize;
+				const size_t end = min(start + chunkSize, currentLevel.size());
+
+				chunkVertices[i].clear();
+				chunkNextLevels[i].clear();
+				chunkCullings[i].testedCubesCount = 0;
+				chunkCullings[i].planeTestsCount = 0;
+
+				for (size_t j = start; j < end; j++)
+				{
+					GetNodeVertices(chunkNextLevels[i], chunkVertices[i], currentLevel[j], octreeConstantBufferData, chunkCullings[i]);
+				}
+			});
+
+			// Concatenating the chunks in order keeps the same output order as a sequential traversal
+			nextLevel.clear();
+
+			for (size_t i = 0; i < chunkCount; i++)
+			{
+				octreeVertices.insert(octreeVertices.end(), chunkVertices[i].begin(), chunkVertices[i].end());
+				nextLevel.insert(nextLevel.end(), chunkNextLevels[i].begin(), chunkNextLevels[i].end());
+				culling.testedCubesCount += chunkCullings[i].testedCubesCount;
+				culling.planeTestsCount += chunkCullings[i].planeTestsCount;
+			}
+		}
+
+		currentLevel.swap(nextLevel);
+	}
+
+	if (outStatistics != NULL)
+	{
+		outStatistics->traversedNodesCount = traversedNodesCount;
+		outStatistics->frustumTestedNodesCount = culling.testedCubesCount;
+		outStatistics->planeTestsCount = culling.planeTestsCount;
+		outStatistics->emittedVerticesCount = octreeVertices.size();
+		outStatistics->truncatedVerticesCount = 0;
+		outStatistics->occlusionTestedNodesCount = (occlusion != nullptr) ? occlusion->testedCubesCount : 0;
+		outStatistics->occludedNodesCount = (occlusion != nullptr) ? occlusion->occludedCubesCount : 0;
+
+		// Count the distinct cache lines and pages of the topology array that were read, compare these between the node orders
+		std::sort(touchedIndices.begin(), touchedIndices.end());
+		UINT64 lastCacheLine = UINT64_MAX;
+		UINT64 lastPage = UINT64_MAX;
+		outStatistics->touchedCacheLinesCount = 0;
+		outStatistics->touchedPagesCount = 0;
+
+		for (auto it = touchedIndices.begin(); it != touchedIndices.end(); it++)
+		{
+			UINT64 address = (UINT64)*it * sizeof(OctreeNodeTopology);
+
+			if (address / TRAVERSAL_CACHE_LINE_SIZE != lastCacheLine)
+			{
+				lastCacheLine = address / TRAVERSAL_CACHE_LINE_SIZE;
+				outStatistics->touchedCacheLinesCount++;
+			}
+
+			if (address / TRAVERSAL_PAGE_SIZE != lastPage)
+			{
+				lastPage = address / TRAVERSAL_PAGE_SIZE;
+				outStatistics->touchedPagesCount++;
+			}
+		}
+	}
 
-    return octreeVertices;
+	return octreeVertices;
 }
 
 bool PointCloudEngine::Octree::LoadFromOctreeFile()
@@ -97,59 +531,2290 @@ bool PointCloudEngine::Octree::LoadFromOctreeFile()
     filename = filename.substr(0, filename.length() - 11);
     octreeFilepath = executableDirectory + L"/Octrees/" + filename + L".octree";
 
-    // Try to load the octree from a file
-    std::ifstream octreeFile(octreeFilepath, std::ios::in | std::ios::binary);
+	return LoadFromOctreeFile(octreeFilepath);
+}
 
-    // Only save the data when the file doesn't exist already
-    if (octreeFile.is_open())
-    {
-		// Read the root position as the first entry
-		octreeFile.read((char*)&rootPosition, sizeof(Vector3));
+bool PointCloudEngine::Octree::LoadFromOctreeFile(const std::wstring &filepath)
+{
+	CloseOctreeFile();
 
-		// Then the root size
-		octreeFile.read((char*)&rootSize, sizeof(float));
+	// Map the file into memory instead of reading it, this returns immediately and the nodes are loaded on demand when they are accessed
+	octreeFileHandle = CreateFile(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
 
-        // Load the size of the nodes vector
-        UINT nodesSize;
-        octreeFile.read((char*)&nodesSize, sizeof(UINT));
+	if (octreeFileHandle == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
 
-        // Read the binary data directly into the nodes vector
-        nodes.resize(nodesSize);
-        octreeFile.read((char*)nodes.data(), nodesSize * sizeof(OctreeNode));
+	const size_t headerSize = sizeof(OctreeFileHeader);
+	LARGE_INTEGER fileSize;
 
-        // Stop here after loading the file
-        return true;
-    }
+	if (GetFileSizeEx(octreeFileHandle, &fileSize) && (fileSize.QuadPart >= (LONGLONG)headerSize))
+	{
+		octreeFileMapping = CreateFileMapping(octreeFileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+
+		if (octreeFileMapping != NULL)
+		{
+			octreeFileView = (const byte*)MapViewOfFile(octreeFileMapping, FILE_MAP_READ, 0, 0, 0);
+		}
+	}
+
+	if (octreeFileView == NULL)
+	{
+		CloseOctreeFile();
+		return false;
+	}
+
+	OctreeFileHeader header;
+	memcpy(&header, octreeFileView, headerSize);
+
+	// Rebuild outdated or truncated files, the nodes checksum is not validated again when the header matches
+	bool isTruncated = (header.compressionBlockSize == 0) && ((LONGLONG)(header.GetShadingOffset() + (UINT64)header.nodesSize * sizeof(OctreeNodeShading)) > fileSize.QuadPart);
 
-    return false;
+	if (!IsMatchingOctreeFileHeader(header) || isTruncated)
+	{
+		OutputDebugString((L"Octree file " + filepath + L" is outdated, rebuilding it\n").c_str());
+		CloseOctreeFile();
+		return false;
+	}
+
+	rootPosition = header.rootPosition;
+	rootSize = header.rootSize;
+
+	// Only load the pages of nodes that the traversal reaches when the octree is paged, this keeps the memory bounded for any octree size
+	if (settings->octreePageCacheSize > 0)
+	{
+		std::vector<OctreeFileBlock> compressedBlocks;
+
+		if (header.compressionBlockSize > 0)
+		{
+			size_t blocksCount = (header.nodesSize + header.compressionBlockSize - 1) / header.compressionBlockSize;
+
+			if ((LONGLONG)(headerSize + blocksCount * sizeof(OctreeFileBlock)) > fileSize.QuadPart)
+			{
+				CloseOctreeFile();
+				return false;
+			}
+
+			const OctreeFileBlock* blocks = (const OctreeFileBlock*)(octreeFileView + headerSize);
+			compressedBlocks.assign(blocks, blocks + blocksCount);
+		}
+
+		CloseOctreeFile();
+		pageCache = new OctreePageCache(filepath, header, compressedBlocks, (size_t)settings->octreePageCacheSize * 1024 * 1024);
+		std::vector<OctreeNode>().swap(nodes);
+
+		return true;
+	}
+
+	// Compressed nodes can't be used directly from the file, they are decompressed in parallel into the split arrays
+	if (header.compressionBlockSize > 0)
+	{
+		bool decompressed = DecompressOctreeFile(header, (size_t)fileSize.QuadPart);
+		UnmapOctreeFile();
+
+		if (!decompressed)
+		{
+			OutputDebugString((L"Octree file " + filepath + L" is corrupted, rebuilding it\n").c_str());
+			CloseOctreeFile();
+		}
+
+		return decompressed;
+	}
+
+	// The arrays of the nodes directly follow the header, no copy is needed
+	topology = (const OctreeNodeTopology*)(octreeFileView + header.GetTopologyOffset());
+	normals = (const OctreeNodeNormals*)(octreeFileView + header.GetNormalsOffset());
+	shading = (const OctreeNodeShading*)(octreeFileView + header.GetShadingOffset());
+	nodesCount = header.nodesSize;
+	std::vector<OctreeNode>().swap(nodes);
+
+	return true;
 }
 
-void PointCloudEngine::Octree::SaveToOctreeFile()
+bool PointCloudEngine::Octree::SaveToOctreeFile()
 {
-    // Try to open a previously saved file
-    std::wifstream file(octreeFilepath);
+	// Save the octree in a file inside a new folder, this replaces outdated files
+	CreateDirectory((executableDirectory + L"/Octrees").c_str(), NULL);
 
-    // Only save the data when the file doesn't exist already
-    if (!file.is_open())
-    {
-        // Save the octree in a file inside a new folder
-        CreateDirectory((executableDirectory + L"/Octrees").c_str(), NULL);
-        std::ofstream octreeFile(octreeFilepath, std::ios::out | std::ios::binary);
+	const std::wstring temporaryFilepath = octreeFilepath + L".tmp";
 
-		// Write the root position
-		octreeFile.write((char*)&rootPosition, sizeof(Vector3));
+	// Write the nodes data in binary format
+	if (settings->octreeSubtreeBlockLevels > 0)
+	{
+		WriteSubtreeBlocks(temporaryFilepath, nodes.size(), [&](size_t index) { return nodes[index]; });
+	}
+	else
+	{
+		OctreeFileWriter octreeFileWriter(*this, temporaryFilepath, nodes.size());
+		octreeFileWriter.Write(nodes.data(), nodes.size());
+		octreeFileWriter.Close();
+	}
 
-		// Then the root size
-		octreeFile.write((char*)&rootSize, sizeof(float));
+	// The nodes are still in memory, they are used directly when the old file can't be replaced
+	if (ReplaceOctreeFile(temporaryFilepath) != octreeFilepath)
+	{
+		DeleteFile(temporaryFilepath.c_str());
+		return false;
+	}
 
-        // Write the size of the nodes vector
-        UINT nodesSize = nodes.size();
-        octreeFile.write((char*)&nodesSize, sizeof(UINT));
+	return true;
+}
 
-        // Write the nodes data in binary format
-        octreeFile.write((char*)nodes.data(), nodesSize * sizeof(OctreeNode));
+const OctreeNodeTopology* PointCloudEngine::Octree::GetTopology() const
+{
+	return topology;
+}
 
-        octreeFile.flush();
-        octreeFile.close();
-    }
+const OctreeNodeNormals* PointCloudEngine::Octree::GetNormals() const
+{
+	return normals;
+}
+
+const OctreeNodeShading* PointCloudEngine::Octree::GetShading() const
+{
+	return shading;
+}
+
+size_t PointCloudEngine::Octree::GetNodesCount() const
+{
+	return (pageCache != NULL) ? pageCache->GetNodesCount() : nodesCount;
+}
+
+PointCloudEngine::OctreeNode PointCloudEngine::Octree::GetNode(size_t index) const
+{
+	return (pageCache != NULL) ? pageCache->GetNode(index) : OctreeNode(topology[index], normals[index], shading[index]);
+}
+
+bool PointCloudEngine::Octree::IsPaged() const
+{
+	return (pageCache != NULL);
+}
+
+void PointCloudEngine::Octree::CloseOctreeFile()
+{
+	UnmapOctreeFile();
+
+	topology = NULL;
+	normals = NULL;
+	shading = NULL;
+	nodesCount = 0;
+	std::vector<OctreeNodeTopology>().swap(loadedTopology);
+	std::vector<OctreeNodeNormals>().swap(loadedNormals);
+	std::vector<OctreeNodeShading>().swap(loadedShading);
+	SafeDelete(pageCache);
+	std::vector<UINT>().swap(levelStarts);
+	std::vector<OctreeNodeCell>().swap(nodeCells);
+
+	if (cut != NULL)
+	{
+		cut->Clear();
+	}
+}
+
+void PointCloudEngine::Octree::UnmapOctreeFile()
+{
+	if (octreeFileView != NULL)
+	{
+		UnmapViewOfFile(octreeFileView);
+		octreeFileView = NULL;
+	}
+
+	if (octreeFileMapping != NULL)
+	{
+		CloseHandle(octreeFileMapping);
+		octreeFileMapping = NULL;
+	}
+
+	if (octreeFileHandle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(octreeFileHandle);
+		octreeFileHandle = INVALID_HANDLE_VALUE;
+	}
+}
+
+bool PointCloudEngine::Octree::DecompressOctreeFile(const OctreeFileHeader &header, size_t fileSize)
+{
+	// The block table directly follows the header
+	const size_t blockSize = header.compressionBlockSize;
+	const size_t blocksCount = (header.nodesSize + blockSize - 1) / blockSize;
+	const size_t blocksStart = sizeof(OctreeFileHeader) + blocksCount * sizeof(OctreeFileBlock);
+
+	if (blocksStart > fileSize)
+	{
+		return false;
+	}
+
+	const OctreeFileBlock* blocks = (const OctreeFileBlock*)(octreeFileView + sizeof(OctreeFileHeader));
+	std::atomic<bool> valid(true);
+	LoadNodes(header.nodesSize);
+
+	threadPool->ParallelFor(blocksCount, [&](size_t i)
+	{
+		const OctreeFileBlock &block = blocks[i];
+		const size_t nodesStart = i * blockSize;
+		std::vector<OctreeNode> blockNodes(min(blockSize, nodesCount - nodesStart));
+
+		if ((block.offset < blocksStart) || (block.offset + block.size > fileSize))
+		{
+			valid = false;
+			return;
+		}
+
+		if (!OctreeCompression::DecompressBlock(octreeFileView + block.offset, block.size, blockNodes.size(), block.firstChildrenStart, blockNodes.data()))
+		{
+			valid = false;
+			return;
+		}
+
+		SplitNodes(blockNodes.data(), blockNodes.size(), loadedTopology.data() + nodesStart, loadedNormals.data() + nodesStart, loadedShading.data() + nodesStart);
+	});
+
+	return valid;
+}
+
+void PointCloudEngine::Octree::CreateLevelIndex()
+{
+	// The nodes of each depth are only stored next to each other in breadth first order, the cells of deeper nodes don't fit into 16 bits
+	std::vector<UINT>().swap(levelStarts);
+	std::vector<OctreeNodeCell>().swap(nodeCells);
+
+	if (IsPaged() || (settings->octreeSubtreeBlockLevels > 0) || (nodesCount == 0))
+	{
+		return;
+	}
+
+	// The children of all the nodes of one level form the next level, the end of the next level is the last child of the current level
+	nodeCells.resize(nodesCount);
+	nodeCells[0] = { { 0, 0, 0 } };
+	levelStarts.push_back(0);
+
+	size_t levelEnd = 1;
+	size_t nextLevelEnd = 1;
+
+	for (size_t i = 0; i < nodesCount; i++)
+	{
+		if (i == levelEnd)
+		{
+			levelStarts.push_back((UINT)i);
+			levelEnd = nextLevelEnd;
+		}
+
+		const OctreeNodeTopology &nodeTopology = topology[i];
+		const UINT childrenMask = nodeTopology.childrenMask & 0xff;
+		UINT count = 0;
+
+		if (childrenMask == 0)
+		{
+			continue;
+		}
+
+		// Same child order as in the traversal, set bits move the child to the negative side of the axis
+		for (int j = 0; j < 8; j++)
+		{
+			if (childrenMask & (1 << j))
+			{
+				const size_t childIndex = nodeTopology.childrenStartOrLeafPositionFactors + count;
+
+				if ((levelStarts.size() > COMPACT_VERTEX_MAX_DEPTH) || (childIndex < levelEnd) || (childIndex >= nodesCount))
+				{
+					std::vector<UINT>().swap(levelStarts);
+					std::vector<OctreeNodeCell>().swap(nodeCells);
+					return;
+				}
+
+				nodeCells[childIndex].cell[0] = 2 * nodeCells[i].cell[0] + ((j & 0x4) ? 0 : 1);
+				nodeCells[childIndex].cell[1] = 2 * nodeCells[i].cell[1] + ((j & 0x2) ? 0 : 1);
+				nodeCells[childIndex].cell[2] = 2 * nodeCells[i].cell[2] + ((j & 0x1) ? 0 : 1);
+				nextLevelEnd = max(nextLevelEnd, childIndex + 1);
+				count++;
+			}
+		}
+	}
+
+	levelStarts.push_back((UINT)nodesCount);
+}
+
+void PointCloudEngine::Octree::LoadNodes(size_t count)
+{
+	// Allocates the arrays of the nodes when they can't be referenced in the file
+	loadedTopology.resize(count);
+	loadedNormals.resize(count);
+	loadedShading.resize(count);
+
+	topology = loadedTopology.data();
+	normals = loadedNormals.data();
+	shading = loadedShading.data();
+	nodesCount = count;
+}
+
+void PointCloudEngine::Octree::SplitNodes(const OctreeNode *nodes, size_t nodesCount, OctreeNodeTopology *outTopology, OctreeNodeNormals *outNormals, OctreeNodeShading *outShading)
+{
+	for (size_t i = 0; i < nodesCount; i++)
+	{
+		outTopology[i] = nodes[i].GetTopology();
+		outNormals[i] = nodes[i].GetNormals();
+		outShading[i] = nodes[i].GetShading();
+	}
+}
+
+template <typename T> void PointCloudEngine::Octree::GetNodeVertices(std::vector<OctreeNodeTraversalEntry> &nextEntries, std::vector<T> &octreeVertices, const OctreeNodeTraversalEntry &entry, const OctreeConstantBuffer &octreeConstantBufferData, OctreeCulling &culling) const
+{
+	// The topology is needed for every node, the normals are only read when culling and the shading only when the vertex is drawn
+	const OctreeNodeTopology nodeTopology = GetNodeTopology(entry.index);
+	bool traverseChildren = true;
+
+	// The node and all of its children face away from the camera, don't draw it or traverse further
+	// The view frustum culling of this node was already done by its parent together with its siblings
+	if (octreeConstantBufferData.useCulling && culling.IsBackfacing(GetNodeNormals(entry.index), entry.position))
+	{
+		return;
+	}
+
+	// Check if only to return the vertices at the given level
+	if (octreeConstantBufferData.level >= 0)
+	{
+		if (entry.depth == octreeConstantBufferData.level)
+		{
+			// Draw this vertex and don't traverse further
+			traverseChildren = false;
+			octreeVertices.emplace_back();
+			GetNodeVertex(entry, nodeTopology, octreeVertices.back());
+		}
+	}
+	else
+	{
+		// Only return the vertices that have a projected size smaller than the required splat size or it is a leaf node
+		float distanceToCamera = Vector3::Distance(octreeConstantBufferData.localCameraPosition, entry.position);
+
+		// Scale the local space splat size by the fov and camera distance (result: size at that distance in local space)
+		float requiredSplatSize = octreeConstantBufferData.splatResolution * (2.0f * tan(octreeConstantBufferData.fovAngleY / 2.0f)) * distanceToCamera;
+
+		if ((entry.size < requiredSplatSize) || (nodeTopology.childrenMask == 0))
+		{
+			// Draw this vertex, don't traverse further
+			traverseChildren = false;
+			octreeVertices.emplace_back();
+			GetNodeVertex(entry, nodeTopology, octreeVertices.back());
+		}
+	}
+
+	if (traverseChildren)
+	{
+		GetChildEntries(nextEntries, entry, nodeTopology, octreeConstantBufferData, culling);
+	}
+}
+
+void PointCloudEngine::Octree::GetChildEntries(std::vector<OctreeNodeTraversalEntry> &outEntries, const OctreeNodeTraversalEntry &entry, const OctreeNodeTopology &nodeTopology, const OctreeConstantBuffer &octreeConstantBufferData, OctreeCulling &culling) const
+{
+	float childPositions[3][8];
+
+	for (int i = 0; i < 8; i++)
+	{
+		Vector3 childPosition = OctreeNode::GetChildPosition(entry.position, entry.size, i);
+		childPositions[0][i] = childPosition.x;
+		childPositions[1][i] = childPosition.y;
+		childPositions[2][i] = childPosition.z;
+	}
+
+	// Classify all the children against the view frustum at once, only the planes that intersect this node have to be tested (none when it is fully inside)
+	byte visibleMask = nodeTopology.childrenMask;
+	UINT childPlaneMasks[8] = { 0 };
+
+	if (octreeConstantBufferData.useCulling && (entry.viewFrustumPlaneMask != 0))
+	{
+		visibleMask = culling.ClassifyCubes(childPositions, nodeTopology.childrenMask, entry.size * 0.5f, entry.viewFrustumPlaneMask, childPlaneMasks);
+	}
+
+	size_t count = 0;
+
+	// Traverse the children
+	for (int i = 0; i < 8; i++)
+	{
+		// Check if this child exists and add it to the next level when it is not outside of the view frustum
+		if (nodeTopology.childrenMask & (1 << i))
+		{
+			if (visibleMask & (1 << i))
+			{
+				OctreeNodeTraversalEntry childEntry;
+				childEntry.index = nodeTopology.childrenStartOrLeafPositionFactors + count;
+				childEntry.position = Vector3(childPositions[0][i], childPositions[1][i], childPositions[2][i]);
+				childEntry.size = entry.size * 0.5f;
+				childEntry.viewFrustumPlaneMask = childPlaneMasks[i];
+				childEntry.depth = entry.depth + 1;
+
+				outEntries.push_back(childEntry);
+			}
+
+			count++;
+		}
+	}
+}
+
+template <typename T> UINT PointCloudEngine::Octree::GetBudgetedVertices(std::vector<T> &octreeVertices, const std::vector<OctreeNodeTraversalEntry> &rootEntries, const OctreeConstantBuffer &octreeConstantBufferData, OctreeCulling &culling, std::vector<UINT> *outTouchedIndices) const
+{
+	// Instead of level by level the queued node with the largest projected size (size divided by the distance to the camera) is refined next
+	// The drawn and the queued nodes always form a cut through the octree, refining a node replaces it with its visible children
+	// When this would exceed the point budget the refinement stops and the queued nodes are drawn as they are, the most visible detail is added first
+	// Without reaching the budget the result contains the same vertices as the level by level traversal
+	struct BudgetEntry
+	{
+		float projectedSize;
+		OctreeNodeTraversalEntry entry;
+		OctreeNodeTopology nodeTopology;
+	};
+
+	auto compare = [](const BudgetEntry &a, const BudgetEntry &b) { return a.projectedSize < b.projectedSize; };
+	std::priority_queue<BudgetEntry, std::vector<BudgetEntry>, decltype(compare)> queue(compare);
+	std::vector<OctreeNodeTraversalEntry> childEntries;
+	std::vector<BudgetEntry> visibleChildren;
+
+	const size_t pointBudget = settings->octreePointBudget;
+	const float splatSizeFactor = octreeConstantBufferData.splatResolution * (2.0f * tan(octreeConstantBufferData.fovAngleY / 2.0f));
+	UINT traversedNodesCount = 0;
+
+	// Reads the topology and computes the priority of the node, returns false when it faces away from the camera
+	auto CheckNode = [&](const OctreeNodeTraversalEntry &entry, BudgetEntry &outBudgetEntry)
+	{
+		traversedNodesCount++;
+
+		if (outTouchedIndices != NULL)
+		{
+			outTouchedIndices->push_back(entry.index);
+		}
+
+		if (octreeConstantBufferData.useCulling && culling.IsBackfacing(GetNodeNormals(entry.index), entry.position))
+		{
+			return false;
+		}
+
+		outBudgetEntry.entry = entry;
+		outBudgetEntry.nodeTopology = GetNodeTopology(entry.index);
+		outBudgetEntry.projectedSize = entry.size / Vector3::Distance(octreeConstantBufferData.localCameraPosition, entry.position);
+
+		return true;
+	};
+
+	// Same check as in the level by level traversal, nodes that are smaller than the required splat size and leaf nodes are drawn right away
+	auto AddNode = [&](const BudgetEntry &budgetEntry)
+	{
+		float requiredSplatSize = splatSizeFactor * Vector3::Distance(octreeConstantBufferData.localCameraPosition, budgetEntry.entry.position);
+
+		if ((budgetEntry.entry.size < requiredSplatSize) || (budgetEntry.nodeTopology.childrenMask == 0))
+		{
+			octreeVertices.emplace_back();
+			GetNodeVertex(budgetEntry.entry, budgetEntry.nodeTopology, octreeVertices.back());
+		}
+		else
+		{
+			queue.push(budgetEntry);
+		}
+	};
+
+	for (auto it = rootEntries.begin(); it != rootEntries.end(); it++)
+	{
+		BudgetEntry rootBudgetEntry;
+
+		if (CheckNode(*it, rootBudgetEntry))
+		{
+			AddNode(rootBudgetEntry);
+		}
+	}
+
+	while (!queue.empty())
+	{
+		const BudgetEntry budgetEntry = queue.top();
+
+		childEntries.clear();
+		visibleChildren.clear();
+		GetChildEntries(childEntries, budgetEntry.entry, budgetEntry.nodeTopology, octreeConstantBufferData, culling);
+
+		for (auto it = childEntries.begin(); it != childEntries.end(); it++)
+		{
+			BudgetEntry childBudgetEntry;
+
+			if (CheckNode(*it, childBudgetEntry))
+			{
+				visibleChildren.push_back(childBudgetEntry);
+			}
+		}
+
+		// Keep this node and all the other queued nodes when its visible children do not fit into the budget anymore
+		if (octreeVertices.size() + queue.size() - 1 + visibleChildren.size() > pointBudget)
+		{
+			break;
+		}
+
+		queue.pop();
+
+		for (auto it = visibleChildren.begin(); it != visibleChildren.end(); it++)
+		{
+			AddNode(*it);
+		}
+	}
+
+	// Draw the nodes that were not refined anymore, the largest first
+	while (!queue.empty())
+	{
+		octreeVertices.emplace_back();
+		GetNodeVertex(queue.top().entry, queue.top().nodeTopology, octreeVertices.back());
+		queue.pop();
+	}
+
+	return traversedNodesCount;
+}
+
+template <typename T> UINT PointCloudEngine::Octree::GetLevelVertices(std::vector<T> &octreeVertices, const OctreeConstantBuffer &octreeConstantBufferData, OctreeCulling &culling, std::vector<UINT> *outTouchedIndices) const
+{
+	// All the nodes of the level are stored between two level starts, the position of each node is computed from its cell
+	// The nodes of a level have the same size, they are culled against all the view frustum planes in groups of 8 and each chunk of the level is processed in parallel
+	if ((UINT)octreeConstantBufferData.level + 1 >= levelStarts.size())
+	{
+		return 0;
+	}
+
+	const size_t levelStart = levelStarts[octreeConstantBufferData.level];
+	const size_t levelEnd = levelStarts[octreeConstantBufferData.level + 1];
+	const size_t levelSize = levelEnd - levelStart;
+	const float size = rootSize / (1 << octreeConstantBufferData.level);
+	const Vector3 rootCorner = rootPosition - (0.5f * rootSize * Vector3::One);
+
+	size_t chunkCount = (levelSize + TRAVERSAL_CHUNK_SIZE - 1) / TRAVERSAL_CHUNK_SIZE;
+	chunkCount = min(chunkCount, 4 * threadPool->GetThreadCount());
+
+	const size_t chunkSize = (levelSize + chunkCount - 1) / chunkCount;
+
+	std::vector<std::vector<T>> chunkVertices(chunkCount);
+	std::vector<OctreeCulling> chunkCullings(chunkCount, culling);
+
+	threadPool->ParallelFor(chunkCount, [&](size_t i)
+	{
+		const size_t start = levelStart + i * chunkSize;
+		const size_t end = min(start + chunkSize, levelEnd);
+
+		chunkCullings[i].testedCubesCount = 0;
+		chunkCullings[i].planeTestsCount = 0;
+
+		for (size_t groupStart = start; groupStart < end; groupStart += 8)
+		{
+			const size_t groupSize = min((size_t)8, end - groupStart);
+			OctreeNodeTraversalEntry entries[8];
+			float positions[3][8];
+			byte mask = (1 << groupSize) - 1;
+
+			for (size_t j = 0; j < groupSize; j++)
+			{
+				const OctreeNodeCell &nodeCell = nodeCells[groupStart + j];
+				entries[j].index = (UINT)(groupStart + j);
+				entries[j].position = rootCorner + size * Vector3(nodeCell.cell[0] + 0.5f, nodeCell.cell[1] + 0.5f, nodeCell.cell[2] + 0.5f);
+				entries[j].size = size;
+				entries[j].viewFrustumPlaneMask = 0;
+				entries[j].depth = octreeConstantBufferData.level;
+				positions[0][j] = entries[j].position.x;
+				positions[1][j] = entries[j].position.y;
+				positions[2][j] = entries[j].position.z;
+			}
+
+			if (octreeConstantBufferData.useCulling)
+			{
+				UINT planeMasks[8];
+				mask = chunkCullings[i].ClassifyCubes(positions, mask, size, VIEW_FRUSTUM_PLANE_MASK, planeMasks);
+			}
+
+			for (size_t j = 0; j < groupSize; j++)
+			{
+				if (mask & (1 << j))
+				{
+					const OctreeNodeTopology nodeTopology = GetNodeTopology(entries[j].index);
+
+					if (octreeConstantBufferData.useCulling && culling.IsBackfacing(GetNodeNormals(entries[j].index), entries[j].position))
+					{
+						continue;
+					}
+
+					chunkVertices[i].emplace_back();
+					GetNodeVertex(entries[j], nodeTopology, chunkVertices[i].back());
+				}
+			}
+		}
+	});
+
+	for (size_t i = 0; i < chunkCount; i++)
+	{
+		octreeVertices.insert(octreeVertices.end(), chunkVertices[i].begin(), chunkVertices[i].end());
+		culling.testedCubesCount += chunkCullings[i].testedCubesCount;
+		culling.planeTestsCount += chunkCullings[i].planeTestsCount;
+	}
+
+	if (outTouchedIndices != NULL)
+	{
+		for (size_t i = levelStart; i < levelEnd; i++)
+		{
+			outTouchedIndices->push_back((UINT)i);
+		}
+	}
+
+	return (UINT)levelSize;
+}
+
+template <typename T> UINT PointCloudEngine::Octree::GetOcclusionCulledVertices(std::vector<T> &octreeVertices, const std::vector<OctreeNodeTraversalEntry> &rootEntries, const OctreeConstantBuffer &octreeConstantBufferData, OctreeCulling &culling, OctreeOcclusion &occlusion, std::vector<UINT> *outTouchedIndices) const
+{
+	// Always continue with the queued node that is closest to the camera, this way the drawn nodes are added to the depth buffer before the nodes behind them are tested
+	// Same checks as in the level by level traversal, additionally the nodes that are behind the covered texels of the depth buffer are not drawn or traversed further
+	struct OcclusionEntry
+	{
+		float nearestDepth;
+		OctreeNodeTraversalEntry entry;
+	};
+
+	auto compare = [](const OcclusionEntry &a, const OcclusionEntry &b) { return a.nearestDepth > b.nearestDepth; };
+	std::priority_queue<OcclusionEntry, std::vector<OcclusionEntry>, decltype(compare)> queue(compare);
+	std::vector<OctreeNodeTraversalEntry> childEntries;
+
+	const float splatSizeFactor = octreeConstantBufferData.splatResolution * (2.0f * tan(octreeConstantBufferData.fovAngleY / 2.0f));
+	UINT traversedNodesCount = 0;
+
+	for (auto it = rootEntries.begin(); it != rootEntries.end(); it++)
+	{
+		queue.push({ occlusion.GetNearestDepth(it->position, it->size), *it });
+	}
+
+	while (!queue.empty())
+	{
+		const OctreeNodeTraversalEntry entry = queue.top().entry;
+		queue.pop();
+
+		traversedNodesCount++;
+
+		if (outTouchedIndices != NULL)
+		{
+			outTouchedIndices->push_back(entry.index);
+		}
+
+		if (culling.IsBackfacing(GetNodeNormals(entry.index), entry.position) || occlusion.IsOccluded(entry.position, entry.size))
+		{
+			continue;
+		}
+
+		const OctreeNodeTopology nodeTopology = GetNodeTopology(entry.index);
+		float requiredSplatSize = splatSizeFactor * Vector3::Distance(octreeConstantBufferData.localCameraPosition, entry.position);
+
+		if ((entry.size < requiredSplatSize) || (nodeTopology.childrenMask == 0))
+		{
+			occlusion.AddOccluder(GetNodePosition(entry, nodeTopology), entry.size);
+			octreeVertices.emplace_back();
+			GetNodeVertex(entry, nodeTopology, octreeVertices.back());
+		}
+		else
+		{
+			childEntries.clear();
+			GetChildEntries(childEntries, entry, nodeTopology, octreeConstantBufferData, culling);
+
+			for (auto it = childEntries.begin(); it != childEntries.end(); it++)
+			{
+				queue.push({ occlusion.GetNearestDepth(it->position, it->size), *it });
+			}
+		}
+	}
+
+	return traversedNodesCount;
+}
+
+template <typename T> UINT PointCloudEngine::Octree::GetIncrementalVertices(std::vector<T> &octreeVertices, const OctreeConstantBuffer &octreeConstantBufferData, OctreeCulling &culling, std::vector<UINT> *outTouchedIndices) const
+{
+	// Small camera movements only change the decision of a few nodes, keep the cut of the last update and only refine or coarsen where it changed
+	// Nodes of the cut are refined above the required splat size plus the hysteresis, refined nodes are coarsened below it minus the hysteresis
+	// In between the previous decision is kept, this way nodes close to the required splat size do not alternate between the frames
+	// Each check also computes how far the camera can move and rotate until its result can change, the node is only checked again after that
+	// This way only the nodes close to the thresholds, the view frustum planes or their backfacing limit are checked and the cost follows the view change
+	OctreeCut &octreeCut = *cut;
+	std::vector<T> &cutVertices = octreeCut.GetVertices((T*)NULL);
+	const OctreeConstantBuffer &lastConstantBufferData = octreeCut.lastConstantBufferData;
+	UINT traversedNodesCount = 0;
+
+	// Only the camera position and orientation are tracked, any other change of the view starts a new cut
+	bool restart = (octreeCut.root == UINT_MAX) || (octreeCut.compact != OctreeCut::IsCompact((T*)NULL))
+		|| (memcmp(&lastConstantBufferData.World, &octreeConstantBufferData.World, sizeof(Matrix)) != 0)
+		|| (memcmp(&lastConstantBufferData.Projection, &octreeConstantBufferData.Projection, sizeof(Matrix)) != 0)
+		|| (lastConstantBufferData.fovAngleY != octreeConstantBufferData.fovAngleY)
+		|| (lastConstantBufferData.splatResolution != octreeConstantBufferData.splatResolution)
+		|| (lastConstantBufferData.useCulling != octreeConstantBufferData.useCulling);
+
+	// The view frustum and the projected node sizes follow from the camera, the cut is the same if it did not move or rotate
+	if (!restart && (memcmp(&lastConstantBufferData.View, &octreeConstantBufferData.View, sizeof(Matrix)) == 0)
+		&& (lastConstantBufferData.localCameraPosition == octreeConstantBufferData.localCameraPosition))
+	{
+		octreeVertices = cutVertices;
+		return traversedNodesCount;
+	}
+
+	if (!restart)
+	{
+		// The signed distance of a point to a plane changes at most by the normal change times the distance to the camera plus the camera translation and the change of the plane offset at the camera
+		OctreeCulling lastCulling(lastConstantBufferData);
+		float normalChange = 0;
+		float offsetChange = 0;
+
+		for (int i = 0; i < 6; i++)
+		{
+			normalChange = max(normalChange, Vector3::Distance(lastCulling.GetPlaneNormal(i), culling.GetPlaneNormal(i)));
+			offsetChange = max(offsetChange, fabs(culling.GetPlaneDistance(i, octreeConstantBufferData.localCameraPosition) - lastCulling.GetPlaneDistance(i, lastConstantBufferData.localCameraPosition)));
+		}
+
+		octreeCut.translation += Vector3::Distance(lastConstantBufferData.localCameraPosition, octreeConstantBufferData.localCameraPosition) + offsetChange;
+		octreeCut.rotation += normalChange;
+	}
+
+	octreeCut.lastConstantBufferData = octreeConstantBufferData;
+
+	const float splatSizeFactor = octreeConstantBufferData.splatResolution * (2.0f * tan(octreeConstantBufferData.fovAngleY / 2.0f));
+	std::vector<OctreeNodeTraversalEntry> childEntries;
+	std::vector<UINT> stack;
+	std::vector<UINT> freeStack;
+
+	// Camera distance that has to be crossed until the projected size of the node passes the required splat size times the factor
+	auto GetSplatSizeSlack = [&](const OctreeNodeTraversalEntry &entry, float factor)
+	{
+		float threshold = factor * splatSizeFactor;
+		return (threshold > 0) ? fabs((entry.size / threshold) - Vector3::Distance(octreeConstantBufferData.localCameraPosition, entry.position)) : FLT_MAX;
+	};
+
+	// Tests the node against all the view frustum planes instead of only the ones of its parent, the parent might not have been tested in this update
+	// Also returns how much the camera can move and rotate until the result can change
+	// The plane distances change at most by translation + rotation * (distance + translation), the view directions at most by 2 * translation / distance and the rotation
+	auto IsVisible = [&](OctreeNodeTraversalEntry &entry, const OctreeNodeNormals &nodeNormals, float &outTranslationSlack, float &outRotationSlack)
+	{
+		traversedNodesCount++;
+		outTranslationSlack = FLT_MAX;
+		outRotationSlack = FLT_MAX;
+
+		if (!octreeConstantBufferData.useCulling)
+		{
+			return true;
+		}
+
+		const float distance = Vector3::Distance(octreeConstantBufferData.localCameraPosition, entry.position);
+		const float frustumMargin = fabs(culling.GetFrustumMargin(entry.position, entry.size));
+
+		outTranslationSlack = frustumMargin / 2;
+		outRotationSlack = (frustumMargin > 0) ? (frustumMargin / (2 * distance + frustumMargin)) : 0;
+
+		float positions[3][8] = { { entry.position.x }, { entry.position.y }, { entry.position.z } };
+		UINT planeMasks[8];
+
+		if (culling.ClassifyCubes(positions, 1, entry.size, VIEW_FRUSTUM_PLANE_MASK, planeMasks) == 0)
+		{
+			return false;
+		}
+
+		entry.viewFrustumPlaneMask = planeMasks[0];
+
+		const float backfacingMargin = fabs(culling.GetBackfacingMargin(nodeNormals, entry.position));
+
+		if (backfacingMargin < FLT_MAX)
+		{
+			outTranslationSlack = min(outTranslationSlack, backfacingMargin * distance / 2);
+			outRotationSlack = min(outRotationSlack, backfacingMargin);
+		}
+
+		return !culling.IsBackfacing(nodeNormals, entry.position);
+	};
+
+	// Checks the node and refines it when its projected size is at least the required splat size times the factor, the new children are refined further with the same check as in the level by level traversal
+	// The vertices are only created for the nodes that become drawn and only removed for the nodes that stop being drawn
+	auto UpdateNode = [&](UINT index, float refineFactor)
+	{
+		stack.push_back(index);
+
+		while (!stack.empty())
+		{
+			UINT nodeIndex = stack.back();
+			stack.pop_back();
+
+			OctreeCut::CutNode &node = octreeCut.nodes[nodeIndex];
+			float translationSlack, rotationSlack;
+			node.visible = IsVisible(node.entry, node.nodeNormals, translationSlack, rotationSlack);
+
+			const float factor = (nodeIndex == index) ? refineFactor : 1.0f;
+			const float requiredSplatSize = factor * splatSizeFactor * Vector3::Distance(octreeConstantBufferData.localCameraPosition, node.entry.position);
+
+			if (!node.visible || (node.nodeTopology.childrenMask == 0) || (node.entry.size < requiredSplatSize))
+			{
+				if (node.visible && (node.vertexIndex == UINT_MAX))
+				{
+					if (outTouchedIndices != NULL)
+					{
+						outTouchedIndices->push_back(node.entry.index);
+					}
+
+					T vertex;
+					GetNodeVertex(node.entry, node.nodeTopology, vertex);
+					octreeCut.AddVertex(nodeIndex, vertex);
+				}
+				else if (!node.visible && (node.vertexIndex != UINT_MAX))
+				{
+					octreeCut.RemoveVertex<T>(nodeIndex);
+				}
+
+				float splatSizeSlack = (node.nodeTopology.childrenMask == 0) ? FLT_MAX : GetSplatSizeSlack(node.entry, 1.0f + INCREMENTAL_TRAVERSAL_HYSTERESIS);
+				octreeCut.Schedule(nodeIndex, min(translationSlack, splatSizeSlack), rotationSlack);
+				continue;
+			}
+
+			// Move the node above the cut
+			if (node.vertexIndex != UINT_MAX)
+			{
+				octreeCut.RemoveVertex<T>(nodeIndex);
+			}
+
+			node.refined = true;
+			octreeCut.Schedule(nodeIndex, min(translationSlack, GetSplatSizeSlack(node.entry, 1.0f - INCREMENTAL_TRAVERSAL_HYSTERESIS)), rotationSlack);
+
+			// The culled children are part of the cut as well, they are only hidden until they become visible again
+			OctreeNodeTraversalEntry parentEntry = node.entry;
+			parentEntry.viewFrustumPlaneMask = 0;
+			childEntries.clear();
+			GetChildEntries(childEntries, parentEntry, node.nodeTopology, octreeConstantBufferData, culling);
+
+			for (auto it = childEntries.begin(); it != childEntries.end(); it++)
+			{
+				if (outTouchedIndices != NULL)
+				{
+					outTouchedIndices->push_back(it->index);
+				}
+
+				// Allocating can move the nodes, only access them by index here
+				UINT childIndex = octreeCut.AllocateNode();
+				OctreeCut::CutNode &childNode = octreeCut.nodes[childIndex];
+				childNode.entry = *it;
+				childNode.nodeTopology = GetNodeTopology(it->index);
+				childNode.nodeNormals = GetNodeNormals(it->index);
+				childNode.parent = nodeIndex;
+				childNode.nextSibling = octreeCut.nodes[nodeIndex].firstChild;
+				octreeCut.nodes[nodeIndex].firstChild = childIndex;
+
+				stack.push_back(childIndex);
+			}
+		}
+	};
+
+	if (restart)
+	{
+		// Start a new cut at the root
+		octreeCut.Clear();
+		octreeCut.compact = OctreeCut::IsCompact((T*)NULL);
+
+		if (outTouchedIndices != NULL)
+		{
+			outTouchedIndices->push_back(0);
+		}
+
+		octreeCut.root = octreeCut.AllocateNode();
+		OctreeCut::CutNode &rootNode = octreeCut.nodes[octreeCut.root];
+		rootNode.entry.index = 0;
+		rootNode.entry.position = rootPosition;
+		rootNode.entry.size = rootSize;
+		rootNode.entry.viewFrustumPlaneMask = VIEW_FRUSTUM_PLANE_MASK;
+		rootNode.entry.depth = 0;
+		rootNode.nodeTopology = GetNodeTopology(0);
+		rootNode.nodeNormals = GetNodeNormals(0);
+		rootNode.parent = UINT_MAX;
+
+		UpdateNode(octreeCut.root, 1.0f);
+	}
+	else
+	{
+		// Collect the nodes whose checks are due, the same node can be due in both queues
+		std::vector<std::pair<int, UINT>> dueNodes;
+
+		auto CollectDueChecks = [&](OctreeCut::CheckQueue &checks, double movement)
+		{
+			while (!checks.empty() && (checks.top().key <= movement))
+			{
+				const OctreeCut::ScheduledCheck &check = checks.top();
+
+				if (octreeCut.nodes[check.node].evaluation == check.evaluation)
+				{
+					dueNodes.push_back(std::make_pair(octreeCut.nodes[check.node].entry.depth, check.node));
+				}
+
+				checks.pop();
+			}
+		};
+
+		CollectDueChecks(octreeCut.translationChecks, octreeCut.translation);
+		CollectDueChecks(octreeCut.rotationChecks, octreeCut.rotation);
+
+		// Check the nodes from the top, a coarsened node frees the nodes below it and their checks are skipped
+		std::sort(dueNodes.begin(), dueNodes.end());
+		dueNodes.erase(std::unique(dueNodes.begin(), dueNodes.end()), dueNodes.end());
+
+		for (auto it = dueNodes.begin(); it != dueNodes.end(); it++)
+		{
+			const UINT nodeIndex = it->second;
+			OctreeCut::CutNode &node = octreeCut.nodes[nodeIndex];
+
+			if (node.evaluation == 0)
+			{
+				continue;
+			}
+
+			if (!node.refined)
+			{
+				UpdateNode(nodeIndex, 1.0f + INCREMENTAL_TRAVERSAL_HYSTERESIS);
+				continue;
+			}
+
+			float translationSlack, rotationSlack;
+			node.visible = IsVisible(node.entry, node.nodeNormals, translationSlack, rotationSlack);
+
+			if (!node.visible || (node.entry.size < (1.0f - INCREMENTAL_TRAVERSAL_HYSTERESIS) * splatSizeFactor * Vector3::Distance(octreeConstantBufferData.localCameraPosition, node.entry.position)))
+			{
+				// Replace the subtree below the node with the node, it is not refined again in the same update
+				octreeCut.FreeChildren<T>(nodeIndex, freeStack);
+				node.refined = false;
+
+				if (node.visible)
+				{
+					if (outTouchedIndices != NULL)
+					{
+						outTouchedIndices->push_back(node.entry.index);
+					}
+
+					T vertex;
+					GetNodeVertex(node.entry, node.nodeTopology, vertex);
+					octreeCut.AddVertex(nodeIndex, vertex);
+				}
+
+				octreeCut.Schedule(nodeIndex, min(translationSlack, GetSplatSizeSlack(node.entry, 1.0f + INCREMENTAL_TRAVERSAL_HYSTERESIS)), rotationSlack);
+			}
+			else
+			{
+				octreeCut.Schedule(nodeIndex, min(translationSlack, GetSplatSizeSlack(node.entry, 1.0f - INCREMENTAL_TRAVERSAL_HYSTERESIS)), rotationSlack);
+			}
+		}
+
+		octreeCut.CompactChecks();
+	}
+
+	// The vertices were patched in place, only this copy for the caller touches all of them
+	octreeVertices = cutVertices;
+
+	return traversedNodesCount;
+}
+
+void PointCloudEngine::Octree::GetNodeVertex(const OctreeNodeTraversalEntry &entry, const OctreeNodeTopology &nodeTopology, OctreeNodeVertex &outVertex) const
+{
+	// Only the drawn nodes gather their normals and shading
+	outVertex.position = GetNodePosition(entry, nodeTopology);
+	outVertex.properties = OctreeNode(nodeTopology, GetNodeNormals(entry.index), GetNodeShading(entry.index)).properties;
+	outVertex.size = entry.size;
+}
+
+void PointCloudEngine::Octree::GetNodeVertex(const OctreeNodeTraversalEntry &entry, const OctreeNodeTopology &nodeTopology, OctreeNodeCompactVertex &outVertex) const
+{
+	// The position is stored as the cell of the node in the grid of its depth inside the root cube, the vertex shader gathers the node parts with the index
+	Vector3 cell = (entry.position - (rootPosition - (0.5f * rootSize * Vector3::One))) / entry.size;
+
+	outVertex.index = entry.index;
+	outVertex.cell[0] = (USHORT)cell.x;
+	outVertex.cell[1] = (USHORT)cell.y;
+	outVertex.cell[2] = (USHORT)cell.z;
+	outVertex.depth = entry.depth;
+}
+
+Vector3 PointCloudEngine::Octree::GetNodePosition(const OctreeNodeTraversalEntry &entry, const OctreeNodeTopology &nodeTopology) const
+{
+	// Check if this is a leaf node and therefore the position is stored more accurately in childrenStartOrLeafPositionFactors
+	if (nodeTopology.childrenMask == 0)
+	{
+		// Extract the factors from childrenStartOrLeafPositionFactors and compute the more accurate position
+		Vector3 startPosition = entry.position - (0.5f * entry.size * Vector3::One);
+
+		// Get the factors from the 32bit uint
+		float factorX = ((nodeTopology.childrenStartOrLeafPositionFactors >> 16) & 0xff) / 255.0f;
+		float factorY = ((nodeTopology.childrenStartOrLeafPositionFactors >> 8) & 0xff) / 255.0f;
+		float factorZ = (nodeTopology.childrenStartOrLeafPositionFactors & 0xff) / 255.0f;
+
+		return startPosition + entry.size * Vector3(factorX, factorY, factorZ);
+	}
+
+	return entry.position;
+}
+
+OctreeNodeTopology PointCloudEngine::Octree::GetNodeTopology(size_t index) const
+{
+	return (pageCache != NULL) ? pageCache->GetNode(index).GetTopology() : topology[index];
+}
+
+OctreeNodeNormals PointCloudEngine::Octree::GetNodeNormals(size_t index) const
+{
+	return (pageCache != NULL) ? pageCache->GetNode(index).GetNormals() : normals[index];
+}
+
+OctreeNodeShading PointCloudEngine::Octree::GetNodeShading(size_t index) const
+{
+	return (pageCache != NULL) ? pageCache->GetNode(index).GetShading() : shading[index];
+}
+
+void PointCloudEngine::Octree::WriteSubtreeBlocks(const std::wstring &filepath, size_t nodesCount, const std::function<OctreeNode(size_t index)> &getNode) const
+{
+	std::vector<UINT> order;
+	GetSubtreeBlockOrder(nodesCount, settings->octreeSubtreeBlockLevels, getNode, order);
+
+	// The children of a node keep their order and stay next to each other, only the index of the first child has to be replaced
+	std::vector<UINT> newIndices(nodesCount);
+
+	for (size_t i = 0; i < nodesCount; i++)
+	{
+		newIndices[order[i]] = (UINT)i;
+	}
+
+	OctreeFileWriter octreeFileWriter(*this, filepath, (UINT)nodesCount);
+
+	const size_t blockSize = 65536;
+	std::vector<OctreeNode> nodesBlock;
+	nodesBlock.reserve(blockSize);
+
+	for (size_t i = 0; i < nodesCount; i++)
+	{
+		OctreeNode node = getNode(order[i]);
+
+		if (!node.IsLeafNode())
+		{
+			node.childrenStartOrLeafPositionFactors = newIndices[node.childrenStartOrLeafPositionFactors];
+		}
+
+		nodesBlock.push_back(node);
+
+		if ((nodesBlock.size() == blockSize) || (i + 1 == nodesCount))
+		{
+			octreeFileWriter.Write(nodesBlock.data(), nodesBlock.size());
+			nodesBlock.clear();
+		}
+	}
+
+	octreeFileWriter.Close();
+}
+
+void PointCloudEngine::Octree::GetSubtreeBlockOrder(size_t nodesCount, UINT blockLevels, const std::function<OctreeNode(size_t index)> &getNode, std::vector<UINT> &outOrder)
+{
+	// Each block starts with the children of one node and contains the next levels of their subtrees in breadth first order
+	// The children of the nodes in the last level of a block start new blocks, these are stored depth first right after their parent block
+	// Therefore the nodes of a few levels below a node are close to it in memory, independent of the size of the octree (like a van Emde Boas layout)
+	struct SiblingRange
+	{
+		UINT start;
+		UINT count;
+	};
+
+	std::vector<SiblingRange> pendingBlocks(1, { 0, 1 });
+	std::vector<SiblingRange> childBlocks;
+	std::vector<SiblingRange> level;
+	std::vector<SiblingRange> nextLevel;
+
+	outOrder.clear();
+	outOrder.reserve(nodesCount);
+
+	while (!pendingBlocks.empty())
+	{
+		level.assign(1, pendingBlocks.back());
+		pendingBlocks.pop_back();
+		childBlocks.clear();
+
+		for (UINT depth = 0; (depth < blockLevels) && !level.empty(); depth++)
+		{
+			nextLevel.clear();
+
+			for (auto range = level.begin(); range != level.end(); range++)
+			{
+				for (UINT index = range->start; index < range->start + range->count; index++)
+				{
+					outOrder.push_back(index);
+					OctreeNode node = getNode(index);
+
+					if (!node.IsLeafNode())
+					{
+						SiblingRange children = { node.childrenStartOrLeafPositionFactors, __popcnt(node.properties.childrenMask) };
+						((depth + 1 < blockLevels) ? nextLevel : childBlocks).push_back(children);
+					}
+				}
+			}
+
+			level.swap(nextLevel);
+		}
+
+		// Continue with the first child block next
+		pendingBlocks.insert(pendingBlocks.end(), childBlocks.rbegin(), childBlocks.rend());
+	}
+}
+
+void PointCloudEngine::Octree::WriteOctreeFileHeader(std::ofstream &octreeFile, OctreeFileHeader header, UINT64 nodesChecksum) const
+{
+	header.nodesChecksum = nodesChecksum;
+	header.rootPosition = rootPosition;
+	header.rootSize = rootSize;
+
+	octreeFile.write((char*)&header, sizeof(OctreeFileHeader));
+}
+
+PointCloudEngine::OctreeFileHeader PointCloudEngine::Octree::CreateOctreeFileHeader() const
+{
+	// Zero the whole header including the padding, this way the file content only depends on the octree
+	OctreeFileHeader header;
+	ZeroMemory(&header, sizeof(OctreeFileHeader));
+
+	header.magic = OCTREE_FILE_MAGIC;
+	header.version = OCTREE_FILE_VERSION;
+	header.sourceHash = sourceHash;
+	header.maxOctreeDepth = settings->maxOctreeDepth;
+	header.octreeBuildEngine = (UINT)settings->octreeBuildEngine;
+	header.octreeBottomUpClustering = settings->octreeBottomUpClustering;
+	header.clusteringMaxIterations = settings->clusteringMaxIterations;
+	header.clusteringTolerance = settings->clusteringTolerance;
+	header.useSIMDClustering = settings->useSIMDClustering;
+	header.octreeMemoryBudget = settings->octreeMemoryBudget;
+	header.compressionBlockSize = settings->compressOctreeFile ? OCTREE_COMPRESSION_BLOCK_SIZE : 0;
+	header.subtreeBlockLevels = settings->octreeSubtreeBlockLevels;
+
+	return header;
+}
+
+bool PointCloudEngine::Octree::IsMatchingOctreeFileHeader(const OctreeFileHeader &header) const
+{
+	OctreeFileHeader expected = CreateOctreeFileHeader();
+
+	// Use the file as it is when the point cloud is not available anymore
+	bool sourceMatches = (sourceHash == 0) || (header.sourceHash == expected.sourceHash);
+
+	return (header.magic == expected.magic) && (header.version == expected.version) && sourceMatches
+		&& (header.maxOctreeDepth == expected.maxOctreeDepth)
+		&& (header.octreeBuildEngine == expected.octreeBuildEngine)
+		&& (header.octreeBottomUpClustering == expected.octreeBottomUpClustering)
+		&& (header.clusteringMaxIterations == expected.clusteringMaxIterations)
+		&& (header.clusteringTolerance == expected.clusteringTolerance)
+		&& (header.useSIMDClustering == expected.useSIMDClustering)
+		&& (header.octreeMemoryBudget == expected.octreeMemoryBudget)
+		&& ((header.compressionBlockSize > 0) == (expected.compressionBlockSize > 0))
+		&& (header.subtreeBlockLevels == expected.subtreeBlockLevels);
+}
+
+std::wstring PointCloudEngine::Octree::ReplaceOctreeFile(const std::wstring &temporaryFilepath)
+{
+	// The file is written completely before it replaces the old one, an interrupted build never leaves a truncated octree file
+	CloseOctreeFile();
+
+	// Replacing fails e.g. while another process still has the old file mapped, the built octree is kept in the temporary file then
+	if (!MoveFileEx(temporaryFilepath.c_str(), octreeFilepath.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DWORD error = GetLastError();
+		OutputDebugString((L"Could not replace octree file " + octreeFilepath + L" (error " + std::to_wstring(error) + L"), using the built octree without caching it\n").c_str());
+		return temporaryFilepath;
+	}
+
+	return octreeFilepath;
+}
+
+UINT64 PointCloudEngine::Octree::GetSourceHash(const std::wstring &pointcloudFile) const
+{
+	// Hash the size, last write time and evenly distributed samples of the file instead of the whole file, this is fast even for very large point clouds
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+
+	if (!GetFileAttributesEx(pointcloudFile.c_str(), GetFileExInfoStandard, &attributes))
+	{
+		return 0;
+	}
+
+	Hash64 hash;
+	hash.Update(&attributes.nFileSizeHigh, sizeof(DWORD));
+	hash.Update(&attributes.nFileSizeLow, sizeof(DWORD));
+	hash.Update(&attributes.ftLastWriteTime, sizeof(FILETIME));
+
+	const UINT64 fileSize = ((UINT64)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+	const UINT64 sampleSize = 65536;
+	const UINT64 sampleCount = (fileSize > sampleSize) ? 16 : 1;
+
+	std::ifstream file(pointcloudFile, std::ios::in | std::ios::binary);
+	std::vector<char> sample(sampleSize);
+
+	for (UINT64 i = 0; i < sampleCount; i++)
+	{
+		// The first and last sample include the header and the end of the file
+		UINT64 offset = (sampleCount > 1) ? (((fileSize - sampleSize) * i) / (sampleCount - 1)) : 0;
+
+		file.clear();
+		file.seekg(offset);
+		file.read(sample.data(), sampleSize);
+		hash.Update(sample.data(), (size_t)file.gcount());
+	}
+
+	return hash.Digest();
+}
+
+void PointCloudEngine::Octree::Build(std::vector<Vertex> &vertices, ThreadPool &pool, OctreeBuildEngine buildEngine)
+{
+	OctreeNodeCreationEntry rootEntry;
+	rootEntry.verticesStart = 0;
+	rootEntry.verticesCount = vertices.size();
+	rootEntry.position = rootPosition;
+	rootEntry.size = rootSize;
+	rootEntry.depth = 0;
+
+	Build(vertices, pool, buildEngine, rootEntry);
+}
+
+void PointCloudEngine::Octree::Build(std::vector<Vertex> &vertices, ThreadPool &pool, OctreeBuildEngine buildEngine, const OctreeNodeCreationEntry &rootEntry, OctreeNodeClusters *outRootClusters)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	// The morton keys only store enough bits for a limited octree depth
+	if ((buildEngine == OctreeBuildEngine::Morton) && (settings->maxOctreeDepth > MORTON_KEY_DEPTH))
+	{
+		OutputDebugString((L"Octree build: " + NAMEOF(maxOctreeDepth) + L" is larger than " + std::to_wstring(MORTON_KEY_DEPTH) + L", using the top down engine instead\n").c_str());
+		buildEngine = OctreeBuildEngine::TopDown;
+	}
+
+	if (buildEngine == OctreeBuildEngine::Morton)
+	{
+		BuildMorton(vertices, pool, rootEntry, outRootClusters);
+	}
+	else
+	{
+		BuildTopDown(vertices, pool, rootEntry, outRootClusters);
+	}
+
+	// Report the build throughput
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	std::wstringstream outputStream;
+	outputStream << L"Octree build: " << ((buildEngine == OctreeBuildEngine::Morton) ? L"morton" : L"top down") << L" engine, ";
+	outputStream << vertices.size() << L" points, " << nodes.size() << L" nodes, " << pool.GetThreadCount() << L" threads, ";
+	outputStream << seconds << L" s, " << (vertices.size() / seconds) << L" points/s" << std::endl;
+	OutputDebugString(outputStream.str().c_str());
+}
+
+void PointCloudEngine::Octree::BuildTopDown(std::vector<Vertex> &vertices, ThreadPool &pool, const OctreeNodeCreationEntry &rootEntry, OctreeNodeClusters *outRootClusters)
+{
+	// Independent subtrees are created in parallel, each node is stored in a build node that references its children
+	// All the nodes share the same vertices array and only store the range of their vertices, the array is reordered in place while splitting the nodes
+	OctreeBuildNode* root = new OctreeBuildNode();
+	root->entry = rootEntry;
+
+	// Without bottom up clustering only the root allocates its clusters and only if they are requested, all the other nodes pass NULL to their constructor
+	if ((outRootClusters != NULL) && !settings->octreeBottomUpClustering)
+	{
+		root->clusters = new OctreeNodeClusters();
+	}
+
+	pool.Enqueue([this, &pool, &vertices, root] { BuildSubtree(pool, vertices, root); });
+	pool.Wait();
+
+	// The root has no parent that deletes its clusters, they are still available after the subtree is created
+	if (outRootClusters != NULL)
+	{
+		*outRootClusters = *root->clusters;
+	}
+
+	// Store the nodes in breadth first order, the root is the first element then all the children of the root node follow and so on
+	// The children of a node are always stored right after each other, therefore only the index of the first child is needed
+	std::queue<OctreeBuildNode*> buildNodesQueue;
+	buildNodesQueue.push(root);
+	nodes.clear();
+
+	while (!buildNodesQueue.empty())
+	{
+		OctreeBuildNode* first = buildNodesQueue.front();
+		buildNodesQueue.pop();
+
+		// All the nodes that are still in the queue will be stored before the children of this node
+		if (!first->node.IsLeafNode())
+		{
+			first->node.childrenStartOrLeafPositionFactors = nodes.size() + 1 + buildNodesQueue.size();
+		}
+
+		nodes.push_back(first->node);
+
+		for (int i = 0; i < 8; i++)
+		{
+			if (first->children[i] != NULL)
+			{
+				buildNodesQueue.push(first->children[i]);
+			}
+		}
+
+		delete first;
+	}
+}
+
+void PointCloudEngine::Octree::BuildSubtree(ThreadPool &pool, std::vector<Vertex> &vertices, OctreeBuildNode *buildNode)
+{
+	// Subtrees with less vertices than this are created on the current thread, larger ones are enqueued and can be stolen by idle threads
+	const size_t parallelVertexCount = 4096;
+
+	OctreeNodeCreationEntry &entry = buildNode->entry;
+
+	if (OctreeNode::IsLeafEntry(entry))
+	{
+		if (settings->octreeBottomUpClustering)
+		{
+			// Only the leaf nodes cluster their vertices, the inner nodes are created from the clusters of their children
+			buildNode->clusters = new OctreeNodeClusters();
+			buildNode->node = OctreeNode(vertices, entry, buildNode->clusters);
+			CreateParentsFromClusters(buildNode);
+		}
+		else
+		{
+			buildNode->node = OctreeNode(vertices, entry, buildNode->clusters);
+		}
+
+		return;
+	}
+
+	if (settings->octreeBottomUpClustering)
+	{
+		buildNode->node.properties.childrenMask = 0;
+	}
+	else
+	{
+		buildNode->node = OctreeNode(vertices, entry, buildNode->clusters);
+	}
+
+	// Reorder the vertices of this node so that the vertices of each child cube are stored right after each other
+	size_t childCounts[8];
+	PartitionVertices(vertices.data() + entry.verticesStart, entry.verticesCount, entry.position, childCounts);
+
+	size_t childStart = entry.verticesStart;
+	int childrenCount = 0;
+
+	for (int i = 0; i < 8; i++)
+	{
+		if (childCounts[i] > 0)
+		{
+			OctreeBuildNode* child = new OctreeBuildNode();
+			child->entry.verticesStart = childStart;
+			child->entry.verticesCount = childCounts[i];
+			child->entry.position = OctreeNode::GetChildPosition(entry.position, entry.size, i);
+			child->entry.size = entry.size * 0.5f;
+			child->entry.depth = entry.depth + 1;
+			child->parent = buildNode;
+
+			// Add this child to the mask
+			buildNode->node.properties.childrenMask |= 1 << i;
+			buildNode->children[i] = child;
+
+			childStart += childCounts[i];
+			childrenCount++;
+		}
+	}
+
+	// All the children have to exist before the first one is created, because the last finished child creates this node when clustering bottom up
+	buildNode->pendingChildren = childrenCount;
+
+	for (int i = 0; i < 8; i++)
+	{
+		OctreeBuildNode* child = buildNode->children[i];
+
+		if (child != NULL)
+		{
+			// Children only access their own range of the vertices array, therefore they can be created in parallel
+			if (child->entry.verticesCount >= parallelVertexCount)
+			{
+				pool.Enqueue([this, &pool, &vertices, child] { BuildSubtree(pool, vertices, child); });
+			}
+			else
+			{
+				BuildSubtree(pool, vertices, child);
+			}
+		}
+	}
+}
+
+void PointCloudEngine::Octree::CreateParentsFromClusters(OctreeBuildNode *buildNode)
+{
+	// The child that finishes last creates the parent node from the clusters of all the children, then this continues with the next parent
+	OctreeBuildNode* parent = buildNode->parent;
+
+	while ((parent != NULL) && (--parent->pendingChildren == 0))
+	{
+		const OctreeNodeClusters* childrenClusters[8];
+		int childrenCount = 0;
+		byte childrenMask = parent->node.properties.childrenMask;
+
+		for (int i = 0; i < 8; i++)
+		{
+			if (parent->children[i] != NULL)
+			{
+				childrenClusters[childrenCount++] = parent->children[i]->clusters;
+			}
+		}
+
+		parent->clusters = new OctreeNodeClusters();
+		parent->node = OctreeNode(childrenClusters, childrenCount, parent->clusters);
+		parent->node.properties.childrenMask = childrenMask;
+
+		for (int i = 0; i < 8; i++)
+		{
+			if (parent->children[i] != NULL)
+			{
+				SafeDelete(parent->children[i]->clusters);
+			}
+		}
+
+		parent = parent->parent;
+	}
+}
+
+void PointCloudEngine::Octree::PartitionVertices(Vertex *vertices, size_t vertexCount, const Vector3 &parentPosition, size_t outChildCounts[8])
+{
+	// In place counting sort of the vertices by their child index (American flag sort), no additional vertex memory is needed
+	size_t heads[8];
+	size_t ends[8];
+
+	for (int i = 0; i < 8; i++)
+	{
+		outChildCounts[i] = 0;
+	}
+
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		outChildCounts[OctreeNode::GetChildIndex(vertices[i].position, parentPosition)]++;
+	}
+
+	size_t offset = 0;
+
+	for (int i = 0; i < 8; i++)
+	{
+		heads[i] = offset;
+		offset += outChildCounts[i];
+		ends[i] = offset;
+	}
+
+	// Move each vertex directly into the next free spot of its child range until every range only contains its own vertices
+	for (int i = 0; i < 8; i++)
+	{
+		while (heads[i] < ends[i])
+		{
+			Vertex vertex = vertices[heads[i]];
+			int childIndex = OctreeNode::GetChildIndex(vertex.position, parentPosition);
+
+			while (childIndex != i)
+			{
+				std::swap(vertex, vertices[heads[childIndex]++]);
+				childIndex = OctreeNode::GetChildIndex(vertex.position, parentPosition);
+			}
+
+			vertices[heads[i]++] = vertex;
+		}
+	}
+}
+
+void PointCloudEngine::Octree::BuildMorton(std::vector<Vertex> &vertices, ThreadPool &pool, const OctreeNodeCreationEntry &rootEntry, OctreeNodeClusters *outRootClusters)
+{
+	// Split the work into more chunks than threads to balance the load
+	const size_t vertexCount = vertices.size();
+	const size_t chunkCount = 4 * pool.GetThreadCount();
+
+	// Quantize the positions relative to the root cube and interleave the bits of the axes to morton keys
+	// Sorting by these keys stores the vertices of every node right after each other in the same order as the children indices
+	std::vector<UINT64> keys(vertexCount);
+	std::vector<UINT> indices(vertexCount);
+
+	pool.ParallelFor(chunkCount, [&](size_t chunk)
+	{
+		for (size_t i = (vertexCount * chunk) / chunkCount; i < (vertexCount * (chunk + 1)) / chunkCount; i++)
+		{
+			keys[i] = GetMortonKey(vertices[i].position);
+			indices[i] = (UINT)i;
+		}
+	});
+
+	SortMortonKeys(keys, indices, pool);
+
+	// Apply the sorted order to the vertices in place by following the permutation cycles
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		if (indices[i] != i)
+		{
+			Vertex first = vertices[i];
+			size_t current = i;
+
+			while (indices[current] != i)
+			{
+				size_t next = indices[current];
+				vertices[current] = vertices[next];
+				indices[current] = current;
+				current = next;
+			}
+
+			vertices[current] = first;
+			indices[current] = current;
+		}
+	}
+
+	std::vector<UINT>().swap(indices);
+
+	// Find all the nodes level by level, this directly results in the breadth first order of the nodes array
+	std::vector<std::vector<OctreeNodeCreationEntry>> levelEntries(1, std::vector<OctreeNodeCreationEntry>(1, rootEntry));
+	std::vector<std::vector<byte>> levelChildrenMasks;
+	std::vector<std::vector<UINT>> levelChildrenStarts;
+	std::vector<size_t> levelStarts(1, 0);
+
+	while (!levelEntries.back().empty())
+	{
+		const std::vector<OctreeNodeCreationEntry> &entries = levelEntries.back();
+		size_t nextLevelStart = levelStarts.back() + entries.size();
+
+		std::vector<OctreeNodeCreationEntry> nextLevelEntries;
+		std::vector<byte> childrenMasks(entries.size(), 0);
+		std::vector<UINT> childrenStarts(entries.size(), 0);
+
+		// Find the children of each node from the key digit at this depth, the keys in the range of a node are sorted and share all the previous digits
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			const OctreeNodeCreationEntry &entry = entries[i];
+
+			if (!OctreeNode::IsLeafEntry(entry))
+			{
+				const int shift = 3 * (MORTON_KEY_DEPTH - 1 - entry.depth);
+				auto childBegin = keys.begin() + entry.verticesStart;
+				auto nodeEnd = childBegin + entry.verticesCount;
+
+				childrenStarts[i] = nextLevelStart + nextLevelEntries.size();
+
+				while (childBegin != nodeEnd)
+				{
+					int childIndex = (*childBegin >> shift) & 0x7;
+					auto childEnd = std::partition_point(childBegin, nodeEnd, [&](UINT64 key) { return ((key >> shift) & 0x7) <= childIndex; });
+
+					OctreeNodeCreationEntry childEntry;
+					childEntry.verticesStart = childBegin - keys.begin();
+					childEntry.verticesCount = childEnd - childBegin;
+					childEntry.position = OctreeNode::GetChildPosition(entry.position, entry.size, childIndex);
+					childEntry.size = entry.size * 0.5f;
+					childEntry.depth = entry.depth + 1;
+
+					childrenMasks[i] |= 1 << childIndex;
+					nextLevelEntries.push_back(childEntry);
+					childBegin = childEnd;
+				}
+			}
+		}
+
+		levelChildrenMasks.push_back(childrenMasks);
+		levelChildrenStarts.push_back(childrenStarts);
+		levelStarts.push_back(nextLevelStart);
+		levelEntries.push_back(nextLevelEntries);
+	}
+
+	std::vector<UINT64>().swap(keys);
+
+	// The node properties of a level are independent from each other and can be computed in parallel
+	// Start with the deepest level because bottom up clustering creates the nodes from the clusters of their children
+	nodes.clear();
+	nodes.resize(levelStarts.back());
+	std::vector<OctreeNodeClusters> levelClusters;
+	std::vector<OctreeNodeClusters> childLevelClusters;
+
+	for (int level = (int)levelChildrenMasks.size() - 1; level >= 0; level--)
+	{
+		const std::vector<OctreeNodeCreationEntry> &entries = levelEntries[level];
+		const std::vector<byte> &childrenMasks = levelChildrenMasks[level];
+		const std::vector<UINT> &childrenStarts = levelChildrenStarts[level];
+		const size_t levelStart = levelStarts[level];
+		const size_t nextLevelStart = levelStarts[level + 1];
+
+		levelClusters.resize(settings->octreeBottomUpClustering ? entries.size() : 0);
+
+		pool.ParallelFor(chunkCount, [&](size_t chunk)
+		{
+			for (size_t i = (entries.size() * chunk) / chunkCount; i < (entries.size() * (chunk + 1)) / chunkCount; i++)
+			{
+				OctreeNode &node = nodes[levelStart + i];
+
+				if (!settings->octreeBottomUpClustering)
+				{
+					// The first level only contains the root node
+					node = OctreeNode(vertices, entries[i], (level == 0) ? outRootClusters : NULL);
+				}
+				else if (childrenMasks[i] == 0)
+				{
+					node = OctreeNode(vertices, entries[i], &levelClusters[i]);
+				}
+				else
+				{
+					// The children of this node are stored right after each other in the next level
+					const OctreeNodeClusters* childrenClusters[8];
+					int childrenCount = 0;
+
+					for (int j = 0; j < 8; j++)
+					{
+						if (childrenMasks[i] & (1 << j))
+						{
+							childrenClusters[childrenCount] = &childLevelClusters[childrenStarts[i] - nextLevelStart + childrenCount];
+							childrenCount++;
+						}
+					}
+
+					node = OctreeNode(childrenClusters, childrenCount, &levelClusters[i]);
+				}
+
+				if (childrenMasks[i] != 0)
+				{
+					node.properties.childrenMask = childrenMasks[i];
+					node.childrenStartOrLeafPositionFactors = childrenStarts[i];
+				}
+			}
+		});
+
+		// Only the clusters of this and the next level are needed at the same time
+		childLevelClusters.swap(levelClusters);
+		std::vector<OctreeNodeCreationEntry>().swap(levelEntries[level + 1]);
+	}
+
+	if ((outRootClusters != NULL) && settings->octreeBottomUpClustering)
+	{
+		*outRootClusters = childLevelClusters[0];
+	}
+}
+
+UINT64 PointCloudEngine::Octree::GetMortonKey(const Vector3 &position) const
+{
+	// Quantize each axis to MORTON_KEY_DEPTH bits in the root cube
+	// The bits are inverted because a set bit in the child index represents the negative side of the parent position
+	// Rounding up and subtracting one puts points exactly on a cell border into the lower cell, this is the same tie-break as OctreeNode::GetChildIndex
+	const UINT maxValue = (1 << MORTON_KEY_DEPTH) - 1;
+	Vector3 factors = (position - (rootPosition - (0.5f * rootSize * Vector3::One))) / rootSize;
+
+	auto quantize = [maxValue](float factor)
+	{
+		return maxValue - (UINT)min((float)maxValue, max(0.0f, ceil(factor * (maxValue + 1)) - 1.0f));
+	};
+
+	UINT x = quantize(factors.x);
+	UINT y = quantize(factors.y);
+	UINT z = quantize(factors.z);
+
+	// Each 3 bit digit from the highest to the lowest one is the child index at the next depth
+	UINT64 key = 0;
+
+	for (int bit = MORTON_KEY_DEPTH - 1; bit >= 0; bit--)
+	{
+		key = (key << 3) | (((x >> bit) & 0x1) << 2) | (((y >> bit) & 0x1) << 1) | ((z >> bit) & 0x1);
+	}
+
+	return key;
+}
+
+void PointCloudEngine::Octree::SortMortonKeys(std::vector<UINT64> &keys, std::vector<UINT> &indices, ThreadPool &pool)
+{
+	// Parallel least significant digit radix sort with 8 bits per pass, each chunk has its own histogram and scatters its keys to its own offsets
+	const size_t keyCount = keys.size();
+	const size_t chunkCount = 4 * pool.GetThreadCount();
+
+	std::vector<UINT64> sortedKeys(keyCount);
+	std::vector<UINT> sortedIndices(keyCount);
+	std::vector<size_t> offsets(chunkCount * 256);
+
+	for (int shift = 0; shift < 3 * MORTON_KEY_DEPTH; shift += 8)
+	{
+		std::fill(offsets.begin(), offsets.end(), 0);
+
+		pool.ParallelFor(chunkCount, [&](size_t chunk)
+		{
+			size_t* histogram = offsets.data() + chunk * 256;
+
+			for (size_t i = (keyCount * chunk) / chunkCount; i < (keyCount * (chunk + 1)) / chunkCount; i++)
+			{
+				histogram[(keys[i] >> shift) & 0xff]++;
+			}
+		});
+
+		// Convert the histograms to the start offsets of each digit and chunk, skip the pass if all the keys have the same digit
+		size_t offset = 0;
+		bool skipPass = false;
+
+		for (int digit = 0; digit < 256; digit++)
+		{
+			size_t digitCount = 0;
+
+			for (size_t chunk = 0; chunk < chunkCount; chunk++)
+			{
+				size_t count = offsets[chunk * 256 + digit];
+				offsets[chunk * 256 + digit] = offset;
+				offset += count;
+				digitCount += count;
+			}
+
+			skipPass |= (digitCount == keyCount);
+		}
+
+		if (skipPass)
+		{
+			continue;
+		}
+
+		pool.ParallelFor(chunkCount, [&](size_t chunk)
+		{
+			size_t* chunkOffsets = offsets.data() + chunk * 256;
+
+			for (size_t i = (keyCount * chunk) / chunkCount; i < (keyCount * (chunk + 1)) / chunkCount; i++)
+			{
+				size_t destination = chunkOffsets[(keys[i] >> shift) & 0xff]++;
+				sortedKeys[destination] = keys[i];
+				sortedIndices[destination] = indices[i];
+			}
+		});
+
+		keys.swap(sortedKeys);
+		indices.swap(sortedIndices);
+	}
+}
+
+bool PointCloudEngine::Octree::BuildOutOfCore(const std::wstring &pointcloudFile, std::wstring &outOctreeFilepath)
+{
+	// Only read the header of the point cloud first to decide if it fits into the memory budget
+	UINT vertexCount = 0;
+
+	if (!ReadPointcloudFile(pointcloudFile, rootPosition, rootSize, vertexCount, nullptr))
+	{
+		throw std::exception("Could not load .pointcloud file!");
+	}
+
+	const size_t maxChunkVertexCount = max(1, ((size_t)settings->octreeMemoryBudget * 1024 * 1024) / OUT_OF_CORE_BYTES_PER_VERTEX);
+	const int maxChunkDepth = min(settings->maxOctreeDepth, MORTON_KEY_DEPTH);
+
+	if ((vertexCount <= maxChunkVertexCount) || (maxChunkDepth < 1))
+	{
+		return false;
+	}
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	// Use enough chunks for an even distribution to fit into the budget, limit the amount of files that are written at the same time
+	// Half of the budget is used for the write buffers of the chunk files, only use as many chunks as there can be buffers with a reasonable write size
+	// Chunks that are still too large are split further while building them
+	const int maxInitialChunkDepth = 4;
+	const size_t minBufferSize = 1024;
+	const size_t buffersBudget = maxChunkVertexCount * OUT_OF_CORE_BYTES_PER_VERTEX / 2;
+	int chunkDepth = 1;
+
+	while ((chunkDepth < min(maxChunkDepth, maxInitialChunkDepth)) && ((maxChunkVertexCount << (3 * chunkDepth)) < vertexCount) && (((minBufferSize * sizeof(Vertex)) << (3 * (chunkDepth + 1))) <= buffersBudget))
+	{
+		chunkDepth++;
+	}
+
+	const size_t chunkCount = (size_t)1 << (3 * chunkDepth);
+	const size_t bufferSize = max(1, buffersBudget / (sizeof(Vertex) * chunkCount));
+
+	CreateDirectory((executableDirectory + L"/Octrees").c_str(), NULL);
+
+	std::vector<size_t> chunkCounts(chunkCount, 0);
+
+	{
+		std::vector<std::vector<Vertex>> buffers(chunkCount);
+		Vector3 position;
+		float size;
+
+		ReadPointcloudFile(pointcloudFile, position, size, vertexCount, [&](const std::vector<Vertex> &vertexBlock)
+		{
+			DistributeToChunks(vertexBlock, chunkDepth, 0, bufferSize, buffers, chunkCounts);
+		});
+
+		DistributeToChunks(std::vector<Vertex>(), chunkDepth, 0, 0, buffers, chunkCounts);
+	}
+
+	// Build the subtree of each chunk, the chunks are created in morton order and large chunks are split further
+	std::vector<OctreeChunk> chunks;
+
+	for (size_t i = 0; i < chunkCount; i++)
+	{
+		if (chunkCounts[i] > 0)
+		{
+			BuildChunk(chunkDepth, i, chunkCounts[i], maxChunkVertexCount, chunks);
+		}
+	}
+
+	// Create the nodes above the chunks from the clusters of their children, deepest level first
+	struct OctreeTopNode
+	{
+		OctreeNode node;
+		OctreeNodeClusters clusters;
+		bool isChunk = false;
+	};
+
+	std::map<std::pair<int, UINT64>, OctreeTopNode> topNodes;
+
+	for (auto it = chunks.begin(); it != chunks.end(); it++)
+	{
+		for (int depth = it->depth - 1; depth >= 0; depth--)
+		{
+			topNodes[std::make_pair(depth, it->prefix >> (3 * (it->depth - depth)))];
+		}
+	}
+
+	for (auto it = chunks.begin(); it != chunks.end(); it++)
+	{
+		OctreeTopNode &chunkRoot = topNodes[std::make_pair(it->depth, it->prefix)];
+		chunkRoot.clusters = it->clusters;
+		chunkRoot.isChunk = true;
+	}
+
+	for (auto it = topNodes.rbegin(); it != topNodes.rend(); it++)
+	{
+		if (!it->second.isChunk)
+		{
+			const OctreeNodeClusters* childrenClusters[8];
+			int childrenCount = 0;
+			byte childrenMask = 0;
+
+			for (int i = 0; i < 8; i++)
+			{
+				auto child = topNodes.find(std::make_pair(it->first.first + 1, (it->first.second << 3) | i));
+
+				if (child != topNodes.end())
+				{
+					childrenClusters[childrenCount++] = &child->second.clusters;
+					childrenMask |= 1 << i;
+				}
+			}
+
+			it->second.node = OctreeNode(childrenClusters, childrenCount, &it->second.clusters);
+			it->second.node.properties.childrenMask = childrenMask;
+		}
+	}
+
+	// Each level of the octree consists of the top nodes at that depth and one range of nodes from every chunk that reaches this level
+	// Sorting these by the first morton key inside of them results in the breadth first order of the whole octree
+	struct OctreeLevelSegment
+	{
+		UINT64 keyStart;
+		std::pair<int, UINT64> topNodeKey;
+		OctreeChunk* chunk;
+		int chunkLevel;
+		size_t nodesCount;
+	};
+
+	std::vector<std::vector<OctreeLevelSegment>> levelSegments;
+	std::map<std::pair<int, UINT64>, size_t> topNodeIndices;
+
+	auto AddSegment = [&](int level, const OctreeLevelSegment &segment)
+	{
+		if (levelSegments.size() <= (size_t)level)
+		{
+			levelSegments.resize(level + 1);
+		}
+
+		levelSegments[level].push_back(segment);
+	};
+
+	for (auto it = topNodes.begin(); it != topNodes.end(); it++)
+	{
+		if (!it->second.isChunk)
+		{
+			OctreeLevelSegment segment = { it->first.second << (3 * (MORTON_KEY_DEPTH - it->first.first)), it->first, NULL, 0, 1 };
+			AddSegment(it->first.first, segment);
+		}
+	}
+
+	for (auto it = chunks.begin(); it != chunks.end(); it++)
+	{
+		for (size_t level = 0; level + 1 < it->levelStarts.size(); level++)
+		{
+			OctreeLevelSegment segment = { it->prefix << (3 * (MORTON_KEY_DEPTH - it->depth)), std::make_pair(it->depth, it->prefix), &(*it), (int)level, it->levelStarts[level + 1] - it->levelStarts[level] };
+			AddSegment(it->depth + (int)level, segment);
+		}
+
+		it->globalLevelStarts.resize(it->levelStarts.size());
+	}
+
+	size_t nodesSize = 0;
+
+	for (auto level = levelSegments.begin(); level != levelSegments.end(); level++)
+	{
+		std::sort(level->begin(), level->end(), [](const OctreeLevelSegment &a, const OctreeLevelSegment &b) { return a.keyStart < b.keyStart; });
+
+		for (auto segment = level->begin(); segment != level->end(); segment++)
+		{
+			if (segment->chunk != NULL)
+			{
+				segment->chunk->globalLevelStarts[segment->chunkLevel] = nodesSize;
+			}
+
+			if ((segment->chunk == NULL) || (segment->chunkLevel == 0))
+			{
+				topNodeIndices[segment->topNodeKey] = nodesSize;
+			}
+
+			nodesSize += segment->nodesCount;
+		}
+	}
+
+	// Stream all the nodes level by level into a temporary file and replace the children indices with the indices in the whole octree
+	const std::wstring temporaryFilepath = octreeFilepath + L".tmp";
+	OctreeFileWriter octreeFileWriter(*this, temporaryFilepath, (UINT)nodesSize, settings->octreeSubtreeBlockLevels > 0);
+
+	const size_t blockSize = 65536;
+	std::vector<OctreeNode> nodesBlock;
+
+	for (auto level = levelSegments.begin(); level != levelSegments.end(); level++)
+	{
+		for (auto segment = level->begin(); segment != level->end(); segment++)
+		{
+			if (segment->chunk == NULL)
+			{
+				OctreeNode node = topNodes[segment->topNodeKey].node;
+
+				// The children of a top node are stored right after each other starting with the lowest child index
+				for (int i = 0; i < 8; i++)
+				{
+					if (node.properties.childrenMask & (1 << i))
+					{
+						node.childrenStartOrLeafPositionFactors = (UINT)topNodeIndices[std::make_pair(segment->topNodeKey.first + 1, (segment->topNodeKey.second << 3) | i)];
+						break;
+					}
+				}
+
+				octreeFileWriter.Write(&node, 1);
+				continue;
+			}
+
+			const OctreeChunk &chunk = *segment->chunk;
+			const size_t localLevelStart = chunk.levelStarts[segment->chunkLevel];
+			std::ifstream nodesFile(GetChunkFilepath(chunk.depth, chunk.prefix, L".nodes"), std::ios::in | std::ios::binary);
+			nodesFile.seekg(localLevelStart * sizeof(OctreeNode));
+
+			for (size_t blockStart = 0; blockStart < segment->nodesCount; blockStart += blockSize)
+			{
+				nodesBlock.resize(min(blockSize, segment->nodesCount - blockStart));
+				nodesFile.read((char*)nodesBlock.data(), nodesBlock.size() * sizeof(OctreeNode));
+
+				for (auto node = nodesBlock.begin(); node != nodesBlock.end(); node++)
+				{
+					if (!node->IsLeafNode())
+					{
+						const size_t childLevel = segment->chunkLevel + 1;
+						node->childrenStartOrLeafPositionFactors = (UINT)(chunk.globalLevelStarts[childLevel] + (node->childrenStartOrLeafPositionFactors - chunk.levelStarts[childLevel]));
+					}
+				}
+
+				octreeFileWriter.Write(nodesBlock.data(), nodesBlock.size());
+			}
+		}
+	}
+
+	octreeFileWriter.Close();
+
+	for (auto it = chunks.begin(); it != chunks.end(); it++)
+	{
+		DeleteFile(GetChunkFilepath(it->depth, it->prefix, L".nodes").c_str());
+	}
+
+	// The nodes can only be streamed in breadth first order, rewrite them in subtree blocks afterwards
+	// The uncompressed breadth first file is read with a page cache, only the new order of the nodes has to fit into memory
+	if (settings->octreeSubtreeBlockLevels > 0)
+	{
+		const std::wstring blocksFilepath = octreeFilepath + L".blocks.tmp";
+
+		{
+			OctreeFileHeader header = CreateOctreeFileHeader();
+			header.nodesSize = (UINT)nodesSize;
+			header.compressionBlockSize = 0;
+
+			OctreePageCache pageCache(temporaryFilepath, header, std::vector<OctreeFileBlock>(), (size_t)settings->octreeMemoryBudget * 1024 * 1024 / 2);
+			WriteSubtreeBlocks(blocksFilepath, nodesSize, [&](size_t index) { return pageCache.GetNode(index); });
+		}
+
+		DeleteFile(temporaryFilepath.c_str());
+		outOctreeFilepath = ReplaceOctreeFile(blocksFilepath);
+	}
+	else
+	{
+		outOctreeFilepath = ReplaceOctreeFile(temporaryFilepath);
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	std::wstringstream outputStream;
+	outputStream << L"Octree build: out of core, " << vertexCount << L" points, " << nodesSize << L" nodes, " << chunks.size() << L" chunks, ";
+	outputStream << settings->octreeMemoryBudget << L" MB budget, " << seconds << L" s, " << (vertexCount / seconds) << L" points/s" << std::endl;
+	OutputDebugString(outputStream.str().c_str());
+
+	return true;
+}
+
+void PointCloudEngine::Octree::BuildChunk(int depth, UINT64 prefix, size_t vertexCount, size_t maxChunkVertexCount, std::vector<OctreeChunk> &outChunks)
+{
+	// Split chunks that are too large into their 8 children, this is only possible until the maximum depth is reached
+	if ((vertexCount > maxChunkVertexCount) && (depth < min(settings->maxOctreeDepth, MORTON_KEY_DEPTH)))
+	{
+		std::vector<std::vector<Vertex>> buffers(8);
+		std::vector<size_t> childCounts(8, 0);
+		const size_t bufferSize = max(1, (maxChunkVertexCount * OUT_OF_CORE_BYTES_PER_VERTEX / 2) / (sizeof(Vertex) * 8));
+
+		ReadChunkVertices(depth, prefix, [&](const std::vector<Vertex> &vertexBlock)
+		{
+			DistributeToChunks(vertexBlock, depth + 1, prefix << 3, bufferSize, buffers, childCounts);
+		});
+
+		DistributeToChunks(std::vector<Vertex>(), depth + 1, prefix << 3, 0, buffers, childCounts);
+		DeleteFile(GetChunkFilepath(depth, prefix, L".vertices").c_str());
+
+		for (int i = 0; i < 8; i++)
+		{
+			if (childCounts[i] > 0)
+			{
+				BuildChunk(depth + 1, (prefix << 3) | i, childCounts[i], maxChunkVertexCount, outChunks);
+			}
+		}
+
+		return;
+	}
+
+	std::vector<Vertex> vertices;
+	vertices.reserve(vertexCount);
+
+	ReadChunkVertices(depth, prefix, [&](const std::vector<Vertex> &vertexBlock)
+	{
+		vertices.insert(vertices.end(), vertexBlock.begin(), vertexBlock.end());
+	});
+
+	DeleteFile(GetChunkFilepath(depth, prefix, L".vertices").c_str());
+
+	// The root of the chunk is the cube of the morton key prefix
+	OctreeNodeCreationEntry rootEntry;
+	rootEntry.verticesStart = 0;
+	rootEntry.verticesCount = vertices.size();
+	rootEntry.position = rootPosition;
+	rootEntry.size = rootSize;
+	rootEntry.depth = depth;
+
+	for (int i = depth - 1; i >= 0; i--)
+	{
+		rootEntry.position = OctreeNode::GetChildPosition(rootEntry.position, rootEntry.size, (prefix >> (3 * i)) & 0x7);
+		rootEntry.size *= 0.5f;
+	}
+
+	// The nodes above the chunks are created from the clusters of the chunk root
+	OctreeChunk chunk;
+	chunk.depth = depth;
+	chunk.prefix = prefix;
+
+	Build(vertices, *threadPool, settings->octreeBuildEngine, rootEntry, &chunk.clusters);
+	std::vector<Vertex>().swap(vertices);
+
+	// Find the start of each level from the children of the previous level
+	chunk.levelStarts.push_back(0);
+	chunk.levelStarts.push_back(1);
+
+	while (chunk.levelStarts.back() < nodes.size())
+	{
+		size_t childrenCount = 0;
+
+		for (size_t i = chunk.levelStarts[chunk.levelStarts.size() - 2]; i < chunk.levelStarts.back(); i++)
+		{
+			childrenCount += __popcnt(nodes[i].properties.childrenMask);
+		}
+
+		chunk.levelStarts.push_back(chunk.levelStarts.back() + childrenCount);
+	}
+
+	std::ofstream nodesFile(GetChunkFilepath(depth, prefix, L".nodes"), std::ios::out | std::ios::binary);
+	nodesFile.write((char*)nodes.data(), nodes.size() * sizeof(OctreeNode));
+	nodesFile.close();
+
+	std::vector<OctreeNode>().swap(nodes);
+	outChunks.push_back(chunk);
+}
+
+void PointCloudEngine::Octree::DistributeToChunks(const std::vector<Vertex> &vertexBlock, int depth, UINT64 firstPrefix, size_t bufferSize, std::vector<std::vector<Vertex>> &buffers, std::vector<size_t> &counts) const
+{
+	// Append each vertex to the buffer of its chunk and write the buffers to the chunk files when they are full, an empty block writes all the remaining vertices
+	// The first write of a chunk holds all of its vertices counted so far, it replaces the chunk file that an aborted build might have left behind
+	for (auto it = vertexBlock.begin(); it != vertexBlock.end(); it++)
+	{
+		size_t chunk = (size_t)((GetMortonKey(it->position) >> (3 * (MORTON_KEY_DEPTH - depth))) - firstPrefix);
+		buffers[chunk].push_back(*it);
+		counts[chunk]++;
+
+		if (buffers[chunk].size() >= bufferSize)
+		{
+			AppendChunkVertices(depth, firstPrefix + chunk, buffers[chunk], counts[chunk] == buffers[chunk].size());
+			buffers[chunk].clear();
+		}
+	}
+
+	if (vertexBlock.empty())
+	{
+		for (size_t chunk = 0; chunk < buffers.size(); chunk++)
+		{
+			if (!buffers[chunk].empty())
+			{
+				AppendChunkVertices(depth, firstPrefix + chunk, buffers[chunk], counts[chunk] == buffers[chunk].size());
+			}
+
+			std::vector<Vertex>().swap(buffers[chunk]);
+		}
+	}
+}
+
+void PointCloudEngine::Octree::AppendChunkVertices(int depth, UINT64 prefix, const std::vector<Vertex> &vertices, bool truncate) const
+{
+	// Only keep the file open while writing, there can be more chunk files than the operating system allows to be open at once
+	std::ofstream chunkFile(GetChunkFilepath(depth, prefix, L".vertices"), std::ios::out | std::ios::binary | (truncate ? std::ios::trunc : std::ios::app));
+
+	if (!chunkFile.is_open())
+	{
+		throw std::exception("Could not write octree chunk file!");
+	}
+
+	chunkFile.write((char*)vertices.data(), vertices.size() * sizeof(Vertex));
+}
+
+bool PointCloudEngine::Octree::ReadChunkVertices(int depth, UINT64 prefix, const std::function<void(const std::vector<Vertex> &vertexBlock)> &processBlock) const
+{
+	std::ifstream chunkFile(GetChunkFilepath(depth, prefix, L".vertices"), std::ios::in | std::ios::binary);
+
+	if (!chunkFile.is_open())
+	{
+		return false;
+	}
+
+	const size_t blockSize = 65536;
+	std::vector<Vertex> vertexBlock(blockSize);
+
+	while (chunkFile.read((char*)vertexBlock.data(), blockSize * sizeof(Vertex)) || (chunkFile.gcount() > 0))
+	{
+		vertexBlock.resize(chunkFile.gcount() / sizeof(Vertex));
+		processBlock(vertexBlock);
+		vertexBlock.resize(blockSize);
+	}
+
+	return true;
+}
+
+std::wstring PointCloudEngine::Octree::GetChunkFilepath(int depth, UINT64 prefix, const std::wstring &extension) const
+{
+	return octreeFilepath + L"." + std::to_wstring(depth) + L"_" + std::to_wstring(prefix) + extension;
+}
+
+PointCloudEngine::Octree::OctreeFileWriter::OctreeFileWriter(const Octree &octree, const std::wstring &filepath, UINT nodesSize, bool intermediate) : octree(octree), nodesSize(nodesSize)
+{
+	file.open(filepath, std::ios::out | std::ios::binary);
+
+	if (!file.is_open())
+	{
+		throw std::exception("Could not write .octree file!");
+	}
+
+	// Reserve the space for the header and the block table, these are written when all the nodes are known
+	header = octree.CreateOctreeFileHeader();
+	header.nodesSize = nodesSize;
+
+	if (intermediate)
+	{
+		header.compressionBlockSize = 0;
+		header.subtreeBlockLevels = 0;
+	}
+
+	compressionBlockSize = header.compressionBlockSize;
+	octree.WriteOctreeFileHeader(file, header, 0);
+
+	if (compressionBlockSize > 0)
+	{
+		blocks.resize((nodesSize + compressionBlockSize - 1) / compressionBlockSize);
+		file.write((char*)blocks.data(), blocks.size() * sizeof(OctreeFileBlock));
+		blocks.clear();
+	}
+}
+
+void PointCloudEngine::Octree::OctreeFileWriter::Write(const OctreeNode *nodes, size_t nodesCount)
+{
+	nodesChecksum.Update(nodes, nodesCount * sizeof(OctreeNode));
+
+	if (compressionBlockSize == 0)
+	{
+		// Split the nodes in blocks to limit the temporary memory
+		const size_t blockSize = 65536;
+		std::vector<OctreeNodeTopology> topology(min(blockSize, nodesCount));
+		std::vector<OctreeNodeNormals> normals(topology.size());
+		std::vector<OctreeNodeShading> shading(topology.size());
+
+		for (size_t blockStart = 0; blockStart < nodesCount; blockStart += blockSize)
+		{
+			const size_t count = min(blockSize, nodesCount - blockStart);
+			SplitNodes(nodes + blockStart, count, topology.data(), normals.data(), shading.data());
+
+			file.seekp(header.GetTopologyOffset() + writtenNodesCount * sizeof(OctreeNodeTopology));
+			file.write((char*)topology.data(), count * sizeof(OctreeNodeTopology));
+			file.seekp(header.GetNormalsOffset() + writtenNodesCount * sizeof(OctreeNodeNormals));
+			file.write((char*)normals.data(), count * sizeof(OctreeNodeNormals));
+			file.seekp(header.GetShadingOffset() + writtenNodesCount * sizeof(OctreeNodeShading));
+			file.write((char*)shading.data(), count * sizeof(OctreeNodeShading));
+
+			writtenNodesCount += count;
+		}
+
+		return;
+	}
+
+	pendingNodes.insert(pendingNodes.end(), nodes, nodes + nodesCount);
+
+	if (pendingNodes.size() >= (size_t)compressionBlockSize * threadPool->GetThreadCount())
+	{
+		CompressPendingNodes(false);
+	}
+}
+
+void PointCloudEngine::Octree::OctreeFileWriter::Close()
+{
+	if (compressionBlockSize > 0)
+	{
+		CompressPendingNodes(true);
+
+		file.seekp(sizeof(OctreeFileHeader));
+		file.write((char*)blocks.data(), blocks.size() * sizeof(OctreeFileBlock));
+	}
+
+	// The checksum is only known after all the nodes are written
+	file.seekp(0);
+	octree.WriteOctreeFileHeader(file, header, nodesChecksum.Digest());
+	file.flush();
+	file.close();
+}
+
+void PointCloudEngine::Octree::OctreeFileWriter::CompressPendingNodes(bool compressPartialBlock)
+{
+	const size_t blocksCount = compressPartialBlock ? ((pendingNodes.size() + compressionBlockSize - 1) / compressionBlockSize) : (pendingNodes.size() / compressionBlockSize);
+	std::vector<std::vector<byte>> blocksData(blocksCount);
+	std::vector<UINT> firstChildrenStarts(blocksCount);
+
+	// The children start prediction of each block depends on all the previous nodes
+	for (size_t i = 0; i < blocksCount; i++)
+	{
+		firstChildrenStarts[i] = nextChildrenStart;
+
+		for (size_t j = i * compressionBlockSize; j < min((i + 1) * compressionBlockSize, pendingNodes.size()); j++)
+		{
+			nextChildrenStart += __popcnt(pendingNodes[j].properties.childrenMask);
+		}
+	}
+
+	threadPool->ParallelFor(blocksCount, [&](size_t i)
+	{
+		size_t nodesStart = i * compressionBlockSize;
+		OctreeCompression::CompressBlock(pendingNodes.data() + nodesStart, min((size_t)compressionBlockSize, pendingNodes.size() - nodesStart), firstChildrenStarts[i], blocksData[i]);
+	});
+
+	for (size_t i = 0; i < blocksCount; i++)
+	{
+		OctreeFileBlock block;
+		block.offset = (UINT64)file.tellp();
+		block.size = blocksData[i].size();
+		block.firstChildrenStart = firstChildrenStarts[i];
+		blocks.push_back(block);
+
+		file.write((char*)blocksData[i].data(), blocksData[i].size());
+	}
+
+	pendingNodes.erase(pendingNodes.begin(), pendingNodes.begin() + min(pendingNodes.size(), blocksCount * compressionBlockSize));
 }
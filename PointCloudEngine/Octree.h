@@ -2,6 +2,30 @@
 #define OCTREE_H
 
 #pragma once
+
+// Bits per axis in the morton keys (3 * 16 = 48 bit keys), this is also the maximum depth of the morton build engine
+#define MORTON_KEY_DEPTH 16
+
+// Identifies .octree files ("PCEO") and their format, increase the version when the nodes or the header change
+#define OCTREE_FILE_MAGIC 0x4F454350
+#define OCTREE_FILE_VERSION 5
+
+// Estimated peak memory per vertex of a chunk in the out of core build (vertices, keys, build nodes, clusters and nodes)
+#define OUT_OF_CORE_BYTES_PER_VERTEX 256
+
+// Minimum amount of traversal entries per task in the parallel CPU traversal, smaller levels are processed by the calling thread
+#define TRAVERSAL_CHUNK_SIZE 4096
+
+// Granularity of the memory that is counted as touched in the traversal statistics
+#define TRAVERSAL_CACHE_LINE_SIZE 64
+#define TRAVERSAL_PAGE_SIZE 4096
+
+// Relative margin around the required splat size in which the incremental traversal keeps the previous refinement of a node
+#define INCREMENTAL_TRAVERSAL_HYSTERESIS 0.1f
+
+// Deepest level whose node cells fit into the 16 bit cell coordinates of the compact vertices
+#define COMPACT_VERTEX_MAX_DEPTH 16
+
 #include "PointCloudEngine.h"
 
 namespace PointCloudEngine
@@ -10,19 +34,138 @@ namespace PointCloudEngine
     {
     public:
         Octree(const std::wstring &pointcloudFile);
+		~Octree();
 
-        std::vector<OctreeNodeVertex> GetVertices(const OctreeConstantBuffer &octreeConstantBufferData) const;
+        std::vector<OctreeNodeVertex> GetVertices(const OctreeConstantBuffer &octreeConstantBufferData, OctreeTraversalStatistics *outStatistics = NULL) const;
+
+		// Same traversal that only returns the index and the cell of each node, the position and size are reconstructed from the cell and the depth in the vertex shader
+		std::vector<OctreeNodeCompactVertex> GetCompactVertices(const OctreeConstantBuffer &octreeConstantBufferData, OctreeTraversalStatistics *outStatistics = NULL) const;
         bool LoadFromOctreeFile();
-        void SaveToOctreeFile();
+        bool SaveToOctreeFile();
+
+		// All the nodes of the octree split into the topology, normals and shading arrays, these are either directly mapped from the octree file or copied when the file is compressed
+		// Paged octrees only keep some of the nodes in memory, then there are no arrays of all the nodes and each node has to be accessed with its index
+		const OctreeNodeTopology* GetTopology() const;
+		const OctreeNodeNormals* GetNormals() const;
+		const OctreeNodeShading* GetShading() const;
+		size_t GetNodesCount() const;
+		OctreeNode GetNode(size_t index) const;
+		bool IsPaged() const;
 
-        // Stores the hole octree, the root is the first element then all the children of the root node follow and so on
+        // Stores the hole octree while building it, the root is the first element then all the children of the root node follow and so on
         std::vector<OctreeNode> nodes;
 		Vector3 rootPosition;
 		float rootSize = 0;
 
 	private:
+		// Node that is created by the parallel build before all the nodes are stored in breadth first order
+		struct OctreeBuildNode;
+
+		// Subtree of the out of core build whose nodes are stored in a temporary file until all the chunks are stitched together
+		struct OctreeChunk;
+
+		// Streams the nodes into an octree file and compresses them block by block when enabled
+		struct OctreeFileWriter;
+
+		// Cut of the previous incremental traversal, it is updated instead of traversing the octree from the root again
+		struct OctreeCut;
+
 		std::wstring octreeFilepath;
+		UINT64 sourceHash = 0;
+
+		// Read only memory mapping of the octree file, the operating system only loads the pages that are accessed and shares them between processes
+		HANDLE octreeFileHandle = INVALID_HANDLE_VALUE;
+		HANDLE octreeFileMapping = NULL;
+		const byte* octreeFileView = NULL;
+
+		// Split arrays of all the nodes that are used by the traversal, these point into the file view or to the loaded vectors
+		const OctreeNodeTopology* topology = NULL;
+		const OctreeNodeNormals* normals = NULL;
+		const OctreeNodeShading* shading = NULL;
+		size_t nodesCount = 0;
+		std::vector<OctreeNodeTopology> loadedTopology;
+		std::vector<OctreeNodeNormals> loadedNormals;
+		std::vector<OctreeNodeShading> loadedShading;
+
+		// Only used when paging is enabled, then the nodes are loaded on demand instead of mapping the file
+		OctreePageCache* pageCache = NULL;
+
+		// Kept between the frames of the incremental traversal, it is cleared whenever the nodes change
+		// The const traversal updates it, so the traversal of one octree must not be called from multiple threads at once
+		mutable OctreeCut* cut = NULL;
+
+		// First node of each depth in the breadth first order (one more entry for the end) and the cell of each node, empty when the nodes are paged or stored in subtree blocks
+		std::vector<UINT> levelStarts;
+		std::vector<OctreeNodeCell> nodeCells;
+
+		bool LoadFromOctreeFile(const std::wstring &filepath);
+		void CloseOctreeFile();
+		void UnmapOctreeFile();
+		bool DecompressOctreeFile(const OctreeFileHeader &header, size_t fileSize);
+		void LoadNodes(size_t count);
+		static void SplitNodes(const OctreeNode *nodes, size_t nodesCount, OctreeNodeTopology *outTopology, OctreeNodeNormals *outNormals, OctreeNodeShading *outShading);
+		void CreateLevelIndex();
+
+		// The traversals are shared by both vertex formats
+		template <typename T> std::vector<T> TraverseVertices(const OctreeConstantBuffer &octreeConstantBufferData, OctreeTraversalStatistics *outStatistics) const;
+
+		// Checks one node of the traversal, only the parts of the node that are needed are read
+		template <typename T> void GetNodeVertices(std::vector<OctreeNodeTraversalEntry> &nextEntries, std::vector<T> &octreeVertices, const OctreeNodeTraversalEntry &entry, const OctreeConstantBuffer &octreeConstantBufferData, OctreeCulling &culling) const;
+		void GetChildEntries(std::vector<OctreeNodeTraversalEntry> &outEntries, const OctreeNodeTraversalEntry &entry, const OctreeNodeTopology &nodeTopology, const OctreeConstantBuffer &octreeConstantBufferData, OctreeCulling &culling) const;
+
+		// Refines the nodes with the largest projected size first until the point budget is reached, returns the amount of traversed nodes
+		template <typename T> UINT GetBudgetedVertices(std::vector<T> &octreeVertices, const std::vector<OctreeNodeTraversalEntry> &rootEntries, const OctreeConstantBuffer &octreeConstantBufferData, OctreeCulling &culling, std::vector<UINT> *outTouchedIndices) const;
+
+		// Only checks the nodes of the requested level with the level index, returns the amount of checked nodes
+		template <typename T> UINT GetLevelVertices(std::vector<T> &octreeVertices, const OctreeConstantBuffer &octreeConstantBufferData, OctreeCulling &culling, std::vector<UINT> *outTouchedIndices) const;
+
+		// Only checks the nodes of the previous cut that are close to a threshold after the camera movement and patches the vertices of the last update, returns the amount of checked nodes
+		template <typename T> UINT GetIncrementalVertices(std::vector<T> &octreeVertices, const OctreeConstantBuffer &octreeConstantBufferData, OctreeCulling &culling, std::vector<UINT> *outTouchedIndices) const;
+
+		// Traverses the nodes front to back and rejects the ones behind the already drawn nodes, returns the amount of traversed nodes
+		template <typename T> UINT GetOcclusionCulledVertices(std::vector<T> &octreeVertices, const std::vector<OctreeNodeTraversalEntry> &rootEntries, const OctreeConstantBuffer &octreeConstantBufferData, OctreeCulling &culling, OctreeOcclusion &occlusion, std::vector<UINT> *outTouchedIndices) const;
+		void GetNodeVertex(const OctreeNodeTraversalEntry &entry, const OctreeNodeTopology &nodeTopology, OctreeNodeVertex &outVertex) const;
+		void GetNodeVertex(const OctreeNodeTraversalEntry &entry, const OctreeNodeTopology &nodeTopology, OctreeNodeCompactVertex &outVertex) const;
+		Vector3 GetNodePosition(const OctreeNodeTraversalEntry &entry, const OctreeNodeTopology &nodeTopology) const;
+		OctreeNodeTopology GetNodeTopology(size_t index) const;
+		OctreeNodeNormals GetNodeNormals(size_t index) const;
+		OctreeNodeShading GetNodeShading(size_t index) const;
+
+		// Writes the nodes in subtree blocks instead of breadth first order, the nodes of a few levels below a node are stored close to it
+		void WriteSubtreeBlocks(const std::wstring &filepath, size_t nodesCount, const std::function<OctreeNode(size_t index)> &getNode) const;
+		static void GetSubtreeBlockOrder(size_t nodesCount, UINT blockLevels, const std::function<OctreeNode(size_t index)> &getNode, std::vector<UINT> &outOrder);
+
+		void WriteOctreeFileHeader(std::ofstream &octreeFile, OctreeFileHeader header, UINT64 nodesChecksum) const;
+		OctreeFileHeader CreateOctreeFileHeader() const;
+		bool IsMatchingOctreeFileHeader(const OctreeFileHeader &header) const;
+		// Returns the file that holds the octree afterwards, this is the temporary file when the old file could not be replaced
+		std::wstring ReplaceOctreeFile(const std::wstring &temporaryFilepath);
+		UINT64 GetSourceHash(const std::wstring &pointcloudFile) const;
+
+		void Build(std::vector<Vertex> &vertices, ThreadPool &pool, OctreeBuildEngine buildEngine);
+		// The clusters of the root node are only kept when outRootClusters is not NULL, the out of core build creates the nodes above the chunks from them
+		void Build(std::vector<Vertex> &vertices, ThreadPool &pool, OctreeBuildEngine buildEngine, const OctreeNodeCreationEntry &rootEntry, OctreeNodeClusters *outRootClusters = NULL);
+
+		// Top down engine that recursively splits the nodes and creates the subtrees in parallel
+		void BuildTopDown(std::vector<Vertex> &vertices, ThreadPool &pool, const OctreeNodeCreationEntry &rootEntry, OctreeNodeClusters *outRootClusters);
+		void BuildSubtree(ThreadPool &pool, std::vector<Vertex> &vertices, OctreeBuildNode *buildNode);
+		void CreateParentsFromClusters(OctreeBuildNode *buildNode);
+		static void PartitionVertices(Vertex *vertices, size_t vertexCount, const Vector3 &parentPosition, size_t outChildCounts[8]);
+
+		// Morton engine that sorts the vertices by their morton keys and creates the nodes level by level from the key digits
+		void BuildMorton(std::vector<Vertex> &vertices, ThreadPool &pool, const OctreeNodeCreationEntry &rootEntry, OctreeNodeClusters *outRootClusters);
+		UINT64 GetMortonKey(const Vector3 &position) const;
+		static void SortMortonKeys(std::vector<UINT64> &keys, std::vector<UINT> &indices, ThreadPool &pool);
+
+		// Out of core build that distributes the vertices to chunk files by their morton key prefix and creates the subtree of each chunk separately
+		// Only the upper levels above the chunks are created from the clusters of the chunks, the nodes are streamed into the octree file
+		bool BuildOutOfCore(const std::wstring &pointcloudFile, std::wstring &outOctreeFilepath);
+		void BuildChunk(int depth, UINT64 prefix, size_t vertexCount, size_t maxChunkVertexCount, std::vector<OctreeChunk> &outChunks);
+		void DistributeToChunks(const std::vector<Vertex> &vertexBlock, int depth, UINT64 firstPrefix, size_t bufferSize, std::vector<std::vector<Vertex>> &buffers, std::vector<size_t> &counts) const;
+		void AppendChunkVertices(int depth, UINT64 prefix, const std::vector<Vertex> &vertices, bool truncate) const;
+		bool ReadChunkVertices(int depth, UINT64 prefix, const std::function<void(const std::vector<Vertex> &vertexBlock)> &processBlock) const;
+		std::wstring GetChunkFilepath(int depth, UINT64 prefix, const std::wstring &extension) const;
     };
 }
 
-#endif
\ No newline at end of file
+#endif
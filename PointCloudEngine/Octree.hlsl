@@ -31,7 +31,7 @@ struct OctreeNodeTraversalEntry
 	uint index;
 	float3 position;
 	float size;
-	bool parentInsideViewFrustum;
+	uint viewFrustumPlaneMask;
 	int depth;
 };
 
@@ -51,10 +51,30 @@ struct OctreeNodeVertex
 	float size;
 };
 
-struct OctreeNode
+struct OctreeNodeCompactVertex
+{
+	uint index;
+	uint cellXY;							// 2 byte cell x, 2 byte cell y
+	uint cellZAndDepth;						// 2 byte cell z, 2 byte depth
+};
+
+struct OctreeNodeTopology
 {
 	uint childrenStartOrLeafPositionFactors;
-    OctreeNodeProperties properties;
+	uint childrenMask;						// 1 byte childrenMask, 3 bytes padding
+};
+
+struct OctreeNodeNormals
+{
+	uint normal01;							// 2 byte normal0, 2 byte normal1
+	uint normal23;							// 2 byte normal2, 2 byte normal3
+};
+
+struct OctreeNodeShading
+{
+	uint weights;							// 1 byte weight0, 1 byte weight1, 1 byte weight2, 1 byte padding
+	uint color01;							// 2 byte color0, 2 byte color1
+	uint color23;							// 2 byte color2, 2 byte color3
 };
 
 float4 ClusterNormalToFloat4(uint thetaPhiCone)
@@ -0,0 +1,300 @@
+#include "OctreeCompression.h"
+
+// The symbol frequencies of each stream are scaled to sum up to 2^12, the coder state is kept in [2^23, 2^31) and written byte by byte
+#define RANS_PROBABILITY_BITS 12
+#define RANS_PROBABILITY_SCALE (1 << RANS_PROBABILITY_BITS)
+#define RANS_LOWER_BOUND (1u << 23)
+
+void PointCloudEngine::OctreeCompression::CompressBlock(const OctreeNode *nodes, size_t nodesCount, UINT firstChildrenStart, std::vector<byte> &outData)
+{
+	const size_t nodeSize = sizeof(OctreeNode);
+	std::vector<byte> streams(nodeSize * nodesCount);
+	UINT nextChildrenStart = firstChildrenStart;
+
+	for (size_t i = 0; i < nodesCount; i++)
+	{
+		OctreeNode node = nodes[i];
+
+		// In breadth first order the children of each inner node start right after the children of all the previous nodes
+		if (!node.IsLeafNode())
+		{
+			node.childrenStartOrLeafPositionFactors -= nextChildrenStart;
+			nextChildrenStart += __popcnt(node.properties.childrenMask);
+		}
+
+		const byte* nodeBytes = (const byte*)&node;
+
+		for (size_t j = 0; j < nodeSize; j++)
+		{
+			streams[j * nodesCount + i] = nodeBytes[j];
+		}
+	}
+
+	outData.clear();
+	std::vector<byte> deltas(nodesCount);
+
+	for (size_t j = 0; j < nodeSize; j++)
+	{
+		const byte* stream = streams.data() + j * nodesCount;
+		UINT counts[256] = { 0 };
+		UINT deltaCounts[256] = { 0 };
+
+		for (size_t i = 0; i < nodesCount; i++)
+		{
+			deltas[i] = stream[i] - ((i > 0) ? stream[i - 1] : 0);
+			counts[stream[i]]++;
+			deltaCounts[deltas[i]]++;
+		}
+
+		// Use the delta coded bytes only when they have a lower entropy
+		StreamMode mode = (GetEntropy(deltaCounts, nodesCount) < GetEntropy(counts, nodesCount)) ? StreamMode::DeltaEntropy : StreamMode::Entropy;
+		const size_t streamStart = outData.size();
+
+		outData.push_back((byte)mode);
+		EncodeStream((mode == StreamMode::DeltaEntropy) ? deltas.data() : stream, nodesCount, outData);
+
+		// Store incompressible streams (e.g. the leaf position factors of sparse octrees) without entropy coding
+		if (outData.size() - streamStart > nodesCount + 1)
+		{
+			outData.resize(streamStart);
+			outData.push_back((byte)StreamMode::Raw);
+			outData.insert(outData.end(), stream, stream + nodesCount);
+		}
+	}
+}
+
+bool PointCloudEngine::OctreeCompression::DecompressBlock(const byte *data, size_t dataSize, size_t nodesCount, UINT firstChildrenStart, OctreeNode *outNodes)
+{
+	const size_t nodeSize = sizeof(OctreeNode);
+	const byte* end = data + dataSize;
+	std::vector<byte> streams(nodeSize * nodesCount);
+
+	for (size_t j = 0; j < nodeSize; j++)
+	{
+		byte* stream = streams.data() + j * nodesCount;
+
+		if (data >= end)
+		{
+			return false;
+		}
+
+		StreamMode mode = (StreamMode)*data++;
+
+		if (mode == StreamMode::Raw)
+		{
+			if ((size_t)(end - data) < nodesCount)
+			{
+				return false;
+			}
+
+			memcpy(stream, data, nodesCount);
+			data += nodesCount;
+		}
+		else if (!DecodeStream(data, end, nodesCount, stream))
+		{
+			return false;
+		}
+
+		if (mode == StreamMode::DeltaEntropy)
+		{
+			for (size_t i = 1; i < nodesCount; i++)
+			{
+				stream[i] += stream[i - 1];
+			}
+		}
+	}
+
+	// Interleave the streams back into nodes and add the predicted children start indices again
+	UINT nextChildrenStart = firstChildrenStart;
+
+	for (size_t i = 0; i < nodesCount; i++)
+	{
+		OctreeNode &node = outNodes[i];
+		byte* nodeBytes = (byte*)&node;
+
+		for (size_t j = 0; j < nodeSize; j++)
+		{
+			nodeBytes[j] = streams[j * nodesCount + i];
+		}
+
+		if (!node.IsLeafNode())
+		{
+			node.childrenStartOrLeafPositionFactors += nextChildrenStart;
+			nextChildrenStart += __popcnt(node.properties.childrenMask);
+		}
+	}
+
+	return true;
+}
+
+void PointCloudEngine::OctreeCompression::EncodeStream(const byte *symbols, size_t symbolsCount, std::vector<byte> &outData)
+{
+	UINT counts[256] = { 0 };
+	USHORT frequencies[256];
+	UINT cumulativeFrequencies[256];
+
+	for (size_t i = 0; i < symbolsCount; i++)
+	{
+		counts[symbols[i]]++;
+	}
+
+	NormalizeFrequencies(counts, symbolsCount, frequencies);
+
+	for (int s = 0, cumulative = 0; s < 256; s++)
+	{
+		cumulativeFrequencies[s] = cumulative;
+		cumulative += frequencies[s];
+	}
+
+	// The symbols are encoded in reverse order, this way the decoder outputs them in the original order
+	std::vector<byte> payload;
+	payload.reserve(symbolsCount + 4);
+	UINT state = RANS_LOWER_BOUND;
+
+	for (size_t i = symbolsCount; i-- > 0;)
+	{
+		const UINT frequency = frequencies[symbols[i]];
+		const UINT maxState = ((RANS_LOWER_BOUND >> RANS_PROBABILITY_BITS) << 8) * frequency;
+
+		while (state >= maxState)
+		{
+			payload.push_back(state & 0xff);
+			state >>= 8;
+		}
+
+		state = ((state / frequency) << RANS_PROBABILITY_BITS) + (state % frequency) + cumulativeFrequencies[symbols[i]];
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+		payload.push_back(state & 0xff);
+		state >>= 8;
+	}
+
+	std::reverse(payload.begin(), payload.end());
+
+	// Store the frequency table, the payload size and then the payload
+	UINT payloadSize = payload.size();
+	outData.insert(outData.end(), (const byte*)frequencies, (const byte*)frequencies + sizeof(frequencies));
+	outData.insert(outData.end(), (const byte*)&payloadSize, (const byte*)&payloadSize + sizeof(UINT));
+	outData.insert(outData.end(), payload.begin(), payload.end());
+}
+
+bool PointCloudEngine::OctreeCompression::DecodeStream(const byte *&data, const byte *end, size_t symbolsCount, byte *outSymbols)
+{
+	USHORT frequencies[256];
+	UINT cumulativeFrequencies[256];
+	UINT payloadSize;
+
+	if ((size_t)(end - data) < sizeof(frequencies) + sizeof(UINT))
+	{
+		return false;
+	}
+
+	memcpy(frequencies, data, sizeof(frequencies));
+	memcpy(&payloadSize, data + sizeof(frequencies), sizeof(UINT));
+	data += sizeof(frequencies) + sizeof(UINT);
+
+	if ((payloadSize < 4) || ((size_t)(end - data) < payloadSize))
+	{
+		return false;
+	}
+
+	// Lookup table from each slot in the probability range to its symbol
+	byte slotSymbols[RANS_PROBABILITY_SCALE];
+	UINT cumulative = 0;
+
+	for (int s = 0; s < 256; s++)
+	{
+		if (cumulative + frequencies[s] > RANS_PROBABILITY_SCALE)
+		{
+			return false;
+		}
+
+		cumulativeFrequencies[s] = cumulative;
+		memset(slotSymbols + cumulative, s, frequencies[s]);
+		cumulative += frequencies[s];
+	}
+
+	if (cumulative != RANS_PROBABILITY_SCALE)
+	{
+		return false;
+	}
+
+	const byte* payload = data;
+	const byte* payloadEnd = data + payloadSize;
+	UINT state = ((UINT)payload[0] << 24) | ((UINT)payload[1] << 16) | ((UINT)payload[2] << 8) | (UINT)payload[3];
+	payload += 4;
+
+	for (size_t i = 0; i < symbolsCount; i++)
+	{
+		const UINT slot = state & (RANS_PROBABILITY_SCALE - 1);
+		const byte symbol = slotSymbols[slot];
+		state = frequencies[symbol] * (state >> RANS_PROBABILITY_BITS) + slot - cumulativeFrequencies[symbol];
+
+		while ((state < RANS_LOWER_BOUND) && (payload < payloadEnd))
+		{
+			state = (state << 8) | *payload++;
+		}
+
+		outSymbols[i] = symbol;
+	}
+
+	data = payloadEnd;
+
+	return true;
+}
+
+void PointCloudEngine::OctreeCompression::NormalizeFrequencies(const UINT counts[256], size_t symbolsCount, USHORT outFrequencies[256])
+{
+	// Every symbol that occurs needs a frequency of at least 1
+	int sum = 0;
+
+	for (int s = 0; s < 256; s++)
+	{
+		outFrequencies[s] = (counts[s] > 0) ? max(1, (USHORT)(((UINT64)counts[s] * RANS_PROBABILITY_SCALE) / symbolsCount)) : 0;
+		sum += outFrequencies[s];
+	}
+
+	// Correct the rounding errors with the most frequent symbols, this takes multiple symbols when many rare symbols were rounded up to 1
+	while (sum != RANS_PROBABILITY_SCALE)
+	{
+		int largest = 0;
+
+		for (int s = 1; s < 256; s++)
+		{
+			if (outFrequencies[s] > outFrequencies[largest])
+			{
+				largest = s;
+			}
+		}
+
+		if (sum < RANS_PROBABILITY_SCALE)
+		{
+			outFrequencies[largest] += RANS_PROBABILITY_SCALE - sum;
+			sum = RANS_PROBABILITY_SCALE;
+		}
+		else
+		{
+			int decrease = min(sum - RANS_PROBABILITY_SCALE, outFrequencies[largest] - 1);
+			outFrequencies[largest] -= decrease;
+			sum -= decrease;
+		}
+	}
+}
+
+double PointCloudEngine::OctreeCompression::GetEntropy(const UINT counts[256], size_t symbolsCount)
+{
+	double entropy = 0;
+
+	for (int s = 0; s < 256; s++)
+	{
+		if (counts[s] > 0)
+		{
+			double probability = (double)counts[s] / symbolsCount;
+			entropy -= probability * log2(probability);
+		}
+	}
+
+	return entropy;
+}
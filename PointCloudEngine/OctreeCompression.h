@@ -0,0 +1,38 @@
+#ifndef OCTREECOMPRESSION_H
+#define OCTREECOMPRESSION_H
+
+// Amount of nodes that are compressed together, each block can be decompressed independently
+#define OCTREE_COMPRESSION_BLOCK_SIZE 65536
+
+#pragma once
+#include "PointCloudEngine.h"
+
+namespace PointCloudEngine
+{
+	// Lossless block wise compression of the octree nodes for the .octree files
+	// The children start indices are predicted from the breadth first order and only the difference is stored
+	// Then the bytes of the nodes are split into one stream per byte of the node struct (neighbouring nodes have similar properties)
+	// Each stream is entropy coded on its own with an order 0 range asymmetric numeral system (rANS) coder, optionally after delta coding the bytes
+	class OctreeCompression
+	{
+	public:
+		// The first children start is the index of the first child of the first inner node in the block when the nodes are stored in breadth first order
+		static void CompressBlock(const OctreeNode *nodes, size_t nodesCount, UINT firstChildrenStart, std::vector<byte> &outData);
+		static bool DecompressBlock(const byte *data, size_t dataSize, size_t nodesCount, UINT firstChildrenStart, OctreeNode *outNodes);
+
+	private:
+		enum class StreamMode : byte
+		{
+			Raw,
+			Entropy,
+			DeltaEntropy
+		};
+
+		static void EncodeStream(const byte *symbols, size_t symbolsCount, std::vector<byte> &outData);
+		static bool DecodeStream(const byte *&data, const byte *end, size_t symbolsCount, byte *outSymbols);
+		static void NormalizeFrequencies(const UINT counts[256], size_t symbolsCount, USHORT outFrequencies[256]);
+		static double GetEntropy(const UINT counts[256], size_t symbolsCount);
+	};
+}
+
+#endif
@@ -1,11 +1,40 @@
 #include "Octree.hlsl"
 #include "OctreeConstantBuffer.hlsl"
 
-StructuredBuffer<OctreeNode> nodesBuffer : register(t0);
+StructuredBuffer<OctreeNodeTopology> topologyBuffer : register(t0);
+StructuredBuffer<OctreeNodeNormals> normalsBuffer : register(t1);
 ConsumeStructuredBuffer<OctreeNodeTraversalEntry> inputConsumeBuffer : register(u0);
 AppendStructuredBuffer<OctreeNodeTraversalEntry> outputAppendBuffer : register(u1);
+
+#ifdef TRAVERSAL_ENTRY_VERTICES
+
+// The cells of the compact vertices only have 16 bits, deeper octrees append the whole traversal entries
 AppendStructuredBuffer<OctreeNodeTraversalEntry> vertexAppendBuffer : register(u2);
 
+OctreeNodeTraversalEntry GetVertex(OctreeNodeTraversalEntry entry)
+{
+	return entry;
+}
+
+#else
+
+AppendStructuredBuffer<OctreeNodeCompactVertex> vertexAppendBuffer : register(u2);
+
+OctreeNodeCompactVertex GetVertex(OctreeNodeTraversalEntry entry)
+{
+	// Integer position of the node in the grid of all the nodes at its depth inside the root cube
+	uint3 cell = (entry.position - (rootPosition - 0.5f * rootSize)) / entry.size;
+
+	OctreeNodeCompactVertex vertex;
+	vertex.index = entry.index;
+	vertex.cellXY = cell.x | (cell.y << 16);
+	vertex.cellZAndDepth = cell.z | (entry.depth << 16);
+
+	return vertex;
+}
+
+#endif
+
 [numthreads(1024, 1, 1)]
 void CS (uint3 id : SV_DispatchThreadID)
 {
@@ -14,26 +43,27 @@ void CS (uint3 id : SV_DispatchThreadID)
     {
         // Get some entry that this thread has to check
 		OctreeNodeTraversalEntry entry = inputConsumeBuffer.Consume();
-        OctreeNode node = nodesBuffer[entry.index];
+        OctreeNodeTopology topology = topologyBuffer[entry.index];
 
 		// Get the childrenMask
-		uint childrenMask = node.properties.childrenMaskAndWeights & 0xff;
+		uint childrenMask = topology.childrenMask & 0xff;
 
 		bool visible = false;
-		bool insideViewFrustum = true;
 		bool traverseChildren = true;
 
 		if (useCulling)
 		{
 			// Backface culling by comparing the maximum angle (normal cone) from the mean to all normals in the cluster against the view direction
+			// The normals are only read when culling, the shading is only read by the vertex shader for the appended vertices
 			float3 localViewDirection = normalize(entry.position - localCameraPosition);
+			OctreeNodeNormals nodeNormals = normalsBuffer[entry.index];
 
 			float4 normals[4] =
 			{
-				ClusterNormalToFloat4(node.properties.normal01 & 0xffff),
-				ClusterNormalToFloat4((node.properties.normal01 >> 16) & 0xffff),
-				ClusterNormalToFloat4(node.properties.normal23 & 0xffff),
-				ClusterNormalToFloat4((node.properties.normal23 >> 16) & 0xffff)
+				ClusterNormalToFloat4(nodeNormals.normal01 & 0xffff),
+				ClusterNormalToFloat4((nodeNormals.normal01 >> 16) & 0xffff),
+				ClusterNormalToFloat4(nodeNormals.normal23 & 0xffff),
+				ClusterNormalToFloat4((nodeNormals.normal23 >> 16) & 0xffff)
 			};
 
 			// Calculate the angle between the view direction, camera forward vector and each normal
@@ -58,134 +88,7 @@ void CS (uint3 id : SV_DispatchThreadID)
 				return;
 			}
 
-			// View frustum culling, check if this node is fully inside the view frustum only when the parent isn't (the children of a node are always inside the view frustum then the node itself is inside it)
-			if (!entry.parentInsideViewFrustum)
-			{
-				// Generate all the 6 planes of the view frustum
-				float3 viewFrustumPlanes[6][2] =
-				{
-					{ localViewFrustumNearTopLeft, localViewPlaneNearNormal },			// Near Plane
-					{ localViewFrustumFarBottomRight, localViewPlaneFarNormal },		// Far Plane
-					{ localViewFrustumNearTopLeft, localViewPlaneLeftNormal },			// Left Plane
-					{ localViewFrustumFarBottomRight, localViewPlaneRightNormal },		// Right Plane
-					{ localViewFrustumNearTopLeft, localViewPlaneTopNormal },			// Top Plane
-					{ localViewFrustumFarBottomRight, localViewPlaneBottomNormal }		// Bottom Plane
-				};
-
-				float extends = entry.size / 2.0f;
-
-				float3 boundingCube[8] =
-				{
-					entry.position + float3(extends, extends, extends),
-					entry.position + float3(-extends, extends, extends),
-					entry.position + float3(extends, -extends, extends),
-					entry.position + float3(extends, extends, -extends),
-					entry.position + float3(-extends, -extends, extends),
-					entry.position + float3(extends, -extends, -extends),
-					entry.position + float3(-extends, extends, -extends),
-					entry.position + float3(-extends, -extends, -extends),
-				};
-
-				int outsideCount = 0;
-				int insideCount = 0;
-
-				// Check if the bounding cube is fully inside, fully outside or overlapping the view frustum
-				for (int i = 0; i < 8; i++)
-				{
-					// Check for each position if it is inside the view frustum
-					bool positionIsInside = true;
-
-					for (int j = 0; j < 6; j++)
-					{
-						// Compute the signed distance to each of the planes
-						if (dot(boundingCube[i] - viewFrustumPlanes[j][0], viewFrustumPlanes[j][1]) > 0)
-						{
-							// The position cannot be fully inside the view frustum when it is on the wrong side of one of the 6 planes
-							positionIsInside = false;
-							break;
-						}
-					}
-
-					if (positionIsInside)
-					{
-						insideCount++;
-					}
-					else
-					{
-						outsideCount++;
-					}
-				}
-
-				if (outsideCount == 8)
-				{
-					// Handle the case that the bounding cube positions are not inside the view frustum but it is still overlapping (e.g. edge only intersection, cube contains view frustum)
-					// Do ray sphere intersection for all the 12 view frustum rays against the sphere representation of the bounding cube (radius is half the diagonal)
-					float3 rays[12][2] =
-					{
-						{ localViewFrustumNearTopRight, localViewFrustumNearTopLeft },
-						{ localViewFrustumNearBottomRight, localViewFrustumNearBottomLeft },
-						{ localViewFrustumNearBottomLeft, localViewFrustumNearTopLeft },
-						{ localViewFrustumNearBottomRight, localViewFrustumNearTopRight },
-						{ localViewFrustumFarTopRight, localViewFrustumFarTopLeft },
-						{ localViewFrustumFarBottomRight, localViewFrustumFarBottomLeft },
-						{ localViewFrustumFarBottomLeft, localViewFrustumFarTopLeft },
-						{ localViewFrustumFarBottomRight, localViewFrustumFarTopRight },
-						{ localViewFrustumNearTopLeft, localViewFrustumFarTopLeft },
-						{ localViewFrustumNearTopRight, localViewFrustumFarTopRight },
-						{ localViewFrustumNearBottomLeft, localViewFrustumFarBottomLeft },
-						{ localViewFrustumNearBottomRight, localViewFrustumFarBottomRight }
-					};
-
-					// Create a sphere that encloses the bounding cube to test against
-					bool intersects = false;
-					float3 c = entry.position;
-					float r = length(float3(extends, extends, extends));
-
-					for (int i = 0; i < 12; i++)
-					{
-						float3 o = rays[i][0];
-						float3 v = rays[i][1] - rays[i][0];
-
-						// Store the length of the frustum line and normalize it
-						float l = length(v);
-						v /= l;
-
-						// Calculate the factor under the square root
-						float3 oMinusC = o - c;
-						float vDotOMinusC = dot(v, oMinusC);
-						float f = vDotOMinusC * vDotOMinusC - (oMinusC.x * oMinusC.x + oMinusC.y * oMinusC.y + oMinusC.z * oMinusC.z - r * r);
-
-						if (f > 0)
-						{
-							// Intersecting the sphere at two points, calculate whether this point is on the line of the view frustum
-							float s = sqrt(f);
-							float d1 = -vDotOMinusC + s;
-							float d2 = -vDotOMinusC - s;
-
-							if ((d1 >= 0 && d1 <= l) || (d2 >= 0 && d2 <= l))
-							{
-								// Interecting, check children again
-								insideViewFrustum = false;
-								intersects = true;
-								break;
-							}
-						}
-					}
-
-					if (!intersects)
-					{
-						// The whole cube is outside, don't add it or any of its children
-						return;
-					}
-				}
-				else if (insideCount != 0 && outsideCount != 0)
-				{
-					// Some positions are outside and some are inside the view frustum, check the children again
-					insideViewFrustum = false;
-				}
-
-				// Otherwise the cube is fully inside the view frustum as assumed
-			}
+			// The view frustum culling of this node was already done by its parent together with its siblings
 		}
 
 		// Check if only to return the vertices at the given level
@@ -195,7 +98,7 @@ void CS (uint3 id : SV_DispatchThreadID)
 			{
 				// Draw this vertex and don't traverse further
 				traverseChildren = false;
-				vertexAppendBuffer.Append(entry);
+				vertexAppendBuffer.Append(GetVertex(entry));
 			}
 		}
 		else
@@ -208,7 +111,7 @@ void CS (uint3 id : SV_DispatchThreadID)
 			if (entry.size < requiredSplatSize || childrenMask == 0)
 			{
 				traverseChildren = false;
-				vertexAppendBuffer.Append(entry);
+				vertexAppendBuffer.Append(GetVertex(entry));
 			}
 		}
 
@@ -228,6 +131,17 @@ void CS (uint3 id : SV_DispatchThreadID)
 				entry.position + float3(-childExtend, -childExtend, -childExtend)
 			};
 
+			// Generate all the 6 planes of the view frustum
+			float3 viewFrustumPlanes[6][2] =
+			{
+				{ localViewFrustumNearTopLeft, localViewPlaneNearNormal },			// Near Plane
+				{ localViewFrustumFarBottomRight, localViewPlaneFarNormal },		// Far Plane
+				{ localViewFrustumNearTopLeft, localViewPlaneLeftNormal },			// Left Plane
+				{ localViewFrustumFarBottomRight, localViewPlaneRightNormal },		// Right Plane
+				{ localViewFrustumNearTopLeft, localViewPlaneTopNormal },			// Top Plane
+				{ localViewFrustumFarBottomRight, localViewPlaneBottomNormal }		// Bottom Plane
+			};
+
 			uint count = 0;
 
             // Check all the children in the next compute shader iteration
@@ -235,14 +149,46 @@ void CS (uint3 id : SV_DispatchThreadID)
             {
 				if (childrenMask & (1 << i))
 				{
-					OctreeNodeTraversalEntry childEntry;
-					childEntry.index = node.childrenStartOrLeafPositionFactors + count;
-					childEntry.position = childPositions[i];
-					childEntry.size = entry.size * 0.5f;
-					childEntry.parentInsideViewFrustum = insideViewFrustum;
-					childEntry.depth = entry.depth + 1;
-
-					outputAppendBuffer.Append(childEntry);
+					bool outsideViewFrustum = false;
+					uint viewFrustumPlaneMask = 0;
+
+					// View frustum culling, only test against the planes that intersect this node (none when it is fully inside the view frustum)
+					if (useCulling)
+					{
+						for (int j = 0; j < 6; j++)
+						{
+							if (entry.viewFrustumPlaneMask & (1 << j))
+							{
+								// Signed distance of the child center to the plane and the largest distance of a corner from the center along the plane normal
+								float centerDistance = dot(childPositions[i] - viewFrustumPlanes[j][0], viewFrustumPlanes[j][1]);
+								float radius = childExtend * dot(abs(viewFrustumPlanes[j][1]), float3(1, 1, 1));
+
+								if (centerDistance > radius)
+								{
+									// Even the corner closest to the inner side is outside, the whole child and all of its children are outside
+									outsideViewFrustum = true;
+									break;
+								}
+								else if (centerDistance > -radius)
+								{
+									// The corner farthest from the inner side is outside, the plane intersects the child
+									viewFrustumPlaneMask |= 1 << j;
+								}
+							}
+						}
+					}
+
+					if (!outsideViewFrustum)
+					{
+						OctreeNodeTraversalEntry childEntry;
+						childEntry.index = topology.childrenStartOrLeafPositionFactors + count;
+						childEntry.position = childPositions[i];
+						childEntry.size = entry.size * 0.5f;
+						childEntry.viewFrustumPlaneMask = viewFrustumPlaneMask;
+						childEntry.depth = entry.depth + 1;
+
+						outputAppendBuffer.Append(childEntry);
+					}
 
 					count++;
 				}
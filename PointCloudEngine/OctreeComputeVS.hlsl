@@ -1,31 +1,54 @@
 #include "Octree.hlsl"
 #include "OctreeConstantBuffer.hlsl"
 
-StructuredBuffer<OctreeNode> nodesBuffer : register(t0);
-StructuredBuffer<OctreeNodeTraversalEntry> vertexBuffer : register(t1);
+StructuredBuffer<OctreeNodeTopology> topologyBuffer : register(t0);
+StructuredBuffer<OctreeNodeNormals> normalsBuffer : register(t1);
+StructuredBuffer<OctreeNodeShading> shadingBuffer : register(t2);
+
+#ifdef TRAVERSAL_ENTRY_VERTICES
+StructuredBuffer<OctreeNodeTraversalEntry> vertexBuffer : register(t3);
+#else
+StructuredBuffer<OctreeNodeCompactVertex> vertexBuffer : register(t3);
+#endif
 
 VS_INPUT VS(uint vertexID : SV_VERTEXID)
 {
+#ifdef TRAVERSAL_ENTRY_VERTICES
+	// The traversal entries of deep octrees already contain the cube of the node
 	OctreeNodeTraversalEntry entry = vertexBuffer[vertexID];
-	OctreeNode n = nodesBuffer[entry.index];
-    OctreeNodeProperties p = n.properties;
+#else
+	// Reconstruct the cube of the node from its cell and depth
+	OctreeNodeCompactVertex vertex = vertexBuffer[vertexID];
+	uint3 cell = uint3(vertex.cellXY & 0xffff, vertex.cellXY >> 16, vertex.cellZAndDepth & 0xffff);
+	uint depth = vertex.cellZAndDepth >> 16;
+
+	OctreeNodeTraversalEntry entry;
+	entry.index = vertex.index;
+	entry.size = rootSize / (1 << depth);
+	entry.position = (rootPosition - 0.5f * rootSize) + (cell + 0.5f) * entry.size;
+#endif
+
+	// Gather the parts of the node only for the vertices that are drawn
+	OctreeNodeTopology t = topologyBuffer[entry.index];
+	OctreeNodeNormals n = normalsBuffer[entry.index];
+	OctreeNodeShading s = shadingBuffer[entry.index];
 
     VS_INPUT input;
 
 	// Convert from the struct in the buffer to the vertex layout
 	// The bit order is swapped here to LittleEndian, highest value bits are actually now the most right bits
-	input.childrenMask = p.childrenMaskAndWeights & 0xff;
-	input.weight0 = (p.childrenMaskAndWeights >> 8) & 0xff;
-	input.weight1 = (p.childrenMaskAndWeights >> 16) & 0xff;
-	input.weight2 = (p.childrenMaskAndWeights >> 24) & 0xff;
-    input.normal0 = p.normal01 & 0xffff;
-    input.normal1 = (p.normal01 >> 16) & 0xffff;
-	input.normal2 = p.normal23 & 0xffff;
-	input.normal3 = (p.normal23 >> 16) & 0xffff;
-    input.color0 = p.color01 & 0xffff;
-    input.color1 = p.color01 >> 16;
-	input.color2 = p.color23 & 0xffff;
-	input.color3 = p.color23 >> 16;
+	input.childrenMask = t.childrenMask & 0xff;
+	input.weight0 = s.weights & 0xff;
+	input.weight1 = (s.weights >> 8) & 0xff;
+	input.weight2 = (s.weights >> 16) & 0xff;
+    input.normal0 = n.normal01 & 0xffff;
+    input.normal1 = (n.normal01 >> 16) & 0xffff;
+	input.normal2 = n.normal23 & 0xffff;
+	input.normal3 = (n.normal23 >> 16) & 0xffff;
+    input.color0 = s.color01 & 0xffff;
+    input.color1 = s.color01 >> 16;
+	input.color2 = s.color23 & 0xffff;
+	input.color3 = s.color23 >> 16;
     input.size = entry.size;
 
 	// Leaf node: compute a more accurate position from the childrenStartOrLeafPositionFactors
@@ -35,9 +58,9 @@ VS_INPUT VS(uint vertexID : SV_VERTEXID)
 		float3 startPosition = entry.position - (0.5f * entry.size * float3(1, 1, 1));
 
 		// Get the factors from the 32bit uint
-		float factorX = ((n.childrenStartOrLeafPositionFactors >> 16) & 0xff) / 255.0f;
-		float factorY = ((n.childrenStartOrLeafPositionFactors >> 8) & 0xff) / 255.0f;
-		float factorZ = (n.childrenStartOrLeafPositionFactors & 0xff) / 255.0f;
+		float factorX = ((t.childrenStartOrLeafPositionFactors >> 16) & 0xff) / 255.0f;
+		float factorY = ((t.childrenStartOrLeafPositionFactors >> 8) & 0xff) / 255.0f;
+		float factorZ = (t.childrenStartOrLeafPositionFactors & 0xff) / 255.0f;
 
 		input.position = startPosition + entry.size * float3(factorX, factorY, factorZ);
 	}
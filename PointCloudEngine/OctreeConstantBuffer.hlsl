@@ -70,4 +70,8 @@ cbuffer OctreeConstantBuffer : register(b0)
 	bool useCulling;
 	uint inputCount;
 //------------------------------------------------------------------------------ (16 byte boundary)
-};	// Total: 608 bytes with constant buffer packing rules
\ No newline at end of file
+	// Root cube of the octree for the compact vertices
+	float3 rootPosition;
+	float rootSize;
+//------------------------------------------------------------------------------ (16 byte boundary)
+};	// Total: 624 bytes with constant buffer packing rules
\ No newline at end of file
@@ -0,0 +1,246 @@
+#include "OctreeCulling.h"
+
+PointCloudEngine::OctreeCulling::OctreeCulling(const OctreeConstantBuffer &octreeConstantBufferData)
+{
+	localCameraPosition = octreeConstantBufferData.localCameraPosition;
+	localViewPlaneNearNormal = octreeConstantBufferData.localViewPlaneNearNormal;
+
+	// AVX2 support also implies AVX support
+	useAVX = (NormalClustering::GetSupportedInstructionSet() == NormalClustering::InstructionSet::AVX2);
+
+	// Generate all the 6 planes of the view frustum, each plane is given by a point on it and its normal
+	Vector3 viewFrustumPlanes[6][2] =
+	{
+		{ octreeConstantBufferData.localViewFrustumNearTopLeft, octreeConstantBufferData.localViewPlaneNearNormal },		// Near Plane
+		{ octreeConstantBufferData.localViewFrustumFarBottomRight, octreeConstantBufferData.localViewPlaneFarNormal },		// Far Plane
+		{ octreeConstantBufferData.localViewFrustumNearTopLeft, octreeConstantBufferData.localViewPlaneLeftNormal },		// Left Plane
+		{ octreeConstantBufferData.localViewFrustumFarBottomRight, octreeConstantBufferData.localViewPlaneRightNormal },	// Right Plane
+		{ octreeConstantBufferData.localViewFrustumNearTopLeft, octreeConstantBufferData.localViewPlaneTopNormal },			// Top Plane
+		{ octreeConstantBufferData.localViewFrustumFarBottomRight, octreeConstantBufferData.localViewPlaneBottomNormal }	// Bottom Plane
+	};
+
+	for (int i = 0; i < 6; i++)
+	{
+		Vector3 normal = viewFrustumPlanes[i][1];
+
+		planes[i][0] = normal.x;
+		planes[i][1] = normal.y;
+		planes[i][2] = normal.z;
+		planes[i][3] = -normal.Dot(viewFrustumPlanes[i][0]);
+		planes[i][4] = fabs(normal.x) + fabs(normal.y) + fabs(normal.z);
+	}
+}
+
+bool PointCloudEngine::OctreeCulling::IsBackfacing(const OctreeNodeNormals &nodeNormals, const Vector3 &position) const
+{
+	// Backface culling by comparing the maximum angle (normal cone) from the mean to all normals in the cluster against the view direction
+	// At the edge of the cone the angle can be up to pi/2 larger for the node to be still visible: acos(dot) < pi/2 + cone <=> dot > cos(pi/2 + cone)
+	// Also check against the camera forward vector since the node position can yield a heavily different view direction
+	const NormalTables &tables = GetNormalTables();
+	Vector3 localViewDirection = position - localCameraPosition;
+	localViewDirection.Normalize();
+
+	// Compare all the 4 cluster normals at once
+	float normals[3][4];
+	float thresholds[4];
+
+	for (int i = 0; i < 4; i++)
+	{
+		const float* normal = tables.normals[nodeNormals.normals[i].thetaPhiCone >> 4];
+		normals[0][i] = normal[0];
+		normals[1][i] = normal[1];
+		normals[2][i] = normal[2];
+		thresholds[i] = tables.coneThresholds[nodeNormals.normals[i].thetaPhiCone & 0xf];
+	}
+
+	__m128 normalX = _mm_loadu_ps(normals[0]);
+	__m128 normalY = _mm_loadu_ps(normals[1]);
+	__m128 normalZ = _mm_loadu_ps(normals[2]);
+
+	__m128 firstDot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX, _mm_set1_ps(-localViewDirection.x)), _mm_mul_ps(normalY, _mm_set1_ps(-localViewDirection.y))), _mm_mul_ps(normalZ, _mm_set1_ps(-localViewDirection.z)));
+	__m128 secondDot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX, _mm_set1_ps(localViewPlaneNearNormal.x)), _mm_mul_ps(normalY, _mm_set1_ps(localViewPlaneNearNormal.y))), _mm_mul_ps(normalZ, _mm_set1_ps(localViewPlaneNearNormal.z)));
+	__m128 visible = _mm_cmpgt_ps(_mm_max_ps(firstDot, secondDot), _mm_loadu_ps(thresholds));
+
+	return (_mm_movemask_ps(visible) == 0);
+}
+
+float PointCloudEngine::OctreeCulling::GetBackfacingMargin(const OctreeNodeNormals &nodeNormals, const Vector3 &position) const
+{
+	// Same comparison as IsBackfacing, this is only needed to know how much the view can change until the result changes
+	const NormalTables &tables = GetNormalTables();
+	Vector3 localViewDirection = position - localCameraPosition;
+	localViewDirection.Normalize();
+
+	float margin = -FLT_MAX;
+
+	for (int i = 0; i < 4; i++)
+	{
+		const float* normal = tables.normals[nodeNormals.normals[i].thetaPhiCone >> 4];
+		float threshold = tables.coneThresholds[nodeNormals.normals[i].thetaPhiCone & 0xf];
+
+		if (threshold == -FLT_MAX)
+		{
+			return FLT_MAX;
+		}
+
+		float firstDot = -(normal[0] * localViewDirection.x + normal[1] * localViewDirection.y + normal[2] * localViewDirection.z);
+		float secondDot = normal[0] * localViewPlaneNearNormal.x + normal[1] * localViewPlaneNearNormal.y + normal[2] * localViewPlaneNearNormal.z;
+		margin = max(margin, max(firstDot, secondDot) - threshold);
+	}
+
+	return margin;
+}
+
+float PointCloudEngine::OctreeCulling::GetFrustumMargin(const Vector3 &position, float size) const
+{
+	// The cube is outside when the center distance to one of the planes is larger than the radius of the cube along the plane normal
+	float extends = size / 2.0f;
+	float insideMargin = FLT_MAX;
+	float outsideMargin = 0;
+
+	for (int i = 0; i < 6; i++)
+	{
+		float centerDistance = GetPlaneDistance(i, position);
+		float radius = extends * planes[i][4];
+
+		if (centerDistance > radius)
+		{
+			outsideMargin = max(outsideMargin, centerDistance - radius);
+		}
+		else
+		{
+			insideMargin = min(insideMargin, radius - centerDistance);
+		}
+	}
+
+	return (outsideMargin > 0) ? -outsideMargin : insideMargin;
+}
+
+Vector3 PointCloudEngine::OctreeCulling::GetPlaneNormal(int plane) const
+{
+	return Vector3(planes[plane][0], planes[plane][1], planes[plane][2]);
+}
+
+float PointCloudEngine::OctreeCulling::GetPlaneDistance(int plane, const Vector3 &position) const
+{
+	return planes[plane][0] * position.x + planes[plane][1] * position.y + planes[plane][2] * position.z + planes[plane][3];
+}
+
+byte PointCloudEngine::OctreeCulling::ClassifyCubes(const float positions[3][8], byte mask, float size, UINT planeMask, UINT outPlaneMasks[8])
+{
+	testedCubesCount += __popcnt(mask);
+	planeTestsCount += __popcnt(mask) * __popcnt(planeMask);
+
+	if (useAVX)
+	{
+		return ClassifyCubesAVX(positions, mask, size, planeMask, outPlaneMasks);
+	}
+
+	return ClassifyCubesScalar(positions, mask, size, planeMask, outPlaneMasks);
+}
+
+const PointCloudEngine::OctreeCulling::NormalTables& PointCloudEngine::OctreeCulling::GetNormalTables()
+{
+	static const NormalTables normalTables = []
+	{
+		NormalTables tables;
+
+		for (int i = 0; i < 4096; i++)
+		{
+			ClusterNormal clusterNormal;
+			clusterNormal.thetaPhiCone = i << 4;
+			Vector3 normal = clusterNormal.GetVector3();
+
+			tables.normals[i][0] = normal.x;
+			tables.normals[i][1] = normal.y;
+			tables.normals[i][2] = normal.z;
+		}
+
+		for (int i = 0; i < 16; i++)
+		{
+			ClusterNormal clusterNormal;
+			clusterNormal.thetaPhiCone = i;
+			float cone = clusterNormal.GetCone();
+
+			// Every normal is visible when the cone is larger than pi/2 (the maximum angle between two normals is pi)
+			tables.coneThresholds[i] = (cone > XM_PI / 2) ? -FLT_MAX : -sin(cone);
+		}
+
+		return tables;
+	}();
+
+	return normalTables;
+}
+
+byte PointCloudEngine::OctreeCulling::ClassifyCubesScalar(const float positions[3][8], byte mask, float size, UINT planeMask, UINT outPlaneMasks[8]) const
+{
+	float extends = size / 2.0f;
+	byte visibleMask = mask;
+
+	for (int i = 0; i < 8; i++)
+	{
+		outPlaneMasks[i] = 0;
+
+		for (int j = 0; (j < 6) && (visibleMask & (1 << i)); j++)
+		{
+			if (planeMask & (1 << j))
+			{
+				// Signed distance of the center to the plane and the largest distance of a corner from the center along the plane normal
+				float centerDistance = planes[j][0] * positions[0][i] + planes[j][1] * positions[1][i] + planes[j][2] * positions[2][i] + planes[j][3];
+				float radius = extends * planes[j][4];
+
+				if (centerDistance > radius)
+				{
+					// Even the corner closest to the inner side is outside, the whole cube and all of its children are outside
+					visibleMask &= ~(1 << i);
+				}
+				else if (centerDistance > -radius)
+				{
+					// The corner farthest from the inner side is outside, the plane intersects the cube
+					outPlaneMasks[i] |= 1 << j;
+				}
+			}
+		}
+	}
+
+	return visibleMask;
+}
+
+byte PointCloudEngine::OctreeCulling::ClassifyCubesAVX(const float positions[3][8], byte mask, float size, UINT planeMask, UINT outPlaneMasks[8]) const
+{
+	// Same computations as in the scalar version with one cube in each lane
+	float extends = size / 2.0f;
+
+	__m256 x = _mm256_loadu_ps(positions[0]);
+	__m256 y = _mm256_loadu_ps(positions[1]);
+	__m256 z = _mm256_loadu_ps(positions[2]);
+	__m256 outside = _mm256_setzero_ps();
+	int intersectingMasks[6] = { 0 };
+
+	for (int j = 0; j < 6; j++)
+	{
+		if (planeMask & (1 << j))
+		{
+			__m256 centerDistance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[j][0]), x), _mm256_mul_ps(_mm256_set1_ps(planes[j][1]), y)), _mm256_mul_ps(_mm256_set1_ps(planes[j][2]), z)), _mm256_set1_ps(planes[j][3]));
+			float radius = extends * planes[j][4];
+
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(centerDistance, _mm256_set1_ps(radius), _CMP_GT_OQ));
+			intersectingMasks[j] = _mm256_movemask_ps(_mm256_cmp_ps(centerDistance, _mm256_set1_ps(-radius), _CMP_GT_OQ));
+		}
+	}
+
+	byte visibleMask = mask & ~_mm256_movemask_ps(outside);
+
+	// Transpose the per plane masks of the cubes into per cube masks of the planes
+	for (int i = 0; i < 8; i++)
+	{
+		outPlaneMasks[i] = 0;
+
+		for (int j = 0; j < 6; j++)
+		{
+			outPlaneMasks[i] |= ((intersectingMasks[j] >> i) & 1) << j;
+		}
+	}
+
+	return visibleMask;
+}
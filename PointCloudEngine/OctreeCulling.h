@@ -0,0 +1,63 @@
+#ifndef OCTREECULLING_H
+#define OCTREECULLING_H
+
+// One bit for each of the near, far, left, right, top and bottom planes of the view frustum
+#define VIEW_FRUSTUM_PLANE_MASK 0x3f
+
+#pragma once
+#include "PointCloudEngine.h"
+
+namespace PointCloudEngine
+{
+	// Backface and view frustum culling for the CPU traversal of the octree, same tests as in the compute shader
+	// The view frustum planes are computed once per traversal from the constant buffer
+	// All the children of a node are classified against the view frustum at once with AVX (one child per lane)
+	// Each cube is only tested against the planes that intersect its parent, for each plane only the cube corners closest to and farthest from the plane are checked
+	class OctreeCulling
+	{
+	public:
+		OctreeCulling(const OctreeConstantBuffer &octreeConstantBufferData);
+
+		// True when all the normal cones of the node face away from the camera
+		bool IsBackfacing(const OctreeNodeNormals &nodeNormals, const Vector3 &position) const;
+
+		// Largest dot product of a normal with the view directions minus the threshold of its cone, the node is backfacing when this is not positive
+		float GetBackfacingMargin(const OctreeNodeNormals &nodeNormals, const Vector3 &position) const;
+
+		// Distance of the cube center from the closest plane at which the cube would become fully outside (positive) or not outside anymore (negative)
+		float GetFrustumMargin(const Vector3 &position, float size) const;
+
+		Vector3 GetPlaneNormal(int plane) const;
+		float GetPlaneDistance(int plane, const Vector3 &position) const;
+
+		// Classifies the cubes of the mask against the planes of the plane mask, the cubes all have the same size and their positions are given as x, y and z arrays
+		// Returns the mask of the cubes that are not fully outside of one of the planes, the output plane masks contain the planes that intersect each of these cubes
+		byte ClassifyCubes(const float positions[3][8], byte mask, float size, UINT planeMask, UINT outPlaneMasks[8]);
+
+		// Counts the classified cubes and the plane tests for the traversal statistics
+		UINT testedCubesCount = 0;
+		UINT planeTestsCount = 0;
+
+	private:
+		Vector3 localCameraPosition;
+		Vector3 localViewPlaneNearNormal;
+		bool useAVX;
+
+		// Normal and distance of each plane (positive distances are outside), the last value scales the cube extends to the largest distance of a corner from the center
+		float planes[6][5];
+
+		// Decoded normals for each theta and phi combination, the normal is visible when the largest dot product with the view direction is above the threshold of its cone
+		struct NormalTables
+		{
+			float normals[4096][3];
+			float coneThresholds[16];
+		};
+
+		static const NormalTables& GetNormalTables();
+
+		byte ClassifyCubesScalar(const float positions[3][8], byte mask, float size, UINT planeMask, UINT outPlaneMasks[8]) const;
+		byte ClassifyCubesAVX(const float positions[3][8], byte mask, float size, UINT planeMask, UINT outPlaneMasks[8]) const;
+	};
+}
+
+#endif
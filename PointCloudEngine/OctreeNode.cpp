@@ -5,9 +5,9 @@ PointCloudEngine::OctreeNode::OctreeNode()
     // Default constructor used for parsing from file
 }
 
-PointCloudEngine::OctreeNode::OctreeNode(std::queue<OctreeNodeCreationEntry> &nodeCreationQueue, std::vector<OctreeNode> &nodes, std::vector<UINT>& children, const OctreeNodeCreationEntry &entry)
+PointCloudEngine::OctreeNode::OctreeNode(const std::vector<Vertex> &vertices, const OctreeNodeCreationEntry &entry, OctreeNodeClusters *outClusters)
 {
-    size_t vertexCount = entry.vertices.size();
+    size_t vertexCount = entry.verticesCount;
     
     if (vertexCount == 0)
     {
@@ -18,225 +18,27 @@ PointCloudEngine::OctreeNode::OctreeNode(std::queue<OctreeNodeCreationEntry> &no
     // The octree is generated by fitting the vertices into a cube at the center position
     // Then this cube is splitted into 8 smaller child cubes along the center
     // For each child cube the octree generation is repeated
-    // Assign this child to its parent
-    if (entry.nodesIndex != UINT_MAX && entry.childrenIndex != UINT_MAX)
-    {
-		children[entry.childrenIndex] = entry.nodesIndex;
-    }
-
-    // Apply the k-means clustering algorithm to find clusters for the normals
-    Vector3 means[4];
-    const int k = min(vertexCount, 4);
-    UINT verticesPerMean[4] = { 0, 0, 0, 0 };
-
-    // Set initial means to the first k normals
-    for (int i = 0; i < k; i++)
-    {
-        means[i] = entry.vertices[i].normal;
-        verticesPerMean[i] = 1;
-    }
-
-    // Save the index of the mean that each vertex is assigned to
-    bool meanChanged = true;
-    byte *clusters = new byte[vertexCount];
-    ZeroMemory(clusters, sizeof(byte) * vertexCount);
-
-    while (meanChanged)
-    {
-        // Assign all the vertices to the closest mean to them
-        for (UINT i = 0; i < vertexCount; i++)
-        {
-            float minDistance = Vector3::Distance(entry.vertices[i].normal, means[clusters[i]]);
-
-            for (UINT j = 0; j < k; j++)
-            {
-                float distance = Vector3::Distance(entry.vertices[i].normal, means[j]);
-
-                if (distance < minDistance)
-                {
-                    clusters[i] = j;
-                    minDistance = distance;
-                }
-            }
-        }
-
-        // Calculate the new means from the vertices in each cluster
-        Vector3 newMeans[4];
-
-        for (int i = 0; i < k; i++)
-        {
-            verticesPerMean[i] = 0;
-        }
-
-        for (UINT i = 0; i < vertexCount; i++)
-        {
-            newMeans[clusters[i]] += entry.vertices[i].normal;
-            verticesPerMean[clusters[i]] += 1;
-        }
-
-        meanChanged = false;
-
-        // Update the means
-        for (int i = 0; i < k; i++)
-        {
-            if (verticesPerMean[i] > 0)
-            {
-                newMeans[i] /= verticesPerMean[i];
-
-                if (Vector3::DistanceSquared(means[i], newMeans[i]) > FLT_EPSILON)
-                {
-                    meanChanged = true;
-                }
-
-                means[i] = newMeans[i];
-            }
-        }
+    // This only computes the properties of this node, the octree assigns the children and their indices
+    // Only the vertices in the range of this node are used
+    const Vertex* nodeVertices = vertices.data() + entry.verticesStart;
 
-    }
-
-	// Normalize the means
-	for (UINT i = 0; i < k; i++)
-	{
-		means[i].Normalize();
-	}
-
-    // Initialize average colors that are calculated per cluster
-	float normalCones[4] = { 0, 0, 0, 0 };
-    double averageReds[4] = { 0, 0, 0, 0 };
-    double averageGreens[4] = { 0, 0, 0, 0 };
-    double averageBlues[4] = { 0, 0, 0, 0 };
-
-    // Calculate color
-    for (UINT i = 0; i < vertexCount; i++)
-    {
-        averageReds[clusters[i]] += entry.vertices[i].color[0];
-        averageGreens[clusters[i]] += entry.vertices[i].color[1];
-        averageBlues[clusters[i]] += entry.vertices[i].color[2];
-
-		// Calculate the angle in [0, pi] between the mean normal and this vertex normal
-		float angle = acos(means[clusters[i]].Dot(entry.vertices[i].normal));
-
-		// Save the maximum angle to any of the vertices in the cluster as normal cone
-		normalCones[clusters[i]] = max(normalCones[clusters[i]], angle);
-    }
-
-	delete[] clusters;
+    // Apply the k-means clustering algorithm to find clusters for the normals, then compute the average colors and normal cones of the clusters
+    OctreeNodeClusters clusters;
+    NormalClustering::Cluster(nodeVertices, vertexCount, clusters);
 
     // Assign node properties
 	properties.childrenMask = 0;
+	SetProperties(clusters);
 
-    for (int i = 0; i < 4; i++)
-    {
-        if (verticesPerMean[i] > 0)
-        {
-            averageReds[i] /= verticesPerMean[i];
-            averageGreens[i] /= verticesPerMean[i];
-            averageBlues[i] /= verticesPerMean[i];
-
-            properties.normals[i] = ClusterNormal(means[i], normalCones[i]);
-            properties.colors[i] = Color16(averageReds[i], averageGreens[i], averageBlues[i]);
-        }
-    }
-
-	// Assign weights (one of the 4 can be omitted because the sum is always 100%)
-	for (int i = 0; i < 3; i++)
+	// Keep the statistics of the clusters when the parent node is created from them
+	if (outClusters != NULL)
 	{
-		properties.weights[i] = (255.0f * verticesPerMean[i]) / vertexCount;
+		*outClusters = clusters;
 	}
 
-    // Only subdivide further when this is not a leaf node and the max octree depth is not met yet
-    if ((vertexCount > 1) && (entry.depth < settings->maxOctreeDepth))
-    {
-		// Split and create children vertices
-		std::vector<Vertex> childVertices[8];
-
-		// Fit each vertex into its corresponding child cube
-		for (auto it = entry.vertices.begin(); it != entry.vertices.end(); it++)
-		{
-			Vertex v = *it;
-
-			if (v.position.x > entry.position.x)
-			{
-				if (v.position.y > entry.position.y)
-				{
-					if (v.position.z > entry.position.z)
-					{
-						childVertices[0].push_back(v);
-					}
-					else
-					{
-						childVertices[1].push_back(v);
-					}
-				}
-				else
-				{
-					if (v.position.z > entry.position.z)
-					{
-						childVertices[2].push_back(v);
-					}
-					else
-					{
-						childVertices[3].push_back(v);
-					}
-				}
-			}
-			else
-			{
-				if (v.position.y > entry.position.y)
-				{
-					if (v.position.z > entry.position.z)
-					{
-						childVertices[4].push_back(v);
-					}
-					else
-					{
-						childVertices[5].push_back(v);
-					}
-				}
-				else
-				{
-					if (v.position.z > entry.position.z)
-					{
-						childVertices[6].push_back(v);
-					}
-					else
-					{
-						childVertices[7].push_back(v);
-					}
-				}
-			}
-		}
-
-		// Store the start index of the children in the children array
-		childrenStartOrLeafPositionFactors = children.size();
-
-        for (int i = 0; i < 8; i++)
-        {
-            if (childVertices[i].size() > 0)
-            {
-                // Add a new entry to the queue
-                OctreeNodeCreationEntry childEntry;
-                childEntry.nodesIndex = UINT_MAX;
-				childEntry.childrenIndex = children.size();
-                childEntry.vertices = childVertices[i];
-                childEntry.position = GetChildPosition(entry.position, entry.size, i);
-                childEntry.size = entry.size * 0.5f;
-                childEntry.depth = entry.depth + 1;
-
-				// Add this entry to the mask
-				properties.childrenMask |= 1 << i;
-
-				// Reserve a spot for the children index that will be assigned later
-				children.push_back(UINT_MAX);
-
-				// Add this to the queue
-                nodeCreationQueue.push(childEntry);
-            }
-        }
-    }
-	else
+	// Leaf nodes have childrenMask=0 and represent exactly one or more vertices
+	if (IsLeafEntry(entry))
 	{
-		// This is a leaf node with childrenMask=0 representing exactly one or more vertices
 		// The bounding cube can be much larger than the vertices that it represents -> the bounding cube position does not represent the vertex positions well
 		// Idea: store factors from the average vertex position in the childrenStartOrLeafPositionFactors to representing a more accurate position
 		// Each 8 bits store the distance factor from the smallest position of the bounding cube in respect to the size of the cube in each axis (x, y, z)
@@ -247,7 +49,7 @@ PointCloudEngine::OctreeNode::OctreeNode(std::queue<OctreeNodeCreationEntry> &no
 
 		for (UINT i = 0; i < vertexCount; i++)
 		{
-			averagePosition += entry.vertices[i].position;
+			averagePosition += nodeVertices[i].position;
 		}
 
 		averagePosition /= vertexCount;
@@ -266,223 +68,194 @@ PointCloudEngine::OctreeNode::OctreeNode(std::queue<OctreeNodeCreationEntry> &no
 	}
 }
 
-void PointCloudEngine::OctreeNode::GetVertices(const std::vector<OctreeNode>& nodes, std::queue<OctreeNodeTraversalEntry> &nodesQueue, std::vector<OctreeNodeVertex> &octreeVertices, const OctreeNodeTraversalEntry &entry, const OctreeConstantBuffer &octreeConstantBufferData) const
+PointCloudEngine::OctreeNode::OctreeNode(const OctreeNodeClusters* const* childrenClusters, int childrenCount, OctreeNodeClusters *outClusters)
 {
-	bool visible = false;
-	bool insideViewFrustum = true;
-	bool traverseChildren = true;
-
-	if (octreeConstantBufferData.useCulling)
+	// Creates the node from the clusters of its children instead of all the vertices in this subtree (bottom up clustering)
+	// The k-means algorithm is applied to the child cluster means weighted by their vertex count
+	// Because the sums are merged, each resulting mean is the same as the mean of all the vertices that belong to the merged clusters
+	const OctreeNodeClusters* itemClusters[32];
+	int itemIndices[32];
+	Vector3 itemMeans[32];
+	int itemCount = 0;
+
+	for (int i = 0; i < childrenCount; i++)
 	{
-		// Backface culling by comparing the maximum angle (normal cone) from the mean to all normals in the cluster against the view direction
-		OctreeNode node = nodes[entry.index];
-		Vector3 localViewDirection = entry.position - octreeConstantBufferData.localCameraPosition;
-		localViewDirection.Normalize();
-
-		// Calculate the angle between the view direction, camera forward vector and each normal
-		for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 4; j++)
 		{
-			ClusterNormal clusterNormal = node.properties.normals[i];
-			Vector3 normal = clusterNormal.GetVector3();
-			float cone = clusterNormal.GetCone();
-
-			// Also check against the camera forward vector since the node position can yield a heavily different view direction
-			float firstAngle = acos(normal.Dot(-localViewDirection));
-			float secondAngle = acos(normal.Dot(octreeConstantBufferData.localViewPlaneNearNormal));
-			float angle = min(firstAngle, secondAngle);
-
-			// At the edge of the cone the angle can be up to pi/2 larger for the node to be still visible
-			if (angle < (XM_PI / 2) + cone)
+			if (childrenClusters[i]->counts[j] > 0)
 			{
-				visible = true;
-				break;
+				itemClusters[itemCount] = childrenClusters[i];
+				itemIndices[itemCount] = j;
+				itemMeans[itemCount] = childrenClusters[i]->normalSums[j] / childrenClusters[i]->counts[j];
+				itemCount++;
 			}
 		}
+	}
 
-		if (!visible)
-		{
-			// The node and all of its children face away from the camera, don't draw it or traverse further
-			return;
-		}
+	if (itemCount == 0)
+	{
+		ERROR_MESSAGE(L"Cannot create " + NAMEOF(OctreeNode) + L" from 0 " + NAMEOF(childrenClusters));
+		return;
+	}
 
-		// View frustum culling, check if this node is fully inside the view frustum only when the parent isn't (the children of a node are always inside the view frustum then the node itself is inside it)
-		if (!entry.parentInsideViewFrustum)
-		{
-			// Generate all the 6 planes of the view frustum
-			Plane viewFrustumPlanes[6] =
-			{
-				Plane(octreeConstantBufferData.localViewFrustumNearTopLeft, octreeConstantBufferData.localViewPlaneNearNormal),			// Near Plane
-				Plane(octreeConstantBufferData.localViewFrustumFarBottomRight, octreeConstantBufferData.localViewPlaneFarNormal),		// Far Plane
-				Plane(octreeConstantBufferData.localViewFrustumNearTopLeft, octreeConstantBufferData.localViewPlaneLeftNormal),			// Left Plane
-				Plane(octreeConstantBufferData.localViewFrustumFarBottomRight, octreeConstantBufferData.localViewPlaneRightNormal),		// Right Plane
-				Plane(octreeConstantBufferData.localViewFrustumNearTopLeft, octreeConstantBufferData.localViewPlaneTopNormal),			// Top Plane
-				Plane(octreeConstantBufferData.localViewFrustumFarBottomRight, octreeConstantBufferData.localViewPlaneBottomNormal)		// Bottom Plane
-			};
+	// Set initial means to the first k child cluster means
+	Vector3 means[4];
+	const int k = min(itemCount, 4);
+	byte clusters[32];
+	ZeroMemory(clusters, sizeof(clusters));
 
-			float extends = entry.size / 2.0f;
+	for (int i = 0; i < k; i++)
+	{
+		means[i] = itemMeans[i];
+	}
 
-			Vector3 boundingCube[8] =
-			{
-				entry.position + Vector3(extends, extends, extends),
-				entry.position + Vector3(-extends, extends, extends),
-				entry.position + Vector3(extends, -extends, extends),
-				entry.position + Vector3(extends, extends, -extends),
-				entry.position + Vector3(-extends, -extends, extends),
-				entry.position + Vector3(extends, -extends, -extends),
-				entry.position + Vector3(-extends, extends, -extends),
-				entry.position + Vector3(-extends, -extends, -extends),
-			};
-
-			int outsideCount = 0;
-			int insideCount = 0;
-
-			// Check if the bounding cube is fully inside, fully outside or overlapping the view frustum
-			for (int i = 0; i < 8; i++)
-			{
-				// Check for each position if it is inside the view frustum
-				bool positionIsInside = true;
+	// Same iteration limit and tolerance as the clustering of the vertices, an iteration limit of 0 iterates until the means converge
+	for (UINT iteration = 0; (settings->clusteringMaxIterations == 0) || (iteration < settings->clusteringMaxIterations); iteration++)
+	{
+		// Assign all the child clusters to the closest mean to them
+		for (int i = 0; i < itemCount; i++)
+		{
+			float minDistance = Vector3::Distance(itemMeans[i], means[clusters[i]]);
 
-				for (int j = 0; j < 6; j++)
-				{
-					// Compute the signed distance to each of the planes
-					if (viewFrustumPlanes[j].DotCoordinate(boundingCube[i]) > 0)
-					{
-						// The position cannot be fully inside the view frustum when it is on the wrong side of one of the 6 planes
-						positionIsInside = false;
-						break;
-					}
-				}
+			for (int j = 0; j < k; j++)
+			{
+				float distance = Vector3::Distance(itemMeans[i], means[j]);
 
-				if (positionIsInside)
-				{
-					insideCount++;
-				}
-				else
+				if (distance < minDistance)
 				{
-					outsideCount++;
+					clusters[i] = j;
+					minDistance = distance;
 				}
 			}
+		}
+
+		// Calculate the new means from the weighted child clusters in each cluster
+		Vector3 newSums[4];
+		UINT newCounts[4] = { 0, 0, 0, 0 };
 
-			if (outsideCount == 8)
+		for (int i = 0; i < itemCount; i++)
+		{
+			newSums[clusters[i]] += itemClusters[i]->normalSums[itemIndices[i]];
+			newCounts[clusters[i]] += itemClusters[i]->counts[itemIndices[i]];
+		}
+
+		bool meanChanged = false;
+
+		for (int i = 0; i < k; i++)
+		{
+			if (newCounts[i] > 0)
 			{
-				// Handle the case that the bounding cube positions are not inside the view frustum but it is still overlapping (e.g. edge only intersection, cube contains view frustum)
-				// Do ray sphere intersection for all the 12 view frustum rays against the sphere representation of the bounding cube (radius is half the diagonal)
-				Vector3 rays[12][2] =
-				{
-					{ octreeConstantBufferData.localViewFrustumNearTopRight, octreeConstantBufferData.localViewFrustumNearTopLeft },
-					{ octreeConstantBufferData.localViewFrustumNearBottomRight, octreeConstantBufferData.localViewFrustumNearBottomLeft },
-					{ octreeConstantBufferData.localViewFrustumNearBottomLeft, octreeConstantBufferData.localViewFrustumNearTopLeft },
-					{ octreeConstantBufferData.localViewFrustumNearBottomRight, octreeConstantBufferData.localViewFrustumNearTopRight },
-					{ octreeConstantBufferData.localViewFrustumFarTopRight, octreeConstantBufferData.localViewFrustumFarTopLeft },
-					{ octreeConstantBufferData.localViewFrustumFarBottomRight, octreeConstantBufferData.localViewFrustumFarBottomLeft },
-					{ octreeConstantBufferData.localViewFrustumFarBottomLeft, octreeConstantBufferData.localViewFrustumFarTopLeft },
-					{ octreeConstantBufferData.localViewFrustumFarBottomRight, octreeConstantBufferData.localViewFrustumFarTopRight },
-					{ octreeConstantBufferData.localViewFrustumNearTopLeft, octreeConstantBufferData.localViewFrustumFarTopLeft },
-					{ octreeConstantBufferData.localViewFrustumNearTopRight, octreeConstantBufferData.localViewFrustumFarTopRight },
-					{ octreeConstantBufferData.localViewFrustumNearBottomLeft, octreeConstantBufferData.localViewFrustumFarBottomLeft },
-					{ octreeConstantBufferData.localViewFrustumNearBottomRight, octreeConstantBufferData.localViewFrustumFarBottomRight }
-				};
-
-				// Create a sphere that encloses the bounding cube to test against
-				bool intersects = false;
-				Vector3 c = entry.position;
-				float r = Vector3(extends, extends, extends).Length();
-
-				for (int i = 0; i < 12; i++)
-				{
-					Vector3 o = rays[i][0];
-					Vector3 v = rays[i][1] - rays[i][0];
-
-					// Store the length of the frustum line and normalize it
-					float l = v.Length();
-					v /= l;
-
-					// Calculate the factor under the square root
-					float vDotOMinusC = v.Dot(o - c);
-					float f = vDotOMinusC * vDotOMinusC - ((o - c).LengthSquared() - r * r);
-
-					if (f > 0)
-					{
-						// Intersecting the sphere at two points, calculate whether this point is on the line of the view frustum
-						float s = sqrt(f);
-						float d1 = -vDotOMinusC + s;
-						float d2 = -vDotOMinusC - s;
-
-						if ((d1 >= 0 && d1 <= l) || (d2 >= 0 && d2 <= l))
-						{
-							// Interecting, check children again
-							insideViewFrustum = false;
-							intersects = true;
-							break;
-						}
-					}
-				}
+				Vector3 newMean = newSums[i] / newCounts[i];
 
-				if (!intersects)
+				if (Vector3::DistanceSquared(means[i], newMean) > settings->clusteringTolerance)
 				{
-					// The whole cube is outside, don't add it or any of its children
-					return;
+					meanChanged = true;
 				}
+
+				means[i] = newMean;
 			}
-			else if (insideCount != 0 && outsideCount != 0)
-			{
-				// Some positions are outside and some are inside the view frustum, check the children again
-				insideViewFrustum = false;
-			}
+		}
 
-			// Otherwise the cube is fully inside the view frustum as assumed
+		if (!meanChanged)
+		{
+			break;
 		}
 	}
 
-	// Check if only to return the vertices at the given level
-	if (octreeConstantBufferData.level >= 0)
+	// Merge the statistics of the child clusters
+	OctreeNodeClusters nodeClusters;
+	ZeroMemory(&nodeClusters, sizeof(OctreeNodeClusters));
+
+	for (int i = 0; i < itemCount; i++)
 	{
-		if (entry.depth == octreeConstantBufferData.level)
-		{
-			// Draw this vertex and don't traverse further
-			traverseChildren = false;
-			octreeVertices.push_back(GetVertexFromTraversalEntry(entry));
-		}
+		const OctreeNodeClusters* item = itemClusters[i];
+		int j = itemIndices[i];
+
+		nodeClusters.normalSums[clusters[i]] += item->normalSums[j];
+		nodeClusters.colorSums[clusters[i]][0] += item->colorSums[j][0];
+		nodeClusters.colorSums[clusters[i]][1] += item->colorSums[j][1];
+		nodeClusters.colorSums[clusters[i]][2] += item->colorSums[j][2];
+		nodeClusters.counts[clusters[i]] += item->counts[j];
 	}
-	else
+
+	// The angle between the merged mean and a vertex is at most the angle to the child cluster mean plus the cone of the child cluster
+	for (int i = 0; i < itemCount; i++)
 	{
-		// Only return the vertices that have a projected size smaller than the required splat size or it is a leaf node
-		float distanceToCamera = Vector3::Distance(octreeConstantBufferData.localCameraPosition, entry.position);
+		Vector3 mean = nodeClusters.normalSums[clusters[i]];
+		Vector3 itemMean = itemMeans[i];
+		mean.Normalize();
+		itemMean.Normalize();
 
-		// Scale the local space splat size by the fov and camera distance (result: size at that distance in local space)
-		float requiredSplatSize = octreeConstantBufferData.splatResolution * (2.0f * tan(octreeConstantBufferData.fovAngleY / 2.0f)) * distanceToCamera;
+		float angle = acos(max(-1.0f, min(1.0f, mean.Dot(itemMean)))) + itemClusters[i]->cones[itemIndices[i]];
+		nodeClusters.cones[clusters[i]] = min(XM_PI, max(nodeClusters.cones[clusters[i]], angle));
+	}
 
-		if ((entry.size < requiredSplatSize) || IsLeafNode())
-		{
-			// Draw this vertex, don't traverse further
-			traverseChildren = false;
-			octreeVertices.push_back(GetVertexFromTraversalEntry(entry));
-		}
+	properties.childrenMask = 0;
+	SetProperties(nodeClusters);
+
+	if (outClusters != NULL)
+	{
+		*outClusters = nodeClusters;
 	}
+}
 
-	if (traverseChildren)
+PointCloudEngine::OctreeNode::OctreeNode(const OctreeNodeTopology &topology, const OctreeNodeNormals &normals, const OctreeNodeShading &shading)
+{
+	childrenStartOrLeafPositionFactors = topology.childrenStartOrLeafPositionFactors;
+	properties.childrenMask = topology.childrenMask;
+
+	for (int i = 0; i < 4; i++)
 	{
-		size_t count = 0;
+		properties.normals[i] = normals.normals[i];
+		properties.colors[i] = shading.colors[i];
+	}
 
-		// Traverse the children
-		for (int i = 0; i < 8; i++)
-		{
-			// Check if this child exists and add it to the queue
-			if (properties.childrenMask & (1 << i))
-			{
-				OctreeNodeTraversalEntry childEntry;
-				childEntry.index = childrenStartOrLeafPositionFactors + count;
-				childEntry.position = GetChildPosition(entry.position, entry.size, i);
-				childEntry.size = entry.size * 0.5f;
-				childEntry.parentInsideViewFrustum = insideViewFrustum;
-				childEntry.depth = entry.depth + 1;
+	for (int i = 0; i < 3; i++)
+	{
+		properties.weights[i] = shading.weights[i];
+	}
+}
 
-				nodesQueue.push(childEntry);
+OctreeNodeTopology PointCloudEngine::OctreeNode::GetTopology() const
+{
+	// Zero the padding, this way the file content only depends on the octree
+	OctreeNodeTopology topology;
+	ZeroMemory(&topology, sizeof(OctreeNodeTopology));
 
-				count++;
-			}
-		}
+	topology.childrenStartOrLeafPositionFactors = childrenStartOrLeafPositionFactors;
+	topology.childrenMask = properties.childrenMask;
+
+	return topology;
+}
+
+OctreeNodeNormals PointCloudEngine::OctreeNode::GetNormals() const
+{
+	OctreeNodeNormals normals;
+
+	for (int i = 0; i < 4; i++)
+	{
+		normals.normals[i] = properties.normals[i];
 	}
+
+	return normals;
+}
+
+OctreeNodeShading PointCloudEngine::OctreeNode::GetShading() const
+{
+	OctreeNodeShading shading;
+	ZeroMemory(&shading, sizeof(OctreeNodeShading));
+
+	for (int i = 0; i < 3; i++)
+	{
+		shading.weights[i] = properties.weights[i];
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+		shading.colors[i] = properties.colors[i];
+	}
+
+	return shading;
 }
 
 bool PointCloudEngine::OctreeNode::IsLeafNode() const
@@ -490,7 +263,25 @@ bool PointCloudEngine::OctreeNode::IsLeafNode() const
 	return (properties.childrenMask == 0);
 }
 
-Vector3 PointCloudEngine::OctreeNode::GetChildPosition(const Vector3& parentPosition, const float& parentSize, int childIndex) const
+bool PointCloudEngine::OctreeNode::IsLeafEntry(const OctreeNodeCreationEntry &entry)
+{
+	// Only subdivide further when there is more than one vertex and the max octree depth is not met yet
+	return (entry.verticesCount <= 1) || (entry.depth >= settings->maxOctreeDepth);
+}
+
+int PointCloudEngine::OctreeNode::GetChildIndex(const Vector3 &position, const Vector3 &parentPosition)
+{
+	// Inverse of GetChildPosition, a set bit means that the position is on the negative side of the parent position in that axis
+	int childIndex = 0;
+
+	childIndex |= (position.x > parentPosition.x) ? 0 : 0x4;
+	childIndex |= (position.y > parentPosition.y) ? 0 : 0x2;
+	childIndex |= (position.z > parentPosition.z) ? 0 : 0x1;
+
+	return childIndex;
+}
+
+Vector3 PointCloudEngine::OctreeNode::GetChildPosition(const Vector3& parentPosition, const float& parentSize, int childIndex)
 {
 	/*
 	Vector3 childPositions[8] =
@@ -516,30 +307,30 @@ Vector3 PointCloudEngine::OctreeNode::GetChildPosition(const Vector3& parentPosi
 	);
 }
 
-OctreeNodeVertex PointCloudEngine::OctreeNode::GetVertexFromTraversalEntry(const OctreeNodeTraversalEntry& entry) const
+void PointCloudEngine::OctreeNode::SetProperties(const OctreeNodeClusters &clusters)
 {
-	OctreeNodeVertex vertex;
+	UINT vertexCount = 0;
 
-	// Check if this is a leaf node and therefore the position is stored more accurately in childrenStartOrLeafPositionFactors
-	if (IsLeafNode())
+	for (int i = 0; i < 4; i++)
 	{
-		// Extract the factors from childrenStartOrLeafPositionFactors and compute the more accurate position
-		Vector3 startPosition = entry.position - (0.5f * entry.size * Vector3::One);
+		vertexCount += clusters.counts[i];
+	}
 
-		// Get the factors from the 32bit uint
-		float factorX = ((childrenStartOrLeafPositionFactors >> 16) & 0xff) / 255.0f;
-		float factorY = ((childrenStartOrLeafPositionFactors >> 8) & 0xff) / 255.0f;
-		float factorZ = (childrenStartOrLeafPositionFactors & 0xff) / 255.0f;
+	for (int i = 0; i < 4; i++)
+	{
+		if (clusters.counts[i] > 0)
+		{
+			Vector3 mean = clusters.normalSums[i];
+			mean.Normalize();
 
-		vertex.position = startPosition + entry.size * Vector3(factorX, factorY, factorZ);
+			properties.normals[i] = ClusterNormal(mean, clusters.cones[i]);
+			properties.colors[i] = Color16(clusters.colorSums[i][0] / clusters.counts[i], clusters.colorSums[i][1] / clusters.counts[i], clusters.colorSums[i][2] / clusters.counts[i]);
+		}
 	}
-	else
+
+	// Assign weights (one of the 4 can be omitted because the sum is always 100%)
+	for (int i = 0; i < 3; i++)
 	{
-		vertex.position = entry.position;
+		properties.weights[i] = (255.0f * clusters.counts[i]) / vertexCount;
 	}
-
-	vertex.properties = properties;
-	vertex.size = entry.size;
-
-	return vertex;
 }
@@ -10,11 +10,20 @@ namespace PointCloudEngine
     {
     public:
         OctreeNode();
-        OctreeNode (std::queue<OctreeNodeCreationEntry> &nodeCreationQueue, std::vector<OctreeNode> &nodes, std::vector<UINT> &children, const OctreeNodeCreationEntry &entry);
+        OctreeNode(const std::vector<Vertex> &vertices, const OctreeNodeCreationEntry &entry, OctreeNodeClusters *outClusters = NULL);
+		OctreeNode(const OctreeNodeClusters* const* childrenClusters, int childrenCount, OctreeNodeClusters *outClusters = NULL);
+		OctreeNode(const OctreeNodeTopology &topology, const OctreeNodeNormals &normals, const OctreeNodeShading &shading);
 
-		void GetVertices(const std::vector<OctreeNode> &nodes, std::queue<OctreeNodeTraversalEntry>& nodesQueue, std::vector<OctreeNodeVertex>& octreeVertices, const OctreeNodeTraversalEntry& entry, const OctreeConstantBuffer& octreeConstantBufferData) const;
+		// Parts of the node in the split layout that is used at runtime
+		OctreeNodeTopology GetTopology() const;
+		OctreeNodeNormals GetNormals() const;
+		OctreeNodeShading GetShading() const;
         bool IsLeafNode() const;
 
+		static bool IsLeafEntry(const OctreeNodeCreationEntry &entry);
+		static int GetChildIndex(const Vector3 &position, const Vector3 &parentPosition);
+		static Vector3 GetChildPosition(const Vector3 &parentPosition, const float &parentSize, int childIndex);
+
 		// Stores either (1) the start index in the nodes array where the actual child indices are stored or (2) the leaf position factors
 		// (1) The childrenMask from the properties determines which children corresponds to which index
 		// (1) E.g. a childrenMask of 01011011 means that the array only stores the 2nd, 4th, 5th, 7th and 8th indices from the start right after each other
@@ -26,8 +35,7 @@ namespace PointCloudEngine
 		OctreeNodeProperties properties;
 
 	private:
-		Vector3 GetChildPosition(const Vector3 &parentPosition, const float &parentSize, int childIndex) const;
-		OctreeNodeVertex GetVertexFromTraversalEntry(const OctreeNodeTraversalEntry& entry) const;
+		void SetProperties(const OctreeNodeClusters &clusters);
     };
 }
 
@@ -0,0 +1,258 @@
+#include "OctreeOcclusion.h"
+
+PointCloudEngine::OctreeOcclusion::OctreeOcclusion(const OctreeConstantBuffer &octreeConstantBufferData)
+{
+	localCameraPosition = octreeConstantBufferData.localCameraPosition;
+
+	// The near plane normal points out of the view frustum
+	forward = -octreeConstantBufferData.localViewPlaneNearNormal;
+	forward.Normalize();
+
+	Vector3 topLeft = octreeConstantBufferData.localViewFrustumNearTopLeft - localCameraPosition;
+	Vector3 right = octreeConstantBufferData.localViewFrustumNearTopRight - octreeConstantBufferData.localViewFrustumNearTopLeft;
+	Vector3 down = octreeConstantBufferData.localViewFrustumNearBottomLeft - octreeConstantBufferData.localViewFrustumNearTopLeft;
+	nearDistance = topLeft.Dot(forward);
+
+	// The splat size is relative to the screen height, the texels are about as large as one splat unless the buffer size is limited
+	float splatSize = octreeConstantBufferData.overlapFactor * octreeConstantBufferData.splatResolution;
+	float bufferHeight = (splatSize > 0) ? min((float)OCCLUSION_BUFFER_MAX_HEIGHT, max(1.0f, 1.0f / splatSize)) : OCCLUSION_BUFFER_MAX_HEIGHT;
+
+	height = (UINT)bufferHeight;
+	width = max(1, (UINT)(bufferHeight * right.Length() / down.Length()));
+
+	// Project onto the near plane and scale the distances from its top left corner to texels
+	horizontal = right * (nearDistance * width / right.LengthSquared());
+	vertical = down * (nearDistance * height / down.LengthSquared());
+	horizontalOffset = topLeft.Dot(right) * width / right.LengthSquared();
+	verticalOffset = topLeft.Dot(down) * height / down.LengthSquared();
+
+	// The splats are never smaller than the sampling rate, this makes the nearby splats much larger than the splat resolution
+	texelScale = nearDistance * height / down.Length();
+	halfSamplingRate = octreeConstantBufferData.samplingRate / 2.0f;
+	splatDepthFactor = splatSize * tan(octreeConstantBufferData.fovAngleY / 2.0f);
+
+	coverageMasks.resize(width * height, 0);
+	splatDepths.resize(width * height, 0);
+
+	UINT levelWidth = width;
+	UINT levelHeight = height;
+
+	while (true)
+	{
+		levels.push_back(std::vector<float>(levelWidth * levelHeight, FLT_MAX));
+		levelWidths.push_back(levelWidth);
+		levelHeights.push_back(levelHeight);
+
+		if ((levelWidth == 1) && (levelHeight == 1))
+		{
+			break;
+		}
+
+		levelWidth = (levelWidth + 1) / 2;
+		levelHeight = (levelHeight + 1) / 2;
+	}
+}
+
+float PointCloudEngine::OctreeOcclusion::GetNearestDepth(const Vector3 &position, float size) const
+{
+	// The corner closest to the camera is offset from the center in the opposite direction of the forward vector in each axis
+	float extends = size / 2.0f;
+
+	return (position - localCameraPosition).Dot(forward) - extends * (fabs(forward.x) + fabs(forward.y) + fabs(forward.z));
+}
+
+bool PointCloudEngine::OctreeOcclusion::IsOccluded(const Vector3 &position, float size)
+{
+	testedCubesCount++;
+
+	// Bounding rectangle of the projected cube corners and the depth of the closest corner
+	float extends = size / 2.0f;
+	float minX = FLT_MAX;
+	float minY = FLT_MAX;
+	float maxX = -FLT_MAX;
+	float maxY = -FLT_MAX;
+	float minDepth = FLT_MAX;
+
+	for (int i = 0; i < 8; i++)
+	{
+		Vector3 corner = position - localCameraPosition;
+		corner.x += (i & 0x4) ? -extends : extends;
+		corner.y += (i & 0x2) ? -extends : extends;
+		corner.z += (i & 0x1) ? -extends : extends;
+
+		float depth = corner.Dot(forward);
+
+		// The projection of a corner in front of the near plane is unbounded
+		if (depth <= nearDistance)
+		{
+			return false;
+		}
+
+		float x = corner.Dot(horizontal) / depth - horizontalOffset;
+		float y = corner.Dot(vertical) / depth - verticalOffset;
+
+		minX = min(minX, x);
+		minY = min(minY, y);
+		maxX = max(maxX, x);
+		maxY = max(maxY, y);
+		minDepth = min(minDepth, depth);
+	}
+
+	// Cubes outside of the buffer are left to the view frustum culling
+	if ((maxX < 0) || (maxY < 0) || (minX >= width) || (minY >= height))
+	{
+		return false;
+	}
+
+	UINT x0 = (UINT)max(0.0f, minX);
+	UINT y0 = (UINT)max(0.0f, minY);
+	UINT x1 = (UINT)min(width - 1.0f, maxX);
+	UINT y1 = (UINT)min(height - 1.0f, maxY);
+
+	// Use the level where the rectangle overlaps at most 2x2 texels
+	UINT level = 0;
+
+	while ((((x1 >> level) - (x0 >> level)) > 1) || (((y1 >> level) - (y0 >> level)) > 1))
+	{
+		level++;
+	}
+
+	float maxDepth = 0;
+
+	for (UINT y = (y0 >> level); y <= (y1 >> level); y++)
+	{
+		for (UINT x = (x0 >> level); x <= (x1 >> level); x++)
+		{
+			maxDepth = max(maxDepth, levels[level][y * levelWidths[level] + x]);
+		}
+	}
+
+	if (minDepth > maxDepth)
+	{
+		occludedCubesCount++;
+		return true;
+	}
+
+	return false;
+}
+
+void PointCloudEngine::OctreeOcclusion::AddOccluder(const Vector3 &position, float size)
+{
+	Vector3 offset = position - localCameraPosition;
+	float depth = offset.Dot(forward);
+
+	if (depth <= nearDistance)
+	{
+		return;
+	}
+
+	float x = offset.Dot(horizontal) / depth - horizontalOffset;
+	float y = offset.Dot(vertical) / depth - verticalOffset;
+
+	// The splat disc fully covers the square inside of it, the points of the node only cover the projection of the node
+	float splatHalfSize = max(halfSamplingRate, splatDepthFactor * offset.Length());
+	float extends = min(size / 2.0f, splatHalfSize / sqrt(2.0f)) * texelScale / depth;
+
+	float minX = max(0.0f, x - extends);
+	float minY = max(0.0f, y - extends);
+	float maxX = min((float)width, x + extends);
+	float maxY = min((float)height, y + extends);
+
+	if ((minX >= maxX) || (minY >= maxY))
+	{
+		return;
+	}
+
+	// Keep the largest depth of all the splats that cover a texel together
+	float splatDepth = depth + splatHalfSize;
+
+	for (UINT texelY = (UINT)minY; texelY < (UINT)ceil(maxY); texelY++)
+	{
+		// Rows of sub-texels that are inside of the splat, each row is 4 bits of the mask
+		unsigned short rowsMask = GetCoverageMask(texelY, minY, maxY);
+
+		if (rowsMask == 0)
+		{
+			continue;
+		}
+
+		for (UINT texelX = (UINT)minX; texelX < (UINT)ceil(maxX); texelX++)
+		{
+			UINT index = texelY * width + texelX;
+
+			// The nodes are drawn front to back, a covered texel already has the depth of the closest splats
+			if (coverageMasks[index] == 0xffff)
+			{
+				continue;
+			}
+
+			unsigned short columnsMask = GetCoverageMask(texelX, minX, maxX);
+			unsigned short mask = 0;
+
+			for (int row = 0; row < 4; row++)
+			{
+				if (rowsMask & (1 << row))
+				{
+					mask |= columnsMask << (4 * row);
+				}
+			}
+
+			if (mask == 0)
+			{
+				continue;
+			}
+
+			coverageMasks[index] |= mask;
+			splatDepths[index] = max(splatDepths[index], splatDepth);
+
+			if (coverageMasks[index] == 0xffff)
+			{
+				levels[0][index] = splatDepths[index];
+				UpdatePyramid(texelX, texelY);
+			}
+		}
+	}
+}
+
+unsigned short PointCloudEngine::OctreeOcclusion::GetCoverageMask(float texel, float minimum, float maximum) const
+{
+	// Bit i is set when the sub-texel from texel + i / 4 to texel + (i + 1) / 4 lies completely between the minimum and the maximum
+	int first = max(0, (int)ceil(4 * (minimum - texel)));
+	int last = min(4, (int)floor(4 * (maximum - texel)));
+
+	if (first >= last)
+	{
+		return 0;
+	}
+
+	return ((1 << last) - 1) & ~((1 << first) - 1);
+}
+
+void PointCloudEngine::OctreeOcclusion::UpdatePyramid(UINT x, UINT y)
+{
+	// Each texel is the max of the 2x2 texels below it, stop as soon as a texel does not change
+	for (UINT level = 1; level < levels.size(); level++)
+	{
+		x /= 2;
+		y /= 2;
+
+		float depth = 0;
+
+		for (UINT childY = 2 * y; childY < min(2 * y + 2, levelHeights[level - 1]); childY++)
+		{
+			for (UINT childX = 2 * x; childX < min(2 * x + 2, levelWidths[level - 1]); childX++)
+			{
+				depth = max(depth, levels[level - 1][childY * levelWidths[level - 1] + childX]);
+			}
+		}
+
+		float &levelDepth = levels[level][y * levelWidths[level] + x];
+
+		if (levelDepth == depth)
+		{
+			break;
+		}
+
+		levelDepth = depth;
+	}
+}
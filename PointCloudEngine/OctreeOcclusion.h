@@ -0,0 +1,68 @@
+#ifndef OCTREEOCCLUSION_H
+#define OCTREEOCCLUSION_H
+
+// Largest height of the occlusion depth buffer in texels, the width follows from the aspect ratio of the view frustum
+#define OCCLUSION_BUFFER_MAX_HEIGHT 256
+
+#pragma once
+#include "PointCloudEngine.h"
+
+namespace PointCloudEngine
+{
+	// Software occlusion culling for the CPU traversal of the octree, the nodes have to be drawn front to back
+	// The splats of the drawn nodes are accumulated in a coarse depth buffer where a texel counts as covered once its splats contain all of its 4x4 sub-texels
+	// Covered texels store the largest depth of their splats, a max depth mip pyramid of them rejects the nodes whose bounding cube lies behind all the texels it overlaps
+	// The projection is computed from the local view frustum, this way it works without the matrices of a camera
+	class OctreeOcclusion
+	{
+	public:
+		OctreeOcclusion(const OctreeConstantBuffer &octreeConstantBufferData);
+
+		// Depth of the cube corner closest to the camera, traversing in the order of this depth draws the nodes front to back
+		float GetNearestDepth(const Vector3 &position, float size) const;
+
+		// True when the whole cube is behind the covered texels that it overlaps
+		bool IsOccluded(const Vector3 &position, float size);
+
+		// Adds the splat of a drawn node to the texels that the projection of the node overlaps, clamped to the area that its splat covers
+		void AddOccluder(const Vector3 &position, float size);
+
+		// Counts the tested and the occluded cubes for the traversal statistics
+		UINT testedCubesCount = 0;
+		UINT occludedCubesCount = 0;
+
+	private:
+		Vector3 localCameraPosition;
+		Vector3 forward;
+		float nearDistance;
+
+		// Texel coordinates on the near plane: x = dot(p - camera, horizontal) / depth - horizontalOffset (same for y)
+		Vector3 horizontal;
+		Vector3 vertical;
+		float horizontalOffset;
+		float verticalOffset;
+
+		// Texels per unit at a depth of 1, half of the sampling rate and the factor from the distance of a splat to half of its size (same size as in the geometry shader)
+		float texelScale;
+		float halfSamplingRate;
+		float splatDepthFactor;
+
+		UINT width;
+		UINT height;
+
+		// Mask of the 4x4 sub-texels that are fully inside of a splat and largest depth of these splats in each texel until it is covered
+		// Overlapping splats set the same bits, this way a texel is only covered when there is no hole left in it
+		std::vector<unsigned short> coverageMasks;
+		std::vector<float> splatDepths;
+
+		// Max depth pyramid, level 0 contains the depths of the covered texels (FLT_MAX when not covered)
+		std::vector<std::vector<float>> levels;
+		std::vector<UINT> levelWidths;
+		std::vector<UINT> levelHeights;
+
+		unsigned short GetCoverageMask(float texel, float minimum, float maximum) const;
+		void UpdatePyramid(UINT x, UINT y);
+	};
+}
+
+#endif
@@ -0,0 +1,126 @@
+#include "OctreePageCache.h"
+
+PointCloudEngine::OctreePageCache::OctreePageCache(const std::wstring &octreeFilepath, const OctreeFileHeader &header, const std::vector<OctreeFileBlock> &compressedBlocks, size_t budgetBytes) : header(header), compressedBlocks(compressedBlocks)
+{
+	octreeFile.open(octreeFilepath, std::ios::in | std::ios::binary);
+
+	if (!octreeFile.is_open())
+	{
+		throw std::exception("Could not open .octree file for paging!");
+	}
+
+	nodesCount = header.nodesSize;
+	pageSize = (header.compressionBlockSize > 0) ? header.compressionBlockSize : OCTREE_PAGE_SIZE;
+
+	// Always keep at least the first page and the page that is currently traversed
+	maxPagesCount = max(2, budgetBytes / (pageSize * sizeof(OctreeNode)));
+
+	// The first page with the upper levels is needed by every traversal
+	LoadPage(0, pages[0].nodes);
+}
+
+PointCloudEngine::OctreeNode PointCloudEngine::OctreePageCache::GetNode(size_t index)
+{
+	size_t pageIndex = index / pageSize;
+
+	if (pageIndex != lastPageIndex)
+	{
+		lastPage = &GetPage(pageIndex);
+		lastPageIndex = pageIndex;
+	}
+
+	return lastPage->nodes[index - pageIndex * pageSize];
+}
+
+size_t PointCloudEngine::OctreePageCache::GetNodesCount() const
+{
+	return nodesCount;
+}
+
+size_t PointCloudEngine::OctreePageCache::GetCachedBytes() const
+{
+	size_t cachedBytes = 0;
+
+	for (auto it = pages.begin(); it != pages.end(); it++)
+	{
+		cachedBytes += it->second.nodes.size() * sizeof(OctreeNode);
+	}
+
+	return cachedBytes;
+}
+
+const PointCloudEngine::OctreePageCache::OctreePage& PointCloudEngine::OctreePageCache::GetPage(size_t pageIndex)
+{
+	auto it = pages.find(pageIndex);
+
+	if (it != pages.end())
+	{
+		// Move the page to the front of the recently used list
+		if (pageIndex != 0)
+		{
+			recentlyUsedPages.splice(recentlyUsedPages.begin(), recentlyUsedPages, it->second.recentlyUsedPosition);
+		}
+
+		return it->second;
+	}
+
+	// Evict the least recently used pages before loading a new one
+	while ((pages.size() >= maxPagesCount) && !recentlyUsedPages.empty())
+	{
+		pages.erase(recentlyUsedPages.back());
+		recentlyUsedPages.pop_back();
+	}
+
+	OctreePage &page = pages[pageIndex];
+	LoadPage(pageIndex, page.nodes);
+
+	recentlyUsedPages.push_front(pageIndex);
+	page.recentlyUsedPosition = recentlyUsedPages.begin();
+
+	return page;
+}
+
+void PointCloudEngine::OctreePageCache::LoadPage(size_t pageIndex, std::vector<OctreeNode> &outNodes)
+{
+	const size_t nodesStart = pageIndex * pageSize;
+	outNodes.resize(min(pageSize, nodesCount - nodesStart));
+	octreeFile.clear();
+
+	if (compressedBlocks.empty())
+	{
+		// The uncompressed nodes are split into three arrays, read the range of the page from each of them
+		std::vector<OctreeNodeTopology> topology(outNodes.size());
+		std::vector<OctreeNodeNormals> normals(outNodes.size());
+		std::vector<OctreeNodeShading> shading(outNodes.size());
+
+		octreeFile.seekg(header.GetTopologyOffset() + nodesStart * sizeof(OctreeNodeTopology));
+		octreeFile.read((char*)topology.data(), topology.size() * sizeof(OctreeNodeTopology));
+		octreeFile.seekg(header.GetNormalsOffset() + nodesStart * sizeof(OctreeNodeNormals));
+		octreeFile.read((char*)normals.data(), normals.size() * sizeof(OctreeNodeNormals));
+		octreeFile.seekg(header.GetShadingOffset() + nodesStart * sizeof(OctreeNodeShading));
+		octreeFile.read((char*)shading.data(), shading.size() * sizeof(OctreeNodeShading));
+
+		if (!octreeFile)
+		{
+			throw std::exception("Could not read .octree file page!");
+		}
+
+		for (size_t i = 0; i < outNodes.size(); i++)
+		{
+			outNodes[i] = OctreeNode(topology[i], normals[i], shading[i]);
+		}
+	}
+	else
+	{
+		const OctreeFileBlock &block = compressedBlocks[pageIndex];
+		std::vector<byte> blockData(block.size);
+
+		octreeFile.seekg(block.offset);
+		octreeFile.read((char*)blockData.data(), block.size);
+
+		if (!octreeFile || !OctreeCompression::DecompressBlock(blockData.data(), block.size, outNodes.size(), block.firstChildrenStart, outNodes.data()))
+		{
+			throw std::exception("Could not decompress .octree file page!");
+		}
+	}
+}
@@ -0,0 +1,50 @@
+#ifndef OCTREEPAGECACHE_H
+#define OCTREEPAGECACHE_H
+
+// Amount of nodes in each page of uncompressed octree files, compressed files use their compression blocks as pages
+#define OCTREE_PAGE_SIZE 16384
+
+#pragma once
+#include "PointCloudEngine.h"
+
+namespace PointCloudEngine
+{
+	// Loads the nodes of an octree file on demand in pages of consecutive nodes (breadth first order) and keeps them in a least recently used cache
+	// The first page contains the upper levels of the octree and is never evicted, all the other pages are evicted when the cache exceeds its byte budget
+	class OctreePageCache
+	{
+	public:
+		OctreePageCache(const std::wstring &octreeFilepath, const OctreeFileHeader &header, const std::vector<OctreeFileBlock> &compressedBlocks, size_t budgetBytes);
+
+		OctreeNode GetNode(size_t index);
+		size_t GetNodesCount() const;
+		size_t GetCachedBytes() const;
+
+	private:
+		struct OctreePage
+		{
+			std::vector<OctreeNode> nodes;
+			std::list<size_t>::iterator recentlyUsedPosition;
+		};
+
+		std::ifstream octreeFile;
+		OctreeFileHeader header;
+		size_t nodesCount;
+		size_t pageSize;
+		size_t maxPagesCount;
+		std::vector<OctreeFileBlock> compressedBlocks;
+
+		// Pages ordered from the most to the least recently used one, the first page is not part of this list
+		std::unordered_map<size_t, OctreePage> pages;
+		std::list<size_t> recentlyUsedPages;
+
+		// Consecutive nodes are usually in the same page, avoid the lookup for them
+		size_t lastPageIndex = SIZE_MAX;
+		const OctreePage* lastPage = NULL;
+
+		const OctreePage& GetPage(size_t pageIndex);
+		void LoadPage(size_t pageIndex, std::vector<OctreeNode> &outNodes);
+	};
+}
+
+#endif
@@ -21,32 +21,14 @@ void OctreeRenderer::Initialize()
     hr = d3d11Device->CreateBuffer(&octreeConstantBufferDesc, NULL, &octreeConstantBuffer);
 	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateBuffer) + L" failed for the " + NAMEOF(octreeRendererConstantBuffer));
 
-    // Create the buffer for the compute shader that stores all the octree nodes
-    // Maximum size is ~4.2 GB due to UINT_MAX
-    D3D11_BUFFER_DESC nodesBufferDesc;
-    ZeroMemory(&nodesBufferDesc, sizeof(nodesBufferDesc));
-    nodesBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-    nodesBufferDesc.ByteWidth = octree->nodes.size() * sizeof(OctreeNode);
-    nodesBufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-    nodesBufferDesc.StructureByteStride = sizeof(OctreeNode);
-    nodesBufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
-
-    D3D11_SUBRESOURCE_DATA nodesBufferData;
-    ZeroMemory(&nodesBufferData, sizeof(nodesBufferData));
-	nodesBufferData.pSysMem = octree->nodes.data();
-
-    hr = d3d11Device->CreateBuffer(&nodesBufferDesc, &nodesBufferData, &nodesBuffer);
-	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateBuffer) + L" failed for the " + NAMEOF(nodesBuffer));
-
-    D3D11_SHADER_RESOURCE_VIEW_DESC nodesBufferSRVDesc;
-    ZeroMemory(&nodesBufferSRVDesc, sizeof(nodesBufferSRVDesc));
-    nodesBufferSRVDesc.Format = DXGI_FORMAT_UNKNOWN;
-    nodesBufferSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
-    nodesBufferSRVDesc.Buffer.ElementWidth = sizeof(OctreeNode);
-    nodesBufferSRVDesc.Buffer.NumElements = octree->nodes.size();
-
-    hr = d3d11Device->CreateShaderResourceView(nodesBuffer, &nodesBufferSRVDesc, &nodesBufferSRV);
-	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateShaderResourceView) + L" failed for the " + NAMEOF(nodesBufferSRV));
+    // Paged octrees only keep some of the nodes in memory and are always traversed on the cpu
+    if (!octree->IsPaged())
+    {
+        // Create the buffers for the compute shader that store all the octree nodes, the compute shader only reads the topology and normals
+        CreateNodesBuffer(octree->GetTopology(), sizeof(OctreeNodeTopology), NAMEOF(topologyBuffer), &topologyBuffer, &topologyBufferSRV);
+        CreateNodesBuffer(octree->GetNormals(), sizeof(OctreeNodeNormals), NAMEOF(normalsBuffer), &normalsBuffer, &normalsBufferSRV);
+        CreateNodesBuffer(octree->GetShading(), sizeof(OctreeNodeShading), NAMEOF(shadingBuffer), &shadingBuffer, &shadingBufferSRV);
+    }
 
     // Create general buffer description for append/consume buffer
     D3D11_BUFFER_DESC appendConsumeBufferDesc;
@@ -79,8 +61,14 @@ void OctreeRenderer::Initialize()
     hr = d3d11Device->CreateUnorderedAccessView(secondBuffer, &appendConsumeBufferUAVDesc, &secondBufferUAV);
 	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateUnorderedAccessView) + L" failed for the " + NAMEOF(secondBufferUAV));
 
-    // Create the vertex append buffer
-    hr = d3d11Device->CreateBuffer(&appendConsumeBufferDesc, NULL, &vertexAppendBuffer);
+    // Create the vertex append buffer, it stores the compact vertices or the whole traversal entries for octrees that are too deep for the compact vertices
+    UINT vertexStride = UseCompactVertices() ? sizeof(OctreeNodeCompactVertex) : sizeof(OctreeNodeTraversalEntry);
+
+    D3D11_BUFFER_DESC vertexAppendBufferDesc = appendConsumeBufferDesc;
+    vertexAppendBufferDesc.ByteWidth = settings->appendBufferCount * vertexStride;
+    vertexAppendBufferDesc.StructureByteStride = vertexStride;
+
+    hr = d3d11Device->CreateBuffer(&vertexAppendBufferDesc, NULL, &vertexAppendBuffer);
 	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateBuffer) + L" failed for the " + NAMEOF(vertexAppendBuffer));
 
     hr = d3d11Device->CreateUnorderedAccessView(vertexAppendBuffer, &appendConsumeBufferUAVDesc, &vertexAppendBufferUAV);
@@ -90,7 +78,7 @@ void OctreeRenderer::Initialize()
     ZeroMemory(&vertexAppendBufferSRVDesc, sizeof(vertexAppendBufferSRVDesc));
     vertexAppendBufferSRVDesc.Format = DXGI_FORMAT_UNKNOWN;
     vertexAppendBufferSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
-    vertexAppendBufferSRVDesc.Buffer.ElementWidth = sizeof(OctreeNodeTraversalEntry);
+    vertexAppendBufferSRVDesc.Buffer.ElementWidth = vertexStride;
     vertexAppendBufferSRVDesc.Buffer.NumElements = settings->appendBufferCount;
 
     hr = d3d11Device->CreateShaderResourceView(vertexAppendBuffer, &vertexAppendBufferSRVDesc, &vertexAppendBufferSRV);
@@ -181,6 +169,8 @@ void OctreeRenderer::Draw()
 	octreeConstantBufferData.blendFactor = settings->blendFactor;
     octreeConstantBufferData.useCulling = settings->useCulling;
     octreeConstantBufferData.level = settings->octreeLevel;
+	octreeConstantBufferData.rootPosition = octree->rootPosition;
+	octreeConstantBufferData.rootSize = octree->rootSize;
 
     // Draw overlapping splats to make sure that continuous surfaces without holes are drawn
     // Higher overlap factor reduces the spacing between tilted splats but reduces the detail (blend overlapping splats to improve this)
@@ -199,8 +189,13 @@ void OctreeRenderer::Draw()
     d3d11DevCon->GSSetConstantBuffers(0, 1, &octreeConstantBuffer);
 	d3d11DevCon->PSSetConstantBuffers(0, 1, &octreeConstantBuffer);
 
+	auto traversalStartTime = std::chrono::high_resolution_clock::now();
+
+	// The page cache, the priority queue of the point budget, the cut of the incremental traversal and the occlusion depth buffer are only implemented for the CPU traversal
+	bool useGPUTraversal = settings->useGPUTraversal && !octree->IsPaged() && (settings->octreePointBudget == 0) && !settings->octreeIncrementalTraversal && !settings->octreeOcclusionCulling;
+
     // Get the vertex buffer and use the specified implementation
-    if (settings->useGPUTraversal)
+    if (useGPUTraversal)
     {
         DrawOctreeCompute();
     }
@@ -208,18 +203,36 @@ void OctreeRenderer::Draw()
     {
         DrawOctree();
     }
+
+	if (settings->octreeTraversalBenchmark)
+	{
+		// Report the amount of traversed and view frustum tested nodes and the memory that the CPU traversal touched together with the time for traversing and drawing this frame
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - traversalStartTime).count();
+
+		std::wstringstream outputStream;
+		outputStream << L"Octree traversal: " << (useGPUTraversal ? L"GPU" : L"CPU") << L", ";
+		outputStream << traversalStatistics.traversedNodesCount << L" traversed nodes, " << traversalStatistics.frustumTestedNodesCount << L" frustum tested nodes, ";
+		outputStream << traversalStatistics.planeTestsCount << L" plane tests, " << traversalStatistics.touchedCacheLinesCount << L" touched cache lines, " << traversalStatistics.touchedPagesCount << L" touched pages, ";
+		outputStream << traversalStatistics.occludedNodesCount << L" of " << traversalStatistics.occlusionTestedNodesCount << L" occlusion tested nodes culled (" << ((traversalStatistics.occlusionTestedNodesCount > 0) ? (100.0 * traversalStatistics.occludedNodesCount) / traversalStatistics.occlusionTestedNodesCount : 0.0) << L"%), ";
+		outputStream << traversalStatistics.emittedVerticesCount << L" emitted vertices, " << traversalStatistics.truncatedVerticesCount << L" truncated vertices, " << milliseconds << L" ms" << std::endl;
+		OutputDebugString(outputStream.str().c_str());
+	}
 }
 
 void OctreeRenderer::Release()
 {
     SafeDelete(octree);
 
-    SAFE_RELEASE(nodesBuffer);
+    SAFE_RELEASE(topologyBuffer);
+    SAFE_RELEASE(normalsBuffer);
+    SAFE_RELEASE(shadingBuffer);
     SAFE_RELEASE(firstBuffer);
     SAFE_RELEASE(secondBuffer);
     SAFE_RELEASE(vertexAppendBuffer);
     SAFE_RELEASE(structureCountBuffer);
-    SAFE_RELEASE(nodesBufferSRV);
+    SAFE_RELEASE(topologyBufferSRV);
+    SAFE_RELEASE(normalsBufferSRV);
+    SAFE_RELEASE(shadingBufferSRV);
     SAFE_RELEASE(firstBufferUAV);
     SAFE_RELEASE(secondBufferUAV);
 	SAFE_RELEASE(vertexAppendBufferSRV);
@@ -238,10 +251,64 @@ void PointCloudEngine::OctreeRenderer::RemoveComponentFromSceneObject()
 	sceneObject->RemoveComponent(this);
 }
 
+bool PointCloudEngine::OctreeRenderer::UseCompactVertices()
+{
+	// The vertex shader reads the nodes from the buffers of all the nodes and the cells have to fit into 16 bits
+	return !octree->IsPaged() && (settings->maxOctreeDepth <= COMPACT_VERTEX_MAX_DEPTH);
+}
+
 void PointCloudEngine::OctreeRenderer::DrawOctree()
 {
+	if (UseCompactVertices())
+	{
+		// Create a new structured buffer sized to the compact vertices of the cpu traversal and draw them like the vertices of the compute shader
+		std::vector<OctreeNodeCompactVertex> octreeVertices = octree->GetCompactVertices(octreeConstantBufferData, settings->octreeTraversalBenchmark ? &traversalStatistics : NULL);
+
+		vertexBufferCount = octreeVertices.size();
+		traversalStatistics.emittedVerticesCount = vertexBufferCount;
+		traversalStatistics.truncatedVerticesCount = 0;
+
+		if (vertexBufferCount > 0)
+		{
+			ID3D11Buffer* vertexBuffer = NULL;
+			ID3D11ShaderResourceView* vertexBufferSRV = NULL;
+
+			D3D11_BUFFER_DESC vertexBufferDesc;
+			ZeroMemory(&vertexBufferDesc, sizeof(vertexBufferDesc));
+			vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+			vertexBufferDesc.ByteWidth = sizeof(OctreeNodeCompactVertex) * vertexBufferCount;
+			vertexBufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+			vertexBufferDesc.StructureByteStride = sizeof(OctreeNodeCompactVertex);
+			vertexBufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+
+			D3D11_SUBRESOURCE_DATA vertexBufferData;
+			ZeroMemory(&vertexBufferData, sizeof(vertexBufferData));
+			vertexBufferData.pSysMem = &octreeVertices[0];
+
+			hr = d3d11Device->CreateBuffer(&vertexBufferDesc, &vertexBufferData, &vertexBuffer);
+			ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateBuffer) + L" failed for the " + NAMEOF(vertexBuffer));
+
+			D3D11_SHADER_RESOURCE_VIEW_DESC vertexBufferSRVDesc;
+			ZeroMemory(&vertexBufferSRVDesc, sizeof(vertexBufferSRVDesc));
+			vertexBufferSRVDesc.Format = DXGI_FORMAT_UNKNOWN;
+			vertexBufferSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+			vertexBufferSRVDesc.Buffer.ElementWidth = sizeof(OctreeNodeCompactVertex);
+			vertexBufferSRVDesc.Buffer.NumElements = vertexBufferCount;
+
+			hr = d3d11Device->CreateShaderResourceView(vertexBuffer, &vertexBufferSRVDesc, &vertexBufferSRV);
+			ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateShaderResourceView) + L" failed for the " + NAMEOF(vertexBufferSRV));
+
+			DrawStructuredVertices(vertexBufferSRV);
+
+			SAFE_RELEASE(vertexBufferSRV);
+			SAFE_RELEASE(vertexBuffer);
+		}
+
+		return;
+	}
+
 	// Create new buffer from the current octree traversal on the cpu
-    std::vector<OctreeNodeVertex> octreeVertices = octree->GetVertices(octreeConstantBufferData);
+    std::vector<OctreeNodeVertex> octreeVertices = octree->GetVertices(octreeConstantBufferData, settings->octreeTraversalBenchmark ? &traversalStatistics : NULL);
 
     vertexBufferCount = octreeVertices.size();
 
@@ -313,13 +380,34 @@ void PointCloudEngine::OctreeRenderer::DrawOctree()
 
 void PointCloudEngine::OctreeRenderer::DrawOctreeCompute()
 {
+	// The compute shader only tests the children of each node against the view frustum, cull the root node here
+	// The view frustum tests of the compute shader are not counted
+	OctreeCulling culling(octreeConstantBufferData);
+	float rootPositions[3][8] = { { octree->rootPosition.x }, { octree->rootPosition.y }, { octree->rootPosition.z } };
+	UINT rootPlaneMasks[8] = { VIEW_FRUSTUM_PLANE_MASK };
+
+	traversalStatistics.traversedNodesCount = 0;
+	traversalStatistics.frustumTestedNodesCount = 0;
+	traversalStatistics.planeTestsCount = 0;
+	traversalStatistics.touchedCacheLinesCount = 0;
+	traversalStatistics.touchedPagesCount = 0;
+	traversalStatistics.occlusionTestedNodesCount = 0;
+	traversalStatistics.occludedNodesCount = 0;
+
+	if (octreeConstantBufferData.useCulling && (culling.ClassifyCubes(rootPositions, 1, octree->rootSize, VIEW_FRUSTUM_PLANE_MASK, rootPlaneMasks) == 0))
+	{
+		vertexBufferCount = 0;
+		return;
+	}
+
     // Set the constant buffer
     d3d11DevCon->CSSetConstantBuffers(0, 1, &octreeConstantBuffer);
 
     // Use compute shader to traverse the octree
     UINT zero = 0;
-    d3d11DevCon->CSSetShader(octreeComputeShader->computeShader, 0, 0);
-    d3d11DevCon->CSSetShaderResources(0, 1, &nodesBufferSRV);
+    d3d11DevCon->CSSetShader((UseCompactVertices() ? octreeComputeShader : octreeComputeEntriesShader)->computeShader, 0, 0);
+    d3d11DevCon->CSSetShaderResources(0, 1, &topologyBufferSRV);
+    d3d11DevCon->CSSetShaderResources(1, 1, &normalsBufferSRV);
     d3d11DevCon->CSSetUnorderedAccessViews(2, 1, &vertexAppendBufferUAV, &zero);
 
 	// Set root entry for the first buffer, will be used as input consume buffer in the shader
@@ -327,7 +415,7 @@ void PointCloudEngine::OctreeRenderer::DrawOctreeCompute()
 	rootEntry.index = 0;
 	rootEntry.position = octree->rootPosition;
 	rootEntry.size = octree->rootSize;
-	rootEntry.parentInsideViewFrustum = false;
+	rootEntry.viewFrustumPlaneMask = rootPlaneMasks[0];
 	rootEntry.depth = 0;
 
 	D3D11_BOX rootEntryBox;
@@ -366,6 +454,8 @@ void PointCloudEngine::OctreeRenderer::DrawOctreeCompute()
         // Update the input count of the constant buffer to make sure that not too much is appended or consumed
         d3d11DevCon->UpdateSubresource(octreeConstantBuffer, 0, NULL, &octreeConstantBufferData, 0, 0);
 
+        traversalStatistics.traversedNodesCount += octreeConstantBufferData.inputCount;
+
         // Execution of the compute shader, appends the indices of the nodes that should be checked next to the output append buffer
         d3d11DevCon->Dispatch(ceil(octreeConstantBufferData.inputCount / 1024.0f), 1, 1);
 
@@ -384,17 +474,28 @@ void PointCloudEngine::OctreeRenderer::DrawOctreeCompute()
 
     } while (octreeConstantBufferData.inputCount > 0);
 
-    // Get the actual vertex buffer count from the vertex append buffer structure counter
-    vertexBufferCount = min(settings->appendBufferCount, GetStructureCount(vertexAppendBufferUAV));
+    // Get the actual vertex buffer count from the vertex append buffer structure counter, the vertices above the append buffer count were dropped
+	UINT appendedVerticesCount = GetStructureCount(vertexAppendBufferUAV);
+    vertexBufferCount = min(settings->appendBufferCount, appendedVerticesCount);
+	traversalStatistics.emittedVerticesCount = vertexBufferCount;
+	traversalStatistics.truncatedVerticesCount = appendedVerticesCount - vertexBufferCount;
 
     // Unbind nodes and vertex append buffer in order to use it in the vertex shader
     d3d11DevCon->CSSetShaderResources(0, 1, nullSRV);
+    d3d11DevCon->CSSetShaderResources(1, 1, nullSRV);
     d3d11DevCon->CSSetUnorderedAccessViews(0, 1, nullUAV, &zero);
     d3d11DevCon->CSSetUnorderedAccessViews(1, 1, nullUAV, &zero);
     d3d11DevCon->CSSetUnorderedAccessViews(2, 1, nullUAV, &zero);
 
-    // Set the shaders, only the vertex shader is different from the CPU implementation
-    d3d11DevCon->VSSetShader(octreeComputeVSShader->vertexShader, 0, 0);
+	DrawStructuredVertices(vertexAppendBufferSRV);
+}
+
+void PointCloudEngine::OctreeRenderer::DrawStructuredVertices(ID3D11ShaderResourceView *verticesSRV)
+{
+    UINT zero = 0;
+
+    // Set the shaders, only the vertex shader is different from the CPU implementation and reads the same vertices that the compute shader appends
+    d3d11DevCon->VSSetShader((UseCompactVertices() ? octreeComputeVSShader : octreeComputeEntriesVSShader)->vertexShader, 0, 0);
 
     if (settings->viewMode == ViewMode::OctreeSplats)
     {
@@ -412,9 +513,11 @@ void PointCloudEngine::OctreeRenderer::DrawOctreeCompute()
         d3d11DevCon->PSSetShader(octreeClusterShader->pixelShader, 0, 0);
     }
 
-    // Set the vertex append buffer as structured buffer in the vertex shader
-    d3d11DevCon->VSSetShaderResources(0, 1, &nodesBufferSRV);
-    d3d11DevCon->VSSetShaderResources(1, 1, &vertexAppendBufferSRV);
+    // Set the node buffers and the vertices as structured buffers in the vertex shader
+    d3d11DevCon->VSSetShaderResources(0, 1, &topologyBufferSRV);
+    d3d11DevCon->VSSetShaderResources(1, 1, &normalsBufferSRV);
+    d3d11DevCon->VSSetShaderResources(2, 1, &shadingBufferSRV);
+    d3d11DevCon->VSSetShaderResources(3, 1, &verticesSRV);
 
     // Set an empty input layout and vertex buffer that only sends the vertex id to the shader
     d3d11DevCon->IASetInputLayout(NULL);
@@ -434,6 +537,37 @@ void PointCloudEngine::OctreeRenderer::DrawOctreeCompute()
     // Unbind the shader resources
     d3d11DevCon->VSSetShaderResources(0, 1, nullSRV);
     d3d11DevCon->VSSetShaderResources(1, 1, nullSRV);
+    d3d11DevCon->VSSetShaderResources(2, 1, nullSRV);
+    d3d11DevCon->VSSetShaderResources(3, 1, nullSRV);
+}
+
+void PointCloudEngine::OctreeRenderer::CreateNodesBuffer(const void *data, UINT stride, const std::wstring &name, ID3D11Buffer **outBuffer, ID3D11ShaderResourceView **outBufferSRV)
+{
+    // Maximum size is ~4.2 GB due to UINT_MAX
+    D3D11_BUFFER_DESC nodesBufferDesc;
+    ZeroMemory(&nodesBufferDesc, sizeof(nodesBufferDesc));
+    nodesBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+    nodesBufferDesc.ByteWidth = octree->GetNodesCount() * stride;
+    nodesBufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    nodesBufferDesc.StructureByteStride = stride;
+    nodesBufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+
+    D3D11_SUBRESOURCE_DATA nodesBufferData;
+    ZeroMemory(&nodesBufferData, sizeof(nodesBufferData));
+	nodesBufferData.pSysMem = data;
+
+    hr = d3d11Device->CreateBuffer(&nodesBufferDesc, &nodesBufferData, outBuffer);
+	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateBuffer) + L" failed for the " + name);
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC nodesBufferSRVDesc;
+    ZeroMemory(&nodesBufferSRVDesc, sizeof(nodesBufferSRVDesc));
+    nodesBufferSRVDesc.Format = DXGI_FORMAT_UNKNOWN;
+    nodesBufferSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+    nodesBufferSRVDesc.Buffer.ElementWidth = stride;
+    nodesBufferSRVDesc.Buffer.NumElements = octree->GetNodesCount();
+
+    hr = d3d11Device->CreateShaderResourceView(*outBuffer, &nodesBufferSRVDesc, outBufferSRV);
+	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateShaderResourceView) + L" failed for the " + name + L" SRV");
 }
 
 UINT PointCloudEngine::OctreeRenderer::GetStructureCount(ID3D11UnorderedAccessView *UAV)
@@ -21,9 +21,13 @@ namespace PointCloudEngine
     private:
         void DrawOctree();
         void DrawOctreeCompute();
+        void DrawStructuredVertices(ID3D11ShaderResourceView *verticesSRV);
+        bool UseCompactVertices();
+        void CreateNodesBuffer(const void *data, UINT stride, const std::wstring &name, ID3D11Buffer **outBuffer, ID3D11ShaderResourceView **outBufferSRV);
         UINT GetStructureCount(ID3D11UnorderedAccessView *UAV);
 
         int vertexBufferCount = 0;
+        OctreeTraversalStatistics traversalStatistics = {};
 
         Octree *octree = NULL;
 
@@ -31,13 +35,17 @@ namespace PointCloudEngine
         ID3D11Buffer* octreeConstantBuffer = NULL;
         OctreeConstantBuffer octreeConstantBufferData;
 
-        // Compute shader
-        ID3D11Buffer *nodesBuffer = NULL;
+        // Compute shader, the nodes are split into the same arrays as in the octree
+        ID3D11Buffer *topologyBuffer = NULL;
+        ID3D11Buffer *normalsBuffer = NULL;
+        ID3D11Buffer *shadingBuffer = NULL;
         ID3D11Buffer *firstBuffer = NULL;
         ID3D11Buffer *secondBuffer = NULL;
         ID3D11Buffer *vertexAppendBuffer = NULL;
         ID3D11Buffer *structureCountBuffer = NULL;
-        ID3D11ShaderResourceView *nodesBufferSRV = NULL;
+        ID3D11ShaderResourceView *topologyBufferSRV = NULL;
+        ID3D11ShaderResourceView *normalsBufferSRV = NULL;
+        ID3D11ShaderResourceView *shadingBufferSRV = NULL;
         ID3D11ShaderResourceView *vertexAppendBufferSRV = NULL;
         ID3D11UnorderedAccessView *firstBufferUAV = NULL;
         ID3D11UnorderedAccessView *secondBufferUAV = NULL;
@@ -38,18 +38,24 @@ void GS(point VS_OUTPUT input[1], inout PointStream<GS_POINT_OUTPUT> output)
 	output.Append(element);
 }
 
-float4 PS(GS_POINT_OUTPUT input) : SV_TARGET
+PS_GBUFFER_OUTPUT PS(GS_POINT_OUTPUT input)
 {
+	PS_GBUFFER_OUTPUT output;
+	output.normal = float4(0.5f * (input.normal + 1), 1);
+	output.normalScreen = float4(0.5f * (input.normalScreen + 1), 1);
+
 	if (drawNormals)
 	{
-		return float4(0.5f * ((normalsInScreenSpace ? input.normalScreen : input.normal) + 1), 1);
+		output.color = normalsInScreenSpace ? output.normalScreen : output.normal;
 	}
 	else if (useLighting)
 	{
-		return float4(PhongLighting(cameraPosition, input.positionWorld, input.normal, input.color), 1);
+		output.color = float4(PhongLighting(cameraPosition, input.positionWorld, input.normal, input.color), 1);
 	}
 	else
 	{
-		return float4(input.color, 1);
+		output.color = float4(input.color, 1);
 	}
+
+	return output;
 }
\ No newline at end of file
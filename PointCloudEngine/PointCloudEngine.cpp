@@ -10,6 +10,7 @@ double dt = 0;
 Timer timer;
 Scene scene;
 Settings* settings;
+ThreadPool* threadPool;
 Camera* camera;
 Shader* textShader;
 Shader* splatShader;
@@ -20,6 +21,8 @@ Shader* octreeSplatShader;
 Shader* octreeClusterShader;
 Shader* octreeComputeShader;
 Shader* octreeComputeVSShader;
+Shader* octreeComputeEntriesShader;
+Shader* octreeComputeEntriesVSShader;
 Shader* blendingShader;
 Shader* gammaCorrectionShader;
 Shader* textureConversionShader;
@@ -49,6 +52,14 @@ ID3D11ShaderResourceView* blendingDepthTextureSRV;
 ID3D11BlendState* additiveBlendState;
 ID3D11DepthStencilState* disabledDepthStencilState;
 
+// Additional render targets of the G-buffer that stores the world and screen space normals together with the color and depth
+ID3D11Texture2D* normalTexture;
+ID3D11RenderTargetView* normalTextureRTV;
+ID3D11UnorderedAccessView* normalTextureUAV;
+ID3D11Texture2D* normalScreenTexture;
+ID3D11RenderTargetView* normalScreenTextureRTV;
+ID3D11UnorderedAccessView* normalScreenTextureUAV;
+
 // This is used to unbind buffers and views from the shaders
 ID3D11Buffer* nullBuffer[1] = { NULL };
 ID3D11UnorderedAccessView* nullUAV[1] = { NULL };
@@ -96,6 +107,23 @@ void ErrorMessageOnFail(HRESULT hr, std::wstring message, std::wstring file, int
 }
 
 bool LoadPointcloudFile(std::vector<Vertex>& outVertices, Vector3& outBoundingCubePosition, float& outBoundingCubeSize, const std::wstring& pointcloudFile)
+{
+	UINT vertexCount = 0;
+	outVertices.clear();
+
+	return ReadPointcloudFile(pointcloudFile, outBoundingCubePosition, outBoundingCubeSize, vertexCount, [&](const std::vector<Vertex> &vertexBlock)
+	{
+		// Reserve the memory for all the vertices when receiving the first block
+		if (outVertices.empty())
+		{
+			outVertices.reserve(vertexCount);
+		}
+
+		outVertices.insert(outVertices.end(), vertexBlock.begin(), vertexBlock.end());
+	});
+}
+
+bool ReadPointcloudFile(const std::wstring &pointcloudFile, Vector3 &outBoundingCubePosition, float &outBoundingCubeSize, UINT &outVertexCount, const std::function<void(const std::vector<Vertex> &vertexBlock)> &processBlock)
 {
 	try
 	{
@@ -112,30 +140,48 @@ bool LoadPointcloudFile(std::vector<Vertex>& outVertices, Vector3& outBoundingCu
 		// Then the position, 8bit normal and 8bit rgb color of each vertex is stored in binary data
 		std::ifstream file(pointcloudFile, std::ios::in | std::ios::binary);
 
+		if (!file.is_open())
+		{
+			return false;
+		}
+
 		// Load the bounding cube position and size
 		file.read((char*)&outBoundingCubePosition, sizeof(Vector3));
 		file.read((char*)&outBoundingCubeSize, sizeof(float));
 
 		// Load the size of the vertices vector
-		UINT vertexCount;
-		file.read((char*)&vertexCount, sizeof(UINT));
+		file.read((char*)&outVertexCount, sizeof(UINT));
 
-		// Read the binary data directly into the vertices vector
-		std::vector<PointcloudVertex> pointcloudVertices = std::vector<PointcloudVertex>(vertexCount);
-		file.read((char*)pointcloudVertices.data(), vertexCount * sizeof(PointcloudVertex));
+		// Only the header is needed when the vertices are not processed
+		if (!processBlock)
+		{
+			return true;
+		}
 
-		// Convert to the required vertex format
-		outVertices = std::vector<Vertex>(vertexCount);
+		// Read the binary data in blocks and convert it to the required vertex format, this never holds the whole point cloud in memory
+		const UINT blockSize = 65536;
+		std::vector<PointcloudVertex> pointcloudVertices = std::vector<PointcloudVertex>(min(blockSize, outVertexCount));
+		std::vector<Vertex> vertexBlock;
 
-		for (UINT i = 0; i < vertexCount; i++)
+		for (UINT blockStart = 0; blockStart < outVertexCount; blockStart += blockSize)
 		{
-			outVertices[i].position = pointcloudVertices[i].position;
-			outVertices[i].normal.x = pointcloudVertices[i].normal[0] / 127.0f;
-			outVertices[i].normal.y = pointcloudVertices[i].normal[1] / 127.0f;
-			outVertices[i].normal.z = pointcloudVertices[i].normal[2] / 127.0f;
-			outVertices[i].color[0] = pointcloudVertices[i].color[0];
-			outVertices[i].color[1] = pointcloudVertices[i].color[1];
-			outVertices[i].color[2] = pointcloudVertices[i].color[2];
+			UINT blockCount = min(blockSize, outVertexCount - blockStart);
+			file.read((char*)pointcloudVertices.data(), blockCount * sizeof(PointcloudVertex));
+			vertexBlock.resize(blockCount);
+
+			for (UINT i = 0; i < blockCount; i++)
+			{
+				Vertex &vertex = vertexBlock[i];
+				vertex.position = pointcloudVertices[i].position;
+				vertex.normal.x = pointcloudVertices[i].normal[0] / 127.0f;
+				vertex.normal.y = pointcloudVertices[i].normal[1] / 127.0f;
+				vertex.normal.z = pointcloudVertices[i].normal[2] / 127.0f;
+				vertex.color[0] = pointcloudVertices[i].color[0];
+				vertex.color[1] = pointcloudVertices[i].color[1];
+				vertex.color[2] = pointcloudVertices[i].color[2];
+			}
+
+			processBlock(vertexBlock);
 		}
 	}
 	catch (const std::exception& e)
@@ -181,8 +227,13 @@ void ChangeRenderingResolution(int newResolutionX, int newResolutionY)
 	d3d11DevCon->OMSetBlendState(blendState, NULL, 0xffffffff);
 }
 
-void DrawBlended(UINT vertexCount, ID3D11Buffer* constantBuffer, const void* constantBufferData, int &useBlending)
+void DrawBlended(UINT vertexCount, ID3D11Buffer* constantBuffer, const void* constantBufferData, int &useBlending, bool drawGBuffer)
 {
+	// Blend into all the render targets of the G-buffer or only into the back buffer
+	ID3D11RenderTargetView* renderTargetViews[3] = { renderTargetView, normalTextureRTV, normalScreenTextureRTV };
+	ID3D11UnorderedAccessView* renderTargetUAVs[3] = { backBufferTextureUAV, normalTextureUAV, normalScreenTextureUAV };
+	UINT renderTargetCount = drawGBuffer ? 3 : 1;
+
 	// Draw with blending
 	// Before this is called all the shaders, buffers and resources have to be set already!
 	// Draw only the depth to the depth texture, don't draw any color
@@ -193,7 +244,7 @@ void DrawBlended(UINT vertexCount, ID3D11Buffer* constantBuffer, const void* con
 	// Draw again but this time with the actual depth buffer, render target and blending
 	useBlending = true;
 	d3d11DevCon->UpdateSubresource(constantBuffer, 0, NULL, constantBufferData, 0, 0);
-	d3d11DevCon->OMSetRenderTargets(1, &renderTargetView, depthStencilView);
+	d3d11DevCon->OMSetRenderTargets(renderTargetCount, renderTargetViews, depthStencilView);
 
 	// Set a different blend state
 	d3d11DevCon->OMSetBlendState(additiveBlendState, NULL, 0xffffffff);
@@ -210,14 +261,18 @@ void DrawBlended(UINT vertexCount, ID3D11Buffer* constantBuffer, const void* con
 	// Unbind shader resources
 	d3d11DevCon->PSSetShaderResources(0, 1, nullSRV);
 
-	// Remove the depth stencil view from the render target in order to make it accessable by the pixel shader (also set the back buffer UAV)
-	d3d11DevCon->OMSetRenderTargetsAndUnorderedAccessViews(0, NULL, NULL, 1, 1, &backBufferTextureUAV, NULL);
 	d3d11DevCon->VSSetShader(blendingShader->vertexShader, NULL, 0);
 	d3d11DevCon->GSSetShader(blendingShader->geometryShader, NULL, 0);
 	d3d11DevCon->PSSetShader(blendingShader->pixelShader, NULL, 0);
 
-	// Use pixel shader to divide the color sum by the weight sum of overlapping splats in each pixel, also remove background color
-	d3d11DevCon->Draw(1, 0);
+	for (UINT i = 0; i < renderTargetCount; i++)
+	{
+		// Remove the depth stencil view from the render target in order to make it accessable by the pixel shader (also set the render target UAV)
+		d3d11DevCon->OMSetRenderTargetsAndUnorderedAccessViews(0, NULL, NULL, 1, 1, &renderTargetUAVs[i], NULL);
+
+		// Use pixel shader to divide the color sum by the weight sum of overlapping splats in each pixel, also remove background color
+		d3d11DevCon->Draw(1, 0);
+	}
 
 	// Unbind shader resources
 	d3d11DevCon->VSSetShader(NULL, NULL, 0);
@@ -241,6 +296,9 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     // Load the settings
     settings = new Settings();
 
+	// Worker threads that are used for CPU heavy tasks like the octree creation
+	threadPool = new ThreadPool(settings->threadCount);
+
 	// Initialize the COM interface
 	hr = CoInitialize(NULL);
 	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(CoInitialize) + L" failed!");
@@ -315,6 +373,12 @@ void InitializeRenderingResources()
 	SAFE_RELEASE(blendingDepthTextureSRV);
 	SAFE_RELEASE(additiveBlendState);
 	SAFE_RELEASE(disabledDepthStencilState);
+	SAFE_RELEASE(normalTexture);
+	SAFE_RELEASE(normalTextureRTV);
+	SAFE_RELEASE(normalTextureUAV);
+	SAFE_RELEASE(normalScreenTexture);
+	SAFE_RELEASE(normalScreenTextureRTV);
+	SAFE_RELEASE(normalScreenTextureUAV);
 
 	if (d3d11Device == NULL)
 	{
@@ -420,6 +484,32 @@ void InitializeRenderingResources()
 	hr = d3d11Device->CreateUnorderedAccessView(backBufferTexture, &backBufferTextureUAVDesc, &backBufferTextureUAV);
 	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateUnorderedAccessView) + L" failed for the " + NAMEOF(backBufferTextureUAV));
 
+	// The normal render targets of the G-buffer have the same format as the back buffer and are also blended and read back in the same way
+	D3D11_TEXTURE2D_DESC normalTextureDesc;
+	backBufferTexture->GetDesc(&normalTextureDesc);
+	normalTextureDesc.Usage = D3D11_USAGE_DEFAULT;
+	normalTextureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_UNORDERED_ACCESS;
+	normalTextureDesc.CPUAccessFlags = 0;
+	normalTextureDesc.MiscFlags = 0;
+
+	hr = d3d11Device->CreateTexture2D(&normalTextureDesc, NULL, &normalTexture);
+	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateTexture2D) + L" failed for the " + NAMEOF(normalTexture));
+
+	hr = d3d11Device->CreateRenderTargetView(normalTexture, NULL, &normalTextureRTV);
+	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateRenderTargetView) + L" failed for the " + NAMEOF(normalTextureRTV));
+
+	hr = d3d11Device->CreateUnorderedAccessView(normalTexture, &backBufferTextureUAVDesc, &normalTextureUAV);
+	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateUnorderedAccessView) + L" failed for the " + NAMEOF(normalTextureUAV));
+
+	hr = d3d11Device->CreateTexture2D(&normalTextureDesc, NULL, &normalScreenTexture);
+	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateTexture2D) + L" failed for the " + NAMEOF(normalScreenTexture));
+
+	hr = d3d11Device->CreateRenderTargetView(normalScreenTexture, NULL, &normalScreenTextureRTV);
+	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateRenderTargetView) + L" failed for the " + NAMEOF(normalScreenTextureRTV));
+
+	hr = d3d11Device->CreateUnorderedAccessView(normalScreenTexture, &backBufferTextureUAVDesc, &normalScreenTextureUAV);
+	ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateUnorderedAccessView) + L" failed for the " + NAMEOF(normalScreenTextureUAV));
+
 	// Depth/Stencil buffer description (needed for 3D Scenes + mirrors and such)
 	D3D11_TEXTURE2D_DESC depthStencilTextureDesc;
 	depthStencilTextureDesc.Width = settings->resolutionX;
@@ -659,6 +749,12 @@ void InitializeScene()
     octreeClusterShader = Shader::Create(L"Shader/OctreeCluster.hlsl", true, true, true, false, Shader::octreeLayout, 14);
     octreeComputeShader = Shader::Create(L"Shader/OctreeCompute.hlsl", false, false, false, true, NULL, 0);
     octreeComputeVSShader = Shader::Create(L"Shader/OctreeComputeVS.hlsl", true, false, false, false, NULL, 0);
+
+	// Octrees that are too deep for the compact vertices append and draw the traversal entries instead
+	D3D_SHADER_MACRO traversalEntryDefines[] = { { "TRAVERSAL_ENTRY_VERTICES", "1" }, { NULL, NULL } };
+	octreeComputeEntriesShader = Shader::Create(L"Shader/OctreeCompute.hlsl", false, false, false, true, NULL, 0, traversalEntryDefines);
+	octreeComputeEntriesVSShader = Shader::Create(L"Shader/OctreeComputeVS.hlsl", true, false, false, false, NULL, 0, traversalEntryDefines);
+
 	blendingShader = Shader::Create(L"Shader/Blending.hlsl", true, true, true, false, NULL, 0);
 	gammaCorrectionShader = Shader::Create(L"Shader/GammaCorrection.hlsl", true, true, true, false, NULL, 0);
 	textureConversionShader = Shader::Create(L"Shader/TextureConversion.hlsl", true, true, true, false, NULL, 0);
@@ -787,6 +883,7 @@ void ReleaseObjects()
     // Delete settings (also saves them to the hard drive)
     SafeDelete(settings);
     SafeDelete(camera);
+	SafeDelete(threadPool);
 
     // Release and delete shaders
     Shader::ReleaseAllShaders();
@@ -812,4 +909,12 @@ void ReleaseObjects()
 	SAFE_RELEASE(blendingDepthTextureSRV);
 	SAFE_RELEASE(additiveBlendState);
 	SAFE_RELEASE(disabledDepthStencilState);
+
+	// Release resources of the G-buffer
+	SAFE_RELEASE(normalTexture);
+	SAFE_RELEASE(normalTextureRTV);
+	SAFE_RELEASE(normalTextureUAV);
+	SAFE_RELEASE(normalScreenTexture);
+	SAFE_RELEASE(normalScreenTextureRTV);
+	SAFE_RELEASE(normalScreenTextureUAV);
 }
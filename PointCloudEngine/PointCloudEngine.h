@@ -8,11 +8,7 @@ using namespace DirectX::SimpleMath;
 
 // Forward declarations
 class HDF5File;
-
-namespace H5
-{
-	class Group;
-}
+struct HDF5Group;
 
 namespace PointCloudEngine
 {
@@ -26,6 +22,15 @@ namespace PointCloudEngine
     class Settings;
     class Camera;
     class Octree;
+	class ThreadPool;
+	class NormalClustering;
+	class Hash64;
+	class OctreeCompression;
+	class OctreeCulling;
+	class OctreeOcclusion;
+	class OctreePageCache;
+	class SplatRasterizer;
+	class PointRasterizer;
 	class GUI;
     struct OctreeNode;
 
@@ -48,6 +53,19 @@ namespace PointCloudEngine
 		Normal,
 		NormalScreen
 	};
+
+	enum class OctreeBuildEngine
+	{
+		TopDown,
+		Morton
+	};
+
+	enum class HDF5Compression
+	{
+		None,
+		Deflate,
+		ShuffleDeflate
+	};
 }
 
 using namespace PointCloudEngine;
@@ -63,8 +81,17 @@ using namespace PointCloudEngine;
 #include "Structures.h"
 #include "Settings.h"
 #include "IRenderer.h"
+#include "ThreadPool.h"
+#include "NormalClustering.h"
+#include "Hash64.h"
+#include "OctreeCompression.h"
+#include "OctreeCulling.h"
+#include "OctreeOcclusion.h"
 #include "OctreeNode.h"
+#include "OctreePageCache.h"
 #include "Octree.h"
+#include "SplatRasterizer.h"
+#include "PointRasterizer.h"
 #include "TextRenderer.h"
 #include "GroundTruthRenderer.h"
 #include "OctreeRenderer.h"
@@ -96,6 +123,7 @@ extern double dt;
 extern HRESULT hr;
 extern HWND hwnd;
 extern Settings* settings;
+extern ThreadPool* threadPool;
 extern Camera* camera;
 extern Shader* textShader;
 extern Shader* splatShader;
@@ -106,6 +134,8 @@ extern Shader* octreeSplatShader;
 extern Shader* octreeClusterShader;
 extern Shader* octreeComputeShader;
 extern Shader* octreeComputeVSShader;
+extern Shader* octreeComputeEntriesShader;
+extern Shader* octreeComputeEntriesVSShader;
 extern Shader* blendingShader;
 extern Shader* textureConversionShader;
 extern IDXGISwapChain* swapChain;
@@ -119,6 +149,11 @@ extern ID3D11DepthStencilView* depthStencilView;
 extern ID3D11ShaderResourceView* depthTextureSRV;
 extern ID3D11DepthStencilState* depthStencilState;
 extern ID3D11BlendState* blendState;
+extern ID3D11Texture2D* blendingDepthTexture;
+extern ID3D11Texture2D* normalTexture;
+extern ID3D11RenderTargetView* normalTextureRTV;
+extern ID3D11Texture2D* normalScreenTexture;
+extern ID3D11RenderTargetView* normalScreenTextureRTV;
 extern ID3D11Buffer* nullBuffer[1];
 extern ID3D11UnorderedAccessView* nullUAV[1];
 extern ID3D11ShaderResourceView* nullSRV[1];
@@ -129,10 +164,11 @@ extern LightingConstantBuffer lightingConstantBufferData;
 extern bool OpenFileDialog(const wchar_t* filter, std::wstring &outFilename);
 extern void ErrorMessageOnFail(HRESULT hr, std::wstring message, std::wstring file, int line);
 extern bool LoadPointcloudFile(std::vector<Vertex> &outVertices, Vector3 &outBoundingCubePosition, float &outBoundingCubeSize, const std::wstring &pointcloudFile);
+extern bool ReadPointcloudFile(const std::wstring &pointcloudFile, Vector3 &outBoundingCubePosition, float &outBoundingCubeSize, UINT &outVertexCount, const std::function<void(const std::vector<Vertex> &vertexBlock)> &processBlock);
 extern void SaveScreenshotToFile();
 extern void SetFullscreen(bool fullscreen);
 extern void ChangeRenderingResolution(int newResolutionX, int newResolutionY);
-extern void DrawBlended(UINT vertexCount, ID3D11Buffer* constantBuffer, const void* constantBufferData, int &useBlending);
+extern void DrawBlended(UINT vertexCount, ID3D11Buffer* constantBuffer, const void* constantBufferData, int &useBlending, bool drawGBuffer = false);
 extern void InitializeRenderingResources();
 
 // Function declarations
@@ -0,0 +1,220 @@
+#include "PointRasterizer.h"
+
+PointCloudEngine::PointRasterizer::PointRasterizer(UINT width, UINT height) : pixels((size_t)width * height)
+{
+	this->width = width;
+	this->height = height;
+}
+
+void PointCloudEngine::PointRasterizer::Draw(const std::vector<Vertex> &vertices, size_t vertexCount, const Parameters &parameters)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	vertexCount = min(vertexCount, vertices.size());
+
+	Matrix viewProjection = parameters.View * parameters.Projection;
+	Matrix worldViewProjection = parameters.World * viewProjection;
+	Matrix worldInverseTranspose = parameters.World.Invert().Transpose();
+
+	// The sign of the dot product between the normal and the view direction does not change with the world matrix, the backface culling is done in object space
+	Vector3 localCameraPosition = Vector3::Transform(parameters.cameraPosition, parameters.World.Invert());
+
+	for (size_t i = 0; i < pixels.size(); i++)
+	{
+		pixels[i].store(UINT64_MAX, std::memory_order_relaxed);
+	}
+
+	// Split the points into a few tasks per thread, each task projects and writes its points block by block
+	size_t blockCount = (vertexCount + POINT_RASTERIZER_BLOCK_SIZE - 1) / POINT_RASTERIZER_BLOCK_SIZE;
+	size_t taskCount = max(1, min(blockCount, 4 * threadPool->GetThreadCount()));
+	size_t blocksPerTask = (blockCount + taskCount - 1) / taskCount;
+
+	const size_t tilesCount = ((width + POINT_RASTERIZER_TILE_SIZE - 1) / POINT_RASTERIZER_TILE_SIZE) * ((height + POINT_RASTERIZER_TILE_SIZE - 1) / POINT_RASTERIZER_TILE_SIZE);
+
+	if (taskBuffers.size() < taskCount)
+	{
+		taskBuffers.resize(taskCount);
+	}
+
+	std::vector<size_t> taskDrawnPointsCounts(taskCount, 0);
+
+	threadPool->ParallelFor(taskCount, [&](size_t i)
+	{
+		// The tasks start writing at different tiles to avoid that all of them write to the same cache lines at the same time
+		size_t firstTile = (i * tilesCount) / taskCount;
+
+		for (size_t j = i * blocksPerTask; j < min(blockCount, (i + 1) * blocksPerTask); j++)
+		{
+			size_t start = j * POINT_RASTERIZER_BLOCK_SIZE;
+			size_t end = min(vertexCount, start + POINT_RASTERIZER_BLOCK_SIZE);
+
+			DrawBlock(vertices, start, end, worldViewProjection, localCameraPosition, parameters.backfaceCulling, firstTile, taskBuffers[i], taskDrawnPointsCounts[i]);
+		}
+	});
+
+	// Compute the attributes of the closest point of each pixel
+	colors.resize(width * height);
+	depths.resize(width * height);
+	normals.resize(width * height);
+	screenNormals.resize(width * height);
+
+	threadPool->ParallelFor(height, [&](size_t y)
+	{
+		ResolveRow(vertices, (UINT)y, parameters, worldInverseTranspose, viewProjection);
+	});
+
+	pointsCount = vertexCount;
+	drawnPointsCount = 0;
+
+	for (size_t i = 0; i < taskCount; i++)
+	{
+		drawnPointsCount += taskDrawnPointsCounts[i];
+	}
+
+	milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+double PointCloudEngine::PointRasterizer::GetPointsPerSecond() const
+{
+	return (milliseconds > 0) ? (1000.0 * pointsCount) / milliseconds : 0;
+}
+
+void PointCloudEngine::PointRasterizer::DrawBlock(const std::vector<Vertex> &vertices, size_t start, size_t end, const Matrix &worldViewProjection, const Vector3 &localCameraPosition, bool backfaceCulling, size_t firstTile, TaskBuffers &buffers, size_t &outDrawnPointsCount)
+{
+	const UINT tilesX = (width + POINT_RASTERIZER_TILE_SIZE - 1) / POINT_RASTERIZER_TILE_SIZE;
+	const size_t tilesCount = tilesX * ((height + POINT_RASTERIZER_TILE_SIZE - 1) / POINT_RASTERIZER_TILE_SIZE);
+
+	buffers.fragments.resize(end - start);
+	buffers.sortedFragments.resize(end - start);
+	buffers.tileStarts.assign(tilesCount + 1, 0);
+
+	size_t fragmentsCount = 0;
+
+	for (size_t i = start; i < end; i++)
+	{
+		const Vertex &vertex = vertices[i];
+
+		// Discard points that have a normal facing away from the camera
+		if (backfaceCulling && (vertex.normal.Dot(localCameraPosition - vertex.position) < 0))
+		{
+			continue;
+		}
+
+		Vector4 clip = Vector4::Transform(Vector4(vertex.position.x, vertex.position.y, vertex.position.z, 1.0f), worldViewProjection);
+
+		// Clip the points behind the camera and outside of the near and far plane, the depth test only passes for depths smaller than the cleared value of 1
+		if ((clip.w <= 0) || (clip.z < 0) || (clip.z >= clip.w))
+		{
+			continue;
+		}
+
+		// The point covers the pixel that contains its projected position
+		float screenX = 0.5f * (clip.x / clip.w + 1.0f) * width;
+		float screenY = 0.5f * (1.0f - clip.y / clip.w) * height;
+
+		if ((screenX < 0) || (screenY < 0) || (screenX >= width) || (screenY >= height))
+		{
+			continue;
+		}
+
+		UINT x = (UINT)screenX;
+		UINT y = (UINT)screenY;
+
+		// Positive floats keep their order when they are compared as integers
+		float depth = clip.z / clip.w;
+		UINT depthBits;
+		memcpy(&depthBits, &depth, sizeof(float));
+
+		PointFragment &fragment = buffers.fragments[fragmentsCount++];
+		fragment.value = ((UINT64)depthBits << 32) | (UINT64)i;
+		fragment.pixel = y * width + x;
+		fragment.tile = (y / POINT_RASTERIZER_TILE_SIZE) * tilesX + (x / POINT_RASTERIZER_TILE_SIZE);
+
+		buffers.tileStarts[fragment.tile + 1]++;
+	}
+
+	outDrawnPointsCount += fragmentsCount;
+
+	// Sort the fragments by their tile with a counting sort, then the writes of the block only touch one tile after the other
+	for (size_t i = 1; i <= tilesCount; i++)
+	{
+		buffers.tileStarts[i] += buffers.tileStarts[i - 1];
+	}
+
+	buffers.tileOffsets.assign(buffers.tileStarts.begin(), buffers.tileStarts.end() - 1);
+
+	for (size_t i = 0; i < fragmentsCount; i++)
+	{
+		buffers.sortedFragments[buffers.tileOffsets[buffers.fragments[i].tile]++] = buffers.fragments[i];
+	}
+
+	for (size_t i = 0; i < tilesCount; i++)
+	{
+		size_t tile = (firstTile + i) % tilesCount;
+
+		for (UINT j = buffers.tileStarts[tile]; j < buffers.tileStarts[tile + 1]; j++)
+		{
+			AtomicMin(pixels[buffers.sortedFragments[j].pixel], buffers.sortedFragments[j].value);
+		}
+	}
+}
+
+void PointCloudEngine::PointRasterizer::ResolveRow(const std::vector<Vertex> &vertices, UINT y, const Parameters &parameters, const Matrix &worldInverseTranspose, const Matrix &viewProjection)
+{
+	for (UINT x = 0; x < width; x++)
+	{
+		const size_t pixel = (size_t)y * width + x;
+		const UINT64 value = pixels[pixel].load(std::memory_order_relaxed);
+
+		if (value == UINT64_MAX)
+		{
+			colors[pixel] = parameters.backgroundColor;
+			depths[pixel] = 1.0f;
+			normals[pixel] = parameters.backgroundColor;
+			screenNormals[pixel] = parameters.backgroundColor;
+			continue;
+		}
+
+		UINT depthBits = (UINT)(value >> 32);
+		memcpy(&depths[pixel], &depthBits, sizeof(float));
+
+		// Same vertex and pixel shader as in GroundTruth.hlsl and Point.hlsl
+		const Vertex &vertex = vertices[(UINT)value];
+		Vector3 position = Vector3::Transform(vertex.position, parameters.World);
+		Vector3 normal = Vector3::TransformNormal(vertex.normal, worldInverseTranspose);
+		Vector3 color = Vector3(vertex.color[0], vertex.color[1], vertex.color[2]) / 255.0f;
+		normal.Normalize();
+
+		if (parameters.useLighting)
+		{
+			Vector3 l = -parameters.lightDirection;
+			Vector3 v = parameters.cameraPosition - position;
+			l.Normalize();
+			v.Normalize();
+
+			Vector3 r = -l + 2.0f * l.Dot(normal) * normal;
+			float diffuseIntensity = max(parameters.ambient, parameters.lightIntensity * parameters.diffuse * normal.Dot(l));
+			float specularIntensity = parameters.lightIntensity * pow(max(0.0f, parameters.specular * r.Dot(v)), parameters.specularExponent);
+
+			color = diffuseIntensity * color + specularIntensity * Vector3::One;
+		}
+
+		Vector3 screenNormal = Vector3::TransformNormal(normal, viewProjection);
+		screenNormal.Normalize();
+		screenNormal.z *= -1;
+
+		colors[pixel] = color;
+		normals[pixel] = 0.5f * (normal + Vector3::One);
+		screenNormals[pixel] = 0.5f * (screenNormal + Vector3::One);
+	}
+}
+
+void PointCloudEngine::PointRasterizer::AtomicMin(std::atomic<UINT64> &pixel, UINT64 value)
+{
+	UINT64 current = pixel.load(std::memory_order_relaxed);
+
+	// Fragments behind the already written point do not need the compare exchange
+	while ((value < current) && !pixel.compare_exchange_weak(current, value, std::memory_order_relaxed))
+	{
+	}
+}
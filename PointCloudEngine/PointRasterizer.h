@@ -0,0 +1,90 @@
+#ifndef POINTRASTERIZER_H
+#define POINTRASTERIZER_H
+
+// Width and height of the screen tiles in pixels, the fragments of each block are sorted by these tiles before they are written
+#define POINT_RASTERIZER_TILE_SIZE 64
+
+// Amount of points that are projected and sorted together, the fragments of a block stay in the cache until they are written
+#define POINT_RASTERIZER_BLOCK_SIZE 16384
+
+#pragma once
+#include "PointCloudEngine.h"
+
+namespace PointCloudEngine
+{
+	// Headless renderer for the one pixel points of Point.hlsl (Points and SparsePoints view modes) that does not need a D3D11 device
+	// Each pixel is a 64 bit word with the depth in the upper and the vertex index in the lower 32 bits, the closest point is kept with an atomic min
+	// Equal depths are resolved by the smaller index, this is the same point that the depth test (LESS) keeps when the points are drawn in order
+	// The points are drawn by many threads without locks, the attributes are only computed for the remaining point of each pixel at the end
+	class PointRasterizer
+	{
+	public:
+		// Same values as in the constant buffers of the point shader, the matrices are not transposed
+		struct Parameters
+		{
+			Matrix World;
+			Matrix View;
+			Matrix Projection;
+			Vector3 cameraPosition;
+			bool backfaceCulling;
+
+			// Lighting
+			bool useLighting;
+			Vector3 lightDirection;
+			float lightIntensity;
+			float ambient;
+			float diffuse;
+			float specular;
+			float specularExponent;
+			Vector3 backgroundColor;
+		};
+
+		PointRasterizer(UINT width, UINT height);
+
+		// Draws the first vertexCount vertices (sparse view modes only draw a portion of the point cloud)
+		void Draw(const std::vector<Vertex> &vertices, size_t vertexCount, const Parameters &parameters);
+		double GetPointsPerSecond() const;
+
+		UINT width;
+		UINT height;
+
+		// Output buffers of the last draw in row major order starting at the top left pixel, same layout as the ones of the splat rasterizer
+		// All attributes of the G-buffer are written in one draw, the normals in world space and in screen space are both encoded in [0, 1]
+		std::vector<Vector3> colors;
+		std::vector<float> depths;
+		std::vector<Vector3> normals;
+		std::vector<Vector3> screenNormals;
+
+		// Statistics of the last draw
+		size_t pointsCount = 0;
+		size_t drawnPointsCount = 0;
+		double milliseconds = 0;
+
+	private:
+		// Projected point that is written to the pixel
+		struct PointFragment
+		{
+			UINT64 value;
+			UINT pixel;
+			UINT tile;
+		};
+
+		// Fragments of the current block of each task, the second buffer receives the fragments sorted by their tile
+		struct TaskBuffers
+		{
+			std::vector<PointFragment> fragments;
+			std::vector<PointFragment> sortedFragments;
+			std::vector<UINT> tileStarts;
+			std::vector<UINT> tileOffsets;
+		};
+
+		std::vector<std::atomic<UINT64>> pixels;
+		std::vector<TaskBuffers> taskBuffers;
+
+		void DrawBlock(const std::vector<Vertex> &vertices, size_t start, size_t end, const Matrix &worldViewProjection, const Vector3 &localCameraPosition, bool backfaceCulling, size_t firstTile, TaskBuffers &buffers, size_t &outDrawnPointsCount);
+		void ResolveRow(const std::vector<Vertex> &vertices, UINT y, const Parameters &parameters, const Matrix &worldInverseTranspose, const Matrix &viewProjection);
+		static void AtomicMin(std::atomic<UINT64> &pixel, UINT64 value);
+	};
+}
+
+#endif
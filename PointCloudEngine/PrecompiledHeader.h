@@ -17,8 +17,19 @@
 #include <algorithm>
 #include <limits>
 #include <map>
+#include <unordered_map>
+#include <list>
 #include <queue>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
 #include <math.h>
+#include <intrin.h>
 #include <wincodec.h>
 #include <CommCtrl.h>
 #include <shellapi.h>
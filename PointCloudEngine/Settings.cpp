@@ -57,6 +57,8 @@ PointCloudEngine::Settings::Settings()
 		TryParse(NAMEOF(backfaceCulling), &backfaceCulling);
 		TryParse(NAMEOF(density), &density);
 		TryParse(NAMEOF(sparseSamplingRate), &sparseSamplingRate);
+		TryParse(NAMEOF(splatRasterizerBenchmark), &splatRasterizerBenchmark);
+		TryParse(NAMEOF(pointRasterizerExport), &pointRasterizerExport);
 
 		// Parse neural network parameters
 		TryParse(NAMEOF(neuralNetworkModelFile), &neuralNetworkModelFile);
@@ -80,6 +82,20 @@ PointCloudEngine::Settings::Settings()
 		TryParse(NAMEOF(sphereMaxTheta), &sphereMaxTheta);
 		TryParse(NAMEOF(sphereMinPhi), &sphereMinPhi);
 		TryParse(NAMEOF(sphereMaxPhi), &sphereMaxPhi);
+		TryParse(NAMEOF(hdf5WriterThreads), &hdf5WriterThreads);
+		TryParse(NAMEOF(hdf5WriterQueueSize), &hdf5WriterQueueSize);
+		TryParse(NAMEOF(hdf5Compression), &hdf5Compression);
+		TryParse(NAMEOF(hdf5CompressionLevel), &hdf5CompressionLevel);
+		TryParse(NAMEOF(hdf5CompressionThreads), &hdf5CompressionThreads);
+		TryParse(NAMEOF(hdf5CompressionBenchmark), &hdf5CompressionBenchmark);
+
+		// Unknown codecs would apply no filter at all and zlib only accepts the levels 0 to 9
+		if (((int)hdf5Compression < 0) || ((int)hdf5Compression >= HDF5_COMPRESSION_COUNT))
+		{
+			hdf5Compression = HDF5Compression::Deflate;
+		}
+
+		hdf5CompressionLevel = max(0, min(9, hdf5CompressionLevel));
 
 		// Parse octree parameters
 		TryParse(NAMEOF(useOctree), &useOctree);
@@ -90,6 +106,25 @@ PointCloudEngine::Settings::Settings()
 		TryParse(NAMEOF(splatResolution), &splatResolution);
 		TryParse(NAMEOF(appendBufferCount), &appendBufferCount);
 		TryParse(NAMEOF(octreeLevel), &octreeLevel);
+		TryParse(NAMEOF(octreeBuildBenchmark), &octreeBuildBenchmark);
+		TryParse(NAMEOF(octreeTraversalBenchmark), &octreeTraversalBenchmark);
+		TryParse(NAMEOF(octreeBuildEngine), &octreeBuildEngine);
+		TryParse(NAMEOF(octreeBottomUpClustering), &octreeBottomUpClustering);
+		TryParse(NAMEOF(octreeMemoryBudget), &octreeMemoryBudget);
+		TryParse(NAMEOF(compressOctreeFile), &compressOctreeFile);
+		TryParse(NAMEOF(octreePageCacheSize), &octreePageCacheSize);
+		TryParse(NAMEOF(octreeSubtreeBlockLevels), &octreeSubtreeBlockLevels);
+		TryParse(NAMEOF(octreePointBudget), &octreePointBudget);
+		TryParse(NAMEOF(octreeIncrementalTraversal), &octreeIncrementalTraversal);
+		TryParse(NAMEOF(octreeOcclusionCulling), &octreeOcclusionCulling);
+
+		// Parse normal clustering parameters
+		TryParse(NAMEOF(useSIMDClustering), &useSIMDClustering);
+		TryParse(NAMEOF(clusteringMaxIterations), &clusteringMaxIterations);
+		TryParse(NAMEOF(clusteringTolerance), &clusteringTolerance);
+
+		// Parse multithreading parameters
+		TryParse(NAMEOF(threadCount), &threadCount);
 
 		// Parse input parameters
 		TryParse(NAMEOF(mouseSensitivity), &mouseSensitivity);
@@ -131,7 +166,7 @@ std::wstring PointCloudEngine::Settings::ToKeyValueString()
 	settingsStream << std::endl;
 
 	settingsStream << L"# Pointcloud File Parameters" << std::endl;
-	settingsStream << L"# Delete old .octree files when changing the " << NAMEOF(maxOctreeDepth) << std::endl;
+	settingsStream << L"# Old .octree files are rebuilt automatically when the point cloud or the octree parameters change" << std::endl;
 	settingsStream << NAMEOF(pointcloudFile) << L"=" << pointcloudFile << std::endl;
 	settingsStream << NAMEOF(samplingRate) << L"=" << samplingRate << std::endl;
 	settingsStream << NAMEOF(scale) << L"=" << scale << std::endl;
@@ -157,6 +192,8 @@ std::wstring PointCloudEngine::Settings::ToKeyValueString()
 	settingsStream << NAMEOF(backfaceCulling) << L"=" << backfaceCulling << std::endl;
 	settingsStream << NAMEOF(density) << L"=" << density << std::endl;
 	settingsStream << NAMEOF(sparseSamplingRate) << L"=" << sparseSamplingRate << std::endl;
+	settingsStream << NAMEOF(splatRasterizerBenchmark) << L"=" << splatRasterizerBenchmark << std::endl;
+	settingsStream << NAMEOF(pointRasterizerExport) << L"=" << pointRasterizerExport << std::endl;
 	settingsStream << std::endl;
 
 	settingsStream << L"# Neural Network Parameters" << std::endl;
@@ -182,6 +219,12 @@ std::wstring PointCloudEngine::Settings::ToKeyValueString()
 	settingsStream << NAMEOF(sphereMaxTheta) << L"=" << sphereMaxTheta << std::endl;
 	settingsStream << NAMEOF(sphereMinPhi) << L"=" << sphereMinPhi << std::endl;
 	settingsStream << NAMEOF(sphereMaxPhi) << L"=" << sphereMaxPhi << std::endl;
+	settingsStream << NAMEOF(hdf5WriterThreads) << L"=" << hdf5WriterThreads << std::endl;
+	settingsStream << NAMEOF(hdf5WriterQueueSize) << L"=" << hdf5WriterQueueSize << std::endl;
+	settingsStream << NAMEOF(hdf5Compression) << L"=" << (int)hdf5Compression << std::endl;
+	settingsStream << NAMEOF(hdf5CompressionLevel) << L"=" << hdf5CompressionLevel << std::endl;
+	settingsStream << NAMEOF(hdf5CompressionThreads) << L"=" << hdf5CompressionThreads << std::endl;
+	settingsStream << NAMEOF(hdf5CompressionBenchmark) << L"=" << hdf5CompressionBenchmark << std::endl;
 	settingsStream << std::endl;
 
 	settingsStream << L"# Octree Parameters, increase " << NAMEOF(appendBufferCount) << L" when you see flickering" << std::endl;
@@ -193,6 +236,39 @@ std::wstring PointCloudEngine::Settings::ToKeyValueString()
 	settingsStream << NAMEOF(splatResolution) << L"=" << splatResolution << std::endl;
 	settingsStream << NAMEOF(appendBufferCount) << L"=" << appendBufferCount << std::endl;
 	settingsStream << NAMEOF(octreeLevel) << L"=" << octreeLevel << std::endl;
+	settingsStream << NAMEOF(octreeBuildBenchmark) << L"=" << octreeBuildBenchmark << std::endl;
+	settingsStream << NAMEOF(octreeTraversalBenchmark) << L"=" << octreeTraversalBenchmark << std::endl;
+	settingsStream << NAMEOF(octreeBuildEngine) << L"=" << (int)octreeBuildEngine << std::endl;
+	settingsStream << NAMEOF(octreeBottomUpClustering) << L"=" << octreeBottomUpClustering << std::endl;
+	settingsStream << NAMEOF(compressOctreeFile) << L"=" << compressOctreeFile << std::endl;
+	settingsStream << std::endl;
+
+	settingsStream << L"# Octree Storage Parameters" << std::endl;
+	settingsStream << L"# " << NAMEOF(octreeMemoryBudget) << L" in MB builds larger point clouds out of core, 0 builds in memory and chunks that reach " << NAMEOF(maxOctreeDepth) << L" can exceed it" << std::endl;
+	settingsStream << NAMEOF(octreeMemoryBudget) << L"=" << octreeMemoryBudget << std::endl;
+	settingsStream << L"# " << NAMEOF(octreePageCacheSize) << L" in MB loads the nodes on demand for the CPU traversal, 0 loads all nodes" << std::endl;
+	settingsStream << NAMEOF(octreePageCacheSize) << L"=" << octreePageCacheSize << std::endl;
+	settingsStream << L"# " << NAMEOF(octreeSubtreeBlockLevels) << L" stores the nodes in blocks of that many levels per subtree, 0 stores them breadth first" << std::endl;
+	settingsStream << NAMEOF(octreeSubtreeBlockLevels) << L"=" << octreeSubtreeBlockLevels << std::endl;
+	settingsStream << std::endl;
+
+	settingsStream << L"# Octree CPU Traversal Parameters" << std::endl;
+	settingsStream << L"# " << NAMEOF(octreePointBudget) << L" limits the vertices per frame and refines the largest nodes first, 0 is unlimited" << std::endl;
+	settingsStream << NAMEOF(octreePointBudget) << L"=" << octreePointBudget << std::endl;
+	settingsStream << L"# " << NAMEOF(octreeIncrementalTraversal) << L" updates the cut of the last frame instead of traversing from the root" << std::endl;
+	settingsStream << NAMEOF(octreeIncrementalTraversal) << L"=" << octreeIncrementalTraversal << std::endl;
+	settingsStream << L"# " << NAMEOF(octreeOcclusionCulling) << L" also culls the nodes behind the drawn ones" << std::endl;
+	settingsStream << NAMEOF(octreeOcclusionCulling) << L"=" << octreeOcclusionCulling << std::endl;
+	settingsStream << std::endl;
+
+	settingsStream << L"# Normal Clustering Parameters, " << NAMEOF(clusteringMaxIterations) << L"=0 iterates until the means converge" << std::endl;
+	settingsStream << NAMEOF(useSIMDClustering) << L"=" << useSIMDClustering << std::endl;
+	settingsStream << NAMEOF(clusteringMaxIterations) << L"=" << clusteringMaxIterations << std::endl;
+	settingsStream << NAMEOF(clusteringTolerance) << L"=" << clusteringTolerance << std::endl;
+	settingsStream << std::endl;
+
+	settingsStream << L"# Multithreading Parameters, " << NAMEOF(threadCount) << L"=0 uses all hardware threads" << std::endl;
+	settingsStream << NAMEOF(threadCount) << L"=" << threadCount << std::endl;
 	settingsStream << std::endl;
 
 	settingsStream << L"# Input Parameters" << std::endl;
@@ -53,6 +53,12 @@ namespace PointCloudEngine
 		float density = 0.2f;
 		float sparseSamplingRate = 0.01f;
 
+		// Also draws the splat view modes with the CPU splat rasterizer and reports its time and throughput
+		bool splatRasterizerBenchmark = false;
+
+		// Draws the point view modes of the HDF5 datasets with the CPU point rasterizer instead of the GPU
+		bool pointRasterizerExport = false;
+
 		// Neural Network parameters
 		std::wstring neuralNetworkModelFile = L"";
 		std::wstring neuralNetworkDescriptionFile = L"";
@@ -76,6 +82,17 @@ namespace PointCloudEngine
 		float sphereMinPhi = 0;
 		float sphereMaxPhi = 2 * XM_PI;
 
+		// Background threads that convert, compress and write the groups and the amount of drawn groups that can wait for them
+		int hdf5WriterThreads = 2;
+		int hdf5WriterQueueSize = 2;
+
+		// Codec of the dataset chunks, the chunks are compressed in parallel (a thread count of 0 uses all hardware threads)
+		// The benchmark also compresses every group with the other codecs and reports the throughput of each codec when the file is closed
+		HDF5Compression hdf5Compression = HDF5Compression::Deflate;
+		int hdf5CompressionLevel = 6;
+		UINT hdf5CompressionThreads = 0;
+		bool hdf5CompressionBenchmark = false;
+
 		// Octree parameters
 		bool useOctree = false;
 		bool useCulling = true;
@@ -85,6 +102,25 @@ namespace PointCloudEngine
 		float overlapFactor = 2.0f;
 		float splatResolution = 0.01f;
 		UINT appendBufferCount = 6000000;
+		bool octreeBuildBenchmark = false;
+		bool octreeTraversalBenchmark = false;
+		OctreeBuildEngine octreeBuildEngine = OctreeBuildEngine::TopDown;
+		bool octreeBottomUpClustering = false;
+		UINT octreeMemoryBudget = 0;
+		bool compressOctreeFile = false;
+		UINT octreePageCacheSize = 0;
+		UINT octreeSubtreeBlockLevels = 0;
+		UINT octreePointBudget = 0;
+		bool octreeIncrementalTraversal = false;
+		bool octreeOcclusionCulling = false;
+
+		// Normal clustering parameters, an iteration limit of 0 iterates until the means converge
+		bool useSIMDClustering = true;
+		UINT clusteringMaxIterations = 100;
+		float clusteringTolerance = FLT_EPSILON;
+
+		// Multithreading parameters, a thread count of 0 uses all hardware threads
+		UINT threadCount = 0;
 
         // Input parameters default values
         float mouseSensitivity = 0.005f;
@@ -129,6 +165,14 @@ namespace PointCloudEngine
 				{
 					*((ViewMode*)outParameterValue) = (ViewMode)std::stoi(settingsMap[parameterName]);
 				}
+				else if (typeid(T) == typeid(OctreeBuildEngine))
+				{
+					*((OctreeBuildEngine*)outParameterValue) = (OctreeBuildEngine)std::stoi(settingsMap[parameterName]);
+				}
+				else if (typeid(T) == typeid(HDF5Compression))
+				{
+					*((HDF5Compression*)outParameterValue) = (HDF5Compression)std::stoi(settingsMap[parameterName]);
+				}
 				else
 				{
 					ERROR_MESSAGE(NAMEOF(TryParse) + L" cannot parse " + parameterName + L" because its type is unknown!");
@@ -41,9 +41,9 @@ D3D11_INPUT_ELEMENT_DESC Shader::waypointLayout[] =
 	{"COLOR", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0},
 };
 
-Shader* Shader::Create(std::wstring filename, bool VS, bool GS, bool PS, bool CS, D3D11_INPUT_ELEMENT_DESC *layout, UINT numElements)
+Shader* Shader::Create(std::wstring filename, bool VS, bool GS, bool PS, bool CS, D3D11_INPUT_ELEMENT_DESC *layout, UINT numElements, const D3D_SHADER_MACRO *defines)
 {
-    Shader *shader = new Shader(filename, VS, GS, PS, CS, layout, numElements);
+    Shader *shader = new Shader(filename, VS, GS, PS, CS, layout, numElements, defines);
     shaders.push_back(shader);
     return shader;
 }
@@ -60,7 +60,7 @@ void Shader::ReleaseAllShaders()
     shaders.clear();
 }
 
-Shader::Shader(std::wstring filename, bool VS, bool GS, bool PS, bool CS, D3D11_INPUT_ELEMENT_DESC *layout, UINT numElements)
+Shader::Shader(std::wstring filename, bool VS, bool GS, bool PS, bool CS, D3D11_INPUT_ELEMENT_DESC *layout, UINT numElements, const D3D_SHADER_MACRO *defines)
 {
     this->VS = VS;
     this->GS = GS;
@@ -71,10 +71,11 @@ Shader::Shader(std::wstring filename, bool VS, bool GS, bool PS, bool CS, D3D11_
     std::wstring filepath = (executableDirectory + L"/" + filename).c_str();
 
     // Compile and create the shaders from file, the shader functions have to be named VS, GS, PS and CS for this to work
+    // The optional defines are a NULL terminated array that selects a variant of the shader file
     if (VS)
     {
         ID3DBlob* vertexShaderData = NULL;
-        hr = D3DCompileFromFile(filepath.c_str(), 0, D3D_COMPILE_STANDARD_FILE_INCLUDE, "VS", "vs_5_0", 0, 0, &vertexShaderData, &compilerErrorMessages);
+        hr = D3DCompileFromFile(filepath.c_str(), defines, D3D_COMPILE_STANDARD_FILE_INCLUDE, "VS", "vs_5_0", 0, 0, &vertexShaderData, &compilerErrorMessages);
 		ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(D3DCompileFromFile) + L" failed for the VS with Compiler Errors:\n\n" + ToWstring(compilerErrorMessages));
         hr = d3d11Device->CreateVertexShader(vertexShaderData->GetBufferPointer(), vertexShaderData->GetBufferSize(), NULL, &vertexShader);
 		ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateVertexShader) + L" failed for the VS of " + filepath);
@@ -92,7 +93,7 @@ Shader::Shader(std::wstring filename, bool VS, bool GS, bool PS, bool CS, D3D11_
     if (GS)
     {
         ID3DBlob* geometryShaderData = NULL;
-        hr = D3DCompileFromFile(filepath.c_str(), 0, D3D_COMPILE_STANDARD_FILE_INCLUDE, "GS", "gs_5_0", 0, 0, &geometryShaderData, &compilerErrorMessages);
+        hr = D3DCompileFromFile(filepath.c_str(), defines, D3D_COMPILE_STANDARD_FILE_INCLUDE, "GS", "gs_5_0", 0, 0, &geometryShaderData, &compilerErrorMessages);
 		ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(D3DCompileFromFile) + L" failed for the GS with Compiler Errors:\n\n" + ToWstring(compilerErrorMessages));
         hr = d3d11Device->CreateGeometryShader(geometryShaderData->GetBufferPointer(), geometryShaderData->GetBufferSize(), NULL, &geometryShader);
 		ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateGeometryShader) + L" failed for the GS of " + filepath);
@@ -102,7 +103,7 @@ Shader::Shader(std::wstring filename, bool VS, bool GS, bool PS, bool CS, D3D11_
     if (PS)
     {
         ID3DBlob* pixelShaderData = NULL;
-        hr = D3DCompileFromFile(filepath.c_str(), 0, D3D_COMPILE_STANDARD_FILE_INCLUDE, "PS", "ps_5_0", 0, 0, &pixelShaderData, &compilerErrorMessages);
+        hr = D3DCompileFromFile(filepath.c_str(), defines, D3D_COMPILE_STANDARD_FILE_INCLUDE, "PS", "ps_5_0", 0, 0, &pixelShaderData, &compilerErrorMessages);
 		ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(D3DCompileFromFile) + L" failed for the PS with Compiler Errors:\n\n" + ToWstring(compilerErrorMessages));
         hr = d3d11Device->CreatePixelShader(pixelShaderData->GetBufferPointer(), pixelShaderData->GetBufferSize(), NULL, &pixelShader);
 		ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreatePixelShader) + L" failed for the PS of " + filepath);
@@ -112,7 +113,7 @@ Shader::Shader(std::wstring filename, bool VS, bool GS, bool PS, bool CS, D3D11_
     if (CS)
     {
         ID3DBlob* computeShaderData = NULL;
-        hr = D3DCompileFromFile(filepath.c_str(), 0, D3D_COMPILE_STANDARD_FILE_INCLUDE, "CS", "cs_5_0", 0, 0, &computeShaderData, &compilerErrorMessages);
+        hr = D3DCompileFromFile(filepath.c_str(), defines, D3D_COMPILE_STANDARD_FILE_INCLUDE, "CS", "cs_5_0", 0, 0, &computeShaderData, &compilerErrorMessages);
 		ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(D3DCompileFromFile) + L" failed for the CS with Compiler Errors:\n\n" + ToWstring(compilerErrorMessages));
         hr = d3d11Device->CreateComputeShader(computeShaderData->GetBufferPointer(), computeShaderData->GetBufferSize(), NULL, &computeShader);
 		ERROR_MESSAGE_ON_FAIL(hr, NAMEOF(d3d11Device->CreateComputeShader) + L" failed for the CS of " + filepath);
@@ -10,10 +10,10 @@ namespace PointCloudEngine
     {
     public:
         // Static functions for automatic memory management
-        static Shader* Create(std::wstring filename, bool VS, bool GS, bool PS, bool CS, D3D11_INPUT_ELEMENT_DESC *layout, UINT numElements);
+        static Shader* Create(std::wstring filename, bool VS, bool GS, bool PS, bool CS, D3D11_INPUT_ELEMENT_DESC *layout, UINT numElements, const D3D_SHADER_MACRO *defines = NULL);
         static void ReleaseAllShaders();
 
-        Shader (std::wstring filename, bool VS, bool GS, bool PS, bool CS, D3D11_INPUT_ELEMENT_DESC *layout, UINT numElements);
+        Shader (std::wstring filename, bool VS, bool GS, bool PS, bool CS, D3D11_INPUT_ELEMENT_DESC *layout, UINT numElements, const D3D_SHADER_MACRO *defines = NULL);
         void Release ();
 
         static D3D11_INPUT_ELEMENT_DESC textLayout[];
@@ -30,15 +30,39 @@ void GS(point VS_OUTPUT input[1], inout TriangleStream<GS_SPLAT_OUTPUT> output)
 	SplatBlendingGS(input[0].position, input[0].normal, input[0].color, up, right, VP, output);
 }
 
-float4 PS(GS_SPLAT_OUTPUT input) : SV_TARGET
+PS_GBUFFER_OUTPUT PS(GS_SPLAT_OUTPUT input)
 {
-	if (drawNormals)
+	PS_GBUFFER_OUTPUT output;
+	output.normal = 0;
+	output.normalScreen = 0;
+
+	// Output and possibly blend the world and screen normal vectors in RGB without lighting, the weights are the same as for the color
+	// They are only needed when the G-buffer targets are bound or when they are drawn as the color
+	if (drawGBuffer || drawNormals)
 	{
-		// Output and possibly blend the world normal vectors in RGB without lighting
-		input.color = 0.5f * ((normalsInScreenSpace ? input.normalScreen : input.normal) + 1);
+		GS_SPLAT_OUTPUT normalInput = input;
 
-		return SplatBlendingPS(false, useBlending, cameraPosition, blendFactor, WorldViewProjectionInverse, input);
+		if (drawGBuffer || !normalsInScreenSpace)
+		{
+			normalInput.color = 0.5f * (input.normal + 1);
+			output.normal = SplatBlendingPS(false, useBlending, cameraPosition, blendFactor, WorldViewProjectionInverse, normalInput);
+		}
+
+		if (drawGBuffer || normalsInScreenSpace)
+		{
+			normalInput.color = 0.5f * (input.normalScreen + 1);
+			output.normalScreen = SplatBlendingPS(false, useBlending, cameraPosition, blendFactor, WorldViewProjectionInverse, normalInput);
+		}
+	}
+
+	if (drawNormals)
+	{
+		output.color = normalsInScreenSpace ? output.normalScreen : output.normal;
+	}
+	else
+	{
+		output.color = SplatBlendingPS(useLighting, useBlending, cameraPosition, blendFactor, WorldViewProjectionInverse, input);
 	}
 
-	return SplatBlendingPS(useLighting, useBlending, cameraPosition, blendFactor, WorldViewProjectionInverse, input);
+	return output;
 }
\ No newline at end of file
@@ -0,0 +1,536 @@
+#include "SplatRasterizer.h"
+
+PointCloudEngine::SplatRasterizer::SplatRasterizer(UINT width, UINT height)
+{
+	this->width = width;
+	this->height = height;
+
+	// AVX2 support also implies AVX support
+	useAVX = (NormalClustering::GetSupportedInstructionSet() == NormalClustering::InstructionSet::AVX2);
+}
+
+void PointCloudEngine::SplatRasterizer::GetVertexSplats(const std::vector<Vertex> &vertices, size_t vertexCount, const Matrix &world, const Vector3 &cameraPosition, float samplingRate, bool backfaceCulling, std::vector<Splat> &outSplats)
+{
+	// Same as the vertex and geometry shader in GroundTruth.hlsl and Splat.hlsl
+	Matrix worldInverseTranspose = world.Invert().Transpose();
+	float radius = 0.5f * samplingRate * Vector3(world._11, world._12, world._13).Length();
+
+	outSplats.clear();
+	outSplats.reserve(min(vertexCount, vertices.size()));
+
+	for (size_t i = 0; i < min(vertexCount, vertices.size()); i++)
+	{
+		Splat splat;
+		splat.position = Vector3::Transform(vertices[i].position, world);
+		splat.normal = Vector3::TransformNormal(vertices[i].normal, worldInverseTranspose);
+		splat.normal.Normalize();
+
+		// Discard splats that face away from the camera
+		if (backfaceCulling && (splat.normal.Dot(cameraPosition - splat.position) < 0))
+		{
+			continue;
+		}
+
+		splat.color = Vector3(vertices[i].color[0], vertices[i].color[1], vertices[i].color[2]) / 255.0f;
+		splat.radius = radius;
+
+		outSplats.push_back(splat);
+	}
+}
+
+void PointCloudEngine::SplatRasterizer::GetOctreeSplats(const std::vector<OctreeNodeVertex> &vertices, const Matrix &world, const Vector3 &cameraPosition, float fovAngleY, float samplingRate, float splatResolution, float overlapFactor, std::vector<Splat> &outSplats)
+{
+	// Same as the geometry shader in OctreeSplat.hlsl, the normal and color of a node are computed from the clusters that face the camera
+	Matrix worldInverseTranspose = world.Invert().Transpose();
+	Vector3 localCameraPosition = Vector3::Transform(cameraPosition, world.Invert());
+	float samplingRateWorld = samplingRate * Vector3(world._11, world._12, world._13).Length();
+
+	outSplats.clear();
+	outSplats.reserve(vertices.size());
+
+	for (auto it = vertices.begin(); it != vertices.end(); it++)
+	{
+		OctreeNodeProperties properties = it->properties;
+		Vector3 viewDirection = it->position - localCameraPosition;
+		viewDirection.Normalize();
+
+		float weights[4] =
+		{
+			properties.weights[0] / 255.0f,
+			properties.weights[1] / 255.0f,
+			properties.weights[2] / 255.0f,
+			1.0f - (properties.weights[0] + properties.weights[1] + properties.weights[2]) / 255.0f
+		};
+
+		Vector3 normal = Vector3::Zero;
+		Vector3 color = Vector3::Zero;
+		float visibilityFactorSum = 0;
+
+		for (int i = 0; i < 4; i++)
+		{
+			Vector3 clusterNormal = properties.normals[i].GetVector3();
+			float visibilityFactor = weights[i] * clusterNormal.Dot(-viewDirection);
+
+			if (visibilityFactor > 0)
+			{
+				// 6 bits red, 6 bits green, 4 bits blue
+				USHORT data = properties.colors[i].data;
+				Vector3 clusterColor(((data >> 10) & 63) / 63.0f, ((data >> 4) & 63) / 63.0f, (data & 15) / 15.0f);
+
+				normal += visibilityFactor * clusterNormal;
+				color += visibilityFactor * clusterColor;
+				visibilityFactorSum += visibilityFactor;
+			}
+		}
+
+		if (visibilityFactorSum > 0)
+		{
+			Splat splat;
+			splat.position = Vector3::Transform(it->position, world);
+			splat.normal = Vector3::TransformNormal(normal / visibilityFactorSum, worldInverseTranspose);
+			splat.normal.Normalize();
+			splat.color = color / visibilityFactorSum;
+
+			// The size should not go below the sampling rate in order to avoid holes
+			float splatResolutionWorld = overlapFactor * splatResolution * (2.0f * tan(fovAngleY / 2.0f)) * Vector3::Distance(cameraPosition, splat.position);
+			splat.radius = 0.5f * max(samplingRateWorld, splatResolutionWorld);
+
+			outSplats.push_back(splat);
+		}
+	}
+}
+
+void PointCloudEngine::SplatRasterizer::Draw(const std::vector<Splat> &splats, const Parameters &parameters)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	frame.parameters = parameters;
+	frame.viewProjection = parameters.View * parameters.Projection;
+	frame.viewProjectionInverse = frame.viewProjection.Invert();
+	frame.cameraRight = Vector3(parameters.View._11, parameters.View._21, parameters.View._31);
+
+	// Unproject the pixel centers onto the near plane, the direction from the camera to this point is linear in the pixel coordinates
+	// Pixel center (x + 0.5, y + 0.5) is at ndc x = (2 * x + 1) / width - 1 and ndc y = 1 - (2 * y + 1) / height
+	const Matrix &inverse = frame.viewProjectionInverse;
+	const Vector3 &camera = parameters.cameraPosition;
+	Vector3 ndcX = Vector3(inverse._11, inverse._12, inverse._13) - camera * inverse._14;
+	Vector3 ndcY = Vector3(inverse._21, inverse._22, inverse._23) - camera * inverse._24;
+	Vector3 ndcOrigin = Vector3(inverse._41, inverse._42, inverse._43) - camera * inverse._44;
+
+	frame.rayStepX = ndcX * (2.0f / width);
+	frame.rayStepY = ndcY * (-2.0f / height);
+	frame.rayStart = ndcOrigin + ndcX * (1.0f / width - 1.0f) + ndcY * (1.0f - 1.0f / height);
+
+	// The clip z and w of a point along the view ray are the values of the camera plus the ray distance times the values of the direction
+	const Matrix &viewProjection = frame.viewProjection;
+	Vector3 clipZ(viewProjection._13, viewProjection._23, viewProjection._33);
+	Vector3 clipW(viewProjection._14, viewProjection._24, viewProjection._34);
+
+	frame.clipZStart = frame.rayStart.Dot(clipZ);
+	frame.clipZStepX = frame.rayStepX.Dot(clipZ);
+	frame.clipZStepY = frame.rayStepY.Dot(clipZ);
+	frame.clipWStart = frame.rayStart.Dot(clipW);
+	frame.clipWStepX = frame.rayStepX.Dot(clipW);
+	frame.clipWStepY = frame.rayStepY.Dot(clipW);
+	frame.cameraClipZ = camera.Dot(clipZ) + viewProjection._43;
+	frame.cameraClipW = camera.Dot(clipW) + viewProjection._44;
+
+	colors.assign(width * height, parameters.backgroundColor);
+	depths.assign(width * height, 1.0f);
+	normals.assign(width * height, parameters.backgroundColor);
+	screenNormals.assign(width * height, parameters.backgroundColor);
+
+	if (parameters.useBlending)
+	{
+		colorSums.assign(width * height, Vector3::Zero);
+		normalSums.assign(width * height, Vector3::Zero);
+		screenNormalSums.assign(width * height, Vector3::Zero);
+		weightSums.assign(width * height, 0.0f);
+	}
+
+	const size_t tilesX = (width + SPLAT_RASTERIZER_TILE_SIZE - 1) / SPLAT_RASTERIZER_TILE_SIZE;
+	const size_t tilesY = (height + SPLAT_RASTERIZER_TILE_SIZE - 1) / SPLAT_RASTERIZER_TILE_SIZE;
+	const size_t tilesCount = tilesX * tilesY;
+
+	size_t chunkCount = (splats.size() + SPLAT_RASTERIZER_CHUNK_SIZE - 1) / SPLAT_RASTERIZER_CHUNK_SIZE;
+	chunkCount = max(1, min(chunkCount, 4 * threadPool->GetThreadCount()));
+
+	const size_t chunkSize = (splats.size() + chunkCount - 1) / chunkCount;
+
+	// Each chunk appends the splats to its own bin of each tile, the tiles later read the bins in chunk order to keep the draw order of the splats
+	splatRects.resize(splats.size());
+	tileBins.resize(chunkCount * tilesCount);
+	std::vector<size_t> chunkDrawnSplatsCounts(chunkCount, 0);
+
+	threadPool->ParallelFor(chunkCount, [&](size_t i)
+	{
+		const size_t start = i * chunkSize;
+		const size_t end = min(start + chunkSize, splats.size());
+
+		for (size_t j = 0; j < tilesCount; j++)
+		{
+			tileBins[i * tilesCount + j].clear();
+		}
+
+		for (size_t j = start; j < end; j++)
+		{
+			const SplatRect rect = GetSplatRect(splats[j]);
+			splatRects[j] = rect;
+
+			if ((rect.maxX < rect.minX) || (rect.maxY < rect.minY))
+			{
+				continue;
+			}
+
+			chunkDrawnSplatsCounts[i]++;
+
+			for (int tileY = rect.minY / SPLAT_RASTERIZER_TILE_SIZE; tileY <= rect.maxY / SPLAT_RASTERIZER_TILE_SIZE; tileY++)
+			{
+				for (int tileX = rect.minX / SPLAT_RASTERIZER_TILE_SIZE; tileX <= rect.maxX / SPLAT_RASTERIZER_TILE_SIZE; tileX++)
+				{
+					tileBins[i * tilesCount + tileY * tilesX + tileX].push_back((UINT)j);
+				}
+			}
+		}
+	});
+
+	// The blending pass reads the depths of the first pass only inside its own tile, both passes of a tile are done by the same task
+	threadPool->ParallelFor(tilesCount, [&](size_t i)
+	{
+		if (parameters.useBlending)
+		{
+			DrawTile(splats, chunkCount, i, Pass::Depth);
+			DrawTile(splats, chunkCount, i, Pass::Blending);
+		}
+		else
+		{
+			DrawTile(splats, chunkCount, i, Pass::Opaque);
+		}
+	});
+
+	splatsCount = splats.size();
+	drawnSplatsCount = 0;
+
+	for (size_t i = 0; i < chunkCount; i++)
+	{
+		drawnSplatsCount += chunkDrawnSplatsCounts[i];
+	}
+
+	milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+double PointCloudEngine::SplatRasterizer::GetSplatsPerSecond() const
+{
+	return (milliseconds > 0) ? (1000.0 * splatsCount) / milliseconds : 0;
+}
+
+PointCloudEngine::SplatRasterizer::SplatRect PointCloudEngine::SplatRasterizer::GetSplatRect(const Splat &splat) const
+{
+	SplatRect rect = { 0, 0, -1, -1 };
+
+	// Same billboard as in the geometry shader, the disc is inscribed in it
+	Vector3 up = splat.normal.Cross(frame.cameraRight);
+	Vector3 right = splat.normal.Cross(up);
+
+	if ((up.LengthSquared() <= 0) || (right.LengthSquared() <= 0))
+	{
+		return rect;
+	}
+
+	up *= splat.radius / up.Length();
+	right *= splat.radius / right.Length();
+
+	// Corners of the billboard in clip space in the order of the polygon
+	Vector4 corners[4];
+
+	for (int i = 0; i < 4; i++)
+	{
+		Vector3 corner = splat.position + ((i & 2) ? up : -up) + (((i == 1) || (i == 2)) ? right : -right);
+		corners[i] = Vector4::Transform(Vector4(corner.x, corner.y, corner.z, 1.0f), frame.viewProjection);
+	}
+
+	// Clip the billboard against the near plane (z >= 0), the remaining corners are in front of the camera and can be projected
+	float minX = FLT_MAX;
+	float minY = FLT_MAX;
+	float maxX = -FLT_MAX;
+	float maxY = -FLT_MAX;
+
+	for (int i = 0; i < 4; i++)
+	{
+		const Vector4 &a = corners[i];
+		const Vector4 &b = corners[(i + 1) % 4];
+		Vector4 points[2];
+		int pointsCount = 0;
+
+		if (a.z >= 0)
+		{
+			points[pointsCount++] = a;
+		}
+
+		if ((a.z >= 0) != (b.z >= 0))
+		{
+			float t = a.z / (a.z - b.z);
+			points[pointsCount++] = Vector4(a.x + t * (b.x - a.x), a.y + t * (b.y - a.y), 0, a.w + t * (b.w - a.w));
+		}
+
+		for (int j = 0; j < pointsCount; j++)
+		{
+			float screenX = 0.5f * (points[j].x / points[j].w + 1.0f) * width;
+			float screenY = 0.5f * (1.0f - points[j].y / points[j].w) * height;
+
+			minX = min(minX, screenX);
+			minY = min(minY, screenY);
+			maxX = max(maxX, screenX);
+			maxY = max(maxY, screenY);
+		}
+	}
+
+	// The whole billboard is between the camera and the near plane
+	if (minX > maxX)
+	{
+		return rect;
+	}
+
+	// Only the pixels with the center inside of the billboard are covered
+	if ((maxX < 0.5f) || (maxY < 0.5f) || (minX > width - 0.5f) || (minY > height - 0.5f))
+	{
+		return rect;
+	}
+
+	rect.minX = (int)ceil(max(0.0f, minX - 0.5f));
+	rect.minY = (int)ceil(max(0.0f, minY - 0.5f));
+	rect.maxX = (int)floor(min(width - 1.0f, maxX - 0.5f));
+	rect.maxY = (int)floor(min(height - 1.0f, maxY - 0.5f));
+
+	return rect;
+}
+
+void PointCloudEngine::SplatRasterizer::DrawTile(const std::vector<Splat> &splats, size_t chunkCount, size_t tileIndex, Pass pass)
+{
+	const size_t tilesX = (width + SPLAT_RASTERIZER_TILE_SIZE - 1) / SPLAT_RASTERIZER_TILE_SIZE;
+	const size_t tilesCount = tilesX * ((height + SPLAT_RASTERIZER_TILE_SIZE - 1) / SPLAT_RASTERIZER_TILE_SIZE);
+	const int tileMinX = (int)(tileIndex % tilesX) * SPLAT_RASTERIZER_TILE_SIZE;
+	const int tileMinY = (int)(tileIndex / tilesX) * SPLAT_RASTERIZER_TILE_SIZE;
+	const int tileMaxX = min((int)width - 1, tileMinX + SPLAT_RASTERIZER_TILE_SIZE - 1);
+	const int tileMaxY = min((int)height - 1, tileMinY + SPLAT_RASTERIZER_TILE_SIZE - 1);
+
+	for (size_t i = 0; i < chunkCount; i++)
+	{
+		const std::vector<UINT> &bin = tileBins[i * tilesCount + tileIndex];
+
+		for (auto it = bin.begin(); it != bin.end(); it++)
+		{
+			SplatRect rect = splatRects[*it];
+			rect.minX = max(rect.minX, tileMinX);
+			rect.minY = max(rect.minY, tileMinY);
+			rect.maxX = min(rect.maxX, tileMaxX);
+			rect.maxY = min(rect.maxY, tileMaxY);
+
+			DrawSplat(splats[*it], rect, pass);
+		}
+	}
+
+	if (pass != Pass::Blending)
+	{
+		return;
+	}
+
+	// Divide the sums by the sum of weights, the background stays where no splat was blended
+	for (int y = tileMinY; y <= tileMaxY; y++)
+	{
+		for (int x = tileMinX; x <= tileMaxX; x++)
+		{
+			const size_t pixel = (size_t)y * width + x;
+
+			if (weightSums[pixel] > 0)
+			{
+				colors[pixel] = colorSums[pixel] / weightSums[pixel];
+				normals[pixel] = normalSums[pixel] / weightSums[pixel];
+				screenNormals[pixel] = screenNormalSums[pixel] / weightSums[pixel];
+			}
+		}
+	}
+}
+
+void PointCloudEngine::SplatRasterizer::DrawSplat(const Splat &splat, const SplatRect &rect, Pass pass)
+{
+	// A point on the view ray is camera + t * direction, it is on the plane of the splat for t = dot(position - camera, normal) / dot(direction, normal)
+	SplatSetup setup;
+	setup.normal = splat.normal;
+	setup.cameraOffset = frame.parameters.cameraPosition - splat.position;
+	setup.planeDistance = -setup.cameraOffset.Dot(splat.normal);
+	setup.radiusSquared = splat.radius * splat.radius;
+
+	Vector3 encodedNormal, encodedScreenNormal;
+	GetEncodedNormals(splat, encodedNormal, encodedScreenNormal);
+	const Parameters &parameters = frame.parameters;
+
+	float pixelDepths[8];
+	float rayDistances[8];
+	float factors[8];
+
+	for (int y = rect.minY; y <= rect.maxY; y++)
+	{
+		for (int x = rect.minX; x <= rect.maxX; x += 8)
+		{
+			const int count = min(8, rect.maxX - x + 1);
+			byte mask = useAVX ? CoverPixelsAVX(setup, x, y, count, pixelDepths, rayDistances, factors) : CoverPixelsScalar(setup, x, y, count, pixelDepths, rayDistances, factors);
+
+			for (int i = 0; i < count; i++)
+			{
+				if (!(mask & (1 << i)))
+				{
+					continue;
+				}
+
+				const size_t pixel = (size_t)y * width + x + i;
+
+				if (pass == Pass::Depth)
+				{
+					depths[pixel] = min(depths[pixel], pixelDepths[i]);
+				}
+				else if (pass == Pass::Opaque)
+				{
+					if (pixelDepths[i] < depths[pixel])
+					{
+						Vector3 position = parameters.cameraPosition + rayDistances[i] * GetRayDirection(x + i, y);
+						depths[pixel] = pixelDepths[i];
+						colors[pixel] = GetShadedColor(splat, position);
+						normals[pixel] = encodedNormal;
+						screenNormals[pixel] = encodedScreenNormal;
+					}
+				}
+				else
+				{
+					// Discard this pixel if it is not close enough to the surface of the depth pass
+					// Use the splat radius as cutoff, a constant value does not work for octree nodes because the distances between the splats become larger with the splat radius
+					Vector3 position = parameters.cameraPosition + rayDistances[i] * GetRayDirection(x + i, y);
+					float ndcX = (2.0f * (x + i) + 1.0f) / width - 1.0f;
+					float ndcY = 1.0f - (2.0f * y + 1.0f) / height;
+					Vector4 surface = Vector4::Transform(Vector4(ndcX, ndcY, depths[pixel], 1.0f), frame.viewProjectionInverse);
+					Vector3 surfacePosition = Vector3(surface.x, surface.y, surface.z) / surface.w;
+
+					if (Vector3::Distance(position, surfacePosition) > parameters.blendFactor * splat.radius)
+					{
+						continue;
+					}
+
+					// Same gaussian weight as in the pixel shader, it is 1 in the center and close to 0 at the edge
+					float distance = 1.2f * sqrt(factors[i]);
+					float weight = (1.0f / (0.4f * sqrt(2.0f * XM_PI))) * exp(-(distance * distance) / (2.0f * 0.4f * 0.4f));
+
+					colorSums[pixel] += weight * GetShadedColor(splat, position);
+					normalSums[pixel] += weight * encodedNormal;
+					screenNormalSums[pixel] += weight * encodedScreenNormal;
+					weightSums[pixel] += weight;
+				}
+			}
+		}
+	}
+}
+
+Vector3 PointCloudEngine::SplatRasterizer::GetRayDirection(int x, int y) const
+{
+	return (frame.rayStart + (float)y * frame.rayStepY) + (float)x * frame.rayStepX;
+}
+
+Vector3 PointCloudEngine::SplatRasterizer::GetShadedColor(const Splat &splat, const Vector3 &position) const
+{
+	const Parameters &parameters = frame.parameters;
+
+	if (!parameters.useLighting)
+	{
+		return splat.color;
+	}
+
+	// Same phong lighting as in LightingConstantBuffer.hlsl
+	Vector3 l = -parameters.lightDirection;
+	Vector3 v = parameters.cameraPosition - position;
+	l.Normalize();
+	v.Normalize();
+
+	Vector3 r = -l + 2.0f * l.Dot(splat.normal) * splat.normal;
+	float diffuseIntensity = max(parameters.ambient, parameters.lightIntensity * parameters.diffuse * splat.normal.Dot(l));
+	float specularIntensity = parameters.lightIntensity * pow(max(0.0f, parameters.specular * r.Dot(v)), parameters.specularExponent);
+
+	return diffuseIntensity * splat.color + specularIntensity * Vector3::One;
+}
+
+void PointCloudEngine::SplatRasterizer::GetEncodedNormals(const Splat &splat, Vector3 &outNormal, Vector3 &outScreenNormal) const
+{
+	// Same screen space normal as in the geometry shader
+	Vector3 screenNormal = Vector3::TransformNormal(splat.normal, frame.viewProjection);
+	screenNormal.Normalize();
+	screenNormal.z *= -1;
+
+	outNormal = 0.5f * (splat.normal + Vector3::One);
+	outScreenNormal = 0.5f * (screenNormal + Vector3::One);
+}
+
+byte PointCloudEngine::SplatRasterizer::CoverPixelsScalar(const SplatSetup &setup, int x, int y, int count, float outDepths[8], float outRayDistances[8], float outFactors[8]) const
+{
+	byte mask = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		Vector3 direction = GetRayDirection(x + i, y);
+		float directionDistance = direction.Dot(setup.normal);
+		float rayDistance = setup.planeDistance / directionDistance;
+
+		// Distance of the point on the plane from the center relative to the radius (the pixel shader discards factors above 1)
+		float factor = (setup.cameraOffset + rayDistance * direction).LengthSquared() / setup.radiusSquared;
+
+		float clipZ = frame.cameraClipZ + rayDistance * ((x + i) * frame.clipZStepX + (frame.clipZStart + y * frame.clipZStepY));
+		float clipW = frame.cameraClipW + rayDistance * ((x + i) * frame.clipWStepX + (frame.clipWStart + y * frame.clipWStepY));
+
+		// Also clip the points behind the camera and outside of the near and far plane
+		if ((factor <= 1.0f) && (clipW > 0) && (clipZ >= 0) && (clipZ <= clipW))
+		{
+			outDepths[i] = clipZ / clipW;
+			outRayDistances[i] = rayDistance;
+			outFactors[i] = factor;
+			mask |= 1 << i;
+		}
+	}
+
+	return mask;
+}
+
+byte PointCloudEngine::SplatRasterizer::CoverPixelsAVX(const SplatSetup &setup, int x, int y, int count, float outDepths[8], float outRayDistances[8], float outFactors[8]) const
+{
+	// Same as the scalar version with one pixel per lane
+	__m256 pixelX = _mm256_add_ps(_mm256_set1_ps((float)x), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+	__m256 pixelY = _mm256_set1_ps((float)y);
+
+	__m256 directionX = _mm256_add_ps(_mm256_mul_ps(pixelX, _mm256_set1_ps(frame.rayStepX.x)), _mm256_set1_ps(frame.rayStart.x + y * frame.rayStepY.x));
+	__m256 directionY = _mm256_add_ps(_mm256_mul_ps(pixelX, _mm256_set1_ps(frame.rayStepX.y)), _mm256_set1_ps(frame.rayStart.y + y * frame.rayStepY.y));
+	__m256 directionZ = _mm256_add_ps(_mm256_mul_ps(pixelX, _mm256_set1_ps(frame.rayStepX.z)), _mm256_set1_ps(frame.rayStart.z + y * frame.rayStepY.z));
+
+	__m256 directionDistance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(directionX, _mm256_set1_ps(setup.normal.x)), _mm256_mul_ps(directionY, _mm256_set1_ps(setup.normal.y))), _mm256_mul_ps(directionZ, _mm256_set1_ps(setup.normal.z)));
+	__m256 rayDistance = _mm256_div_ps(_mm256_set1_ps(setup.planeDistance), directionDistance);
+
+	__m256 offsetX = _mm256_add_ps(_mm256_set1_ps(setup.cameraOffset.x), _mm256_mul_ps(rayDistance, directionX));
+	__m256 offsetY = _mm256_add_ps(_mm256_set1_ps(setup.cameraOffset.y), _mm256_mul_ps(rayDistance, directionY));
+	__m256 offsetZ = _mm256_add_ps(_mm256_set1_ps(setup.cameraOffset.z), _mm256_mul_ps(rayDistance, directionZ));
+	__m256 factor = _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(offsetX, offsetX), _mm256_mul_ps(offsetY, offsetY)), _mm256_mul_ps(offsetZ, offsetZ)), _mm256_set1_ps(setup.radiusSquared));
+
+	__m256 clipZ = _mm256_add_ps(_mm256_set1_ps(frame.cameraClipZ), _mm256_mul_ps(rayDistance, _mm256_add_ps(_mm256_mul_ps(pixelX, _mm256_set1_ps(frame.clipZStepX)), _mm256_set1_ps(frame.clipZStart + y * frame.clipZStepY))));
+	__m256 clipW = _mm256_add_ps(_mm256_set1_ps(frame.cameraClipW), _mm256_mul_ps(rayDistance, _mm256_add_ps(_mm256_mul_ps(pixelX, _mm256_set1_ps(frame.clipWStepX)), _mm256_set1_ps(frame.clipWStart + y * frame.clipWStepY))));
+
+	// Comparisons with NaN are false, this also removes the pixels whose view ray is parallel to the plane
+	__m256 covered = _mm256_cmp_ps(factor, _mm256_set1_ps(1.0f), _CMP_LE_OQ);
+	covered = _mm256_and_ps(covered, _mm256_cmp_ps(clipW, _mm256_setzero_ps(), _CMP_GT_OQ));
+	covered = _mm256_and_ps(covered, _mm256_cmp_ps(clipZ, _mm256_setzero_ps(), _CMP_GE_OQ));
+	covered = _mm256_and_ps(covered, _mm256_cmp_ps(clipZ, clipW, _CMP_LE_OQ));
+
+	byte mask = _mm256_movemask_ps(covered) & ((1 << count) - 1);
+
+	if (mask != 0)
+	{
+		_mm256_storeu_ps(outDepths, _mm256_div_ps(clipZ, clipW));
+		_mm256_storeu_ps(outRayDistances, rayDistance);
+		_mm256_storeu_ps(outFactors, factor);
+	}
+
+	return mask;
+}
@@ -0,0 +1,141 @@
+#ifndef SPLATRASTERIZER_H
+#define SPLATRASTERIZER_H
+
+// Width and height of the screen tiles in pixels, the splats are binned into these tiles and each tile is rasterized by a single thread
+#define SPLAT_RASTERIZER_TILE_SIZE 64
+
+// Minimum amount of splats per task when the splats are set up and binned into the tiles
+#define SPLAT_RASTERIZER_CHUNK_SIZE 16384
+
+#pragma once
+#include "PointCloudEngine.h"
+
+namespace PointCloudEngine
+{
+	// Headless splat renderer on the CPU that does not need a D3D11 device, e.g. to generate the ground truth datasets on machines without a GPU
+	// Reproduces the oriented discs of Splat.hlsl and OctreeSplat.hlsl together with the depth pass and the additive blending pass of DrawBlended
+	// The splats are set up and binned into screen tiles in parallel, then the tiles are rasterized in parallel and each tile draws its splats in the input order
+	// Instead of interpolating the billboard the view ray of each pixel center is intersected with the plane of the splat, this gives the same position and depth
+	// The coverage and depth of 8 pixels of a row are computed at once with AVX
+	class SplatRasterizer
+	{
+	public:
+		// Disc in world space, the radius is half of the splat size in the geometry shader
+		struct Splat
+		{
+			Vector3 position;
+			Vector3 normal;
+			Vector3 color;
+			float radius;
+		};
+
+		// Same values as in the constant buffers of the splat shaders, the matrices are not transposed
+		struct Parameters
+		{
+			Matrix View;
+			Matrix Projection;
+			Vector3 cameraPosition;
+			bool useBlending;
+			float blendFactor;
+
+			// Lighting
+			bool useLighting;
+			Vector3 lightDirection;
+			float lightIntensity;
+			float ambient;
+			float diffuse;
+			float specular;
+			float specularExponent;
+			Vector3 backgroundColor;
+		};
+
+		SplatRasterizer(UINT width, UINT height);
+
+		// Create the splats in the same way as the geometry shaders, the ground truth only uses the first vertexCount vertices (sparse view modes)
+		static void GetVertexSplats(const std::vector<Vertex> &vertices, size_t vertexCount, const Matrix &world, const Vector3 &cameraPosition, float samplingRate, bool backfaceCulling, std::vector<Splat> &outSplats);
+		static void GetOctreeSplats(const std::vector<OctreeNodeVertex> &vertices, const Matrix &world, const Vector3 &cameraPosition, float fovAngleY, float samplingRate, float splatResolution, float overlapFactor, std::vector<Splat> &outSplats);
+
+		void Draw(const std::vector<Splat> &splats, const Parameters &parameters);
+		double GetSplatsPerSecond() const;
+
+		UINT width;
+		UINT height;
+
+		// Output buffers of the last draw in row major order starting at the top left pixel
+		// Colors and normals contain the background color where no splat was drawn, the normals are encoded in [0, 1] like in the normal view modes
+		// The depths are the values of the depth buffer (1 where no splat was drawn), these are not changed by the blending
+		// All attributes of the G-buffer are written in one draw, the normals are in world space and the screen normals in screen space
+		std::vector<Vector3> colors;
+		std::vector<float> depths;
+		std::vector<Vector3> normals;
+		std::vector<Vector3> screenNormals;
+
+		// Statistics of the last draw
+		size_t splatsCount = 0;
+		size_t drawnSplatsCount = 0;
+		double milliseconds = 0;
+
+	private:
+		// Values of the whole frame, the view ray direction of each pixel center and its clip z and w are linear in the pixel coordinates
+		struct FrameSetup
+		{
+			Parameters parameters;
+			Matrix viewProjection;
+			Matrix viewProjectionInverse;
+			Vector3 cameraRight;
+			Vector3 rayStart;
+			Vector3 rayStepX;
+			Vector3 rayStepY;
+			float clipZStart, clipZStepX, clipZStepY;
+			float clipWStart, clipWStepX, clipWStepY;
+			float cameraClipZ, cameraClipW;
+		};
+
+		// Values of a single splat that are needed for the coverage tests
+		struct SplatSetup
+		{
+			Vector3 normal;
+			Vector3 cameraOffset;
+			float planeDistance;
+			float radiusSquared;
+		};
+
+		// Pixel rectangle of a splat, empty when maxX < minX
+		struct SplatRect
+		{
+			int minX, minY, maxX, maxY;
+		};
+
+		enum class Pass
+		{
+			Opaque,
+			Depth,
+			Blending
+		};
+
+		FrameSetup frame;
+		std::vector<SplatRect> splatRects;
+		std::vector<std::vector<UINT>> tileBins;
+
+		// Weighted sums of the additive blending pass
+		std::vector<Vector3> colorSums;
+		std::vector<Vector3> normalSums;
+		std::vector<Vector3> screenNormalSums;
+		std::vector<float> weightSums;
+
+		bool useAVX;
+
+		SplatRect GetSplatRect(const Splat &splat) const;
+		void DrawTile(const std::vector<Splat> &splats, size_t chunkCount, size_t tileIndex, Pass pass);
+		void DrawSplat(const Splat &splat, const SplatRect &rect, Pass pass);
+		Vector3 GetRayDirection(int x, int y) const;
+		Vector3 GetShadedColor(const Splat &splat, const Vector3 &position) const;
+		void GetEncodedNormals(const Splat &splat, Vector3 &outNormal, Vector3 &outScreenNormal) const;
+
+		// Returns the mask of the covered pixels from x to x + count - 1 in the row y together with their depths, distances along the view ray and squared distances to the center relative to the radius
+		byte CoverPixelsScalar(const SplatSetup &setup, int x, int y, int count, float outDepths[8], float outRayDistances[8], float outFactors[8]) const;
+		byte CoverPixelsAVX(const SplatSetup &setup, int x, int y, int count, float outDepths[8], float outRayDistances[8], float outFactors[8]) const;
+	};
+}
+
+#endif
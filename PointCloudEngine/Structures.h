@@ -98,6 +98,17 @@ namespace PointCloudEngine
         byte color[3];
     };
 
+	struct OctreeNodeClusters
+	{
+		// Cluster statistics of a node that are needed to compute the clusters of its parent node without clustering all the vertices again
+		// The sums and counts can be merged exactly, the cones are an upper bound of the largest angle to one of the vertices in the cluster
+		// The normal sums are the raw sums of the vertex normals, they must not be computed from the normalized cluster means
+		Vector3 normalSums[4];
+		double colorSums[4][3];
+		UINT counts[4];
+		float cones[4];
+	};
+
 	struct OctreeNodeProperties
 	{
 		// Mask where the lowest 8 bit store one bit for each of the children: 1 when it exists, 0 when it doesn't
@@ -113,6 +124,28 @@ namespace PointCloudEngine
 		Color16 colors[4];
 	};
 
+	// Split layout of the nodes that is used at runtime, each part of the nodes is stored in its own array with the same indices
+	// The traversal reads the topology of every node, the normals only when culling and the shading only for the nodes that are drawn
+	struct OctreeNodeTopology
+	{
+		// Same as in the OctreeNode, the childrenMask is padded to 32bit for the shader
+		UINT childrenStartOrLeafPositionFactors;
+		byte childrenMask;
+		byte padding[3];
+	};
+
+	struct OctreeNodeNormals
+	{
+		ClusterNormal normals[4];
+	};
+
+	struct OctreeNodeShading
+	{
+		byte weights[3];
+		byte padding;
+		Color16 colors[4];
+	};
+
     struct OctreeNodeVertex
     {
         // Bounding volume cube position
@@ -125,27 +158,116 @@ namespace PointCloudEngine
         float size;
     };
 
+	// Integer position of a node in the grid of all the nodes at its depth inside the root cube
+	struct OctreeNodeCell
+	{
+		USHORT cell[3];
+	};
+
+	// Compact vertex of the traversal output, the properties are read with the node index and the cube is reconstructed from the root cube
+	// The cell is the integer position of the node in the grid of all the nodes at its depth inside the root cube
+	struct OctreeNodeCompactVertex
+	{
+		UINT index;
+		USHORT cell[3];
+		USHORT depth;
+	};
+
     // Stores all the data that is needed to create octree nodes
+    // The vertices of the node are the range [verticesStart, verticesStart + verticesCount) in the vertices array that is shared by all the nodes
     struct OctreeNodeCreationEntry
     {
-        UINT nodesIndex;
-		UINT childrenIndex;
-        std::vector<Vertex> vertices;
+        size_t verticesStart;
+        size_t verticesCount;
         Vector3 position;
         float size;
         int depth;
     };
 
+	// Header at the start of .octree files, the nodes directly follow it
+	// Uncompressed files store the topology, normals and shading of all the nodes in three consecutive arrays
+	// The cached octree is only used when the format version, build parameters and source point cloud hash all match
+	struct OctreeFileHeader
+	{
+		UINT magic;
+		UINT version;
+		UINT64 sourceHash;
+		UINT64 nodesChecksum;
+
+		// Build parameters that change the resulting nodes
+		int maxOctreeDepth;
+		UINT octreeBuildEngine;
+		UINT octreeBottomUpClustering;
+		UINT clusteringMaxIterations;
+		float clusteringTolerance;
+		UINT useSIMDClustering;
+		UINT octreeMemoryBudget;
+
+		Vector3 rootPosition;
+		float rootSize;
+		UINT nodesSize;
+
+		// Nodes per compressed block, 0 when the nodes are stored uncompressed
+		// Compressed files store a table with one OctreeFileBlock per block after the header
+		UINT compressionBlockSize;
+
+		// Levels of the subtree blocks that the nodes are ordered in, 0 when the nodes are stored in breadth first order
+		UINT subtreeBlockLevels;
+
+		UINT64 GetTopologyOffset() const
+		{
+			return sizeof(OctreeFileHeader);
+		}
+
+		UINT64 GetNormalsOffset() const
+		{
+			return GetTopologyOffset() + (UINT64)nodesSize * sizeof(OctreeNodeTopology);
+		}
+
+		UINT64 GetShadingOffset() const
+		{
+			return GetNormalsOffset() + (UINT64)nodesSize * sizeof(OctreeNodeNormals);
+		}
+	};
+
+	struct OctreeFileBlock
+	{
+		// Byte range of the compressed block in the file and the children start index that is used to predict the indices in this block
+		UINT64 offset;
+		UINT size;
+		UINT firstChildrenStart;
+	};
+
 	// Stores all the data that is needed to traverse the octree
 	struct OctreeNodeTraversalEntry
 	{
 		UINT index;
 		Vector3 position;
 		float size;
-		int parentInsideViewFrustum;	// Its used like a bool but stored as an int because the shader can only read 32bit values
+		UINT viewFrustumPlaneMask;		// One bit for each view frustum plane that intersects the bounding cube, only these planes are tested for the children (0 when fully inside)
 		int depth;
 	};
 
+	// Amount of work done by one octree traversal, the frustum tests are only counted by the CPU traversal
+	struct OctreeTraversalStatistics
+	{
+		UINT traversedNodesCount;
+		UINT frustumTestedNodesCount;
+		UINT planeTestsCount;
+
+		// Distinct cache lines and memory pages of the topology array that the CPU traversal read, these depend on the order of the nodes
+		UINT touchedCacheLinesCount;
+		UINT touchedPagesCount;
+
+		// Vertices that are drawn, the GPU traversal drops the vertices that do not fit into the append buffer
+		UINT emittedVerticesCount;
+		UINT truncatedVerticesCount;
+
+		// Nodes that were tested against the occlusion depth buffer and the ones of them that were rejected
+		UINT occlusionTestedNodesCount;
+		UINT occludedNodesCount;
+	};
+
 	// Same constant buffers as in hlsl file, keep packing rules in mind
 	struct OctreeConstantBuffer
 	{
@@ -198,6 +320,10 @@ namespace PointCloudEngine
 		// Compute shader data
 		int useCulling;				// Bool in the shader
 		UINT inputCount;
+
+		// Root cube of the octree for the compact vertices
+		Vector3 rootPosition;
+		float rootSize;
 	};
 
 	struct LightingConstantBuffer
@@ -0,0 +1,154 @@
+#include "ThreadPool.h"
+
+thread_local PointCloudEngine::ThreadPool* PointCloudEngine::ThreadPool::currentPool = NULL;
+thread_local UINT PointCloudEngine::ThreadPool::currentQueueIndex = 0;
+
+PointCloudEngine::ThreadPool::ThreadPool(UINT threadCount)
+{
+	if (threadCount == 0)
+	{
+		threadCount = max(1, std::thread::hardware_concurrency());
+	}
+
+	nextQueueIndex = 0;
+	queuedTaskCount = 0;
+	pendingTaskCount = 0;
+
+	for (UINT i = 0; i < threadCount; i++)
+	{
+		queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+	}
+
+	// Start the workers only after all the queues exist because they immediately try to steal from each other
+	for (UINT i = 0; i < threadCount; i++)
+	{
+		workers.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+	}
+}
+
+PointCloudEngine::ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stop = true;
+	}
+
+	sleepCondition.notify_all();
+
+	for (auto it = workers.begin(); it != workers.end(); it++)
+	{
+		it->join();
+	}
+}
+
+void PointCloudEngine::ThreadPool::Enqueue(std::function<void()> task)
+{
+	pendingTaskCount++;
+
+	// Workers push to their own queue, other threads distribute the tasks evenly
+	UINT queueIndex = (currentPool == this) ? currentQueueIndex : (nextQueueIndex++ % queues.size());
+
+	{
+		// Increment while holding the sleep mutex, otherwise a worker could miss the notification right before going to sleep
+		// This has to happen before the push, a worker could otherwise dequeue the task and decrement the count below zero
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		queuedTaskCount++;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(queues[queueIndex]->mutex);
+		queues[queueIndex]->tasks.push_back(std::move(task));
+	}
+
+	sleepCondition.notify_one();
+}
+
+void PointCloudEngine::ThreadPool::Wait()
+{
+	// Blocks until every enqueued task (including the ones enqueued by other tasks) has finished
+	// Must not be called from inside a task of this pool
+	std::unique_lock<std::mutex> lock(waitMutex);
+	waitCondition.wait(lock, [this] { return pendingTaskCount == 0; });
+}
+
+void PointCloudEngine::ThreadPool::ParallelFor(size_t count, const std::function<void(size_t index)> &function)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		Enqueue([&function, i] { function(i); });
+	}
+
+	Wait();
+}
+
+UINT PointCloudEngine::ThreadPool::GetThreadCount() const
+{
+	return workers.size();
+}
+
+void PointCloudEngine::ThreadPool::WorkerLoop(UINT queueIndex)
+{
+	currentPool = this;
+	currentQueueIndex = queueIndex;
+
+	std::function<void()> task;
+
+	while (true)
+	{
+		if (TryGetTask(queueIndex, task))
+		{
+			task();
+			task = nullptr;
+
+			if (--pendingTaskCount == 0)
+			{
+				std::lock_guard<std::mutex> lock(waitMutex);
+				waitCondition.notify_all();
+			}
+		}
+		else
+		{
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			sleepCondition.wait(lock, [this] { return stop || (queuedTaskCount > 0); });
+
+			if (stop && (queuedTaskCount == 0))
+			{
+				return;
+			}
+		}
+	}
+}
+
+bool PointCloudEngine::ThreadPool::TryGetTask(UINT queueIndex, std::function<void()> &outTask)
+{
+	// Take the newest task from the own queue first
+	{
+		WorkerQueue* queue = queues[queueIndex].get();
+		std::lock_guard<std::mutex> lock(queue->mutex);
+
+		if (!queue->tasks.empty())
+		{
+			outTask = std::move(queue->tasks.back());
+			queue->tasks.pop_back();
+			queuedTaskCount--;
+			return true;
+		}
+	}
+
+	// Otherwise steal the oldest task of another worker
+	for (UINT i = 1; i < queues.size(); i++)
+	{
+		WorkerQueue* queue = queues[(queueIndex + i) % queues.size()].get();
+		std::lock_guard<std::mutex> lock(queue->mutex);
+
+		if (!queue->tasks.empty())
+		{
+			outTask = std::move(queue->tasks.front());
+			queue->tasks.pop_front();
+			queuedTaskCount--;
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,53 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#pragma once
+#include "PointCloudEngine.h"
+
+namespace PointCloudEngine
+{
+	// Work stealing thread pool where every worker thread owns a task deque
+	// Tasks enqueued by a worker are pushed to its own deque and popped in LIFO order (keeps recursive work like subtrees local and cache friendly)
+	// Idle workers steal the oldest tasks from the other deques (these are usually the largest pieces of work)
+	class ThreadPool
+	{
+	public:
+		// A thread count of 0 uses all the available hardware threads
+		ThreadPool(UINT threadCount = 0);
+		~ThreadPool();
+
+		void Enqueue(std::function<void()> task);
+		void Wait();
+
+		// Calls the function for each index in [0, count) in parallel and waits until all of them are done
+		void ParallelFor(size_t count, const std::function<void(size_t index)> &function);
+		UINT GetThreadCount() const;
+
+	private:
+		struct WorkerQueue
+		{
+			std::mutex mutex;
+			std::deque<std::function<void()>> tasks;
+		};
+
+		std::vector<std::thread> workers;
+		std::vector<std::unique_ptr<WorkerQueue>> queues;
+		std::atomic<UINT> nextQueueIndex;
+		std::atomic<size_t> queuedTaskCount;
+		std::atomic<size_t> pendingTaskCount;
+		std::mutex sleepMutex;
+		std::condition_variable sleepCondition;
+		std::mutex waitMutex;
+		std::condition_variable waitCondition;
+		bool stop = false;
+
+		// Identifies the pool and queue of the worker thread that is currently executing (NULL for all other threads)
+		static thread_local ThreadPool* currentPool;
+		static thread_local UINT currentQueueIndex;
+
+		void WorkerLoop(UINT queueIndex);
+		bool TryGetTask(UINT queueIndex, std::function<void()> &outTask);
+	};
+}
+
+#endif